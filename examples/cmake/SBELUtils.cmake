@@ -153,6 +153,13 @@ macro(enable_cuda_support)
 		# support for additional CCs
 		set_compute_capability(${CUDA_DEVICE_VERSION})
 
+		# SaP uses C++11 (thread_local, <random>, std::exception_ptr)
+		list(APPEND CUDA_NVCC_FLAGS "-std=c++11")
+
+		# Give each host thread its own default stream, so that the Krylov
+		# methods raced by Solver::raceKrylov() do not serialize on stream 0
+		list(APPEND CUDA_NVCC_FLAGS "--default-stream" "per-thread")
+
 		# Enable fast-math if selected
 		if(CUDA_FAST_MATH)
 				list(APPEND CUDA_NVCC_FLAGS "-use_fast_math")
@@ -2,6 +2,7 @@
 #include <fstream>
 
 #include <sap/solver.h>
+#include <sap/tuner.h>
 #include <sap/spmv.h>
 #include <sap/exception.h>
 
@@ -25,6 +26,8 @@ typedef typename cusp::array1d<REAL, cusp::device_memory>         Vector;
 
 typedef typename sap::Solver<Vector, PREC_REAL>                 SaPSolver;
 typedef typename sap::SpmvCusp<Matrix>                          SpmvFunctor;
+typedef typename sap::SpmvSymmetric<Matrix>                     SpmvSymFunctor;
+typedef typename sap::Tuner<Vector, PREC_REAL>                  SaPTuner;
 
 
 // -----------------------------------------------------------------------------
@@ -49,7 +52,8 @@ enum {OPT_HELP, OPT_VERBOSE, OPT_PART,
       OPT_MATFILE, OPT_RHSFILE,
       OPT_OUTFILE, OPT_FACTORIZATION, OPT_PRECOND,
       OPT_KRYLOV, OPT_SAFE_FACT,
-      OPT_CONST_BAND};
+      OPT_CONST_BAND, OPT_MEM_BUDGET, OPT_OVERLAP, OPT_TUNE, OPT_IDR_S, OPT_S_STEP,
+      OPT_SYM_SPMV, OPT_FALLBACK, OPT_RACE};
 
 // Table of CSimpleOpt::Soption structures. Each entry specifies:
 // - the ID for the option (returned from OptionId() during processing)
@@ -83,12 +87,20 @@ CSimpleOptA::SOption g_options[] = {
 	{ OPT_PRECOND,       "--precond-method",     SO_REQ_CMB },
 	{ OPT_KRYLOV,        "-k",                   SO_REQ_CMB },
 	{ OPT_KRYLOV,        "--krylov-method",      SO_REQ_CMB },
+	{ OPT_FALLBACK,      "--fallback-method",    SO_REQ_CMB },
+	{ OPT_RACE,          "--race-fallbacks",     SO_NONE    },
 	{ OPT_SAFE_FACT,     "--safe-fact",          SO_NONE    },
 	{ OPT_CONST_BAND,    "--const-band",         SO_NONE    },
+	{ OPT_MEM_BUDGET,    "--memory-budget",      SO_REQ_CMB },
+	{ OPT_OVERLAP,       "--overlap",            SO_REQ_CMB },
+	{ OPT_TUNE,          "--tune",               SO_REQ_CMB },
+	{ OPT_IDR_S,         "--idr-s",              SO_REQ_CMB },
+	{ OPT_S_STEP,        "--s-step",             SO_REQ_CMB },
 	{ OPT_HELP,          "-?",                   SO_NONE    },
 	{ OPT_HELP,          "-h",                   SO_NONE    },
 	{ OPT_HELP,          "--help",               SO_NONE    },
 	{ OPT_SPD,           "--spd",                SO_NONE    },
+	{ OPT_SYM_SPMV,      "--sym-spmv",           SO_NONE    },
 	SO_END_OF_OPTIONS
 };
 
@@ -98,11 +110,14 @@ CSimpleOptA::SOption g_options[] = {
 // -----------------------------------------------------------------------------
 void ShowUsage();
 void sapSetDevice();
+bool ParseKrylovMethod(string kry, sap::KrylovSolverType& method);
 bool GetProblemSpecs(int             argc, 
                      char**          argv,
                      string&         fileMat,
                      string&         fileRhs,
                      string&         fileSol,
+                     string&         fileTune,
+                     bool&           symSpmv,
                      int&            numPart,
                      sap::Options& opts);
 void PrintStats(bool               success,
@@ -119,10 +134,12 @@ int main(int argc, char** argv)
 	string         fileMat;
 	string         fileRhs;
 	string         fileSol;
+	string         fileTune;
+	bool           symSpmv;
 	int            numPart;
 	sap::Options opts;
 
-	if (!GetProblemSpecs(argc, argv, fileMat, fileRhs, fileSol, numPart, opts))
+	if (!GetProblemSpecs(argc, argv, fileMat, fileRhs, fileSol, fileTune, symSpmv, numPart, opts))
 		return 1;
 
 	// Get the device with most available memory.
@@ -139,17 +156,41 @@ int main(int argc, char** argv)
 	else
 		b.resize(A.num_rows, 1);
 
-	// Create the SAP Solver object and the SPMV functor. Perform the solver
-	// setup, then solve the linear system using a 0 initial guess.
+	SpmvFunctor  mySpmv(A);
+
+	// If requested, select the number of partitions and the solver options
+	// with the tuner (or from its database).
+	if (fileTune.length() > 0) {
+		SaPTuner  myTuner(fileTune);
+
+		if (!myTuner.tune(A, mySpmv, b, numPart, opts)) {
+			cout << "Tuning failed: no trial configuration succeeded." << endl;
+			return 1;
+		}
+
+		cout << "Tuned configuration (" << (myTuner.fromDatabase() ? "from database" : "trials")
+		     << ", key " << myTuner.getFeatures().key() << ", " << myTuner.getNumTrials() << " trials, "
+		     << myTuner.getTimeTuning() << " ms):" << endl;
+		cout << "  partitions = " << numPart << "  precond = " << opts.precondType
+		     << "  factorization = " << opts.factMethod << "  variable bandwidth = " << opts.variableBandwidth
+		     << "  drop-off = " << opts.dropOffFraction << "  ILU level = " << opts.ilu_level
+		     << "  Krylov = " << opts.solverType << endl << endl;
+	}
+
+	// Create the SAP Solver object. Perform the solver setup, then solve the
+	// linear system using a 0 initial guess.
 	// Set the initial guess to the zero vector.
 	SaPSolver  mySolver(numPart, opts);
-	SpmvFunctor  mySpmv(A);
 	Vector x(A.num_rows, 0);
 	bool   success;
 
 	try {
 		mySolver.setup(A);
-		success = mySolver.solve(mySpmv, b, x);
+		if (symSpmv) {
+			SpmvSymFunctor  mySymSpmv(A);
+			success = mySolver.solve(mySymSpmv, b, x);
+		} else
+			success = mySolver.solve(mySpmv, b, x);
 	} catch (const std::bad_alloc& e) {
 		std::cout << "Exception (bad_alloc): " << e.what() << std::endl;
 		return 1;
@@ -200,6 +241,45 @@ void sapSetDevice() {
 }
 
 
+// -----------------------------------------------------------------------------
+// ParseKrylovMethod()
+//
+// This function converts the specified Krylov method name (or number) into
+// the corresponding solver type.
+// -----------------------------------------------------------------------------
+bool
+ParseKrylovMethod(string                  kry,
+                  sap::KrylovSolverType&  method)
+{
+	std::transform(kry.begin(), kry.end(), kry.begin(), ::toupper);
+	if (kry == "0" || kry == "BICGSTAB_C")
+		method = sap::BiCGStab_C;
+	else if (kry == "1" || kry == "GMRES_C")
+		method = sap::GMRES_C;
+	else if (kry == "2" || kry == "CG_C")
+		method = sap::CG_C;
+	else if (kry == "3" || kry == "CR_C")
+		method = sap::CR_C;
+	else if (kry == "4" || kry == "BICGSTAB1")
+		method = sap::BiCGStab1;
+	else if (kry == "5" || kry == "BICGSTAB2")
+		method = sap::BiCGStab2;
+	else if (kry == "6" || kry == "BICGSTAB")
+		method = sap::BiCGStab;
+	else if (kry == "7" || kry == "MINRES")
+		method = sap::MINRES;
+	else if (kry == "8" || kry == "IDRS")
+		method = sap::IDRs;
+	else if (kry == "9" || kry == "CG")
+		method = sap::CG;
+	else if (kry == "10" || kry == "SGMRES")
+		method = sap::SGMRES;
+	else
+		return false;
+
+	return true;
+}
+
 // -----------------------------------------------------------------------------
 // GetProblemSpecs()
 //
@@ -212,10 +292,13 @@ GetProblemSpecs(int             argc,
                 string&         fileMat,
                 string&         fileRhs,
                 string&         fileSol,
+                string&         fileTune,
+                bool&           symSpmv,
                 int&            numPart,
                 sap::Options& opts)
 {
 	numPart = -1;
+	symSpmv = false;
 
 	// Create the option parser and pass it the program arguments and the array
 	// of valid options. Then loop for as long as there are arguments to be
@@ -256,6 +339,21 @@ GetProblemSpecs(int             argc,
 				opts.maxBandwidth = atoi(args.OptionArg());
 				maxBandwidth_specified = true;
 				break;
+			case OPT_MEM_BUDGET:
+				opts.memoryBudget = (size_t)(atof(args.OptionArg()) * 1024 * 1024);
+				break;
+			case OPT_OVERLAP:
+				opts.overlap = atoi(args.OptionArg());
+				break;
+			case OPT_TUNE:
+				fileTune = args.OptionArg();
+				break;
+			case OPT_IDR_S:
+				opts.idrS = atoi(args.OptionArg());
+				break;
+			case OPT_S_STEP:
+				opts.sStep = atoi(args.OptionArg());
+				break;
 			case OPT_NO_REORDERING:
 				opts.performReorder = false;
 				break;
@@ -296,34 +394,31 @@ GetProblemSpecs(int             argc,
 						opts.precondType = sap::Block;
 					else if(precond == "2" || precond == "NONE")
 						opts.precondType = sap::None;
+					else if(precond == "3" || precond == "POLYNOMIAL")
+						opts.precondType = sap::Polynomial;
+					else if(precond == "4" || precond == "SCHWARZ")
+						opts.precondType = sap::Schwarz;
+					else if(precond == "5" || precond == "SPAI")
+						opts.precondType = sap::SPAI;
 					else
 						return false;
 				}
 				break;
 			case OPT_KRYLOV:
+				if (!ParseKrylovMethod(args.OptionArg(), opts.solverType))
+					return false;
+				break;
+			case OPT_FALLBACK:
 				{
-					string kry = args.OptionArg();
-					std::transform(kry.begin(), kry.end(), kry.begin(), ::toupper);
-					if (kry == "0" || kry == "BICGSTAB_C")
-						opts.solverType = sap::BiCGStab_C;
-					else if (kry == "1" || kry == "GMRES_C")
-						opts.solverType = sap::GMRES_C;
-					else if (kry == "2" || kry == "CG_C")
-						opts.solverType = sap::CG_C;
-					else if (kry == "3" || kry == "CR_C")
-						opts.solverType = sap::CR_C;
-					else if (kry == "4" || kry == "BICGSTAB1")
-						opts.solverType = sap::BiCGStab1;
-					else if (kry == "5" || kry == "BICGSTAB2")
-						opts.solverType = sap::BiCGStab2;
-					else if (kry == "6" || kry == "BICGSTAB")
-						opts.solverType = sap::BiCGStab;
-					else if (kry == "7" || kry == "MINRES")
-						opts.solverType = sap::MINRES;
-					else
+					sap::KrylovSolverType method;
+					if (!ParseKrylovMethod(args.OptionArg(), method))
 						return false;
+					opts.fallbackSolvers.push_back(method);
 				}
 				break;
+			case OPT_RACE:
+				opts.raceSolvers = true;
+				break;
 			case OPT_SAFE_FACT:
 				opts.safeFactorization = true;
 				break;
@@ -334,11 +429,15 @@ GetProblemSpecs(int             argc,
 				opts.isSPD   = true;
 				opts.saveMem = true;
 				break;
+			case OPT_SYM_SPMV:
+				symSpmv = true;
+				break;
 		}
 	}
 
-	// If the number of partitions was not defined, show usage and exit.
-	if (numPart <= 0) {
+	// If the number of partitions was not defined (and is not tuned), show
+	// usage and exit.
+	if (numPart <= 0 && fileTune.length() == 0) {
 		cout << "The number of partitions must be specified." << endl << endl;
 		ShowUsage();
 		return false;
@@ -390,6 +489,12 @@ GetProblemSpecs(int             argc,
 			cout << "BiCGStab (SaP::GPU)" << endl; break;
 		case sap::MINRES:
 			cout << "MINRES (SaP::GPU)" << endl; break;
+		case sap::IDRs:
+			cout << "IDR(" << opts.idrS << ") (SaP::GPU)" << endl; break;
+		case sap::CG:
+			cout << "CG (SaP::GPU)" << endl; break;
+		case sap::SGMRES:
+			cout << "s-step GMRES, s=" << opts.sStep << " (SaP::GPU)" << endl; break;
 	}
 	cout << "Relative tolerance: " << opts.relTol << endl;
 	cout << "Absolute tolerance: " << opts.absTol << endl;
@@ -402,9 +507,22 @@ GetProblemSpecs(int             argc,
 			cout << "BLOCK DIAGONAL" << endl; break;
 		case sap::None:
 			cout << "NONE" << endl; break;
+		case sap::Polynomial:
+			cout << "POLYNOMIAL (" << (opts.polyType == sap::Chebyshev ? "Chebyshev" : "Neumann")
+			     << ", degree " << opts.polyDegree << ")" << endl; break;
+		case sap::Schwarz:
+			cout << "RESTRICTED ADDITIVE SCHWARZ (overlap ";
+			if (opts.overlap > 0)
+				cout << opts.overlap << ")" << endl;
+			else
+				cout << "= half-bandwidth)" << endl;
+			break;
+		case sap::SPAI:
+			cout << (opts.isSPD ? "FSAI" : "SPAI") << endl; break;
 	}
-	if (opts.precondType != sap::None) {
-		cout << "Using " << numPart << (numPart ==1 ? " partition." : " partitions.") << endl;
+	if (opts.precondType != sap::None && opts.precondType != sap::Polynomial && opts.precondType != sap::SPAI) {
+		if (numPart > 0)
+			cout << "Using " << numPart << (numPart ==1 ? " partition." : " partitions.") << endl;
 		cout << "Factorization method: " << (opts.factMethod == sap::LU_UL ? "LU - UL" : "LU - LU") << endl;
 		if (opts.dropOffFraction > 0)
 			cout << "Drop-off fraction: " << opts.dropOffFraction << endl;
@@ -458,6 +576,15 @@ void ShowUsage()
 	cout << " -b=MAX_BANDWIDTH" << endl;
 	cout << " --max-bandwidth=MAX_BANDWIDTH" << endl;
 	cout << "        Drop off elements such that the bandwidth is at most MAX_BANDWIDTH" << endl;
+	cout << " --memory-budget=MEGABYTES" << endl;
+	cout << "        Adjust the preconditioner setup so that it uses at most MEGABYTES of memory" << endl;
+	cout << "        (default 0 -- i.e. no limit)." << endl;
+	cout << " --overlap=ROWS" << endl;
+	cout << "        Extend each partition by ROWS rows on either side (Schwarz preconditioner only;" << endl;
+	cout << "        default 0 -- i.e. the half-bandwidth)." << endl;
+	cout << " --tune=DBFILE" << endl;
+	cout << "        Select the number of partitions and the solver options automatically," << endl;
+	cout << "        reusing (and updating) the tuned configurations in DBFILE." << endl;
 	cout << " -m=MATFILE" << endl;
 	cout << " --matrix-file=MATFILE" << endl;
 	cout << "        Read the matrix from the file MATFILE (MatrixMarket format)." << endl;
@@ -479,6 +606,22 @@ void ShowUsage()
 	cout << "        METHOD=5 or METHOD=BICGSTAB2     use BiCGStab(2) (SaP::GPU). This is the default." << endl;
 	cout << "        METHOD=6 or METHOD=BICGSTAB      use BiCGStab (SaP::GPU)" << endl;
 	cout << "        METHOD=7 or METHOD=MINRES        use MINRES (SaP::GPU)" << endl;
+	cout << "        METHOD=8 or METHOD=IDRS          use IDR(s) (SaP::GPU)" << endl;
+	cout << "        METHOD=9 or METHOD=CG            use single-reduction CG (SaP::GPU)" << endl;
+	cout << "        METHOD=10 or METHOD=SGMRES       use s-step GMRES (SaP::GPU)" << endl;
+	cout << " --fallback-method=METHOD" << endl;
+	cout << "        Krylov method (same values as above) used if the previous method does not" << endl;
+	cout << "        converge, continuing from its last iterate. May be given several times." << endl;
+	cout << " --race-fallbacks" << endl;
+	cout << "        Run the Krylov method and the fallback methods concurrently, keeping the" << endl;
+	cout << "        first to converge and cancelling the others." << endl;
+	cout << " --idr-s=S" << endl;
+	cout << "        Dimension of the IDR(s) shadow space (default 4)." << endl;
+	cout << " --s-step=S" << endl;
+	cout << "        Number of basis vectors per block orthogonalization in s-step GMRES (default 4)." << endl;
+	cout << " --sym-spmv" << endl;
+	cout << "        Use the symmetric matrix-vector product, which stores only the upper half" << endl;
+	cout << "        of the matrix (the matrix must be symmetric)." << endl;
 	cout << " --safe-fact" << endl;
 	cout << "        Use safe LU-UL factorization." << endl; 
 	cout << " --const-band" << endl;
@@ -493,6 +636,9 @@ void ShowUsage()
 	cout << "        METHOD=0 or METHOD=SPIKE         SPIKE preconditioner.  This is the default." << endl;
 	cout << "        METHOD=1 or METHOD=BLOCK         Block-diagonal preconditioner." << endl;
 	cout << "        METHOD=2 or METHOD=NONE          no preconditioner." << endl;
+	cout << "        METHOD=3 or METHOD=POLYNOMIAL    Chebyshev polynomial preconditioner." << endl;
+	cout << "        METHOD=4 or METHOD=SCHWARZ       Restricted additive Schwarz preconditioner." << endl;
+	cout << "        METHOD=5 or METHOD=SPAI          Sparse approximate inverse (FSAI if --spd)." << endl;
 	cout << " -? -h --help" << endl;
 	cout << "        Print this message and exit." << endl;
 	cout << endl;
@@ -517,6 +663,7 @@ void PrintStats(bool               success,
 	cout << "  " << mySolver.getMonitorMessage() << endl;
 
 	cout << "Number of iterations = " << stats.numIterations << endl;
+	cout << "Fallback methods run = " << stats.numFallbacks << endl;
 	cout << "RHS norm             = " << stats.rhsNorm << endl;
 	cout << "Residual norm        = " << stats.residualNorm << endl;
 	cout << "Rel. residual norm   = " << stats.relResidualNorm << endl;
@@ -526,6 +673,9 @@ void PrintStats(bool               success,
 	cout << "Bandwidth after drop-off   = " << stats.bandwidth << endl;
 	cout << "Actual drop-off fraction   = " << stats.actualDropOff << endl;
 	cout << endl;
+	cout << "Predicted setup memory peak (MB) = " << stats.memPredictedPeak / 1048576.0 << endl;
+	cout << "Measured setup memory peak (MB)  = " << stats.memMeasuredPeak / 1048576.0 << endl;
+	cout << endl;
 	cout << "Setup time total  = " << stats.timeSetup << endl;
 	double timeSetupGPU = stats.time_toBanded + stats.time_offDiags
 		+ stats.time_bandLU + stats.time_bandUL
@@ -539,8 +689,11 @@ void PrintStats(bool               success,
 	cout << "    reduced matrix LU        = " << stats.time_fullLU << endl;
 	cout << "  Setup time CPU  = " << stats.timeSetup - timeSetupGPU << endl;
 	cout << "    reorder                  = " << stats.time_reorder << endl;
+	cout << "      second-level           = " << stats.time_secondLevel << endl;
 	cout << "    CPU assemble             = " << stats.time_cpu_assemble << endl;
 	cout << "    data transfer            = " << stats.time_transfer << endl;
+	if (stats.polyLambdaMax > 0)
+		cout << "  Polynomial spectral bounds = [" << stats.polyLambdaMin << ", " << stats.polyLambdaMax << "]" << endl;
 	cout << "Solve time        = " << stats.timeSolve << endl;
 	cout << "  shuffle time    = " << stats.time_shuffle << endl;
 	cout << endl;
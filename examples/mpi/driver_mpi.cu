@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpi.h>
+
+#include <sap/distributed.h>
+
+#include <cusp/io/matrix_market.h>
+#include <cusp/csr_matrix.h>
+
+
+// -----------------------------------------------------------------------------
+// Typedefs
+// -----------------------------------------------------------------------------
+typedef double REAL;
+typedef double PREC_REAL;
+
+typedef typename cusp::csr_matrix<int, REAL, cusp::host_memory>   MatrixH;
+typedef typename cusp::array1d<REAL, cusp::device_memory>         Vector;
+
+typedef typename sap::DistributedSolver<Vector, PREC_REAL>        SaPSolver;
+
+
+// -----------------------------------------------------------------------------
+using std::cout;
+using std::endl;
+using std::string;
+
+
+// -----------------------------------------------------------------------------
+// Definitions for SimpleOpt and SimpleGlob
+// -----------------------------------------------------------------------------
+#include <SimpleOpt/SimpleOpt.h>
+
+// ID values to identify command line arguments
+enum {OPT_HELP, OPT_PART, OPT_RTOL, OPT_MAXIT, OPT_MATFILE, OPT_NO_REORDERING};
+
+// Table of CSimpleOpt::Soption structures. Each entry specifies:
+// - the ID for the option (returned from OptionId() during processing)
+// - the option as it should appear on the command line
+// - type of the option
+// The last entry must be SO_END_OF_OPTIONS
+CSimpleOptA::SOption g_options[] = {
+	{ OPT_PART,          "-p",                   SO_REQ_CMB },
+	{ OPT_PART,          "--num-partitions",     SO_REQ_CMB },
+	{ OPT_RTOL,          "-t",                   SO_REQ_CMB },
+	{ OPT_RTOL,          "--tolerance",          SO_REQ_CMB },
+	{ OPT_MAXIT,         "-i",                   SO_REQ_CMB },
+	{ OPT_MAXIT,         "--max-num-iterations", SO_REQ_CMB },
+	{ OPT_MATFILE,       "-m",                   SO_REQ_CMB },
+	{ OPT_MATFILE,       "--matrix-file",        SO_REQ_CMB },
+	{ OPT_NO_REORDERING, "--no-reordering",      SO_NONE    },
+	{ OPT_HELP,          "-?",                   SO_NONE    },
+	{ OPT_HELP,          "-h",                   SO_NONE    },
+	{ OPT_HELP,          "--help",               SO_NONE    },
+	SO_END_OF_OPTIONS
+};
+
+
+// -----------------------------------------------------------------------------
+// Forward declarations.
+// -----------------------------------------------------------------------------
+void ShowUsage();
+bool GetProblemSpecs(int argc, char** argv, string& fileMat, int& numPart, sap::Options& opts);
+
+
+// -----------------------------------------------------------------------------
+// MAIN
+//
+// Every rank reads the whole matrix, keeps its own rows and solves A*x = b,
+// with b = A*1. Run with, e.g., mpirun -np 4 driver_mpi -m matrix.mtx -p 8
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	MPI_Init(&argc, &argv);
+
+	sap::Communicator comm(MPI_COMM_WORLD);
+
+	string         fileMat;
+	int            numPart;
+	sap::Options   opts;
+
+	if (!GetProblemSpecs(argc, argv, fileMat, numPart, opts)) {
+		MPI_Finalize();
+		return 1;
+	}
+
+	// Bind each rank on a node to a different device.
+	int deviceCount = 0;
+	cudaGetDeviceCount(&deviceCount);
+	if (deviceCount > 0)
+		cudaSetDevice(comm.rank() % deviceCount);
+
+	MatrixH A;
+	cusp::io::read_matrix_market_file(A, fileMat);
+
+	SaPSolver  mySolver(comm, std::max(numPart, comm.size()), opts);
+
+	// Extract the rows owned by this rank.
+	sap::DistributedLayout layout = mySolver.getLayout(A.num_rows);
+
+	int begin = A.row_offsets[layout.rowBegin];
+	int end   = A.row_offsets[layout.rowEnd];
+
+	MatrixH Aloc(layout.numLocalRows(), A.num_cols, end - begin);
+	for (int i = 0; i <= layout.numLocalRows(); i++)
+		Aloc.row_offsets[i] = A.row_offsets[layout.rowBegin + i] - begin;
+	std::copy(A.column_indices.begin() + begin, A.column_indices.begin() + end, Aloc.column_indices.begin());
+	std::copy(A.values.begin() + begin, A.values.begin() + end, Aloc.values.begin());
+
+	// Right-hand side corresponding to the solution of all ones.
+	cusp::array1d<REAL, cusp::host_memory> bh(layout.numLocalRows(), 0);
+	for (int i = 0; i < layout.numLocalRows(); i++)
+		for (int j = Aloc.row_offsets[i]; j < Aloc.row_offsets[i + 1]; j++)
+			bh[i] += Aloc.values[j];
+
+	Vector b = bh;
+	Vector x(layout.numLocalRows(), 0);
+	bool   success;
+
+	try {
+		mySolver.setup(Aloc, A.num_rows);
+		success = mySolver.solve(b, x);
+	} catch (const std::bad_alloc& e) {
+		cout << "Rank " << comm.rank() << " exception (bad_alloc): " << e.what() << endl;
+		MPI_Abort(MPI_COMM_WORLD, 1);
+		return 1;
+	} catch (const sap::system_error& e) {
+		cout << "Rank " << comm.rank() << " exception (system_error): " << e.what() << " Error code: " << e.reason() << endl;
+		MPI_Abort(MPI_COMM_WORLD, 1);
+		return 1;
+	}
+
+	if (comm.rank() == 0) {
+		sap::Stats stats = mySolver.getStats();
+
+		cout << (success ? "Success" : "Failed") << endl;
+		cout << "Code: " << mySolver.getMonitorCode() << "  " << mySolver.getMonitorMessage() << endl;
+		cout << "Number of ranks      = " << comm.size() << endl;
+		cout << "Number of partitions = " << stats.numPartitions << endl;
+		cout << "Number of iterations = " << stats.numIterations << endl;
+		cout << "Rel. residual norm   = " << stats.relResidualNorm << endl;
+		cout << "Bandwidth            = " << stats.bandwidth << endl;
+		cout << "Setup time           = " << stats.timeSetup << endl;
+		cout << "Solve time           = " << stats.timeSolve << endl;
+	}
+
+	MPI_Finalize();
+
+	return 0;
+}
+
+
+// -----------------------------------------------------------------------------
+// GetProblemSpecs()
+//
+// This function parses the specified program arguments.
+// -----------------------------------------------------------------------------
+bool
+GetProblemSpecs(int             argc,
+                char**          argv,
+                string&         fileMat,
+                int&            numPart,
+                sap::Options&   opts)
+{
+	numPart = 1;
+	opts.solverType = sap::BiCGStab;
+
+	CSimpleOptA args(argc, argv, g_options);
+
+	while (args.Next()) {
+		if (args.LastError() != SO_SUCCESS) {
+			cout << "Invalid argument: " << args.OptionText() << endl;
+			ShowUsage();
+			return false;
+		}
+
+		switch (args.OptionId()) {
+			case OPT_HELP:
+				ShowUsage();
+				return false;
+			case OPT_PART:
+				numPart = atoi(args.OptionArg());
+				break;
+			case OPT_RTOL:
+				opts.relTol = atof(args.OptionArg());
+				break;
+			case OPT_MAXIT:
+				opts.maxNumIterations = atoi(args.OptionArg());
+				break;
+			case OPT_MATFILE:
+				fileMat = args.OptionArg();
+				break;
+			case OPT_NO_REORDERING:
+				opts.performReorder = false;
+				break;
+		}
+	}
+
+	if (fileMat.length() == 0) {
+		cout << "The matrix filename is required." << endl;
+		ShowUsage();
+		return false;
+	}
+
+	return true;
+}
+
+
+// -----------------------------------------------------------------------------
+// ShowUsage()
+// -----------------------------------------------------------------------------
+void ShowUsage()
+{
+	cout << "Usage:  mpirun -np NUM_RANKS driver_mpi -m=MATFILE [OPTIONS]" << endl;
+	cout << " -p=NUM_PARTITIONS" << endl;
+	cout << " --num-partitions=NUM_PARTITIONS" << endl;
+	cout << "        Specify the total number of partitions (at least one per rank)." << endl;
+	cout << " -t=TOLERANCE" << endl;
+	cout << " --tolerance=TOLERANCE" << endl;
+	cout << "        Use TOLERANCE for BiCGStab stopping criteria (default 1e-6)." << endl;
+	cout << " -i=ITERATIONS" << endl;
+	cout << " --max-num-iterations=ITERATIONS" << endl;
+	cout << "        Use at most ITERATIONS for BiCGStab (default 100)." << endl;
+	cout << " -m=MATFILE" << endl;
+	cout << " --matrix-file=MATFILE" << endl;
+	cout << "        Read the matrix from the file MATFILE (MatrixMarket format)." << endl;
+	cout << " --no-reordering" << endl;
+	cout << "        Do not reorder the diagonal blocks." << endl;
+	cout << " -? -h --help" << endl;
+	cout << "        Print this message and exit." << endl;
+	cout << endl;
+}
@@ -46,7 +46,7 @@ enum {OPT_HELP, OPT_VERBOSE, OPT_PART,
       OPT_TOL, OPT_MAXIT,
       OPT_DROPOFF_FRAC, 
       OPT_MATFILE,
-      OPT_SAFE_FACT};
+      OPT_SAFE_FACT, OPT_HISTORY};
 
 // Table of CSimpleOpt::Soption structures. Each entry specifies:
 // - the ID for the option (returned from OptionId() during processing)
@@ -65,6 +65,7 @@ CSimpleOptA::SOption g_options[] = {
 	{ OPT_MATFILE,       "-m",                   SO_REQ_CMB },
 	{ OPT_MATFILE,       "--matrix-file",        SO_REQ_CMB },
 	{ OPT_SAFE_FACT,     "--safe-fact",          SO_NONE    },
+	{ OPT_HISTORY,       "--history",            SO_REQ_CMB },
 	{ OPT_VERBOSE,       "-v",                   SO_NONE    },
 	{ OPT_VERBOSE,       "--verbose",            SO_NONE    },
 	{ OPT_HELP,          "-?",                   SO_NONE    },
@@ -283,6 +284,9 @@ GetProblemSpecs(int             argc,
 			case OPT_SAFE_FACT:
 				opts.safeFactorization = true;
 				break;
+			case OPT_HISTORY:
+				opts.solutionHistory = atoi(args.OptionArg());
+				break;
 		}
 	}
 
@@ -344,6 +348,9 @@ void ShowUsage()
 	cout << "        element-wise 1-norm is ignored (default 0.0 -- i.e. no drop-off)." << endl;
 	cout << " --safe-fact" << endl;
 	cout << "        Use safe LU-UL factorization (default false)." << endl; 
+	cout << " --history=NUM" << endl;
+	cout << "        Improve the initial guess of each solve with the last NUM" << endl;
+	cout << "        solutions (default 0 -- i.e. use the given initial guess)." << endl;
 	cout << " -? -h --help" << endl;
 	cout << "        Print this message and exit." << endl;
 	cout << endl;
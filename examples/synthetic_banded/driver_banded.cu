@@ -462,6 +462,12 @@ GetProblemSpecs(int             argc,
 						opts.solverType = sap::BiCGStab;
 					else if (kry == "7" || kry == "MINRES")
 						opts.solverType = sap::MINRES;
+					else if (kry == "8" || kry == "IDRS")
+						opts.solverType = sap::IDRs;
+					else if (kry == "9" || kry == "CG")
+						opts.solverType = sap::CG;
+					else if (kry == "10" || kry == "SGMRES")
+						opts.solverType = sap::SGMRES;
 					else
 						return false;
 				}
@@ -514,6 +520,12 @@ GetProblemSpecs(int             argc,
 			cout << "BiCGStab (SaP::GPU)" << endl; break;
 		case sap::MINRES:
 			cout << "MINRES (SaP::GPU)" << endl; break;
+		case sap::IDRs:
+			cout << "IDR(" << opts.idrS << ") (SaP::GPU)" << endl; break;
+		case sap::CG:
+			cout << "CG (SaP::GPU)" << endl; break;
+		case sap::SGMRES:
+			cout << "s-step GMRES, s=" << opts.sStep << " (SaP::GPU)" << endl; break;
 		}
 		cout << "Relative tolerance: " << opts.relTol << endl;
 		cout << "Absolute tolerance: " << opts.absTol << endl;
@@ -588,6 +600,9 @@ void ShowUsage()
 	cout << "        METHOD=5 or METHOD=BICGSTAB2     use BiCGStab(2) (SaP::GPU). This is the default." << endl;
 	cout << "        METHOD=6 or METHOD=BICGSTAB      use BiCGStab (SaP::GPU)" << endl;
 	cout << "        METHOD=7 or METHOD=MINRES        use MINRES (SaP::GPU)" << endl;
+	cout << "        METHOD=8 or METHOD=IDRS          use IDR(s) (SaP::GPU)" << endl;
+	cout << "        METHOD=9 or METHOD=CG            use single-reduction CG (SaP::GPU)" << endl;
+	cout << "        METHOD=10 or METHOD=SGMRES       use s-step GMRES (SaP::GPU)" << endl;
 	cout << " --precond-method=METHOD" << endl;
 	cout << "        Specify the preconditioner to be used" << endl;
 	cout << "        METHOD=0 or METHOD=SPIKE         SPIKE preconditioner.  This is the default." << endl;
@@ -71,7 +71,11 @@ enum {OPT_HELP, OPT_PART,
       OPT_MATFILE, OPT_RHSFILE, 
       OPT_OUTFILE, OPT_FACTORIZATION, OPT_PRECOND,
       OPT_KRYLOV, OPT_SAFE_FACT,
-      OPT_CONST_BAND, OPT_ILU_LEVEL};
+      OPT_CONST_BAND, OPT_ILU_LEVEL,
+      OPT_ILU_SWEEPS, OPT_ILU_TRI_SWEEPS, OPT_ILU_MULTICOLOR,
+      OPT_HOST_CHOLESKY, OPT_SPIKE_TOL, OPT_DROPOFF_PART,
+      OPT_HOST_SPIKES, OPT_SUPERVARIABLES,
+      OPT_SPARSE_RHS};
 
 // Color to print
 enum TestColor {COLOR_NO = 0,
@@ -117,6 +121,15 @@ CSimpleOptA::SOption g_options[] = {
 	{ OPT_SAFE_FACT,     "--safe-fact",          SO_NONE    },
 	{ OPT_CONST_BAND,    "--const-band",         SO_NONE    },
 	{ OPT_ILU_LEVEL,     "--ilu-level",          SO_REQ_CMB },
+	{ OPT_ILU_SWEEPS,    "--ilu-sweeps",         SO_REQ_CMB },
+	{ OPT_ILU_TRI_SWEEPS,"--ilu-tri-sweeps",     SO_REQ_CMB },
+	{ OPT_ILU_MULTICOLOR,"--ilu-multicolor",     SO_NONE    },
+	{ OPT_HOST_CHOLESKY, "--host-cholesky",      SO_NONE    },
+	{ OPT_SPIKE_TOL,     "--spike-tol",          SO_REQ_CMB },
+	{ OPT_DROPOFF_PART,  "--drop-off-per-partition", SO_NONE },
+	{ OPT_HOST_SPIKES,   "--host-spikes",        SO_NONE    },
+	{ OPT_SUPERVARIABLES,"--supervariables",     SO_NONE    },
+	{ OPT_SPARSE_RHS,    "--sparse-rhs",         SO_NONE    },
 	{ OPT_HELP,          "-?",                   SO_NONE    },
 	{ OPT_HELP,          "-h",                   SO_NONE    },
 	{ OPT_HELP,          "--help",               SO_NONE    },
@@ -843,6 +856,33 @@ GetProblemSpecs(int             argc,
 			case OPT_ILU_LEVEL:
 				opts.ilu_level = atoi(args.OptionArg());
 				break;
+			case OPT_ILU_SWEEPS:
+				opts.iluSweeps = atoi(args.OptionArg());
+				break;
+			case OPT_ILU_TRI_SWEEPS:
+				opts.iluTriSweeps = atoi(args.OptionArg());
+				break;
+			case OPT_ILU_MULTICOLOR:
+				opts.iluMulticolor = true;
+				break;
+			case OPT_HOST_CHOLESKY:
+				opts.hostCholesky = true;
+				break;
+			case OPT_SPIKE_TOL:
+				opts.spikeTol = atof(args.OptionArg());
+				break;
+			case OPT_DROPOFF_PART:
+				opts.dropOffPerPartition = true;
+				break;
+			case OPT_HOST_SPIKES:
+				opts.hostSpikes = true;
+				break;
+			case OPT_SUPERVARIABLES:
+				opts.supervariables = true;
+				break;
+			case OPT_SPARSE_RHS:
+				opts.sparseRHS = true;
+				break;
 		}
 	}
 
@@ -943,6 +983,25 @@ void ShowUsage()
 	cout << "        Use safe LU-UL factorization." << endl; 
 	cout << " --const-band" << endl;
 	cout << "        Force using the constant-bandwidth method." << endl; 
+	cout << " --ilu-sweeps=NUM" << endl;
+	cout << "        Compute the ILU(0) factors with NUM fine-grained fixed-point sweeps." << endl;
+	cout << " --ilu-tri-sweeps=NUM" << endl;
+	cout << "        Apply the ILU triangular solves with NUM Jacobi sweeps." << endl;
+	cout << " --ilu-multicolor" << endl;
+	cout << "        Use a multicolor ordering (instead of Sloan) for ILU(0)." << endl;
+	cout << " --host-cholesky" << endl;
+	cout << "        (With --spd) Perform the banded LDL^T factorization and sweeps on the host." << endl;
+	cout << " --spike-tol=TOL" << endl;
+	cout << "        Compress the spike blocks to the relative tolerance TOL." << endl;
+	cout << " --drop-off-per-partition" << endl;
+	cout << "        Spend the drop-off fraction separately on each partition." << endl;
+	cout << " --host-spikes" << endl;
+	cout << "        (With --ilu-level) Calculate the sparse spikes on the host." << endl;
+	cout << " --supervariables" << endl;
+	cout << "        Reorder the graph of the supervariables (rows with identical patterns)." << endl;
+	cout << "        Ignored if DB permutes the rows." << endl;
+	cout << " --sparse-rhs" << endl;
+	cout << "        Skip the partitions not reached by the right-hand side in the sweeps." << endl;
 	cout << " -f=METHOD" << endl;
 	cout << " --factorization-method=METHOD" << endl;
 	cout << "        Specify the factorization type used to assemble the reduced matrix" << endl;
@@ -978,6 +1037,8 @@ void PrintStats(bool               success,
 	cout << "Rel. residual norm   = " << stats.relResidualNorm << endl;
 	cout << endl;
 	cout << "Bandwidth after reordering = " << stats.bandwidthReorder << endl;
+	if (stats.numSupervariables > 0)
+		cout << "Number of supervariables   = " << stats.numSupervariables << endl;
 	cout << "Bandwidth                  = " << stats.bandwidth << endl;
 	cout << "Actual drop-off fraction   = " << stats.actualDropOff << endl;
 	cout << endl;
@@ -4,6 +4,7 @@
 #include <sap/common.h>
 #include <sap/solver.h>
 #include <sap/spmv.h>
+#include <sap/low_rank.h>
 
 #ifdef   USE_OLD_CUSP
 #include <cusp/blas.h>
@@ -36,7 +37,9 @@ typedef typename cusp::coo_matrix<int, REAL, cusp::host_memory>   MatrixCooH;
 typedef typename cusp::array1d<REAL, cusp::host_memory>           VectorH;
 
 void GetBandedMatrix(int N, int k, REAL d, Matrix& A);
+void GetSymmetricBandedMatrix(int N, int k, REAL d, Matrix& A);
 void GetRhsVector(const Matrix& A, Vector& b, Vector& x_target);
+void DenseSolve(int n, std::vector<REAL> A, REAL* x);
 
 class MockSaPSolver: public sap::Solver<Vector, PREC_REAL> {
 public:
@@ -93,6 +96,326 @@ TEST(DenseBandedTest, OverallTest) {
     EXPECT_GE(1e-13, mySolver.getStats().relResidualNorm);
 }
 
+// IDR(s) must converge on the diagonally dominant banded system of
+// DenseBandedTest, preconditioned with Spike.
+TEST(IDRsTest, ConvergesOnBandedMatrix) {
+    Matrix A;
+    Vector x_target;
+    Vector b;
+
+    GetBandedMatrix(10000, 20, 1.0, A);
+    GetRhsVector(A, b, x_target);
+
+    sap::Options opts;
+
+    opts.solverType = sap::IDRs;
+    opts.idrS = 4;
+    opts.variableBandwidth = false;
+    opts.performReorder = false;
+    opts.applyScaling = false;
+    opts.relTol = 1e-10;
+
+    MockSaPSolver  mySolver(10, opts);
+    SpmvFunctor  mySpmv(A);
+    Vector x(A.num_rows, 0);
+
+    mySolver.setup(A);
+
+    EXPECT_TRUE(mySolver.solve(mySpmv, b, x));
+    EXPECT_EQ(1, mySolver.getMonitorCode());
+    EXPECT_GE(1e-10, mySolver.getStats().relResidualNorm);
+}
+
+// The single-reduction CG must converge on a symmetric, strictly diagonally
+// dominant (hence SPD) banded system, with the symmetric SPMV and the
+// block-diagonal preconditioner (which is symmetric, unlike truncated Spike).
+TEST(CGTest, ConvergesOnSPDBandedMatrix) {
+    Matrix A;
+    Vector x_target;
+    Vector b;
+
+    GetSymmetricBandedMatrix(10000, 20, 1.2, A);
+    GetRhsVector(A, b, x_target);
+
+    sap::Options opts;
+
+    opts.solverType = sap::CG;
+    opts.precondType = sap::Block;
+    opts.isSPD = true;
+    opts.variableBandwidth = false;
+    opts.performReorder = false;
+    opts.applyScaling = false;
+    opts.relTol = 1e-10;
+
+    MockSaPSolver  mySolver(10, opts);
+    sap::SpmvSymmetric<Matrix>  mySpmv(A);
+    Vector x(A.num_rows, 0);
+
+    mySolver.setup(A);
+
+    EXPECT_TRUE(mySolver.solve(mySpmv, b, x));
+    EXPECT_EQ(1, mySolver.getMonitorCode());
+    EXPECT_GE(1e-10, mySolver.getStats().relResidualNorm);
+}
+
+// The s-step GMRES must converge on the banded system of DenseBandedTest,
+// preconditioned with Spike, across restarts.
+TEST(SGMRESTest, ConvergesOnBandedMatrix) {
+    Matrix A;
+    Vector x_target;
+    Vector b;
+
+    GetBandedMatrix(10000, 20, 1.0, A);
+    GetRhsVector(A, b, x_target);
+
+    sap::Options opts;
+
+    opts.solverType = sap::SGMRES;
+    opts.sStep = 4;
+    opts.restart = 16;
+    opts.variableBandwidth = false;
+    opts.performReorder = false;
+    opts.applyScaling = false;
+    opts.relTol = 1e-10;
+
+    MockSaPSolver  mySolver(10, opts);
+    SpmvFunctor  mySpmv(A);
+    Vector x(A.num_rows, 0);
+
+    mySolver.setup(A);
+
+    EXPECT_TRUE(mySolver.solve(mySpmv, b, x));
+    EXPECT_EQ(1, mySolver.getMonitorCode());
+    EXPECT_GE(1e-10, mySolver.getStats().relResidualNorm);
+}
+
+// Without truncation (tol = 0), the compressed reduced matrix must act as
+// the dense truncated SPIKE reduced matrix, assembled from the same spike
+// blocks with the layout of device::assembleReducedMat().
+TEST(CompressedSpikesTest, MatchesDenseReducedMatrix) {
+    int k = 8;
+    int numInterfaces = 3;
+    int k2 = k * k;
+
+    VectorH WV(2 * k2 * numInterfaces);
+    for (size_t i = 0; i < WV.size(); i++)
+        WV[i] = RAND(-0.1, 0.1);
+
+    VectorH v(2 * k * numInterfaces);
+    for (size_t i = 0; i < v.size(); i++)
+        v[i] = RAND(-1.0, 1.0);
+
+    sap::CompressedSpikes<REAL> spikes;
+    spikes.build(WV, k, numInterfaces, REAL(0));
+
+    VectorH x = v;
+    VectorH work;
+    spikes.solve(x, work);
+
+    for (int i = 0; i < numInterfaces; i++) {
+        std::vector<REAL> R(4 * k2, 0);
+        const REAL*       W = &WV[0] + 2 * k2 * i;
+
+        for (int r = 0; r < k; r++) {
+            for (int c = 0; c < k; c++) {
+                R[2*k*r + c + k]   = W[k*(r+k) + c];
+                R[2*k*(r+k) + c]   = W[k*r + c];
+            }
+            R[2*k*r + r]         = 1;
+            R[2*k*(r+k) + r + k] = 1;
+        }
+
+        std::vector<REAL> x_ref(&v[0] + 2 * k * i, &v[0] + 2 * k * (i + 1));
+        DenseSolve(2 * k, R, &x_ref[0]);
+
+        for (int j = 0; j < 2 * k; j++)
+            EXPECT_NEAR(x_ref[j], x[2 * k * i + j], 1e-12);
+    }
+}
+
+// With a negligible tolerance, the compressed reduced matrix must give the
+// same preconditioner as the dense one.
+TEST(CompressedSpikesTest, MatchesDenseSolve) {
+    Matrix A;
+    Vector x_target;
+    Vector b;
+
+    int numPart = 10;
+
+    GetBandedMatrix(10000, 20, 1.0, A);
+    GetRhsVector(A, b, x_target);
+
+    sap::Options opts;
+
+    opts.variableBandwidth = false;
+    opts.factMethod = sap::LU_only;
+    opts.performReorder = false;
+    opts.applyScaling = false;
+    opts.relTol = 1e-10;
+
+    SpmvFunctor  mySpmv(A);
+
+    MockSaPSolver  denseSolver(numPart, opts);
+    Vector x_dense(A.num_rows, 0);
+    denseSolver.setup(A);
+    EXPECT_TRUE(denseSolver.solve(mySpmv, b, x_dense));
+
+    opts.spikeTol = 1e-14;
+
+    MockSaPSolver  compressedSolver(numPart, opts);
+    Vector x_compressed(A.num_rows, 0);
+    compressedSolver.setup(A);
+    EXPECT_TRUE(compressedSolver.solve(mySpmv, b, x_compressed));
+
+    EXPECT_NEAR(denseSolver.getStats().numIterations, compressedSolver.getStats().numIterations, 1.0);
+}
+
+// The matrix passed to setupAssembler() only provides the sparsity pattern,
+// so a pattern with zero values must locate the same entries as the matrix
+// used in setup(). The elements are the two-node elements of a 1-D chain.
+TEST(ElementAssemblerTest, PatternWithZeroValues) {
+    int numElements = 9999;
+    int N = numElements + 1;
+
+    MatrixCooH Ah(N, N, 3 * N - 2);
+
+    int iiz = 0;
+    for (int ir = 0; ir < N; ir++) {
+        for (int ic = std::max(0, ir - 1); ic <= std::min(N - 1, ir + 1); ic++, iiz++) {
+            Ah.row_indices[iiz] = ir;
+            Ah.column_indices[iiz] = ic;
+            Ah.values[iiz] = (ir != ic ? -1 : (ir == 0 || ir == N - 1 ? 3 : 4));
+        }
+    }
+
+    cusp::array1d<int, cusp::host_memory> conn(2 * numElements);
+    std::vector<PREC_REAL>                Ke(4 * numElements);
+
+    for (int e = 0; e < numElements; e++) {
+        conn[2 * e] = e;
+        conn[2 * e + 1] = e + 1;
+
+        // Column-major element matrix; the ends of the chain get an extra
+        // unit on the diagonal.
+        Ke[4 * e]     = (e == 0 ? 3 : 2);
+        Ke[4 * e + 1] = -1;
+        Ke[4 * e + 2] = -1;
+        Ke[4 * e + 3] = (e == numElements - 1 ? 3 : 2);
+    }
+
+    Matrix A = Ah;
+    Vector x_target;
+    Vector b;
+
+    GetRhsVector(A, b, x_target);
+
+    thrust::fill(Ah.values.begin(), Ah.values.end(), REAL(0));
+    Matrix pattern = Ah;
+
+    sap::Options opts;
+
+    opts.trackReordering = true;
+    opts.variableBandwidth = false;
+    opts.relTol = 1e-10;
+
+    SpmvFunctor  mySpmv(A);
+
+    MockSaPSolver  mySolver(10, opts);
+    mySolver.setup(A);
+
+    sap::ElementAssembler<PREC_REAL> assembler;
+    ASSERT_NO_THROW(mySolver.setupAssembler(pattern, conn, 2, assembler));
+
+    assembler.addElements(&Ke[0]);
+    EXPECT_TRUE(mySolver.update(assembler));
+
+    Vector x(N, 0);
+    EXPECT_TRUE(mySolver.solve(mySpmv, b, x));
+    EXPECT_EQ(1, mySolver.getMonitorCode());
+}
+
+// With an exact preconditioner (one partition, no drop-off, factorization in
+// the solver precision), the multi-shift iteration must solve every shift
+// without a separate solve.
+TEST(ShiftedSolveTest, ExactPreconditionerNeedsNoRefinement) {
+    Matrix A;
+    Vector x_target;
+    Vector b;
+
+    GetBandedMatrix(1000, 5, 1.0, A);
+    GetRhsVector(A, b, x_target);
+
+    sap::Options opts;
+
+    opts.variableBandwidth = false;
+    opts.performReorder = false;
+    opts.applyScaling = false;
+    opts.relTol = 1e-10;
+
+    SpmvFunctor  mySpmv(A);
+
+    sap::Solver<Vector, REAL>  mySolver(1, opts);
+    mySolver.setup(A);
+
+    std::vector<REAL>    shifts(4);
+    std::vector<Vector>  X;
+
+    shifts[0] = 0;
+    shifts[1] = 0.5;
+    shifts[2] = 1;
+    shifts[3] = 2;
+
+    EXPECT_TRUE(mySolver.solveShifted(mySpmv, b, shifts, X));
+    EXPECT_EQ(0, mySolver.getStats().numShiftsRefined);
+    EXPECT_GE(1e-10, mySolver.getStats().relResidualNorm);
+}
+
+// With an approximate preconditioner, the shifts must be solved one after the
+// other, with the same work as separate solves of the shifted systems.
+TEST(ShiftedSolveTest, ApproximatePreconditionerSolvesEachShift) {
+    Matrix A;
+    Vector x_target;
+    Vector b;
+
+    GetBandedMatrix(10000, 20, 1.0, A);
+    GetRhsVector(A, b, x_target);
+
+    sap::Options opts;
+
+    opts.variableBandwidth = false;
+    opts.performReorder = false;
+    opts.applyScaling = false;
+    opts.relTol = 1e-10;
+
+    SpmvFunctor  mySpmv(A);
+
+    MockSaPSolver  mySolver(10, opts);
+    mySolver.setup(A);
+
+    std::vector<REAL>    shifts(2);
+    std::vector<Vector>  X;
+
+    shifts[0] = 0;
+    shifts[1] = 1;
+
+    EXPECT_TRUE(mySolver.solveShifted(mySpmv, b, shifts, X));
+    EXPECT_EQ(2, mySolver.getStats().numShiftsRefined);
+    EXPECT_GE(1e-10, mySolver.getStats().relResidualNorm);
+
+    float shiftedIterations = mySolver.getStats().numIterations;
+    float separateIterations = 0;
+
+    for (int i = 0; i < 2; i++) {
+        sap::ShiftedOperator<SpmvFunctor, Vector> Ai(mySpmv, A.num_rows, shifts[i]);
+        Vector x(A.num_rows, 0);
+
+        EXPECT_TRUE(mySolver.solve(Ai, b, x));
+        separateIterations += mySolver.getStats().numIterations;
+    }
+
+    EXPECT_FLOAT_EQ(separateIterations, shiftedIterations);
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -144,6 +467,53 @@ GetBandedMatrix(int N, int k, REAL d, Matrix& A)
 	////cusp::io::write_matrix_market_file(Ah, "A.mtx");
 }
 
+// -------------------------------------------------------------------
+// GetSymmetricBandedMatrix()
+//
+// This function generates a symmetric banded matrix like
+// GetBandedMatrix(): the random elements of the strictly upper half are
+// mirrored to the lower half and the diagonal elements are set to d times
+// the absolute row sum. With d > 1, the matrix is SPD.
+// -------------------------------------------------------------------
+void
+GetSymmetricBandedMatrix(int N, int k, REAL d, Matrix& A)
+{
+	// Random elements of the strictly upper half, row by row (band storage).
+	std::vector<REAL> upper((size_t) N * k);
+	for (size_t i = 0; i < upper.size(); i++)
+		upper[i] = RAND(-10.0, 10.0);
+
+	int     num_entries = (2 * k + 1) * N - k * (k + 1);
+	MatrixCooH Ah(N, N, num_entries);
+
+	int iiz = 0;
+	for (int ir = 0; ir < N; ir++) {
+		int left = std::max(0, ir - k);
+		int right = std::min(N - 1, ir + k);
+
+		REAL row_sum = 0;
+		int  diag_iiz;
+		for (int ic = left; ic <= right; ic++, iiz++) {
+			REAL val = 0;
+
+			if (ir == ic)
+				diag_iiz = iiz;
+			else {
+				int lo = std::min(ir, ic);
+				val = upper[(size_t) lo * k + std::abs(ir - ic) - 1];
+				row_sum += abs(val);
+			}
+
+			Ah.row_indices[iiz] = ir;
+			Ah.column_indices[iiz] = ic;
+			Ah.values[iiz] = val;
+		}
+		Ah.values[diag_iiz] = d * row_sum;
+	}
+
+	A = Ah;
+}
+
 // -------------------------------------------------------------------
 // GetRhsVector()
 //
@@ -175,3 +545,39 @@ GetRhsVector(const Matrix& A, Vector& b, Vector& x_target)
 	cusp::multiply(A, x_target, b);
 	////cusp::io::write_matrix_market_file(b, "b.mtx");
 }
+
+// -------------------------------------------------------------------
+// DenseSolve()
+//
+// This function solves the dense (column-major) system A * x = b in
+// place, using Gaussian elimination with partial pivoting.
+// -------------------------------------------------------------------
+void
+DenseSolve(int n, std::vector<REAL> A, REAL* x)
+{
+	for (int j = 0; j < n; j++) {
+		int p = j;
+		for (int i = j + 1; i < n; i++)
+			if (std::abs(A[j*n + i]) > std::abs(A[j*n + p]))
+				p = i;
+
+		if (p != j) {
+			for (int c = 0; c < n; c++)
+				std::swap(A[c*n + j], A[c*n + p]);
+			std::swap(x[j], x[p]);
+		}
+
+		for (int i = j + 1; i < n; i++) {
+			REAL l = A[j*n + i] / A[j*n + j];
+			for (int c = j; c < n; c++)
+				A[c*n + i] -= l * A[c*n + j];
+			x[i] -= l * x[j];
+		}
+	}
+
+	for (int j = n - 1; j >= 0; j--) {
+		x[j] /= A[j*n + j];
+		for (int i = 0; i < j; i++)
+			x[i] -= A[j*n + i] * x[j];
+	}
+}
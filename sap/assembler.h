@@ -0,0 +1,210 @@
+/** \file assembler.h
+ *  \brief Element-level assembly directly into the banded storage of the
+ *         SaP preconditioner.
+ */
+
+#ifndef SAP_ASSEMBLER_H
+#define SAP_ASSEMBLER_H
+
+#include <vector>
+#include <cstddef>
+
+#include <cusp/array1d.h>
+
+#include <thrust/fill.h>
+
+#include <omp.h>
+
+namespace sap {
+
+template <typename PrecVector>
+class Precond;
+
+
+/// Element assembler.
+/**
+ * This class accumulates element matrices directly into the storage used by
+ * the SaP preconditioner: the reordered (and DB-scaled) banded matrix, the
+ * off-diagonal coupling blocks and the right-hand sides of the spikes. The
+ * destination and the scaling factor of every entry of every element matrix
+ * are computed once, by Solver::setupAssembler(), from the element
+ * connectivity and the reordering information tracked during setup. The
+ * assembled storage is then passed to Solver::update(), which bypasses the
+ * sparse matrix and the scatter into the banded storage.
+ *
+ * All elements have the same number m of nodes, with one unknown per node.
+ * Element matrices are dense, m x m, stored column-major: the entry (a, b)
+ * of the matrix of element e is added to the matrix entry (conn[e*m + a],
+ * conn[e*m + b]). Entries that are not part of the preconditioner (dropped
+ * or not in the sparsity pattern of the setup matrix) are ignored.
+ *
+ * The elements are colored so that elements of the same color share no
+ * node; addElements() processes the colors in sequence and the elements of
+ * each color in parallel.
+ *
+ * \tparam T is the floating point type of the preconditioner.
+ */
+template <typename T>
+class ElementAssembler
+{
+public:
+	typedef typename cusp::array1d<T, cusp::host_memory>    VectorH;
+	typedef typename cusp::array1d<int, cusp::host_memory>  IntVectorH;
+
+	ElementAssembler() : m_numElements(0), m_nodesPerElement(0) {}
+
+	void zero();
+	void addElement(int e, const T* Ke);
+	void addElements(const T* Ke);
+
+	int  getNumElements() const      {return m_numElements;}
+	int  getNodesPerElement() const  {return m_nodesPerElement;}
+	int  getNumColors() const        {return m_colorOffsets.size() > 0 ? (int) m_colorOffsets.size() - 1 : 0;}
+
+private:
+	template <typename PrecVector>
+	friend class Precond;
+
+	int         m_numElements;
+	int         m_nodesPerElement;
+
+	IntVectorH  m_destB;          // per element entry: index in m_B (-1 if not in the banded matrix)
+	IntVectorH  m_destOffDiag;    // per element entry: index in m_offDiags (-1 if not an off-diagonal entry)
+	IntVectorH  m_destWV;         // per element entry: index in m_WV (-1 if not an off-diagonal entry)
+	VectorH     m_scale;          // per element entry: DB scaling factor
+
+	IntVectorH  m_colorOffsets;   // first position in m_colorElements of every color (plus the end)
+	IntVectorH  m_colorElements;  // elements sorted by color
+
+	VectorH     m_B;              // banded matrix (layout of Precond::m_B)
+	VectorH     m_offDiags;       // off-diagonal blocks (layout of Precond::m_offDiags)
+	VectorH     m_WV;             // right-hand sides of the spikes
+
+	void color(const IntVectorH& connectivity, int numNodes);
+};
+
+
+/**
+ * This function clears the assembled storage. It must be called before the
+ * element contributions of a new matrix are added.
+ */
+template <typename T>
+void
+ElementAssembler<T>::zero()
+{
+	thrust::fill(m_B.begin(), m_B.end(), T(0));
+	thrust::fill(m_offDiags.begin(), m_offDiags.end(), T(0));
+	thrust::fill(m_WV.begin(), m_WV.end(), T(0));
+}
+
+/**
+ * This function adds the matrix Ke (m x m, column-major) of element e.
+ */
+template <typename T>
+void
+ElementAssembler<T>::addElement(int       e,
+                                const T*  Ke)
+{
+	int     m2   = m_nodesPerElement * m_nodesPerElement;
+	size_t  base = (size_t) e * m2;
+
+	const int* destB       = &m_destB[0] + base;
+	const int* destOffDiag = &m_destOffDiag[0] + base;
+	const int* destWV      = &m_destWV[0] + base;
+	const T*   scale       = &m_scale[0] + base;
+
+	for (int l = 0; l < m2; l++) {
+		T val = Ke[l] * scale[l];
+
+		if (destB[l] >= 0)
+			m_B[destB[l]] += val;
+		else if (destOffDiag[l] >= 0) {
+			m_offDiags[destOffDiag[l]] += val;
+			m_WV[destWV[l]] += val;
+		}
+	}
+}
+
+/**
+ * This function adds the matrices of all elements, stored one after the
+ * other in Ke (m*m values per element). The elements of a color update
+ * disjoint entries and are processed in parallel.
+ */
+template <typename T>
+void
+ElementAssembler<T>::addElements(const T* Ke)
+{
+	int    numColors = getNumColors();
+	size_t m2        = (size_t) m_nodesPerElement * m_nodesPerElement;
+
+	for (int c = 0; c < numColors; c++) {
+		int first = m_colorOffsets[c];
+		int last  = m_colorOffsets[c+1];
+
+#pragma omp parallel for schedule(static)
+		for (int i = first; i < last; i++) {
+			int e = m_colorElements[i];
+			addElement(e, Ke + e * m2);
+		}
+	}
+}
+
+/**
+ * This function colors the elements greedily, so that no two elements of
+ * the same color share a node.
+ */
+template <typename T>
+void
+ElementAssembler<T>::color(const IntVectorH&  connectivity,
+                           int                numNodes)
+{
+	int m = m_nodesPerElement;
+
+	std::vector<int> elemColor(m_numElements, -1);
+	std::vector<int> nodeMark(numNodes, -1);
+
+	int numColors  = 0;
+	int numColored = 0;
+
+	while (numColored < m_numElements) {
+		for (int e = 0; e < m_numElements; e++) {
+			if (elemColor[e] >= 0)
+				continue;
+
+			bool free = true;
+			for (int a = 0; a < m && free; a++)
+				free = (nodeMark[connectivity[(size_t) e * m + a]] != numColors);
+
+			if (!free)
+				continue;
+
+			for (int a = 0; a < m; a++)
+				nodeMark[connectivity[(size_t) e * m + a]] = numColors;
+
+			elemColor[e] = numColors;
+			numColored++;
+		}
+
+		numColors++;
+	}
+
+	m_colorOffsets.resize(numColors + 1);
+	m_colorElements.resize(m_numElements);
+
+	thrust::fill(m_colorOffsets.begin(), m_colorOffsets.end(), 0);
+	for (int e = 0; e < m_numElements; e++)
+		m_colorOffsets[elemColor[e] + 1]++;
+	for (int c = 0; c < numColors; c++)
+		m_colorOffsets[c + 1] += m_colorOffsets[c];
+
+	std::vector<int> pos(m_colorOffsets.begin(), m_colorOffsets.end() - 1);
+	for (int e = 0; e < m_numElements; e++)
+		m_colorElements[pos[elemColor[e]]++] = e;
+}
+
+
+
+} // namespace sap
+
+
+#endif
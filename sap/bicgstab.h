@@ -82,7 +82,7 @@ void bicgstab(LinearOperator&  A,
 	// r_star <- r
 	cusp::blas::copy(r, r_star);
 
-	ValueType r_r_star_old = cusp::blas::dotc(r_star, r);
+	ValueType r_r_star_old = monitor.dot(r_star, r);
 
 	while (!monitor.finished(r)) {
 		// Prevent divison by zero at this iteration.
@@ -98,7 +98,7 @@ void bicgstab(LinearOperator&  A,
 		cusp::multiply(A, Mp, AMp);
 
 		// alpha = (r_j, r_star) / (A*M*p, r_star)
-		ValueType tmp1 = cusp::blas::dotc(r_star, AMp);
+		ValueType tmp1 = monitor.dot(r_star, AMp);
 		if (tmp1 == 0) {
 			monitor.stop(-11, "r_star * AMp is zero");
 			break;
@@ -121,12 +121,12 @@ void bicgstab(LinearOperator&  A,
 		cusp::multiply(A, Ms, AMs);
 
 		// omega = (AMs, s) / (AMs, AMs)
-		ValueType tmp2 = cusp::blas::dotc(AMs, AMs);
+		ValueType tmp2 = monitor.dot(AMs, AMs);
 		if (tmp2 == 0) {
 			monitor.stop(-12, "AMs * AMs is zero");
 			break;
 		}
-		ValueType omega = cusp::blas::dotc(AMs, s) / tmp2;
+		ValueType omega = monitor.dot(AMs, s) / tmp2;
 
 		// x_{j+1} = x_j + alpha*M*p_j + omega*M*s_j
 		cusp::blas::axpbypcz(x, Mp, Ms, x, ValueType(1), alpha, omega);
@@ -135,7 +135,7 @@ void bicgstab(LinearOperator&  A,
 		cusp::blas::axpby(s, AMs, r, ValueType(1), -omega);
 
 		// beta_j = (r_{j+1}, r_star) / (r_j, r_star) * (alpha/omega)
-		ValueType r_r_star_new = cusp::blas::dotc(r_star, r);
+		ValueType r_r_star_new = monitor.dot(r_star, r);
 
 		ValueType beta = (r_r_star_new / r_r_star_old) * (alpha / omega);
 		r_r_star_old = r_r_star_new;
@@ -0,0 +1,214 @@
+/** \file cg.h
+ *  \brief Single-reduction CG preconditioned iterative Krylov solver.
+ */
+
+#ifndef SAP_CG_H
+#define SAP_CG_H
+
+#include <vector>
+#include <cmath>
+
+#ifdef   USE_OLD_CUSP
+#include <cusp/blas.h>
+#else
+#include <cusp/blas/blas.h>
+#endif
+#include <cusp/multiply.h>
+#include <cusp/array1d.h>
+
+#include <thrust/for_each.h>
+#include <thrust/fill.h>
+#include <thrust/transform_reduce.h>
+#include <thrust/iterator/zip_iterator.h>
+
+#include <sap/monitor.h>
+
+
+namespace sap {
+
+namespace detail {
+
+/**
+ * This functor performs the four vector updates of one CG iteration in a
+ * single pass over the tuple (u, w, p, s, x, r):
+ *   p <- u + beta * p,   s <- w + beta * s,
+ *   x <- x + alpha * p,  r <- r - alpha * s.
+ */
+template <typename ValueType>
+struct CgUpdate
+{
+	ValueType m_alpha;
+	ValueType m_beta;
+
+	CgUpdate(ValueType alpha, ValueType beta) : m_alpha(alpha), m_beta(beta) {}
+
+	template <typename Tuple>
+	__host__ __device__
+	void operator() (Tuple t) const
+	{
+		ValueType p = thrust::get<0>(t) + m_beta * thrust::get<2>(t);
+		ValueType s = thrust::get<1>(t) + m_beta * thrust::get<3>(t);
+
+		thrust::get<2>(t) = p;
+		thrust::get<3>(t) = s;
+		thrust::get<4>(t) += m_alpha * p;
+		thrust::get<5>(t) -= m_alpha * s;
+	}
+};
+
+/**
+ * This functor maps the tuple (r, u, w) to the products (r*u, w*u, r*r),
+ * so that all inner products of one CG iteration are computed by a single
+ * reduction.
+ */
+template <typename ValueType>
+struct CgProducts : public thrust::unary_function<thrust::tuple<ValueType, ValueType, ValueType>,
+                                                  thrust::tuple<ValueType, ValueType, ValueType> >
+{
+	__host__ __device__
+	thrust::tuple<ValueType, ValueType, ValueType> operator() (const thrust::tuple<ValueType, ValueType, ValueType>& a) const
+	{
+		ValueType r = thrust::get<0>(a);
+		ValueType u = thrust::get<1>(a);
+		ValueType w = thrust::get<2>(a);
+
+		return thrust::make_tuple(r * u, w * u, r * r);
+	}
+};
+
+template <typename ValueType>
+struct CgSum : public thrust::binary_function<thrust::tuple<ValueType, ValueType, ValueType>,
+                                              thrust::tuple<ValueType, ValueType, ValueType>,
+                                              thrust::tuple<ValueType, ValueType, ValueType> >
+{
+	__host__ __device__
+	thrust::tuple<ValueType, ValueType, ValueType> operator() (const thrust::tuple<ValueType, ValueType, ValueType>& a,
+	                                                         const thrust::tuple<ValueType, ValueType, ValueType>& b) const
+	{
+		return thrust::make_tuple(thrust::get<0>(a) + thrust::get<0>(b),
+		                          thrust::get<1>(a) + thrust::get<1>(b),
+		                          thrust::get<2>(a) + thrust::get<2>(b));
+	}
+};
+
+/**
+ * This function calculates gamma = (r, u), delta = (w, u), and rr = (r, r)
+ * with a single reduction.
+ */
+template <typename Vector, typename ValueType>
+void cgReduce(const Vector&  r,
+              const Vector&  u,
+              const Vector&  w,
+              ValueType&     gamma,
+              ValueType&     delta,
+              ValueType&     rr)
+{
+	thrust::tuple<ValueType, ValueType, ValueType> res =
+		thrust::transform_reduce(thrust::make_zip_iterator(thrust::make_tuple(r.begin(), u.begin(), w.begin())),
+		                         thrust::make_zip_iterator(thrust::make_tuple(r.end(), u.end(), w.end())),
+		                         CgProducts<ValueType>(),
+		                         thrust::make_tuple(ValueType(0), ValueType(0), ValueType(0)),
+		                         CgSum<ValueType>());
+
+	gamma = thrust::get<0>(res);
+	delta = thrust::get<1>(res);
+	rr    = thrust::get<2>(res);
+}
+
+} // namespace detail
+
+
+/// Preconditioned CG Krylov method (single-reduction variant)
+/**
+ * This is the Chronopoulos-Gear formulation of the preconditioned conjugate
+ * gradient method. The direction s = A*p is updated by recurrence, so that
+ * the inner products (r, u), (A*u, u) and (r, r) of an iteration are all
+ * available after the matrix-vector product and are computed by a single
+ * fused reduction (i.e. one synchronization per iteration). The vector
+ * updates of an iteration are likewise fused in a single pass.
+ *
+ * The work vectors are taken from the array work (resized to 5 vectors of
+ * the system size as needed), so that repeated solves do not allocate.
+ *
+ * \tparam LinearOperator is a functor class for sparse matrix-vector product.
+ * \tparam Vector is the vector type for the linear system solution.
+ * \tparam Monitor is the convergence test object.
+ * \tparam Preconditioner is the preconditioner (must be symmetric positive definite).
+ */
+template <typename LinearOperator, typename Vector, typename Monitor, typename Preconditioner>
+void cg(LinearOperator&       A,
+        Vector&               x,
+        const Vector&         b,
+        Monitor&              monitor,
+        Preconditioner&       P,
+        std::vector<Vector>&  work)
+{
+	typedef typename Vector::value_type   ValueType;
+
+	int  n = b.size();
+
+	if (work.size() < 5)
+		work.resize(5);
+	for (int i = 0; i < 5; i++)
+		if (work[i].size() != (size_t) n)
+			work[i].resize(n);
+
+	Vector& r = work[0];
+	Vector& u = work[1];
+	Vector& w = work[2];
+	Vector& p = work[3];
+	Vector& s = work[4];
+
+	// r <- b - A * x
+	cusp::multiply(A, x, r);
+	cusp::blas::axpby(b, r, r, ValueType(1), ValueType(-1));
+
+	// u <- P^{-1} * r,   w <- A * u
+	cusp::multiply(P, r, u);
+	cusp::multiply(A, u, w);
+
+	ValueType gamma, delta, rr;
+	detail::cgReduce(r, u, w, gamma, delta, rr);
+
+	thrust::fill(p.begin(), p.end(), ValueType(0));
+	thrust::fill(s.begin(), s.end(), ValueType(0));
+
+	ValueType alpha = 0;
+	ValueType beta  = 0;
+	ValueType denom = delta;
+
+	while (!monitor.finished(std::sqrt(rr))) {
+		if (!(denom > 0)) {
+			monitor.stop(-10, "The matrix or the preconditioner is not positive definite");
+			break;
+		}
+
+		alpha = gamma / denom;
+
+		// p <- u + beta * p,   s <- w + beta * s
+		// x <- x + alpha * p,  r <- r - alpha * s
+		thrust::for_each(thrust::make_zip_iterator(thrust::make_tuple(u.begin(), w.begin(), p.begin(), s.begin(), x.begin(), r.begin())),
+		                 thrust::make_zip_iterator(thrust::make_tuple(u.end(), w.end(), p.end(), s.end(), x.end(), r.end())),
+		                 detail::CgUpdate<ValueType>(alpha, beta));
+
+		// u <- P^{-1} * r,   w <- A * u
+		cusp::multiply(P, r, u);
+		cusp::multiply(A, u, w);
+
+		ValueType gamma_old = gamma;
+		detail::cgReduce(r, u, w, gamma, delta, rr);
+
+		beta  = gamma / gamma_old;
+		denom = delta - beta * gamma / alpha;
+
+		++monitor;
+	}
+}
+
+
+
+} // namespace sap
+
+
+
+#endif
@@ -65,6 +65,8 @@ const unsigned int MAX_GRID_DIMENSION = 32768;
 
 const unsigned int CRITICAL_THRESHOLD = 70;
 
+const unsigned int HOST_CHOLESKY_THRESHOLD = 256;
+
 /**
  * This defines the types of Krylov subspace methods used in SaP.
  */
@@ -78,7 +80,10 @@ enum KrylovSolverType {
 	BiCGStab1,
 	BiCGStab2,
 	BiCGStab,
-	MINRES
+	MINRES,
+	IDRs,
+	CG,
+	SGMRES
 };
 
 enum FactorizationMethod {
@@ -92,7 +97,18 @@ enum FactorizationMethod {
 enum PreconditionerType {
 	Spike,
 	Block,
-	None
+	None,
+	Polynomial,
+	Schwarz,
+	SPAI
+};
+
+/**
+ * This defines the polynomials used by the Polynomial preconditioner.
+ */
+enum PolynomialType {
+	Chebyshev,
+	Neumann
 };
 
 inline
@@ -302,8 +302,11 @@ innerProductBCX_var_bandwidth_g256(T* d_spike,
                                    int* offsets,
                                    int  b_partition_size,
                                    int  b_partition_num,
-                                   int  b_rest_num)
+                                   int  b_rest_num,
+                                   const int* active = 0)
 {
+	if (active && !active[blockIdx.y]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y, bidz = blockIdx.z;
 	int k = ks[bidy];
 	if (bidx >= k) return;
@@ -385,8 +388,11 @@ innerProductBCX_var_bandwidth_g64(T*   d_spike,
                                   int* offsets,
                                   int  b_partition_size,
                                   int  b_partition_num,
-                                  int  b_rest_num)
+                                  int  b_rest_num,
+                                  const int* active = 0)
 {
+	if (active && !active[blockIdx.y]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y, bidz = blockIdx.z;
 	int k = ks[bidy];
 	if (bidx >= k) return;
@@ -471,8 +477,11 @@ innerProductBCX_var_bandwidth_g32(T*   d_spike,
                                   int* offsets,
                                   int  b_partition_size,
                                   int  b_partition_num,
-                                  int  b_rest_num) 
+                                  int  b_rest_num,
+                                  const int* active = 0)
 {
+	if (active && !active[blockIdx.y]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y, bidz = blockIdx.z;
 	int k = ks[bidy];
 	if (bidx >= k) return;
@@ -544,8 +553,11 @@ innerProductBCX_var_bandwidth(T*   d_spike,
                               int* offsets,
                               int  b_partition_size,
                               int  b_partition_num,
-                              int  b_rest_num)
+                              int  b_rest_num,
+                              const int* active = 0)
 {
+	if (active && !active[blockIdx.y]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y, bidz = blockIdx.z;
 	int k = ks[bidy];
 	if (bidx >= k) return;
@@ -598,6 +610,78 @@ innerProductBCX_var_bandwidth(T*   d_spike,
 	}
 }
 
+// ----------------------------------------------------------------------------
+// Transposed purification products: for each partition boundary, the k rows
+// above and below the boundary of dB_final receive the products of the
+// transposed coupling blocks with the corresponding rows of dB (the other
+// rows of dB_final are not touched). One block per boundary.
+// ----------------------------------------------------------------------------
+template <typename T>
+__global__ void
+innerProductBCXTrans(T*  d_spike,
+                     T*  dB,
+                     T*  dB_final,
+                     int N,
+                     int k,
+                     int b_partition_size,
+                     int b_partition_num,
+                     int b_rest_num)
+{
+	int bidy = blockIdx.x;
+	int offset1 = 2*k*k*bidy;
+	int offset2 = offset1 + k*k;
+	int start;
+
+	if(bidy+1 <= b_rest_num)
+		start = (bidy+1)*(b_partition_size+1);
+	else
+		start = (bidy+1)*b_partition_size+b_rest_num;
+
+	for(int c = threadIdx.x; c < k; c += blockDim.x) {
+		T sum = 0, sum2 = 0;
+		for(int r = 0; r < k; r++) {
+			sum  += d_spike[offset1 + r*k + c] * dB[start-k+r];
+			sum2 += d_spike[offset2 + r*k + c] * dB[start+r];
+		}
+		dB_final[start+c]   = sum;
+		dB_final[start-k+c] = sum2;
+	}
+}
+
+template <typename T>
+__global__ void
+innerProductBCXTrans_var_bandwidth(T*   d_spike,
+                                   T*   dB,
+                                   T*   dB_final,
+                                   int  N,
+                                   int* ks,
+                                   int* offsets,
+                                   int  b_partition_size,
+                                   int  b_partition_num,
+                                   int  b_rest_num)
+{
+	int bidy = blockIdx.x;
+	int k = ks[bidy];
+	int offset1 = offsets[bidy];
+	int offset2 = offsets[bidy] + k*k;
+	int start;
+
+	if(bidy+1 <= b_rest_num)
+		start = (bidy+1)*(b_partition_size+1);
+	else
+		start = (bidy+1)*b_partition_size+b_rest_num;
+
+	for(int c = threadIdx.x; c < k; c += blockDim.x) {
+		T sum = 0, sum2 = 0;
+		for(int r = 0; r < k; r++) {
+			sum  += d_spike[offset1 + r*k + c] * dB[start-k+r];
+			sum2 += d_spike[offset2 + r*k + c] * dB[start+r];
+		}
+		dB_final[start+c]   = sum;
+		dB_final[start-k+c] = sum2;
+	}
+}
+
 
 } // namespace device
 } // namespace sap
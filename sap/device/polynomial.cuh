@@ -0,0 +1,84 @@
+/** \file polynomial.cuh
+ *  \brief Fused SpMV kernels for the polynomial preconditioner.
+ */
+
+#ifndef POLYNOMIAL_CUH
+#define POLYNOMIAL_CUH
+
+
+namespace sap {
+namespace device {
+
+
+/**
+ * This kernel performs one step of the Jacobi-preconditioned Chebyshev
+ * iteration for the CSR matrix A (one thread per row). With q = A * d_old,
+ * it updates
+ *     r     <- r - q
+ *     d_new <- alpha * d_old + beta * dinv .* r
+ *     x     <- x + d_new
+ */
+template <typename T>
+__global__ void
+chebyshevStep(int        n,
+              const int* row_offsets,
+              const int* column_indices,
+              const T*   values,
+              const T*   dinv,
+              const T*   d_old,
+              T*         d_new,
+              T*         r,
+              T*         x,
+              T          alpha,
+              T          beta)
+{
+	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
+	int i = tid + bidx * blockDim.x + bidy * gridDim.x * blockDim.x;
+	if (i >= n) return;
+
+	T q = 0;
+	for (int l = row_offsets[i]; l < row_offsets[i+1]; l++)
+		q += values[l] * d_old[column_indices[l]];
+
+	T ri = r[i] - q;
+	T di = alpha * d_old[i] + beta * dinv[i] * ri;
+
+	r[i]     = ri;
+	d_new[i] = di;
+	x[i]    += di;
+}
+
+/**
+ * This kernel performs one step of the damped Jacobi (truncated Neumann
+ * series) iteration for the CSR matrix A (one thread per row):
+ *     x_new <- x_old + omega * dinv .* (b - A * x_old)
+ */
+template <typename T>
+__global__ void
+neumannStep(int        n,
+            const int* row_offsets,
+            const int* column_indices,
+            const T*   values,
+            const T*   dinv,
+            const T*   b,
+            const T*   x_old,
+            T*         x_new,
+            T          omega)
+{
+	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
+	int i = tid + bidx * blockDim.x + bidy * gridDim.x * blockDim.x;
+	if (i >= n) return;
+
+	T q = 0;
+	for (int l = row_offsets[i]; l < row_offsets[i+1]; l++)
+		q += values[l] * x_old[column_indices[l]];
+
+	x_new[i] = x_old[i] + omega * dinv[i] * (b[i] - q);
+}
+
+
+} // namespace device
+} // namespace sap
+
+
+#endif
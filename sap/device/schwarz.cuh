@@ -0,0 +1,66 @@
+/** \file schwarz.cuh
+ *  \brief Assembly of the overlapping blocks of the Schwarz preconditioner.
+ */
+
+#ifndef SCHWARZ_CUH
+#define SCHWARZ_CUH
+
+
+namespace sap {
+namespace device {
+
+
+/**
+ * This kernel assembles the overlapping diagonal blocks of the banded matrix
+ * B (half-bandwidth k, n rows) into Bext. Partition i is extended by
+ * 'overlap' rows on either side (clipped to the matrix) and stored in the
+ * columns [i*blockSize, (i+1)*blockSize) of Bext; the entries coupling the
+ * block with rows outside of it are dropped. Trailing columns which are not
+ * used by a (smaller) block are set to the identity, so that all blocks have
+ * the same size blockSize. Each thread block handles one column of Bext.
+ */
+template <typename T>
+__global__ void
+assembleOverlapBlocks(int      n,
+                      int      k,
+                      int      numPartitions,
+                      int      overlap,
+                      int      blockSize,
+                      const T* B,
+                      T*       Bext)
+{
+	int col = blockIdx.x + blockIdx.y * gridDim.x;
+	if (col >= numPartitions * blockSize) return;
+
+	int part  = col / blockSize;
+	int local = col % blockSize;
+
+	int partSize  = n / numPartitions;
+	int remainder = n % numPartitions;
+
+	int begin = part * partSize + (part < remainder ? part : remainder);
+	int end   = begin + partSize + (part < remainder ? 1 : 0);
+
+	int lo = max(begin - overlap, 0);
+	int hi = min(end + overlap, n);
+
+	int colWidth = 2 * k + 1;
+
+	for (int t = threadIdx.x; t < colWidth; t += blockDim.x) {
+		int row = local + t - k;
+
+		if (local >= hi - lo)
+			Bext[col * colWidth + t] = (t == k) ? T(1) : T(0);
+		else if (row < 0 || row >= hi - lo)
+			Bext[col * colWidth + t] = T(0);
+		else
+			Bext[col * colWidth + t] = B[(lo + local) * colWidth + t];
+	}
+}
+
+
+} // namespace device
+} // namespace sap
+
+
+#endif
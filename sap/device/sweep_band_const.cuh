@@ -1275,6 +1275,67 @@ backwardElimU_LU_UL(int N, int k, T *dA, T *dB, int partition_size, int rest_num
 }
 
 
+// ----------------------------------------------------------------------------
+// Forward and backward sweeps with the transposed factors of the diagonal
+// blocks. The factors are stored as A = L * D * U with L and U unit
+// triangular, so (LU)^T x = b is solved as U^T y = b (fwdElimTrans_sol),
+// followed by the division by the diagonal and L^T x = y (bckElimTrans_sol).
+// ----------------------------------------------------------------------------
+template <typename T>
+__global__ void
+fwdElimTrans_sol(int N, int k, T *dA, T *dB, int partition_size, int rest_num)
+{
+	int tid = threadIdx.x;
+	int col_width = 2*k + 1;
+	int first_row = blockIdx.x*partition_size;
+	int last_row;
+	if(blockIdx.x < rest_num) {
+		first_row += blockIdx.x;
+		last_row = first_row + partition_size + 1;
+	} else {
+		first_row += rest_num;
+		last_row = first_row + partition_size;
+	}
+
+	for(int i=first_row; i<last_row; i++) {
+		T tmp = dB[i];
+		int it_last = last_row-i-1;
+		if(it_last > k)
+			it_last = k;
+		for(int ttid = tid; ttid<it_last; ttid+=blockDim.x)
+			dB[i+ttid+1] -= tmp * dA[(i+ttid+1)*col_width + k - ttid - 1];
+		__syncthreads();
+	}
+}
+
+template <typename T>
+__global__ void
+bckElimTrans_sol(int N, int k, T *dA, T *dB, int partition_size, int rest_num)
+{
+	int tid = threadIdx.x;
+	int col_width = 2*k + 1;
+	int first_row = blockIdx.x*partition_size;
+	int last_row;
+	if(blockIdx.x < rest_num) {
+		first_row += blockIdx.x;
+		last_row = first_row + partition_size + 1;
+	} else {
+		first_row += rest_num;
+		last_row = first_row + partition_size;
+	}
+
+	for(int i=last_row-1; i>first_row; i--) {
+		T tmp = dB[i];
+		int it_last = i-first_row;
+		if(it_last > k)
+			it_last = k;
+		for(int ttid = tid; ttid<it_last; ttid+=blockDim.x)
+			dB[i-ttid-1] -= tmp * dA[(i-ttid-1)*col_width + k + ttid + 1];
+		__syncthreads();
+	}
+}
+
+
 
 } // namespace device
 } // namespace sap
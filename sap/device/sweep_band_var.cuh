@@ -20,8 +20,10 @@ namespace var {
 // ----------------------------------------------------------------------------
 template <typename T>
 __global__ void
-fwdElim_full_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+fwdElim_full_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int bidx = blockIdx.x;
 	int k = ks[bidx];
 	int tid = threadIdx.x;
@@ -57,8 +59,10 @@ fwdElim_full_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_
 
 template <typename T>
 __global__ void
-fwdElim_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+fwdElim_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x;
 	int k = ks[bidx];
 	int partition_size = (k<<1);
@@ -103,8 +107,10 @@ fwdElim_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, i
 
 template <typename T>
 __global__ void
-preBck_full_divide_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+preBck_full_divide_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int k = ks[blockIdx.x];
 	int offset = offsets[blockIdx.x];
 
@@ -116,8 +122,10 @@ preBck_full_divide_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_part
 
 template <typename T>
 __global__ void
-preBck_full_divide(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+preBck_full_divide(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int k = ks[blockIdx.x];
 	int offset = offsets[blockIdx.x];
 
@@ -132,8 +140,10 @@ preBck_full_divide(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_s
 
 template <typename T>
 __global__ void
-bckElim_full_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+bckElim_full_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x;
 	int k = ks[bidx];
 	int partition_size = (2*k);
@@ -158,8 +168,10 @@ bckElim_full_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_
 
 template <typename T>
 __global__ void
-bckElim_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+bckElim_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x;
 	int k = ks[bidx];
 	int partition_size = (2*k);
@@ -191,13 +203,70 @@ bckElim_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, i
 }
 
 
+// Forward and backward substitution with the transposed factors of the
+// truncated SPIKE reduced matrix. Each 2k x 2k block is stored as L * D * U
+// with L = [I 0; L21 L22] and U = [I U12; 0 U22] unit triangular and D equal
+// to the identity in its first k entries; fwdElimTrans_full solves
+// U^T y = b and divides by D, bckElimTrans_full solves L^T x = y.
+template <typename T>
+__global__ void
+fwdElimTrans_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+{
+	int tid = threadIdx.x, bidx = blockIdx.x;
+	int k = ks[bidx];
+	int partition_size = (k<<1);
+	int offset = offsets[bidx];
+	int base;
+
+	if(bidx + 1 <= b_rest_num)
+		base = (bidx+1)*(b_partition_size+1) - k;
+	else
+		base = (bidx+1)*b_partition_size + b_rest_num - k;
+
+	for(int j=0; j<partition_size-1; j++) {
+		T tmp = dB[base+j];
+		for(int i = (j < k ? k : j+1) + tid; i < partition_size; i += blockDim.x)
+			dB[base+i] -= tmp * dA[offset + i*partition_size + j];
+		__syncthreads();
+	}
+
+	for(int i = k + tid; i < partition_size; i += blockDim.x)
+		dB[base+i] /= dA[offset + i*partition_size + i];
+}
+
+template <typename T>
+__global__ void
+bckElimTrans_full(int N, int *ks, int *offsets, T *dA, T *dB, int b_partition_size, int b_rest_num)
+{
+	int tid = threadIdx.x, bidx = blockIdx.x;
+	int k = ks[bidx];
+	int partition_size = (k<<1);
+	int offset = offsets[bidx];
+	int base;
+
+	if(bidx + 1 <= b_rest_num)
+		base = (bidx+1)*(b_partition_size+1) - k;
+	else
+		base = (bidx+1)*b_partition_size + b_rest_num - k;
+
+	for(int j=partition_size-1; j>=k; j--) {
+		T tmp = dB[base+j];
+		for(int i = tid; i < j; i += blockDim.x)
+			dB[base+i] -= tmp * dA[offset + i*partition_size + j];
+		__syncthreads();
+	}
+}
+
+
 // ----------------------------------------------------------------------------
 // Kernels for forward and backward substitution 
 // ----------------------------------------------------------------------------
 template <typename T>
 __global__ void
-fwdElim_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+fwdElim_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidy = blockIdx.y;
 	int k = ks[blockIdx.x];
 	if (tid >= k) return;
@@ -234,8 +303,10 @@ fwdElim_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int
 
 template <typename T>
 __global__ void
-fwdElimCholesky_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+fwdElimCholesky_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidy = blockIdx.y;
 	int k = ks[blockIdx.x];
 	if (tid >= k) return;
@@ -272,8 +343,10 @@ fwdElimCholesky_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_si
 
 template <typename T>
 __global__ void
-fwdElim_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+fwdElim_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -303,8 +376,10 @@ fwdElim_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_siz
 
 template <typename T>
 __global__ void
-fwdElimCholesky_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+fwdElimCholesky_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -334,8 +409,10 @@ fwdElimCholesky_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int parti
 
 template <typename T>
 __global__ void
-fwdElim_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+fwdElim_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -360,8 +437,10 @@ fwdElim_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_siz
 
 template <typename T>
 __global__ void
-fwdElimCholesky_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+fwdElimCholesky_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -386,8 +465,10 @@ fwdElimCholesky_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int parti
 
 template <typename T>
 __global__ void
-bckElim_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+bckElim_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidy = blockIdx.y;
 	int k = ks[blockIdx.x];
 	if (tid >= k) return;
@@ -426,8 +507,10 @@ bckElim_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int
 
 template <typename T>
 __global__ void
-bckElimCholesky_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+bckElimCholesky_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidy = blockIdx.y;
 	int k = ks[blockIdx.x];
 	if (tid >= k) return;
@@ -466,8 +549,10 @@ bckElimCholesky_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_si
 
 template <typename T>
 __global__ void
-bckElim_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+bckElim_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y * N;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -501,8 +586,10 @@ bckElim_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_siz
 
 template <typename T>
 __global__ void
-bckElimCholesky_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+bckElimCholesky_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y * N;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -536,8 +623,10 @@ bckElimCholesky_sol_medium(int N, int *ks, int *offsets, T *dA, T *dB, int parti
 
 template <typename T>
 __global__ void
-bckElim_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+bckElim_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -569,8 +658,10 @@ bckElim_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_siz
 
 template <typename T>
 __global__ void
-bckElimCholesky_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+bckElimCholesky_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, const int *active = 0)
 {
+	if (active && !active[blockIdx.x]) return;
+
 	int tid = threadIdx.x, bidx = blockIdx.x, bidy = blockIdx.y;
 	int k = ks[bidx];
 	if (tid >= k) return;
@@ -602,8 +693,10 @@ bckElimCholesky_sol_narrow(int N, int *ks, int *offsets, T *dA, T *dB, int parti
 
 template <typename T>
 __global__ void
-preBck_sol_divide(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, bool isSPD)
+preBck_sol_divide(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num, bool isSPD, const int *active = 0)
 {
+	if (active && !active[blockIdx.y]) return;
+
 	int k = ks[blockIdx.y];
 	int first_row = blockIdx.y*partition_size;
 	int last_row;
@@ -1899,6 +1992,72 @@ bckSweepRHS_stride(
     }
 }
 
+// ----------------------------------------------------------------------------
+// Forward and backward sweeps with the transposed factors of the diagonal
+// blocks. The factors are stored as A = L * D * U with L and U unit
+// triangular, so (LU)^T x = b is solved as U^T y = b (fwdElimTrans_sol),
+// followed by the division by the diagonal and L^T x = y (bckElimTrans_sol).
+// ----------------------------------------------------------------------------
+template <typename T>
+__global__ void
+fwdElimTrans_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+{
+	int tid = threadIdx.x;
+	int k = ks[blockIdx.x];
+	int col_width = (k<<1) + 1;
+	int offset = offsets[blockIdx.x];
+	int first_row = blockIdx.x*partition_size;
+	int last_row;
+	if(blockIdx.x < rest_num) {
+		first_row += blockIdx.x;
+		last_row = first_row + partition_size + 1;
+	} else {
+		first_row += rest_num;
+		last_row = first_row + partition_size;
+	}
+
+	for(int i=first_row; i<last_row; i++) {
+		T tmp = dB[i];
+		int it_last = last_row-i-1;
+		if(it_last > k)
+			it_last = k;
+		for(int ttid = tid; ttid<it_last; ttid+=blockDim.x)
+			dB[i+ttid+1] -= tmp * dA[offset + (ttid+1)*col_width + k - ttid - 1];
+		offset += col_width;
+		__syncthreads();
+	}
+}
+
+template <typename T>
+__global__ void
+bckElimTrans_sol(int N, int *ks, int *offsets, T *dA, T *dB, int partition_size, int rest_num)
+{
+	int tid = threadIdx.x;
+	int k = ks[blockIdx.x];
+	int col_width = (k<<1) + 1;
+	int first_row = blockIdx.x*partition_size;
+	int last_row;
+	if(blockIdx.x < rest_num) {
+		first_row += blockIdx.x;
+		last_row = first_row + partition_size + 1;
+	} else {
+		first_row += rest_num;
+		last_row = first_row + partition_size;
+	}
+	int offset = offsets[blockIdx.x] + (last_row-first_row-1)*col_width;
+
+	for(int i=last_row-1; i>first_row; i--) {
+		T tmp = dB[i];
+		int it_last = i-first_row;
+		if(it_last > k)
+			it_last = k;
+		for(int ttid = tid; ttid<it_last; ttid+=blockDim.x)
+			dB[i-ttid-1] -= tmp * dA[offset - (ttid+1)*col_width + k + ttid + 1];
+		offset -= col_width;
+		__syncthreads();
+	}
+}
+
 
 } // namespace var
 } // namespace device
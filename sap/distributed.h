@@ -0,0 +1,851 @@
+/** \file distributed.h
+ *  \brief Definition of the distributed-memory SaP solver, with the partitions
+ *         spread over MPI ranks.
+ */
+
+#ifndef SAP_DISTRIBUTED_H
+#define SAP_DISTRIBUTED_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#ifdef SAP_USE_MPI
+#include <mpi.h>
+#endif
+
+#include <cusp/csr_matrix.h>
+#include <cusp/coo_matrix.h>
+#include <cusp/array1d.h>
+#include <cusp/multiply.h>
+#include <cusp/linear_operator.h>
+#ifdef   USE_OLD_CUSP
+#include <cusp/blas.h>
+#else
+#include <cusp/blas/blas.h>
+#endif
+
+#include <thrust/copy.h>
+#include <thrust/transform.h>
+
+#include <sap/common.h>
+#include <sap/exception.h>
+#include <sap/monitor.h>
+#include <sap/precond.h>
+#include <sap/solver.h>
+#include <sap/bicgstab.h>
+#include <sap/timer.h>
+
+
+namespace sap {
+
+/// Thin wrapper around an MPI communicator.
+/**
+ * The ranks are arranged in a line: rank r only exchanges data with ranks
+ * r-1 and r+1. Without SAP_USE_MPI, this is a single-rank communicator.
+ */
+class Communicator
+{
+public:
+#ifdef SAP_USE_MPI
+    explicit Communicator(MPI_Comm comm = MPI_COMM_WORLD)
+    :   m_comm(comm)
+    {
+        MPI_Comm_rank(m_comm, &m_rank);
+        MPI_Comm_size(m_comm, &m_size);
+    }
+#else
+    Communicator() : m_rank(0), m_size(1) {}
+#endif
+
+    int     rank() const      {return m_rank;}
+    int     size() const      {return m_size;}
+
+    double  allreduceSum(double val) const;
+    int     allreduceMax(int val) const;
+
+    template <typename T>
+    void    exchange(const std::vector<T>&  toLeft,
+                     std::vector<T>&        fromLeft,
+                     const std::vector<T>&  toRight,
+                     std::vector<T>&        fromRight) const;
+
+private:
+#ifdef SAP_USE_MPI
+    MPI_Comm  m_comm;
+#endif
+    int       m_rank;
+    int       m_size;
+};
+
+
+/// Distribution of the SaP partitions over the ranks.
+/**
+ * Rank r owns a contiguous block of partitions and the rows of these
+ * partitions. The partitions are split over the ranks exactly like they
+ * are split over the devices in the multi-GPU path: the first P%R ranks
+ * get one extra partition, and the first n%P partitions get one extra row.
+ */
+struct DistributedLayout
+{
+    DistributedLayout()
+    :   numPartitions(0), partBegin(0), partEnd(0),
+        rowBegin(0), rowEnd(0), leftRowBegin(0), rightRowEnd(0)
+    {}
+
+    DistributedLayout(int n, int numPartitions, const Communicator& comm);
+
+    int  numLocalRows() const        {return rowEnd - rowBegin;}
+    int  numLocalPartitions() const  {return partEnd - partBegin;}
+
+    int  numPartitions;     /**< Total number of partitions. */
+    int  partBegin;         /**< First partition owned by this rank. */
+    int  partEnd;           /**< One past the last partition owned by this rank. */
+    int  rowBegin;          /**< First row owned by this rank. */
+    int  rowEnd;            /**< One past the last row owned by this rank. */
+    int  leftRowBegin;      /**< First row owned by the left neighbor (rowBegin if none). */
+    int  rightRowEnd;       /**< One past the last row owned by the right neighbor (rowEnd if none). */
+};
+
+
+/// Functor calculating x - a*y.
+template <typename T>
+struct ScaledSubtract: public thrust::binary_function<T, T, T>
+{
+    ScaledSubtract(T a) : m_a(a) {}
+
+    __host__ __device__
+    T operator() (T x, T y) const
+    {
+        return x - m_a * y;
+    }
+
+    T m_a;
+};
+
+
+/// Convergence monitor with globally reduced inner products.
+template <typename SolverVector>
+class DistributedMonitor : public Monitor<SolverVector>
+{
+public:
+    typedef typename SolverVector::value_type  SolverValueType;
+
+    DistributedMonitor(const Communicator&    comm,
+                       const int              maxIterations,
+                       const SolverValueType  relTol,
+                       const SolverValueType  absTol = SolverValueType(0))
+    :   Monitor<SolverVector>(maxIterations, relTol, absTol),
+        m_comm(comm)
+    {}
+
+    virtual SolverValueType dot(const SolverVector& a, const SolverVector& b) const {
+        return (SolverValueType) m_comm.allreduceSum(cusp::blas::dotc(a, b));
+    }
+
+    virtual SolverValueType norm(const SolverVector& v) const {
+        SolverValueType localNorm = cusp::blas::nrm2(v);
+        return (SolverValueType) std::sqrt(m_comm.allreduceSum(localNorm * localNorm));
+    }
+
+private:
+    const Communicator&  m_comm;
+};
+
+
+/// Distributed-memory SaP solver.
+/**
+ * Each rank owns a contiguous block of rows (see DistributedLayout) and
+ * builds a SaP preconditioner for its diagonal block. The coupling between
+ * the blocks of neighboring ranks is handled as in the truncated SPIKE
+ * algorithm: every rank computes the spikes V = D^{-1} C and W = D^{-1} B of
+ * its coupling blocks, neighbors exchange the spike tips once during setup,
+ * and each pair of neighbors redundantly factors the small reduced system
+ * coupling them. Applying the preconditioner requires one exchange of the
+ * tips of the local solution with each neighbor; matrix-vector products
+ * exchange the halo of the operand the same way, and all inner products
+ * are reduced with MPI_Allreduce. The Krylov method must be BiCGStab, the
+ * only one whose inner products go through the (distributed) monitor.
+ *
+ * The matrix is expected to be ordered such that each row only couples with
+ * the rows of its own rank and of the neighboring ranks; reorderings are only
+ * performed within the diagonal blocks.
+ *
+ * \tparam Array is the array type for the local linear system solution.
+ * \tparam PrecValueType is the floating point type used in the preconditioner.
+ */
+template <typename Array, typename PrecValueType>
+class DistributedSolver
+{
+public:
+    DistributedSolver(const Communicator&  comm,
+                      int                  numPartitions,
+                      const Options&       opts);
+
+    ~DistributedSolver() {}
+
+    DistributedLayout  getLayout(int n) const {return DistributedLayout(n, m_numPartitions, m_comm);}
+
+    template <typename Matrix>
+    bool setup(const Matrix& A,
+               int           n);
+
+    bool solve(const Array&  b,
+               Array&        x);
+
+    const Stats&  getStats() const {return m_stats;}
+
+    int                getMonitorCode() const    {return m_monitor.getCode();}
+    const std::string& getMonitorMessage() const {return m_monitor.getMessage();}
+
+    /// Linear operator wrapper for the distributed matrix.
+    class Operator : public cusp::linear_operator<typename Array::value_type, typename Array::memory_space>
+    {
+    public:
+        Operator(DistributedSolver& solver)
+        :   cusp::linear_operator<typename Array::value_type, typename Array::memory_space>(solver.m_nLocal, solver.m_nLocal),
+            m_solver(solver)
+        {}
+
+        template <typename VectorType>
+        void operator()(const VectorType& v, VectorType& Av) {m_solver.multiply(v, Av);}
+
+    private:
+        DistributedSolver&  m_solver;
+    };
+
+    /// Linear operator wrapper for the distributed preconditioner.
+    class Preconditioner : public cusp::linear_operator<typename Array::value_type, typename Array::memory_space>
+    {
+    public:
+        Preconditioner(DistributedSolver& solver)
+        :   cusp::linear_operator<typename Array::value_type, typename Array::memory_space>(solver.m_nLocal, solver.m_nLocal),
+            m_solver(solver)
+        {}
+
+        template <typename VectorType>
+        void operator()(const VectorType& v, VectorType& z) {m_solver.applyPreconditioner(v, z);}
+
+    private:
+        DistributedSolver&  m_solver;
+    };
+
+    template <typename VectorType>
+    void multiply(const VectorType& v, VectorType& Av);
+
+    template <typename VectorType>
+    void applyPreconditioner(const VectorType& v, VectorType& z);
+
+private:
+    typedef typename Array::value_type    SolverValueType;
+    typedef typename Array::memory_space  MemorySpace;
+
+    typedef typename cusp::array1d<SolverValueType, MemorySpace>        SolverVector;
+    typedef typename cusp::array1d<PrecValueType,   MemorySpace>        PrecVector;
+    typedef typename cusp::array1d<PrecValueType,   cusp::host_memory>  PrecVectorH;
+
+    typedef typename cusp::csr_matrix<int, SolverValueType, MemorySpace>        SolverMatrix;
+    typedef typename cusp::coo_matrix<int, SolverValueType, cusp::host_memory>  SolverMatrixCooH;
+    typedef typename cusp::csr_matrix<int, SolverValueType, cusp::host_memory>  SolverMatrixCsrH;
+
+    Communicator                    m_comm;
+    Options                         m_opts;
+    int                             m_numPartitions;
+    DistributedLayout               m_layout;
+
+    Precond<PrecVector>             m_precond;
+    DistributedMonitor<SolverVector> m_monitor;
+
+    int                             m_n;
+    int                             m_nLocal;
+
+    int                             m_haloLeft;    // number of left-neighbor rows coupled to this rank
+    int                             m_haloRight;   // number of right-neighbor rows coupled to this rank
+    int                             m_tipLeft;     // number of own rows coupled to the left neighbor
+    int                             m_tipRight;    // number of own rows coupled to the right neighbor
+
+    SolverMatrix                    m_Adiag;       // diagonal block
+    SolverMatrix                    m_Aleft;       // coupling to the last m_haloLeft rows of the left neighbor
+    SolverMatrix                    m_Aright;      // coupling to the first m_haloRight rows of the right neighbor
+
+    PrecVector                      m_V;           // right spikes (column-major, m_nLocal x m_haloRight)
+    PrecVector                      m_W;           // left spikes (column-major, m_nLocal x m_haloLeft)
+
+    std::vector<PrecValueType>      m_Rleft;       // LU factors of the reduced system with the left neighbor
+    std::vector<PrecValueType>      m_Rright;      // LU factors of the reduced system with the right neighbor
+    std::vector<int>                m_pivLeft;
+    std::vector<int>                m_pivRight;
+
+    PrecVector                      m_vp;
+    PrecVector                      m_zp;
+    SolverVector                    m_halo;
+    SolverVector                    m_tmp;
+
+    bool                            m_setupDone;
+    Stats                           m_stats;
+
+    template <typename Vector, typename T>
+    void exchangeTips(const Vector& x, std::vector<T>& fromLeft, std::vector<T>& fromRight);
+
+    void computeSpikes(const SolverMatrixCsrH& C, int numCols, PrecVector& S);
+
+    static void denseLU(std::vector<PrecValueType>& A, std::vector<int>& piv, int n);
+    static void denseSolve(const std::vector<PrecValueType>& LU, const std::vector<int>& piv, int n, std::vector<PrecValueType>& b);
+
+    DistributedSolver(const DistributedSolver&);
+    DistributedSolver& operator=(const DistributedSolver&);
+};
+
+
+// ----------------------------------------------------------------------------
+// Communicator implementation
+// ----------------------------------------------------------------------------
+inline
+double
+Communicator::allreduceSum(double val) const
+{
+#ifdef SAP_USE_MPI
+    double sum = 0;
+    MPI_Allreduce(&val, &sum, 1, MPI_DOUBLE, MPI_SUM, m_comm);
+    return sum;
+#else
+    return val;
+#endif
+}
+
+inline
+int
+Communicator::allreduceMax(int val) const
+{
+#ifdef SAP_USE_MPI
+    int res = 0;
+    MPI_Allreduce(&val, &res, 1, MPI_INT, MPI_MAX, m_comm);
+    return res;
+#else
+    return val;
+#endif
+}
+
+/**
+ * This function sends toLeft (toRight) to the left (right) neighbor and
+ * receives fromLeft (fromRight) from it. The receiving vectors must be sized
+ * by the caller; they are left untouched if there is no such neighbor.
+ */
+template <typename T>
+inline
+void
+Communicator::exchange(const std::vector<T>&  toLeft,
+                       std::vector<T>&        fromLeft,
+                       const std::vector<T>&  toRight,
+                       std::vector<T>&        fromRight) const
+{
+#ifdef SAP_USE_MPI
+    int left  = (m_rank > 0)          ? m_rank - 1 : MPI_PROC_NULL;
+    int right = (m_rank < m_size - 1) ? m_rank + 1 : MPI_PROC_NULL;
+
+    // Shift to the right, then shift to the left.
+    MPI_Sendrecv(toRight.empty()  ? 0 : (void*) &toRight[0],  (int)(toRight.size() * sizeof(T)),  MPI_BYTE, right, 0,
+                 fromLeft.empty() ? 0 : (void*) &fromLeft[0], (int)(fromLeft.size() * sizeof(T)), MPI_BYTE, left,  0,
+                 m_comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(toLeft.empty()    ? 0 : (void*) &toLeft[0],    (int)(toLeft.size() * sizeof(T)),    MPI_BYTE, left,  1,
+                 fromRight.empty() ? 0 : (void*) &fromRight[0], (int)(fromRight.size() * sizeof(T)), MPI_BYTE, right, 1,
+                 m_comm, MPI_STATUS_IGNORE);
+#endif
+}
+
+
+// ----------------------------------------------------------------------------
+// DistributedLayout implementation
+// ----------------------------------------------------------------------------
+inline
+DistributedLayout::DistributedLayout(int                  n,
+                                     int                  numParts,
+                                     const Communicator&  comm)
+{
+    numPartitions = std::max(numParts, comm.size());
+
+    int rows_per_partition    = n / numPartitions;
+    int rows_remainder        = n % numPartitions;
+    int partitions_per_rank   = numPartitions / comm.size();
+    int part_remainder        = numPartitions % comm.size();
+
+    std::vector<int> partBegins(comm.size() + 1, 0);
+    std::vector<int> rowBegins(comm.size() + 1, 0);
+
+    for (int i = 0; i < comm.size(); i++) {
+        partBegins[i+1] = partBegins[i] + partitions_per_rank + (i < part_remainder ? 1 : 0);
+
+        rowBegins[i+1] = rowBegins[i];
+        for (int j = partBegins[i]; j < partBegins[i+1]; j++)
+            rowBegins[i+1] += rows_per_partition + (j < rows_remainder ? 1 : 0);
+    }
+
+    int r = comm.rank();
+
+    partBegin    = partBegins[r];
+    partEnd      = partBegins[r + 1];
+    rowBegin     = rowBegins[r];
+    rowEnd       = rowBegins[r + 1];
+    leftRowBegin = (r > 0) ? rowBegins[r - 1] : rowBegin;
+    rightRowEnd  = (r < comm.size() - 1) ? rowBegins[r + 2] : rowEnd;
+}
+
+
+// ----------------------------------------------------------------------------
+// DistributedSolver implementation
+// ----------------------------------------------------------------------------
+
+/// Distributed SaP solver constructor.
+/**
+ * This is the constructor for the DistributedSolver class. It specifies the
+ * communicator, the total number of partitions (over all ranks) and the set
+ * of solver options.
+ */
+template <typename Array, typename PrecValueType>
+DistributedSolver<Array, PrecValueType>::DistributedSolver(const Communicator&  comm,
+                                                           int                  numPartitions,
+                                                           const Options&       opts)
+:   m_comm(comm),
+    m_opts(opts),
+    m_numPartitions(numPartitions),
+    m_monitor(m_comm, opts.maxNumIterations, opts.relTol, opts.absTol),
+    m_n(0),
+    m_nLocal(0),
+    m_haloLeft(0),
+    m_haloRight(0),
+    m_tipLeft(0),
+    m_tipRight(0),
+    m_setupDone(false)
+{
+}
+
+/// Preconditioner setup.
+/**
+ * This function sets up the distributed preconditioner. A must contain the
+ * rows of the global matrix owned by this rank (see getLayout()), with global
+ * column indices; n is the size of the global matrix.
+ *
+ * \tparam Matrix is the sparse matrix type of the local rows.
+ */
+template <typename Array, typename PrecValueType>
+template <typename Matrix>
+bool
+DistributedSolver<Array, PrecValueType>::setup(const Matrix&  A,
+                                               int            n)
+{
+    CPUTimer timer;
+
+    timer.Start();
+
+    m_n      = n;
+    m_layout = getLayout(n);
+    m_nLocal = m_layout.numLocalRows();
+
+    SolverMatrixCsrH Ah(A);
+
+    if (Ah.num_rows != m_nLocal)
+        throw system_error(system_error::Illegal_layout, "The number of local rows does not match the distributed layout.");
+
+    const int rowBegin = m_layout.rowBegin;
+    const int rowEnd   = m_layout.rowEnd;
+
+    // Find the width of the coupling with each neighbor.
+    m_haloLeft  = 0;
+    m_haloRight = 0;
+
+    for (int i = 0; i < Ah.num_entries; i++) {
+        int j = Ah.column_indices[i];
+
+        if (j < m_layout.leftRowBegin || j >= m_layout.rightRowEnd)
+            throw system_error(system_error::Illegal_layout, "A row couples with a rank other than its neighbors.");
+
+        if (j < rowBegin)
+            m_haloLeft = std::max(m_haloLeft, rowBegin - j);
+        else if (j >= rowEnd)
+            m_haloRight = std::max(m_haloRight, j - rowEnd + 1);
+    }
+
+    {
+        std::vector<int> toLeft(1, m_haloLeft), toRight(1, m_haloRight);
+        std::vector<int> fromLeft(1, 0), fromRight(1, 0);
+
+        m_comm.exchange(toLeft, fromLeft, toRight, fromRight);
+
+        m_tipLeft  = fromLeft[0];
+        m_tipRight = fromRight[0];
+    }
+
+    // Split the local rows into the diagonal block and the two coupling blocks.
+    SolverMatrixCsrH Dh, Lh, Rh;
+    {
+        int nnzD = 0, nnzL = 0, nnzR = 0;
+
+        for (int i = 0; i < Ah.num_entries; i++) {
+            int j = Ah.column_indices[i];
+            if (j < rowBegin)     nnzL++;
+            else if (j >= rowEnd) nnzR++;
+            else                  nnzD++;
+        }
+
+        SolverMatrixCooH Dc(m_nLocal, m_nLocal, nnzD);
+        SolverMatrixCooH Lc(m_nLocal, m_haloLeft, nnzL);
+        SolverMatrixCooH Rc(m_nLocal, m_haloRight, nnzR);
+
+        nnzD = nnzL = nnzR = 0;
+
+        for (int row = 0; row < m_nLocal; row++) {
+            for (int i = Ah.row_offsets[row]; i < Ah.row_offsets[row + 1]; i++) {
+                int             j   = Ah.column_indices[i];
+                SolverValueType val = Ah.values[i];
+
+                if (j < rowBegin) {
+                    Lc.row_indices[nnzL] = row; Lc.column_indices[nnzL] = j - (rowBegin - m_haloLeft); Lc.values[nnzL++] = val;
+                } else if (j >= rowEnd) {
+                    Rc.row_indices[nnzR] = row; Rc.column_indices[nnzR] = j - rowEnd; Rc.values[nnzR++] = val;
+                } else {
+                    Dc.row_indices[nnzD] = row; Dc.column_indices[nnzD] = j - rowBegin; Dc.values[nnzD++] = val;
+                }
+            }
+        }
+
+        Dh = Dc;
+        Lh = Lc;
+        Rh = Rc;
+    }
+
+    m_Adiag  = Dh;
+    m_Aleft  = Lh;
+    m_Aright = Rh;
+
+    // Set up the SaP preconditioner of the diagonal block.
+    m_precond = Precond<PrecVector>(m_layout.numLocalPartitions(), m_opts.isSPD, m_opts.saveMem, m_opts.performReorder, m_opts.testDB,
+                                    m_opts.performDB, m_opts.dbFirstStageOnly, m_opts.applyScaling, m_opts.dropOffFraction,
+                                    m_opts.maxBandwidth, 1, m_opts.factMethod, m_opts.precondType, m_opts.safeFactorization,
+                                    m_opts.variableBandwidth, false, m_opts.useBCR, m_opts.ilu_level, m_opts.relTol,
+                                    m_opts.memoryBudget, m_opts.polyType, m_opts.polyDegree, m_opts.polyEigSteps,
+                                    m_opts.overlap, m_opts.iluSweeps, m_opts.iluTriSweeps, m_opts.iluMulticolor,
+                                    m_opts.hostCholesky, m_opts.spikeTol, m_opts.dropOffPerPartition,
+                                    m_opts.hostSpikes, m_opts.supervariables, m_opts.sparseRHS);
+    m_precond.setup(Dh);
+
+    // Spikes of the coupling blocks.
+    computeSpikes(Rh, m_haloRight, m_V);
+    computeSpikes(Lh, m_haloLeft,  m_W);
+
+    // Exchange the spike tips: the bottom of V goes to the right neighbor,
+    // the top of W goes to the left neighbor.
+    std::vector<PrecValueType> Vb(m_tipRight * m_haloRight), Wt(m_tipLeft * m_haloLeft);
+    {
+        PrecVectorH Vh = m_V;
+        PrecVectorH Wh = m_W;
+
+        for (int i = 0; i < m_tipRight; i++)
+            for (int j = 0; j < m_haloRight; j++)
+                Vb[i * m_haloRight + j] = Vh[j * m_nLocal + (m_nLocal - m_tipRight + i)];
+
+        for (int i = 0; i < m_tipLeft; i++)
+            for (int j = 0; j < m_haloLeft; j++)
+                Wt[i * m_haloLeft + j] = Wh[j * m_nLocal + i];
+    }
+
+    std::vector<PrecValueType> Vb_left(m_haloLeft * m_tipLeft), Wt_right(m_haloRight * m_tipRight);
+
+    m_comm.exchange(Wt, Vb_left, Vb, Wt_right);
+
+    // Reduced system with the right neighbor; unknowns are [x_r^b; x_{r+1}^t].
+    {
+        int a = m_tipRight, b = m_haloRight, s = a + b;
+
+        m_Rright.assign(s * s, PrecValueType(0));
+        for (int i = 0; i < s; i++)
+            m_Rright[i * s + i] = PrecValueType(1);
+        for (int i = 0; i < a; i++)
+            for (int j = 0; j < b; j++)
+                m_Rright[i * s + a + j] = Vb[i * b + j];
+        for (int i = 0; i < b; i++)
+            for (int j = 0; j < a; j++)
+                m_Rright[(a + i) * s + j] = Wt_right[i * a + j];
+
+        denseLU(m_Rright, m_pivRight, s);
+    }
+
+    // Reduced system with the left neighbor; unknowns are [x_{r-1}^b; x_r^t].
+    {
+        int a = m_haloLeft, b = m_tipLeft, s = a + b;
+
+        m_Rleft.assign(s * s, PrecValueType(0));
+        for (int i = 0; i < s; i++)
+            m_Rleft[i * s + i] = PrecValueType(1);
+        for (int i = 0; i < a; i++)
+            for (int j = 0; j < b; j++)
+                m_Rleft[i * s + a + j] = Vb_left[i * b + j];
+        for (int i = 0; i < b; i++)
+            for (int j = 0; j < a; j++)
+                m_Rleft[(a + i) * s + j] = Wt[i * a + j];
+
+        denseLU(m_Rleft, m_pivLeft, s);
+    }
+
+    m_vp.resize(m_nLocal);
+    m_zp.resize(m_nLocal);
+    m_tmp.resize(m_nLocal);
+
+    timer.Stop();
+
+    m_stats.timeSetup        = timer.getElapsed();
+    m_stats.numPartitions    = m_layout.numPartitions;
+    m_stats.bandwidthReorder = m_comm.allreduceMax(m_precond.getBandwidthReordering());
+    m_stats.bandwidth        = m_comm.allreduceMax(m_precond.getBandwidth());
+    m_stats.bandwidthDB      = m_comm.allreduceMax(m_precond.getBandwidthDB());
+    m_stats.actualDropOff    = m_precond.getActualDropOff();
+
+    m_setupDone = true;
+
+    return true;
+}
+
+/// Linear system solve.
+/**
+ * This function solves the distributed system Ax=b; b and x hold the entries
+ * owned by this rank.
+ */
+template <typename Array, typename PrecValueType>
+bool
+DistributedSolver<Array, PrecValueType>::solve(const Array&  b,
+                                               Array&        x)
+{
+    if (!m_setupDone)
+        throw system_error(system_error::Illegal_solve, "Illegal call to solve() before setup().");
+
+    // Only BiCGStab reduces its inner products through the monitor; the other
+    // methods would only see the local rows.
+    if (m_opts.solverType != BiCGStab || !m_opts.fallbackSolvers.empty())
+        throw system_error(system_error::Illegal_solve, "The distributed solver only supports BiCGStab (without fallback methods).");
+
+    SolverVector b_vector = b;
+    SolverVector x_vector = x;
+
+    Operator        A(*this);
+    Preconditioner  M(*this);
+
+    m_monitor.init(b_vector);
+
+    CPUTimer timer;
+    timer.Start();
+
+    sap::bicgstab(A, x_vector, b_vector, m_monitor, M);
+
+    timer.Stop();
+
+    thrust::copy(x_vector.begin(), x_vector.end(), x.begin());
+
+    m_stats.timeSolve       = timer.getElapsed();
+    m_stats.rhsNorm         = m_monitor.getRHSNorm();
+    m_stats.residualNorm    = m_monitor.getResidualNorm();
+    m_stats.relResidualNorm = m_monitor.getRelResidualNorm();
+    m_stats.numIterations   = m_monitor.getNumIterations();
+
+    return m_monitor.converged();
+}
+
+/**
+ * This function calculates Av = A*v, exchanging the halo of v with the
+ * neighboring ranks.
+ */
+template <typename Array, typename PrecValueType>
+template <typename VectorType>
+void
+DistributedSolver<Array, PrecValueType>::multiply(const VectorType&  v,
+                                                  VectorType&        Av)
+{
+    std::vector<SolverValueType> fromLeft, fromRight;
+
+    exchangeTips(v, fromLeft, fromRight);
+
+    cusp::multiply(m_Adiag, v, Av);
+
+    if (m_haloLeft > 0) {
+        m_halo.resize(m_haloLeft);
+        thrust::copy(fromLeft.begin(), fromLeft.end(), m_halo.begin());
+        cusp::multiply(m_Aleft, m_halo, m_tmp);
+        cusp::blas::axpy(m_tmp, Av, SolverValueType(1));
+    }
+
+    if (m_haloRight > 0) {
+        m_halo.resize(m_haloRight);
+        thrust::copy(fromRight.begin(), fromRight.end(), m_halo.begin());
+        cusp::multiply(m_Aright, m_halo, m_tmp);
+        cusp::blas::axpy(m_tmp, Av, SolverValueType(1));
+    }
+}
+
+/**
+ * This function applies the truncated SPIKE preconditioner: it solves with
+ * the local SaP preconditioner, solves the reduced systems with the two
+ * neighbors and purifies the local solution.
+ */
+template <typename Array, typename PrecValueType>
+template <typename VectorType>
+void
+DistributedSolver<Array, PrecValueType>::applyPreconditioner(const VectorType&  v,
+                                                             VectorType&        z)
+{
+    cusp::blas::copy(v, m_vp);
+    m_precond(m_vp, m_zp);
+
+    // Both reduced systems use the tips of the unpurified local solution
+    // (which is also what the neighbors receive), so they are saved before
+    // any correction is applied.
+    std::vector<PrecValueType> gLeft, gRight;
+    std::vector<PrecValueType> tipLeft(m_tipLeft), tipRight(m_tipRight);
+
+    thrust::copy(m_zp.begin(), m_zp.begin() + m_tipLeft, tipLeft.begin());
+    thrust::copy(m_zp.end() - m_tipRight, m_zp.end(), tipRight.begin());
+
+    exchangeTips(m_zp, gLeft, gRight);
+
+    // x_{r+1}^t from the reduced system with the right neighbor.
+    std::vector<PrecValueType> rhsRight(m_tipRight + m_haloRight);
+
+    if (m_tipRight + m_haloRight > 0) {
+        std::copy(tipRight.begin(), tipRight.end(), rhsRight.begin());
+        std::copy(gRight.begin(), gRight.end(), rhsRight.begin() + m_tipRight);
+
+        denseSolve(m_Rright, m_pivRight, (int) rhsRight.size(), rhsRight);
+    }
+
+    // x_{r-1}^b from the reduced system with the left neighbor.
+    std::vector<PrecValueType> rhsLeft(m_haloLeft + m_tipLeft);
+
+    if (m_haloLeft + m_tipLeft > 0) {
+        std::copy(gLeft.begin(), gLeft.end(), rhsLeft.begin());
+        std::copy(tipLeft.begin(), tipLeft.end(), rhsLeft.begin() + m_haloLeft);
+
+        denseSolve(m_Rleft, m_pivLeft, (int) rhsLeft.size(), rhsLeft);
+    }
+
+    // Purify the local solution with both neighbors' contributions.
+    for (int j = 0; j < m_haloRight; j++)
+        thrust::transform(m_zp.begin(), m_zp.end(), m_V.begin() + (size_t) j * m_nLocal, m_zp.begin(),
+                          ScaledSubtract<PrecValueType>(rhsRight[m_tipRight + j]));
+
+    for (int j = 0; j < m_haloLeft; j++)
+        thrust::transform(m_zp.begin(), m_zp.end(), m_W.begin() + (size_t) j * m_nLocal, m_zp.begin(),
+                          ScaledSubtract<PrecValueType>(rhsLeft[j]));
+
+    cusp::blas::copy(m_zp, z);
+}
+
+/**
+ * This function sends the first m_tipLeft (last m_tipRight) entries of x to
+ * the left (right) neighbor and receives its halo from them.
+ */
+template <typename Array, typename PrecValueType>
+template <typename Vector, typename T>
+void
+DistributedSolver<Array, PrecValueType>::exchangeTips(const Vector&    x,
+                                                      std::vector<T>&  fromLeft,
+                                                      std::vector<T>&  fromRight)
+{
+    std::vector<T> toLeft(m_tipLeft), toRight(m_tipRight);
+
+    thrust::copy(x.begin(), x.begin() + m_tipLeft, toLeft.begin());
+    thrust::copy(x.end() - m_tipRight, x.end(), toRight.begin());
+
+    fromLeft.assign(m_haloLeft, T(0));
+    fromRight.assign(m_haloRight, T(0));
+
+    m_comm.exchange(toLeft, fromLeft, toRight, fromRight);
+}
+
+/**
+ * This function calculates the spikes S = M^{-1} C, column by column, using
+ * the local SaP preconditioner M.
+ */
+template <typename Array, typename PrecValueType>
+void
+DistributedSolver<Array, PrecValueType>::computeSpikes(const SolverMatrixCsrH&  C,
+                                                       int                      numCols,
+                                                       PrecVector&              S)
+{
+    S.resize((size_t) m_nLocal * numCols);
+
+    PrecVectorH Ch((size_t) m_nLocal * numCols, PrecValueType(0));
+
+    for (int row = 0; row < m_nLocal; row++)
+        for (int i = C.row_offsets[row]; i < C.row_offsets[row + 1]; i++)
+            Ch[(size_t) C.column_indices[i] * m_nLocal + row] = (PrecValueType) C.values[i];
+
+    PrecVector col(m_nLocal), spike(m_nLocal);
+
+    for (int j = 0; j < numCols; j++) {
+        thrust::copy(Ch.begin() + (size_t) j * m_nLocal, Ch.begin() + (size_t)(j + 1) * m_nLocal, col.begin());
+        m_precond(col, spike);
+        thrust::copy(spike.begin(), spike.end(), S.begin() + (size_t) j * m_nLocal);
+    }
+}
+
+/**
+ * This function performs an in-place LU factorization with partial pivoting
+ * of the dense, row-major, n-by-n matrix A.
+ */
+template <typename Array, typename PrecValueType>
+void
+DistributedSolver<Array, PrecValueType>::denseLU(std::vector<PrecValueType>&  A,
+                                                 std::vector<int>&            piv,
+                                                 int                          n)
+{
+    piv.resize(n);
+
+    for (int k = 0; k < n; k++) {
+        int p = k;
+        for (int i = k + 1; i < n; i++)
+            if (std::abs(A[i * n + k]) > std::abs(A[p * n + k]))
+                p = i;
+
+        piv[k] = p;
+
+        if (A[p * n + k] == PrecValueType(0))
+            throw system_error(system_error::Matrix_singular, "Found a singular reduced system between neighboring ranks.");
+
+        if (p != k)
+            for (int j = 0; j < n; j++)
+                std::swap(A[k * n + j], A[p * n + j]);
+
+        for (int i = k + 1; i < n; i++) {
+            A[i * n + k] /= A[k * n + k];
+            for (int j = k + 1; j < n; j++)
+                A[i * n + j] -= A[i * n + k] * A[k * n + j];
+        }
+    }
+}
+
+/**
+ * This function solves in place with the factors computed by denseLU().
+ */
+template <typename Array, typename PrecValueType>
+void
+DistributedSolver<Array, PrecValueType>::denseSolve(const std::vector<PrecValueType>&  LU,
+                                                    const std::vector<int>&            piv,
+                                                    int                                n,
+                                                    std::vector<PrecValueType>&        b)
+{
+    for (int k = 0; k < n; k++) {
+        std::swap(b[k], b[piv[k]]);
+        for (int i = k + 1; i < n; i++)
+            b[i] -= LU[i * n + k] * b[k];
+    }
+
+    for (int k = n - 1; k >= 0; k--) {
+        for (int j = k + 1; j < n; j++)
+            b[k] -= LU[k * n + j] * b[j];
+        b[k] /= LU[k * n + k];
+    }
+}
+
+
+} // namespace sap
+
+
+#endif
@@ -19,7 +19,9 @@ public:
 		Negative_DB_weight = -2,
 		Illegal_update       = -3,
 		Illegal_solve        = -4,
-		Matrix_singular      = -5
+		Matrix_singular      = -5,
+		Illegal_layout       = -6,
+		Memory_budget        = -7
 	};
 
 	system_error(Reason             reason,
@@ -26,9 +26,13 @@
 #include <thrust/sequence.h>
 #include <thrust/iterator/zip_iterator.h>
 #include <thrust/gather.h>
+#include <thrust/sort.h>
+#include <thrust/equal.h>
+#include <thrust/iterator/counting_iterator.h>
 
 #include <sap/common.h>
 #include <sap/timer.h>
+#include <sap/memory_pool.h>
 #include <sap/device/data_transfer.cuh>
 #include <sap/device/db.cuh>
 
@@ -55,6 +59,8 @@ public:
 	typedef typename cusp::array1d<double, cusp::device_memory>  DoubleVectorD;
 	typedef typename cusp::array1d<bool, cusp::host_memory>      BoolVector;
 	typedef typename cusp::array1d<bool, cusp::device_memory>    BoolVectorD;
+	typedef typename PooledVector<int>::type                     IntWorkVector;
+	typedef typename PooledVector<bool>::type                    BoolWorkVector;
 	typedef Vector                                               MatrixMapF;
 	typedef IntVector                                            MatrixMap;
 
@@ -92,6 +98,9 @@ public:
 	double     getTimeDBPost() const     {return m_timeDB_post;}
 	double     getTimeRCM() const      {return m_timeRCM;}
 	double     getTimeDropoff() const  {return m_timeDropoff;}
+	int        getNumSupervariables() const {return m_numSupervariables;}
+
+	const IntVector&  getColorOffsets() const     {return m_colorOffsets;}
 
     double     getDiagDominance(bool before_db = false) const {
         return (before_db ? m_diag_dom_ori : m_diag_dom);
@@ -108,6 +117,8 @@ public:
 	                   bool             scale,
 					   bool             doRCM,
 					   bool             doSloan,
+					   bool             doColoring,
+					   bool             doSupervariables,
 	                   IntVector&       optReordering,
 	                   IntVector&       optPerm,
 	                   IntVectorD&      d_dbRowPerm,
@@ -120,6 +131,9 @@ public:
 	                   int maxBandwidth,
 	                   T&  frac_actual);
 
+	T          dropOffPartitions(T   frac,
+	                             int numPartitions);
+
 	void       assembleOffDiagMatrices(int         bandwidth,
 	                                   int         numPartitions,
 	                                   Vector&     WV_host,
@@ -159,30 +173,30 @@ public:
 	void       get_csr_matrix(MatrixCsr&        Acsr,
 							  int               numPartitions);
 
-	void       unorderedBFS(bool          doRCM,
-			        		bool          doSloan,
-							IntVector&    tmp_reordering,
-							IntVector&    row_offsets,
-							IntVector&    column_indices,
-							IntVector&    visited,
-							IntVector&    levels,
-							IntVector&    ori_degrees,
-							BoolVector&   tried);
-
-	void       unorderedBFSIteration(int            width,
-							         int            start_idx,
-									 int            end_idx,
-									 IntVector&     tmp_reordering,
-									 IntVector&     levels,
-									 IntVector&     visited,
-									 IntVector&     row_offsets,
-									 IntVector&     column_indices,
-									 IntVector&     ori_degrees,
-									 BoolVector&    tried,
-									 IntVector&     costs,
-									 IntVector&     ori_costs,
-									 StatusVector&  status,
-									 int &          next_level);
+	void       unorderedBFS(bool            doRCM,
+			        		bool            doSloan,
+							IntVector&      tmp_reordering,
+							IntWorkVector&  row_offsets,
+							IntWorkVector&  column_indices,
+							IntWorkVector&  visited,
+							IntWorkVector&  levels,
+							IntWorkVector&  ori_degrees,
+							BoolWorkVector& tried);
+
+	void       unorderedBFSIteration(int             width,
+							         int             start_idx,
+									 int             end_idx,
+									 IntVector&      tmp_reordering,
+									 IntWorkVector&  levels,
+									 IntWorkVector&  visited,
+									 IntWorkVector&  row_offsets,
+									 IntWorkVector&  column_indices,
+									 IntWorkVector&  ori_degrees,
+									 BoolWorkVector& tried,
+									 IntWorkVector&  costs,
+									 IntWorkVector&  ori_costs,
+									 StatusVector&   status,
+									 int &           next_level);
 
 private:
 	int           m_n;
@@ -202,11 +216,17 @@ private:
 	double        m_timeRCM;
 	double        m_timeDropoff;
 
+	// Number of supervariables the reordering worked on (0 if not compressed)
+	int           m_numSupervariables;
+
 	BoolVector    m_exists;
 
 	// Temporarily used in partitioned RCM for buffering
 	IntVector     m_buffer_reordering;
 
+	// First row of every color (plus the end) after the multicolor ordering
+	IntVector     m_colorOffsets;
+
 	// Temporarily used in the third stage of DB for buffering
 	IntVector     m_DB_B;
 	BoolVector    m_DB_inB;
@@ -236,15 +256,16 @@ private:
 	                          int            node_end,
 	                          IntVector&     optReordering,
 	                          IntVector&     optPerm,
-							  IntVector&     row_offsets,
+							  IntWorkVector& row_offsets,
 							  IntVector&     row_indices);
 
+	template <typename OffsetVector, typename IndexVector>
 	void       buildTopology(EdgeIterator&      begin,
 							 EdgeIterator&      end,
 							 int                node_begin,
 							 int                node_end,
-	                         IntVector&         row_offsets,
-							 IntVector&         column_indices);
+	                         OffsetVector&      row_offsets,
+							 IndexVector&       column_indices);
 
 	static const double LOC_INFINITY;
 
@@ -274,6 +295,23 @@ private:
 	                 IntVector&   optReordering,
 	                 IntVector&   optPerm);
 
+	int        multicolor(MatrixCsr&   matcsr,
+	                      IntVector&   optReordering,
+	                      IntVector&   optPerm);
+
+	int        supervariables(const MatrixCsr&  matcsr,
+	                          IntVector&        sv_offsets,
+	                          IntVector&        sv_nodes,
+	                          IntVector&        sv_index);
+
+	int        supervariableOrdering(MatrixCsr&  matcsr,
+	                                 bool        doSloan,
+	                                 IntVector&  optReordering,
+	                                 IntVector&  optPerm);
+
+	int        permuteMatrix(MatrixCsr&        matcsr,
+	                         const IntVector&  optPerm);
+
 	size_t     symbolicFactorization(const MatrixCsr&  Acsr);
 
 public:
@@ -431,6 +469,7 @@ Graph<T>::Graph(bool trackReordering)
 	m_timeDB_post(0),
 	m_timeRCM(0),
 	m_timeDropoff(0),
+	m_numSupervariables(0),
 	m_trackReordering(trackReordering)
 {
 }
@@ -442,6 +481,16 @@ Graph<T>::Graph(bool trackReordering)
 // This function applies various reordering algorithms to the specified matrix
 // (assumed to be in COO format and on the host) for bandwidth reduction and
 // diagonal boosting. It returns the half-bandwidth after reordering.
+//
+// With doColoring, the bandwidth is not reduced; instead the nodes are
+// grouped by color (see multicolor()).
+//
+// With doSupervariables, RCM and Sloan are applied to the (typically much
+// smaller) graph of the supervariables, i.e. of the groups of rows with
+// identical patterns, and the rows of a supervariable are numbered
+// contiguously (see supervariableOrdering()). This requires rows with
+// identical patterns to also have identical column patterns, which no longer
+// holds once DB has permuted the rows; the graph is then not compressed.
 // ----------------------------------------------------------------------------
 template <typename T>
 int
@@ -452,6 +501,8 @@ Graph<T>::reorder(const MatrixCsr&  Acsr,
                   bool              scale,
 				  bool              doRCM,
 				  bool              doSloan,
+				  bool              doColoring,
+				  bool              doSupervariables,
                   IntVector&        optReordering,
                   IntVector&        optPerm,
                   IntVectorD&       d_dbRowPerm,
@@ -464,6 +515,7 @@ Graph<T>::reorder(const MatrixCsr&  Acsr,
 	m_nnz = Acsr.num_entries;
 
 	m_buffer_reordering.resize(m_n);
+	m_colorOffsets.clear();
 
 	if (testDB) {
         DoubleVector all_ds(m_n, 0.0);
@@ -560,12 +612,29 @@ Graph<T>::reorder(const MatrixCsr&  Acsr,
 		return k_db;
     }
 
-	// Apply reverse Cuthill-McKee algorithm.
-	int bandwidth;
+	// Apply reverse Cuthill-McKee algorithm, on the supervariables if
+	// requested and worthwhile. After a nontrivial DB row permutation, row i
+	// and column i of m_matrix stem from different rows of A, so the groups
+	// of rows with identical patterns are not nodes of the same kind in the
+	// graph and the scalar ordering is used instead.
+	int bandwidth = -1;
+	m_numSupervariables = 0;
+	if (doSupervariables && (doRCM || doSloan)) {
+		bool rowsPermuted = doDB && !thrust::equal(d_dbRowPerm.begin(), d_dbRowPerm.end(), thrust::make_counting_iterator(0));
+
+		if (!rowsPermuted)
+			bandwidth = supervariableOrdering(m_matrix, !doRCM, optReordering, optPerm);
+	}
+
+	if (bandwidth >= 0)
+		return bandwidth;
+
 	if (doRCM)
 		bandwidth = RCM(m_matrix, optReordering, optPerm);
 	else if (doSloan)
 		bandwidth = sloan(m_matrix, optReordering, optPerm);
+	else if (doColoring)
+		bandwidth = multicolor(m_matrix, optReordering, optPerm);
 	else {
 		bandwidth = k_db;
 		optReordering.resize(m_n);
@@ -608,7 +677,7 @@ Graph<T>::dropOff(T   frac,
 	// between the indices of their adjacent nodes).
 	// std::sort(m_edges.begin(), m_edges.end(), CompareEdgeLength());
 	MatrixCoo  Acoo(m_n, m_n, m_nnz);
-	IntVector  bucket(m_n, 0);
+	IntWorkVector  bucket(m_n, 0);
 
 	for (int i = 0; i < m_n; i++) {
 		int start_idx = m_matrix.row_offsets[i];
@@ -710,7 +779,7 @@ Graph<T>::dropOff(T   frac,
 
 			thrust::exclusive_scan(bucket.begin(), bucket.end(), bucket.begin());
 
-			IntVector  tmp_row_indices(m_nnz);
+			IntWorkVector  tmp_row_indices(m_nnz);
 
 			for (int i = 0; i < m_nnz; i++) {
 				int idx = (bucket[Acoo.column_indices[i]]++);
@@ -747,6 +816,112 @@ Graph<T>::dropOff(T   frac,
 }
 
 
+// ----------------------------------------------------------------------------
+// Graph::dropOffPartitions()
+//
+// This function performs the drop-off separately on each diagonal block,
+// after the second-level reordering. Each partition may drop up to the
+// fraction 'frac' of the weight of its own rows, and keeps the smallest
+// half-bandwidth k_p within this budget (i.e. the one minimizing the
+// n_p * k_p^2 cost of its factorization). A few long-range entries in one
+// partition therefore no longer inflate its band.
+//
+// The entries of the off-diagonal blocks are not affected. The return value
+// is the fraction of the weight of the matrix that was dropped.
+// ----------------------------------------------------------------------------
+template <typename T>
+T
+Graph<T>::dropOffPartitions(T   frac,
+                            int numPartitions)
+{
+	CPUTimer timer;
+	timer.Start();
+
+	int partSize  = m_n / numPartitions;
+	int remainder = m_n % numPartitions;
+
+	T norm_in = thrust::transform_reduce(m_matrix.values.begin(), m_matrix.values.end(), Square(), (T)0, thrust::plus<T>());
+	T norm_dropped = 0;
+
+	IntVector ks(numPartitions, 0);
+
+	for (int p = 0; p < numPartitions; p++) {
+		int part_begin = p * partSize + std::min(p, remainder);
+		int part_end   = part_begin + partSize + (p < remainder ? 1 : 0);
+
+		// The budget is a fraction of the weight of the rows of this partition.
+		T budget = 0;
+		for (int l = m_matrix.row_offsets[part_begin]; l < m_matrix.row_offsets[part_end]; l++)
+			budget += m_matrix.values[l] * m_matrix.values[l];
+		budget *= frac;
+
+		// Weight of each band of the diagonal block.
+		Vector band_norms(part_end - part_begin, (T)0);
+		int    k_p = 0;
+
+		for (int i = part_begin; i < part_end; i++)
+			for (int l = m_matrix_diagonal.row_offsets[i]; l < m_matrix_diagonal.row_offsets[i+1]; l++) {
+				int d = abs(i - m_matrix_diagonal.column_indices[l]);
+				band_norms[d] += m_matrix_diagonal.values[l] * m_matrix_diagonal.values[l];
+				if (k_p < d)
+					k_p = d;
+			}
+
+		// Drop the outermost bands while the budget allows it.
+		T dropped = 0;
+		while (k_p > 0 && dropped + band_norms[k_p] <= budget) {
+			dropped += band_norms[k_p];
+			k_p--;
+		}
+
+		ks[p] = k_p;
+		norm_dropped += dropped;
+	}
+
+	// Compact the diagonal blocks (preserving the order of the entries).
+	{
+		int num_entries = 0;
+		int p = 0;
+		int part_end = partSize + (0 < remainder ? 1 : 0);
+
+		for (int i = 0; i < m_n; i++) {
+			if (i == part_end) {
+				p++;
+				part_end += partSize + (p < remainder ? 1 : 0);
+			}
+
+			int start_idx = m_matrix_diagonal.row_offsets[i];
+			int end_idx   = m_matrix_diagonal.row_offsets[i+1];
+
+			m_matrix_diagonal.row_offsets[i] = num_entries;
+
+			for (int l = start_idx; l < end_idx; l++) {
+				if (abs(i - m_matrix_diagonal.column_indices[l]) > ks[p])
+					continue;
+
+				m_matrix_diagonal.column_indices[num_entries] = m_matrix_diagonal.column_indices[l];
+				m_matrix_diagonal.values[num_entries]         = m_matrix_diagonal.values[l];
+				if (m_trackReordering)
+					m_ori_indices_diagonal[num_entries] = m_ori_indices_diagonal[l];
+				num_entries++;
+			}
+		}
+
+		m_matrix_diagonal.row_offsets[m_n] = num_entries;
+		m_matrix_diagonal.column_indices.resize(num_entries);
+		m_matrix_diagonal.values.resize(num_entries);
+		m_matrix_diagonal.num_entries = num_entries;
+		if (m_trackReordering)
+			m_ori_indices_diagonal.resize(num_entries);
+	}
+
+	timer.Stop();
+	m_timeDropoff += timer.getElapsed();
+
+	return (norm_in > 0 ? norm_dropped / norm_in : (T)0);
+}
+
+
 // ----------------------------------------------------------------------------
 // Graph::assembleOffDiagMatrices()
 //
@@ -913,10 +1088,8 @@ Graph<T>::secondLevelReordering(int       bandwidth,
                                 IntVector&  secondPerm,
                                 IntVector&  first_rows)
 {
-	int node_begin = 0, node_end;
 	int partSize = m_n / numPartitions;
 	int remainder = m_n % numPartitions;
-	int edgeBegin = 0, edgeEnd;
 	secondReorder.resize(m_n);
 	secondPerm.resize(m_n);
 
@@ -931,28 +1104,43 @@ Graph<T>::secondLevelReordering(int       bandwidth,
 #endif
 
 
+	// The partitions are reordered independently of each other, in parallel.
+	// Each partition works on its own range of nodes and edges, with work
+	// arrays of the size of the partition. The current memory pool is per
+	// thread, so the one of the calling thread is installed in the workers.
+	MemoryPool* pool        = MemoryPool::current();
+	bool        outOfMemory = false;
+
+#pragma omp parallel for schedule(dynamic)
 	for (int i = 0; i < numPartitions; i++) {
-		if (i < remainder)
-			node_end = node_begin + partSize + 1;
-		else
-			node_end = node_begin + partSize;
-
-		edgeEnd = m_matrix_diagonal.row_offsets[node_end];
-
-		partitionedRCM(m_matrix_diagonal,
-					   edgeBegin,
-		               edgeEnd,
-		               node_begin,
-		               node_end,
-		               secondReorder,
-		               secondPerm,
-					   row_offsets,
-					   row_indices);
-
-		node_begin = node_end;
-		edgeBegin = edgeEnd;
+		MemoryPool::Scope poolScope(pool);
+
+		int node_begin = i * partSize + std::min(i, remainder);
+		int node_end   = node_begin + partSize + (i < remainder ? 1 : 0);
+
+		// Exceptions cannot leave the parallel region; report running out of
+		// memory to the caller as usual.
+		try {
+			IntWorkVector part_row_offsets(node_end - node_begin + 1);
+
+			partitionedRCM(m_matrix_diagonal,
+			               m_matrix_diagonal.row_offsets[node_begin],
+			               m_matrix_diagonal.row_offsets[node_end],
+			               node_begin,
+			               node_end,
+			               secondReorder,
+			               secondPerm,
+			               part_row_offsets,
+			               row_indices);
+		} catch (const std::bad_alloc&) {
+#pragma omp atomic write
+			outOfMemory = true;
+		}
 	}
 
+	if (outOfMemory)
+		throw std::bad_alloc();
+
 	{
 		int *perm_array = thrust::raw_pointer_cast(&secondPerm[0]);
 		thrust::transform(thrust::make_zip_iterator(thrust::make_tuple(row_indices.begin(), m_matrix_diagonal.column_indices.begin())),
@@ -1379,14 +1567,14 @@ Graph<T>::RCM(MatrixCsr&   mat_csr,
 
 	int nnz = mat_csr.num_entries;
 
-	IntVector tmp_reordering(m_n);
+	IntWorkVector tmp_reordering(m_n);
 
 	thrust::sequence(optReordering.begin(), optReordering.end());
 
-	IntVector row_indices(nnz);
-	IntVector column_indices(nnz);
-	IntVector row_offsets(m_n + 1);
-	IntVector ori_degrees(m_n);
+	IntWorkVector row_indices(nnz);
+	IntWorkVector column_indices(nnz);
+	IntWorkVector row_offsets(m_n + 1);
+	IntWorkVector ori_degrees(m_n);
 #ifdef USE_OLD_CUSP
 	cusp::detail::offsets_to_indices(mat_csr.row_offsets, row_indices);
 #else
@@ -1406,9 +1594,9 @@ Graph<T>::RCM(MatrixCsr&   mat_csr,
 	CPUTimer timer;
 	timer.Start();
 
-	BoolVector tried(m_n, false);
-	IntVector pushed(m_n, -1);
-	IntVector levels(m_n);
+	BoolWorkVector tried(m_n, false);
+	IntWorkVector  pushed(m_n, -1);
+	IntWorkVector  levels(m_n);
 
 	int max_level = 0;
 	int p_max_level = 0;
@@ -1428,8 +1616,8 @@ Graph<T>::RCM(MatrixCsr&   mat_csr,
 			int max_count = thrust::count(levels.begin(), levels.end(), max_level);
 
 			if (max_count > 1) {
-				IntVector max_level_vertices(max_count);
-				IntVector max_level_valence(max_count);
+				IntWorkVector max_level_vertices(max_count);
+				IntWorkVector max_level_valence(max_count);
 
 				thrust::copy_if(thrust::counting_iterator<int>(0),
 						thrust::counting_iterator<int>(int(m_n)),
@@ -1511,7 +1699,7 @@ Graph<T>::RCM(MatrixCsr&   mat_csr,
 
 		if(bandwidth > tmp_bdwidth) {
 			bandwidth = tmp_bdwidth;
-			optReordering = tmp_reordering;
+			thrust::copy(tmp_reordering.begin(), tmp_reordering.end(), optReordering.begin());
 		}
 
 		if (trial_num > 0) {
@@ -1572,7 +1760,7 @@ Graph<T>::RCM(MatrixCsr&   mat_csr,
 
 			mat_csr.column_indices = column_indices;
 			mat_csr.values         = values;
-			mat_csr.row_offsets    = row_offsets;
+			mat_csr.row_offsets.assign(row_offsets.begin(), row_offsets.end());
 
 			if (m_trackReordering)
 				m_ori_indices = ori_indices;
@@ -1599,7 +1787,7 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
                          int            node_end,
                          IntVector&     optReordering,
                          IntVector&     optPerm,
-						 IntVector&     row_offsets,
+						 IntWorkVector& row_offsets,
 						 IntVector&     row_indices)
 {
 	thrust::sequence(optReordering.begin()+node_begin, optReordering.begin()+node_end, node_begin);
@@ -1611,16 +1799,18 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 	int opt_bdwidth = tmp_bdwidth;
 	EdgeIterator begin = thrust::make_zip_iterator(thrust::make_tuple(row_indices.begin() + index_begin, mat_csr.column_indices.begin() + index_begin));
 	EdgeIterator end   = thrust::make_zip_iterator(thrust::make_tuple(row_indices.begin() + index_end,   mat_csr.column_indices.begin() + index_end));
-	IntVector column_indices;
+	IntWorkVector column_indices;
 	buildTopology(begin, end, node_begin, node_end, row_offsets, column_indices);
 
 	const int MAX_NUM_TRIAL = 5;
 	const int BANDWIDTH_THRESHOLD = 128;
 
-	BoolVector tried(m_n, false);
-	IntVector  pushed(node_end, -1);
-	IntVector  ori_degrees(node_end - node_begin);
-	IntVector  levels(m_n);
+	// The work arrays only cover the partition: node i is at i - node_begin.
+	int            num_nodes = node_end - node_begin;
+	BoolWorkVector tried(num_nodes, false);
+	IntWorkVector  pushed(num_nodes, -1);
+	IntWorkVector  ori_degrees(num_nodes);
+	IntWorkVector  levels(num_nodes);
 	int        max_level, p_max_level;
 	thrust::transform(mat_csr.row_offsets.begin() + (node_begin + 1), mat_csr.row_offsets.begin() + (node_end), mat_csr.row_offsets.begin() + node_begin, ori_degrees.begin(), thrust::minus<int>());
 
@@ -1635,16 +1825,16 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 		int tmp_node;
 
 		if (trial_num > 0) {
-			IntIterator max_level_iter = thrust::max_element(levels.begin() + node_begin, levels.begin() + node_end);
-			int max_count = thrust::count(levels.begin() + node_begin, levels.begin() + node_end, max_level);
+			IntIterator max_level_iter = thrust::max_element(levels.begin(), levels.end());
+			int max_count = thrust::count(levels.begin(), levels.end(), max_level);
 
 			if (max_count > 1) {
-				IntVector max_level_vertices(max_count);
-				IntVector max_level_valence(max_count);
+				IntWorkVector max_level_vertices(max_count);
+				IntWorkVector max_level_valence(max_count);
 
 				thrust::copy_if(thrust::counting_iterator<int>(node_begin),
 						thrust::counting_iterator<int>(node_end),
-						levels.begin()+node_begin,
+						levels.begin(),
 						max_level_vertices.begin(),
 						EqualTo<int>(max_level));
 
@@ -1656,16 +1846,22 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 				int min_valence_pos = thrust::min_element(max_level_valence.begin(), max_level_valence.end()) - max_level_valence.begin();
 				tmp_node = max_level_vertices[min_valence_pos];
 			} else
-				tmp_node = max_level_iter - levels.begin();
+				tmp_node = max_level_iter - levels.begin() + node_begin;
 
-			while(tried[tmp_node])
-				tmp_node = (tmp_node + 1) % m_n;
+			// Look for an untried node of the partition; stop once all of
+			// them were tried.
+			int num_checked = 0;
+			while(tried[tmp_node - node_begin] && num_checked++ < num_nodes)
+				tmp_node = node_begin + (tmp_node + 1 - node_begin) % num_nodes;
+
+			if (tried[tmp_node - node_begin])
+				break;
 		} else
 			tmp_node = thrust::min_element(ori_degrees.begin(), ori_degrees.end()) - ori_degrees.begin() + node_begin;
 
-		tried[tmp_node]  = true;
-		levels[tmp_node] = 0;
-		pushed[tmp_node] = trial_num;
+		tried[tmp_node - node_begin]  = true;
+		levels[tmp_node - node_begin] = 0;
+		pushed[tmp_node - node_begin] = trial_num;
 		q.push(tmp_node);
 
 		int left_cnt = node_end - node_begin;
@@ -1676,9 +1872,9 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 				left_cnt++;
 				int i;
 				for(i = last; i < node_end; i++) {
-					if(pushed[i] != trial_num) {
+					if(pushed[i - node_begin] != trial_num) {
 						q.push(i);
-						pushed[i] = trial_num;
+						pushed[i - node_begin] = trial_num;
 						last = i;
 						break;
 					}
@@ -1694,14 +1890,15 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 
 			q.pop();
 
-			int start_idx = row_offsets[tmp_node], end_idx = row_offsets[tmp_node + 1];
+			int local_node = tmp_node - node_begin;
+			int start_idx = row_offsets[local_node], end_idx = row_offsets[local_node + 1];
 
 			for (int i = start_idx; i < end_idx; i++)  {
-				int target_node = column_indices[i];
+				int target_node = column_indices[i] - node_begin;
 				if(pushed[target_node] != trial_num) {
 					pushed[target_node] = trial_num;
-					pq.push(thrust::make_tuple(target_node, row_offsets[target_node + 1] - row_offsets[target_node]));
-					max_level = levels[target_node] = levels[tmp_node] + 1;
+					pq.push(thrust::make_tuple(column_indices[i], row_offsets[target_node + 1] - row_offsets[target_node]));
+					max_level = levels[target_node] = levels[local_node] + 1;
 				}
 			}
 
@@ -1746,7 +1943,9 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 	}
 
 	timer.Stop();
-	m_timeRCM += timer.getElapsed();
+	double elapsed = timer.getElapsed();
+#pragma omp atomic
+	m_timeRCM += elapsed;
 
 	thrust::scatter(thrust::make_counting_iterator(node_begin),
 	                thrust::make_counting_iterator(node_end),
@@ -1762,20 +1961,23 @@ Graph<T>::partitionedRCM(MatrixCsr&     mat_csr,
 //	This function builds the topology for the graph for RCM processing
 //	--------------------------------------------------------------------------
 template <typename T>
+template <typename OffsetVector, typename IndexVector>
 void
 Graph<T>::buildTopology(EdgeIterator&      begin,
                         EdgeIterator&      end,
 						int                node_begin,
 						int                node_end,
-                        IntVector&         row_offsets,
-                        IntVector&         column_indices)
+                        OffsetVector&      row_offsets,
+                        IndexVector&       column_indices)
 {
-	if (row_offsets.size() != m_n + 1)
-		row_offsets.resize(m_n + 1, 0);
+	int num_nodes = node_end - node_begin;
+
+	if (row_offsets.size() != num_nodes + 1)
+		row_offsets.resize(num_nodes + 1, 0);
 	else
 		thrust::fill(row_offsets.begin(), row_offsets.end(), 0);
 
-	IntVector row_indices((end - begin) << 1);
+	IntWorkVector row_indices((end - begin) << 1);
 	column_indices.resize((end - begin) << 1);
 	int actual_cnt = 0;
 
@@ -1793,15 +1995,15 @@ Graph<T>::buildTopology(EdgeIterator&      begin,
 	column_indices.resize(actual_cnt);
 	// thrust::sort_by_key(row_indices.begin(), row_indices.end(), column_indices.begin());
 	{
-		int&      nnz = actual_cnt;
-		IntVector tmp_column_indices(nnz);
+		int&        nnz = actual_cnt;
+		IndexVector tmp_column_indices(nnz);
 		for (int i = 0; i < nnz; i++)
-			row_offsets[row_indices[i]] ++;
+			row_offsets[row_indices[i] - node_begin] ++;
 
-		thrust::inclusive_scan(row_offsets.begin() + node_begin, row_offsets.begin() + (node_end + 1), row_offsets.begin() + node_begin);
+		thrust::inclusive_scan(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
 
 		for (int i = nnz - 1; i >= 0; i--) {
-			int idx = (--row_offsets[row_indices[i]]);
+			int idx = (--row_offsets[row_indices[i] - node_begin]);
 			tmp_column_indices[idx] = column_indices[i];
 		}
 		column_indices = tmp_column_indices;
@@ -2178,10 +2380,9 @@ Graph<T>::sloan(MatrixCsr&   matcsr,
 	            IntVector&   optReordering,
 	            IntVector&   optPerm)
 {
-	IntVector   row_indices(m_nnz);
-	IntVector   tmp_row_indices(m_nnz << 1);
-	IntVector   tmp_column_indices(m_nnz << 1);
-	IntVector   tmp_row_offsets(m_n + 1);
+	IntWorkVector   row_indices(m_nnz);
+	IntWorkVector   tmp_column_indices(m_nnz << 1);
+	IntWorkVector   tmp_row_offsets(m_n + 1);
 
 	IntVector&  column_indices = matcsr.column_indices;
 	IntVector&  row_offsets    = matcsr.row_offsets;
@@ -2196,10 +2397,10 @@ Graph<T>::sloan(MatrixCsr&   matcsr,
 	EdgeIterator end   = thrust::make_zip_iterator(thrust::make_tuple(row_indices.end(),   column_indices.end()));
 	buildTopology(begin, end, 0, m_n, tmp_row_offsets, tmp_column_indices);
 
-	IntVector   ori_degrees(m_n);
-	BoolVector  tried(m_n, false);
-	IntVector   visited(m_n, -1);
-	IntVector   levels(m_n);
+	IntWorkVector   ori_degrees(m_n);
+	BoolWorkVector  tried(m_n, false);
+	IntWorkVector   visited(m_n, -1);
+	IntWorkVector   levels(m_n);
 
 	thrust::transform(tmp_row_offsets.begin() + 1, tmp_row_offsets.end(), tmp_row_offsets.begin(), ori_degrees.begin(), thrust::minus<int>());
 
@@ -2264,17 +2465,474 @@ Graph<T>::sloan(MatrixCsr&   matcsr,
 	return bandwidth;
 }
 
+// ----------------------------------------------------------------------------
+// Graph::multicolor()
+//
+// This function computes a distance-1 coloring of the graph of A+A^T with the
+// Jones-Plassmann algorithm and reorders the matrix so that the nodes of each
+// color are numbered contiguously. Since no two nodes of the same color are
+// coupled, the rows of one color can be factored (ILU(0)) and eliminated in
+// the triangular sweeps independently of each other. The first row of every
+// color is saved in m_colorOffsets. The return value is the half-bandwidth of
+// the reordered matrix (which is typically large).
+// ----------------------------------------------------------------------------
+template<typename T>
+int
+Graph<T>::multicolor(MatrixCsr&   matcsr,
+                     IntVector&   optReordering,
+                     IntVector&   optPerm)
+{
+	IntWorkVector   row_indices(m_nnz);
+	IntWorkVector   tmp_column_indices(m_nnz << 1);
+	IntWorkVector   tmp_row_offsets(m_n + 1);
+
+	IntVector&  column_indices = matcsr.column_indices;
+	IntVector&  row_offsets    = matcsr.row_offsets;
+
+#ifdef USE_OLD_CUSP
+	cusp::detail::offsets_to_indices(row_offsets, row_indices);
+#else
+	cusp::offsets_to_indices(row_offsets, row_indices);
+#endif
+
+	EdgeIterator begin = thrust::make_zip_iterator(thrust::make_tuple(row_indices.begin(), column_indices.begin()));
+	EdgeIterator end   = thrust::make_zip_iterator(thrust::make_tuple(row_indices.end(),   column_indices.end()));
+	buildTopology(begin, end, 0, m_n, tmp_row_offsets, tmp_column_indices);
+
+	// Jones-Plassmann: in every round, the uncolored nodes whose (pseudo-random)
+	// weight is larger than that of all their uncolored neighbors form an
+	// independent set; each of them then takes the smallest color not used by
+	// its neighbors.
+	IntWorkVector   colors(m_n, -1);
+	IntWorkVector   weights(m_n);
+	IntWorkVector   selected(m_n, 0);
+
+	for (int i = 0; i < m_n; i++) {
+		unsigned int h = (unsigned int) i * 2654435761u;
+		weights[i] = (int) ((h ^ (h >> 16)) & 0x7fffffff);
+	}
+
+	const int*  adj_offsets = thrust::raw_pointer_cast(&tmp_row_offsets[0]);
+	const int*  adj         = thrust::raw_pointer_cast(&tmp_column_indices[0]);
+	const int*  weight      = thrust::raw_pointer_cast(&weights[0]);
+	int*        color       = thrust::raw_pointer_cast(&colors[0]);
+	int*        sel         = thrust::raw_pointer_cast(&selected[0]);
+	int         n           = m_n;
+	int         numColored  = 0;
+
+	while (numColored < n) {
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < n; i++) {
+			sel[i] = 0;
+			if (color[i] >= 0)
+				continue;
+
+			bool isMax = true;
+			for (int l = adj_offsets[i]; l < adj_offsets[i+1]; l++) {
+				int j = adj[l];
+				if (color[j] < 0 && (weight[j] > weight[i] || (weight[j] == weight[i] && j > i))) {
+					isMax = false;
+					break;
+				}
+			}
+			sel[i] = isMax;
+		}
+
+		int roundColored = 0;
+
+#pragma omp parallel reduction(+: roundColored)
+		{
+			std::vector<int> used;
+
+#pragma omp for schedule(dynamic, 256)
+			for (int i = 0; i < n; i++) {
+				if (!sel[i])
+					continue;
+
+				used.clear();
+				for (int l = adj_offsets[i]; l < adj_offsets[i+1]; l++)
+					if (color[adj[l]] >= 0)
+						used.push_back(color[adj[l]]);
+				std::sort(used.begin(), used.end());
+
+				int c = 0;
+				for (size_t q = 0; q < used.size() && used[q] <= c; q++)
+					if (used[q] == c)
+						c++;
+
+				color[i] = c;
+				roundColored++;
+			}
+		}
+
+		numColored += roundColored;
+	}
+
+	// Number the nodes color by color (in their original order within a color).
+	int numColors = (n > 0 ? *std::max_element(color, color + n) + 1 : 0);
+
+	m_colorOffsets.resize(numColors + 1);
+	thrust::fill(m_colorOffsets.begin(), m_colorOffsets.end(), 0);
+	for (int i = 0; i < n; i++)
+		m_colorOffsets[color[i] + 1] ++;
+	thrust::inclusive_scan(m_colorOffsets.begin(), m_colorOffsets.end(), m_colorOffsets.begin());
+
+	optReordering.resize(m_n);
+	optPerm.resize(m_n);
+
+	{
+		IntWorkVector next(m_colorOffsets.begin(), m_colorOffsets.end() - 1);
+		for (int i = 0; i < n; i++)
+			optReordering[next[color[i]]++] = i;
+	}
+
+	thrust::scatter(thrust::make_counting_iterator(0),
+					thrust::make_counting_iterator(int(m_n)),
+					optReordering.begin(),
+					optPerm.begin());
+
+	// Permute the matrix. The entries are bucketed by their new column first
+	// and then (stably) by their new row, so that the columns in every row
+	// remain sorted, as required by the ILU factorization.
+	int bandwidth = 0;
+	{
+		IntVector     new_row_offsets(m_n + 1, 0);
+		IntVector     new_column_indices(m_nnz);
+		Vector        new_values(m_nnz);
+		IntVector     ori_indices;
+		IntWorkVector bucket(m_n + 1, 0);
+		IntWorkVector by_column(m_nnz);
+
+		if (m_trackReordering)
+			ori_indices.resize(m_nnz);
+
+		for (int l = 0; l < m_nnz; l++)
+			bucket[optPerm[column_indices[l]] + 1] ++;
+		thrust::inclusive_scan(bucket.begin(), bucket.end(), bucket.begin());
+		for (int l = 0; l < m_nnz; l++)
+			by_column[bucket[optPerm[column_indices[l]]]++] = l;
+
+		for (int l = 0; l < m_nnz; l++)
+			new_row_offsets[optPerm[row_indices[l]] + 1] ++;
+		thrust::inclusive_scan(new_row_offsets.begin(), new_row_offsets.end(), new_row_offsets.begin());
+		thrust::copy(new_row_offsets.begin(), new_row_offsets.end(), bucket.begin());
+
+		for (int q = 0; q < m_nnz; q++) {
+			int l   = by_column[q];
+			int row = optPerm[row_indices[l]];
+			int col = optPerm[column_indices[l]];
+			int idx = (bucket[row]++);
+
+			new_column_indices[idx] = col;
+			new_values[idx]         = matcsr.values[l];
+			if (m_trackReordering)
+				ori_indices[idx] = m_ori_indices[l];
+
+			bandwidth = std::max(bandwidth, abs(row - col));
+		}
+
+		matcsr.row_offsets    = new_row_offsets;
+		matcsr.column_indices = new_column_indices;
+		matcsr.values         = new_values;
+
+		if (m_trackReordering)
+			m_ori_indices = ori_indices;
+	}
+
+	return bandwidth;
+}
+
+// ----------------------------------------------------------------------------
+// Graph::supervariables()
+//
+// This function detects the supervariables of the specified matrix, i.e. the
+// groups of rows with identical sparsity patterns (for instance, the degrees
+// of freedom of one mesh node). Rows are bucketed by their length and by an
+// order-independent hash of their column indices; within a bucket, patterns
+// are compared exactly. On return, sv_offsets and sv_nodes list the rows of
+// every supervariable (in increasing order; supervariables are numbered by
+// their first row) and sv_index gives the supervariable of every row. The
+// return value is the number of supervariables.
+// ----------------------------------------------------------------------------
+template <typename T>
+int
+Graph<T>::supervariables(const MatrixCsr&  matcsr,
+                         IntVector&        sv_offsets,
+                         IntVector&        sv_nodes,
+                         IntVector&        sv_index)
+{
+	int n = matcsr.num_rows;
+
+	IntWorkVector  lengths(n);
+	IntWorkVector  hashes(n);
+	IntWorkVector  order(n);
+	IntWorkVector  leader(n, -1);
+	IntWorkVector  mark(n, -1);
+
+	for (int i = 0; i < n; i++) {
+		unsigned int h = 0;
+		for (int l = matcsr.row_offsets[i]; l < matcsr.row_offsets[i+1]; l++) {
+			unsigned int c = (unsigned int) matcsr.column_indices[l] * 2654435761u;
+			h += c ^ (c >> 15);
+		}
+		lengths[i] = matcsr.row_offsets[i+1] - matcsr.row_offsets[i];
+		hashes[i]  = (int) (h & 0x7fffffff);
+	}
+
+	thrust::sequence(order.begin(), order.end());
+	thrust::stable_sort_by_key(thrust::make_zip_iterator(thrust::make_tuple(lengths.begin(), hashes.begin())),
+	                           thrust::make_zip_iterator(thrust::make_tuple(lengths.end(), hashes.end())),
+	                           order.begin());
+
+	// Within every bucket (rows in increasing order), attach each row not yet
+	// assigned to the first row with the same pattern.
+	for (int b = 0; b < n; ) {
+		int e = b + 1;
+		while (e < n && lengths[e] == lengths[b] && hashes[e] == hashes[b])
+			e++;
+
+		for (int p = b; p < e; p++) {
+			int r = order[p];
+			if (leader[r] >= 0)
+				continue;
+
+			leader[r] = r;
+			for (int l = matcsr.row_offsets[r]; l < matcsr.row_offsets[r+1]; l++)
+				mark[matcsr.column_indices[l]] = r;
+
+			for (int q = p + 1; q < e; q++) {
+				int i = order[q];
+				if (leader[i] >= 0)
+					continue;
+
+				bool same = true;
+				for (int l = matcsr.row_offsets[i]; l < matcsr.row_offsets[i+1] && same; l++)
+					same = (mark[matcsr.column_indices[l]] == r);
+
+				if (same)
+					leader[i] = r;
+			}
+		}
+
+		b = e;
+	}
+
+	// Number the supervariables by their first row and list their rows.
+	int num_sv = 0;
+
+	sv_index.resize(n);
+	for (int i = 0; i < n; i++)
+		sv_index[i] = (leader[i] == i ? num_sv++ : sv_index[leader[i]]);
+
+	sv_offsets.resize(num_sv + 1);
+	sv_nodes.resize(n);
+
+	thrust::fill(sv_offsets.begin(), sv_offsets.end(), 0);
+	for (int i = 0; i < n; i++)
+		sv_offsets[sv_index[i] + 1] ++;
+	thrust::inclusive_scan(sv_offsets.begin(), sv_offsets.end(), sv_offsets.begin());
+
+	{
+		IntWorkVector next(sv_offsets.begin(), sv_offsets.end() - 1);
+		for (int i = 0; i < n; i++)
+			sv_nodes[next[sv_index[i]]++] = i;
+	}
+
+	return num_sv;
+}
+
+// ----------------------------------------------------------------------------
+// Graph::supervariableOrdering()
+//
+// This function applies RCM (or Sloan, with doSloan) to the quotient graph of
+// the supervariables of the specified matrix (two supervariables are adjacent
+// if the rows of the first have entries in the columns of the second), and
+// expands the resulting ordering by numbering the rows of every supervariable
+// contiguously, so that the blocks of a multi-DOF problem stay together in
+// the reordered matrix. The matrix is then permuted accordingly.
+//
+// The return value is the obtained bandwidth, or -1 if the rows have too few
+// common patterns for the compression to pay off, in which case nothing is
+// modified.
+// ----------------------------------------------------------------------------
+template <typename T>
+int
+Graph<T>::supervariableOrdering(MatrixCsr&  matcsr,
+                                bool        doSloan,
+                                IntVector&  optReordering,
+                                IntVector&  optPerm)
+{
+	CPUTimer timer;
+	timer.Start();
+
+	IntVector  sv_offsets;
+	IntVector  sv_nodes;
+	IntVector  sv_index;
+
+	int num_sv = supervariables(matcsr, sv_offsets, sv_nodes, sv_index);
+
+	// Require supervariables of 1.5 rows on average.
+	if (3 * num_sv > 2 * m_n)
+		return -1;
+
+	// Assemble the pattern of the quotient graph from the first row of every
+	// supervariable (all its rows have the same pattern).
+	IntWorkVector  mark(num_sv, -1);
+	IntWorkVector  q_offsets(num_sv + 1, 0);
+
+	for (int s = 0; s < num_sv; s++) {
+		int r = sv_nodes[sv_offsets[s]];
+		for (int l = matcsr.row_offsets[r]; l < matcsr.row_offsets[r+1]; l++) {
+			int t = sv_index[matcsr.column_indices[l]];
+			if (mark[t] != s) {
+				mark[t] = s;
+				q_offsets[s + 1] ++;
+			}
+		}
+	}
+	thrust::inclusive_scan(q_offsets.begin(), q_offsets.end(), q_offsets.begin());
+
+	int        q_nnz = q_offsets[num_sv];
+	MatrixCsr  qcsr(num_sv, num_sv, q_nnz);
+
+	thrust::copy(q_offsets.begin(), q_offsets.end(), qcsr.row_offsets.begin());
+	thrust::fill(qcsr.values.begin(), qcsr.values.end(), (T) 1);
+	thrust::fill(mark.begin(), mark.end(), -1);
+
+	for (int s = 0; s < num_sv; s++) {
+		int r   = sv_nodes[sv_offsets[s]];
+		int idx = q_offsets[s];
+		for (int l = matcsr.row_offsets[r]; l < matcsr.row_offsets[r+1]; l++) {
+			int t = sv_index[matcsr.column_indices[l]];
+			if (mark[t] != s) {
+				mark[t] = s;
+				qcsr.column_indices[idx++] = t;
+			}
+		}
+	}
+
+	// Order the quotient graph. The scalar orderings work on the matrix
+	// dimensions stored in the graph and track the reordering of the matrix
+	// entries, so both are switched to the quotient graph for the call.
+	IntVector  sv_reordering;
+	IntVector  sv_perm;
+	int        sv_bandwidth;
+
+	{
+		int   n     = m_n;
+		int   nnz   = m_nnz;
+		bool  track = m_trackReordering;
+
+		m_n               = num_sv;
+		m_nnz             = q_nnz;
+		m_trackReordering = false;
+
+		sv_bandwidth = (doSloan ? sloan(qcsr, sv_reordering, sv_perm) : RCM(qcsr, sv_reordering, sv_perm));
+
+		m_n               = n;
+		m_nnz             = nnz;
+		m_trackReordering = track;
+	}
+
+	if (sv_bandwidth < 0)
+		return -1;
+
+	m_numSupervariables = num_sv;
+
+	// Expand the ordering of the supervariables to the rows.
+	optReordering.resize(m_n);
+	optPerm.resize(m_n);
+
+	for (int q = 0, j = 0; q < num_sv; q++) {
+		int s = sv_reordering[q];
+		for (int l = sv_offsets[s]; l < sv_offsets[s+1]; l++)
+			optReordering[j++] = sv_nodes[l];
+	}
+
+	thrust::scatter(thrust::make_counting_iterator(0),
+	                thrust::make_counting_iterator(int(m_n)),
+	                optReordering.begin(),
+	                optPerm.begin());
+
+	int bandwidth = permuteMatrix(matcsr, optPerm);
+
+	timer.Stop();
+	m_timeRCM = timer.getElapsed();
+
+	return bandwidth;
+}
+
+// ----------------------------------------------------------------------------
+// Graph::permuteMatrix()
+//
+// This function applies the symmetric permutation optPerm (old to new index)
+// to the specified matrix, keeping track of the original entry indices if
+// requested. The return value is the half-bandwidth of the permuted matrix.
+// ----------------------------------------------------------------------------
+template <typename T>
+int
+Graph<T>::permuteMatrix(MatrixCsr&        matcsr,
+                        const IntVector&  optPerm)
+{
+	int nnz = matcsr.num_entries;
+
+	IntWorkVector  row_indices(nnz);
+#ifdef USE_OLD_CUSP
+	cusp::detail::offsets_to_indices(matcsr.row_offsets, row_indices);
+#else
+	cusp::offsets_to_indices(matcsr.row_offsets, row_indices);
+#endif
+
+	IntVector      row_offsets(m_n + 1, 0);
+	IntVector      column_indices(nnz);
+	Vector         values(nnz);
+	IntVector      ori_indices;
+	IntWorkVector  next(m_n);
+
+	if (m_trackReordering)
+		ori_indices.resize(nnz);
+
+	for (int l = 0; l < nnz; l++)
+		row_offsets[optPerm[row_indices[l]] + 1] ++;
+	thrust::inclusive_scan(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
+	thrust::copy(row_offsets.begin(), row_offsets.end() - 1, next.begin());
+
+	int bandwidth = 0;
+
+	for (int l = 0; l < nnz; l++) {
+		int row = optPerm[row_indices[l]];
+		int col = optPerm[matcsr.column_indices[l]];
+		int idx = (next[row]++);
+
+		column_indices[idx] = col;
+		values[idx]         = matcsr.values[l];
+		if (m_trackReordering)
+			ori_indices[idx] = m_ori_indices[l];
+
+		bandwidth = std::max(bandwidth, abs(row - col));
+	}
+
+	matcsr.row_offsets    = row_offsets;
+	matcsr.column_indices = column_indices;
+	matcsr.values         = values;
+
+	if (m_trackReordering)
+		m_ori_indices = ori_indices;
+
+	return bandwidth;
+}
+
 template <typename T>
 void 
-Graph<T>::unorderedBFS(bool          doRCM,
-					   bool          doSloan,
-					   IntVector&    tmp_reordering,
-					   IntVector&    row_offsets,
-					   IntVector&    column_indices,
-					   IntVector&    visited,
-					   IntVector&    levels,
-					   IntVector&    ori_degrees,
-					   BoolVector&   tried)
+Graph<T>::unorderedBFS(bool            doRCM,
+					   bool            doSloan,
+					   IntVector&      tmp_reordering,
+					   IntWorkVector&  row_offsets,
+					   IntWorkVector&  column_indices,
+					   IntWorkVector&  visited,
+					   IntWorkVector&  levels,
+					   IntWorkVector&  ori_degrees,
+					   BoolWorkVector& tried)
 {
 	int min_idx = thrust::min_element(ori_degrees.begin(), ori_degrees.end()) - ori_degrees.begin();
 
@@ -2291,7 +2949,7 @@ Graph<T>::unorderedBFS(bool          doRCM,
 
 	int width = 0, max_width = 0;
 
-	IntVector costs(m_n), ori_costs(m_n);
+	IntWorkVector costs(m_n), ori_costs(m_n);
 
 	StatusVector status(m_n, INACTIVE);
 
@@ -2358,20 +3016,20 @@ Graph<T>::unorderedBFS(bool          doRCM,
 
 template <typename T>
 void
-Graph<T>::unorderedBFSIteration(int            width,
-							    int            start_idx,
-							    int            end_idx,
-							    IntVector&     tmp_reordering,
-							    IntVector&     levels,
-							    IntVector&     visited,
-							    IntVector&     row_offsets,
-							    IntVector&     column_indices,
-							    IntVector&     ori_degrees,
-							    BoolVector&    tried,
-							    IntVector&     costs,
-							    IntVector&     ori_costs,
-							    StatusVector&  status,
-							    int &          next_level)
+Graph<T>::unorderedBFSIteration(int             width,
+							    int             start_idx,
+							    int             end_idx,
+							    IntVector&      tmp_reordering,
+							    IntWorkVector&  levels,
+							    IntWorkVector&  visited,
+							    IntWorkVector&  row_offsets,
+							    IntWorkVector&  column_indices,
+							    IntWorkVector&  ori_degrees,
+							    BoolWorkVector& tried,
+							    IntWorkVector&  costs,
+							    IntWorkVector&  ori_costs,
+							    StatusVector&   status,
+							    int &           next_level)
 {
 	int S = tmp_reordering[start_idx], E = -1;
 	int pS = S, pE;
@@ -2384,7 +3042,7 @@ Graph<T>::unorderedBFSIteration(int            width,
 	int max_level = p_max_level;
 	int start_level = levels[start_idx];
 
-	IntVector tmp_reordering_bak(end_idx - start_idx);
+	IntWorkVector tmp_reordering_bak(end_idx - start_idx);
 
 	for (int i = 1; i < ITER_COUNT; i++)
 	{
@@ -2392,7 +3050,7 @@ Graph<T>::unorderedBFSIteration(int            width,
 
 		int max_count = end_idx - max_level_start_idx;
 
-		IntVector max_level_valence(max_count);
+		IntWorkVector max_level_valence(max_count);
 		if( max_count > 1 ) {
 
 			thrust::gather(tmp_reordering.begin() + max_level_start_idx, tmp_reordering.begin() + end_idx, ori_degrees.begin(), max_level_valence.begin());
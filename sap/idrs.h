@@ -0,0 +1,378 @@
+/** \file idrs.h
+ *  \brief IDR(s) preconditioned iterative Krylov solver.
+ */
+
+#ifndef SAP_IDRS_H
+#define SAP_IDRS_H
+
+#include <vector>
+#include <cmath>
+
+#ifdef   USE_OLD_CUSP
+#include <cusp/blas.h>
+#else
+#include <cusp/blas/blas.h>
+#endif
+#include <cusp/multiply.h>
+#include <cusp/array1d.h>
+
+#include <thrust/reduce.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/discard_iterator.h>
+#include <thrust/iterator/permutation_iterator.h>
+#include <thrust/iterator/transform_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
+
+#include <sap/monitor.h>
+
+
+namespace sap {
+
+namespace detail {
+
+struct IdrsColumnIndex : public thrust::unary_function<int, int>
+{
+	int m_n;
+	IdrsColumnIndex(int n) : m_n(n) {}
+	__host__ __device__
+	int operator() (int i) const {return i / m_n;}
+};
+
+struct IdrsRowIndex : public thrust::unary_function<int, int>
+{
+	int m_n;
+	IdrsRowIndex(int n) : m_n(n) {}
+	__host__ __device__
+	int operator() (int i) const {return i % m_n;}
+};
+
+template <typename ValueType>
+struct IdrsProduct : public thrust::unary_function<thrust::tuple<ValueType, ValueType>, ValueType>
+{
+	__host__ __device__
+	ValueType operator() (const thrust::tuple<ValueType, ValueType>& a) const {return thrust::get<0>(a) * thrust::get<1>(a);}
+};
+
+/**
+ * This function calculates the s inner products of v with the columns of the
+ * shadow space P (stored column after column in one array of size n*s) with a
+ * single segmented reduction, and copies them to the host array dots.
+ */
+template <typename Array, typename Vector, typename ValueType>
+void idrsShadowDots(const Array&             P,
+                    const Vector&            v,
+                    int                      n,
+                    int                      s,
+                    Array&                   sums,
+                    std::vector<ValueType>&  dots)
+{
+	thrust::counting_iterator<int> first(0);
+
+	thrust::reduce_by_key(thrust::make_transform_iterator(first, IdrsColumnIndex(n)),
+	                      thrust::make_transform_iterator(first, IdrsColumnIndex(n)) + n * s,
+	                      thrust::make_transform_iterator(
+	                          thrust::make_zip_iterator(thrust::make_tuple(
+	                              P.begin(),
+	                              thrust::make_permutation_iterator(v.begin(), thrust::make_transform_iterator(first, IdrsRowIndex(n))))),
+	                          IdrsProduct<ValueType>()),
+	                      thrust::make_discard_iterator(),
+	                      sums.begin());
+
+	thrust::copy(sums.begin(), sums.end(), dots.begin());
+}
+
+/**
+ * This function solves the lower triangular system M(k:m, k:m) c = f(k:m),
+ * where M is stored row-major with leading dimension s.
+ */
+template <typename ValueType>
+void idrsLowerSolve(const std::vector<ValueType>&  M,
+                    int                            s,
+                    int                            k,
+                    int                            m,
+                    const ValueType*               f,
+                    ValueType*                     c)
+{
+	for (int i = k; i < m; i++) {
+		ValueType sum = f[i - k];
+		for (int j = k; j < i; j++)
+			sum -= M[i * s + j] * c[j - k];
+		c[i - k] = sum / M[i * s + i];
+	}
+}
+
+} // namespace detail
+
+
+/// Preconditioned IDR(s) Krylov method
+/**
+ * This is the IDR(s) method with biorthogonalization (van Gijzen and
+ * Sonneveld, 2011), right-preconditioned. Every cycle performs s+1 matrix-
+ * vector products and preconditioner applies. All inner products with the s
+ * shadow vectors needed in one step are computed by a single fused reduction
+ * (the biorthogonalization against the previous directions uses the known
+ * projections M instead of one inner product per direction). The iteration
+ * count is incremented by one for every cycle.
+ *
+ * \tparam LinearOperator is a functor class for sparse matrix-vector product.
+ * \tparam Vector is the vector type for the linear system solution.
+ * \tparam Monitor is the convergence test object.
+ * \tparam Preconditioner is the preconditioner.
+ */
+template <typename LinearOperator, typename Vector, typename Monitor, typename Preconditioner>
+void idrs(LinearOperator&  A,
+          Vector&          x,
+          const Vector&    b,
+          Monitor&         monitor,
+          Preconditioner&  P,
+          int              s)
+{
+	typedef typename Vector::value_type   ValueType;
+	typedef typename Vector::memory_space MemorySpace;
+
+	typedef typename cusp::array1d<ValueType, MemorySpace>        WorkVector;
+	typedef typename cusp::array1d<ValueType, cusp::host_memory>  WorkVectorH;
+
+	const ValueType eps   = 1e-20;
+	const ValueType kappa = 0.7;
+
+	int  n = b.size();
+
+	if (s < 1)
+		s = 1;
+
+	// Shadow space: s pseudo-random orthonormal vectors (generated on the
+	// host with a fixed seed, so that runs are reproducible).
+	WorkVector  shadow(n * s);
+	{
+		WorkVectorH   Ph(n * s);
+		unsigned int  seed = 12345u;
+
+		for (int i = 0; i < n * s; i++) {
+			seed = 1664525u * seed + 1013904223u;
+			Ph[i] = ValueType(seed >> 8) / ValueType(1 << 24) - ValueType(0.5);
+		}
+
+		for (int j = 0; j < s; j++) {
+			for (int i = 0; i < j; i++) {
+				ValueType dot = 0;
+				for (int l = 0; l < n; l++)
+					dot += Ph[i * n + l] * Ph[j * n + l];
+				for (int l = 0; l < n; l++)
+					Ph[j * n + l] -= dot * Ph[i * n + l];
+			}
+
+			ValueType norm = 0;
+			for (int l = 0; l < n; l++)
+				norm += Ph[j * n + l] * Ph[j * n + l];
+			norm = std::sqrt(norm);
+			for (int l = 0; l < n; l++)
+				Ph[j * n + l] /= norm;
+		}
+
+		shadow = Ph;
+	}
+
+	std::vector<WorkVector>  G(s);
+	std::vector<WorkVector>  U(s);
+
+	for (int k = 0; k < s; k++) {
+		G[k].resize(n, 0);
+		U[k].resize(n, 0);
+	}
+
+	WorkVector  r(n);
+	WorkVector  v(n);
+	WorkVector  t(n);
+	WorkVector  sums(s);
+	WorkVector  x_min(x);
+
+	// M = P^T G (lower triangular, row-major); f = P^T r.
+	std::vector<ValueType>  M(s * s, ValueType(0));
+	std::vector<ValueType>  f(s);
+	std::vector<ValueType>  m(s);
+	std::vector<ValueType>  c(s);
+
+	for (int k = 0; k < s; k++)
+		M[k * s + k] = ValueType(1);
+
+	ValueType omega = ValueType(1);
+
+	// r <- b - A * x
+	cusp::multiply(A, x, r);
+	cusp::blas::axpby(b, r, r, ValueType(1), ValueType(-1));
+
+	ValueType r_norm_min = cusp::blas::nrm2(r);
+	ValueType r_norm     = r_norm_min;
+	ValueType r_norm_act = r_norm;
+
+	while (!monitor.finished()) {
+		detail::idrsShadowDots(shadow, r, n, s, sums, f);
+
+		for (int k = 0; k < s; k++) {
+			// c <- M(k:s, k:s) \ f(k:s)
+			detail::idrsLowerSolve(M, s, k, s, &f[k], &c[0]);
+
+			// v <- P^{-1} * (r - G(:, k:s) * c)
+			cusp::blas::copy(r, t);
+			for (int i = k; i < s; i++)
+				cusp::blas::axpy(G[i], t, -c[i - k]);
+			cusp::multiply(P, t, v);
+
+			// U(:, k) <- U(:, k:s) * c + omega * v
+			cusp::blas::axpby(v, U[k], U[k], omega, c[0]);
+			for (int i = k + 1; i < s; i++)
+				cusp::blas::axpy(U[i], U[k], c[i - k]);
+
+			// G(:, k) <- A * U(:, k)
+			cusp::multiply(A, U[k], G[k]);
+
+			monitor.increment(1.0f / (s + 1));
+
+			// m <- P^T G(:, k). Make G(:, k) orthogonal to P(:, 0:k) using
+			// the projections of the previous directions, i.e. solve
+			// M(0:k, 0:k) alpha = m(0:k).
+			detail::idrsShadowDots(shadow, G[k], n, s, sums, m);
+
+			if (k > 0) {
+				detail::idrsLowerSolve(M, s, 0, k, &m[0], &c[0]);
+
+				for (int i = 0; i < k; i++) {
+					cusp::blas::axpy(G[i], G[k], -c[i]);
+					cusp::blas::axpy(U[i], U[k], -c[i]);
+				}
+			}
+
+			for (int i = k; i < s; i++) {
+				M[i * s + k] = m[i];
+				for (int j = 0; j < k; j++)
+					M[i * s + k] -= M[i * s + j] * c[j];
+			}
+
+			if (M[k * s + k] == 0) {
+				monitor.stop(-10, "M(k,k) is zero");
+				break;
+			}
+
+			ValueType beta = f[k] / M[k * s + k];
+
+			if (std::fabs(beta) * cusp::blas::nrm2(U[k]) < eps * cusp::blas::nrm2(x)) {
+				monitor.incrementStag();
+			} else {
+				monitor.resetStag();
+			}
+
+			// r <- r - beta * G(:, k)
+			// x <- x + beta * U(:, k)
+			cusp::blas::axpy(G[k], r, -beta);
+			cusp::blas::axpy(U[k], x, beta);
+
+			for (int i = k + 1; i < s; i++)
+				f[i] -= beta * M[i * s + k];
+
+			r_norm_act = r_norm = cusp::blas::nrm2(r);
+
+			if (monitor.needCheckConvergence(r_norm)) {
+				// r <- b - A * x
+				cusp::multiply(A, x, t);
+				cusp::blas::axpby(b, t, r, ValueType(1), ValueType(-1));
+				r_norm_act = cusp::blas::nrm2(r);
+
+				if (monitor.finished(r_norm_act))
+					break;
+			}
+
+			if (r_norm_act < r_norm_min) {
+				r_norm_min = r_norm_act;
+				cusp::blas::copy(x, x_min);
+			}
+
+			if (monitor.finished())
+				break;
+		}
+
+		if (monitor.finished())
+			break;
+
+		// Dimension reduction step:
+		//   v <- P^{-1} * r
+		//   t <- A * v
+		cusp::multiply(P, r, v);
+		cusp::multiply(A, v, t);
+
+		monitor.increment(1.0f / (s + 1));
+
+		ValueType t_norm = cusp::blas::nrm2(t);
+		ValueType tr     = cusp::blas::dotc(t, r);
+
+		if (t_norm == 0) {
+			monitor.stop(-11, "t is zero");
+			break;
+		}
+
+		// Maintain the convergence: limit how small omega may become.
+		omega = tr / (t_norm * t_norm);
+		ValueType rho = std::fabs(tr / (t_norm * r_norm));
+		if (rho < kappa)
+			omega *= kappa / rho;
+
+		if (omega == 0) {
+			monitor.stop(-12, "omega is zero");
+			break;
+		}
+
+		if (std::fabs(omega) * cusp::blas::nrm2(v) < eps * cusp::blas::nrm2(x)) {
+			monitor.incrementStag();
+		} else {
+			monitor.resetStag();
+		}
+
+		// x <- x + omega * v
+		// r <- r - omega * t
+		cusp::blas::axpy(v, x, omega);
+		cusp::blas::axpy(t, r, -omega);
+
+		r_norm_act = r_norm = cusp::blas::nrm2(r);
+
+		if (monitor.needCheckConvergence(r_norm)) {
+			// r <- b - A * x
+			cusp::multiply(A, x, t);
+			cusp::blas::axpby(b, t, r, ValueType(1), ValueType(-1));
+			r_norm_act = cusp::blas::nrm2(r);
+
+			if (monitor.finished(r_norm_act))
+				break;
+		}
+
+		if (r_norm_act < r_norm_min) {
+			r_norm_min = r_norm_act;
+			cusp::blas::copy(x, x_min);
+		}
+	}
+
+	if (!monitor.converged()) {
+		// Return the better of the last and the best iterate.
+		cusp::multiply(A, x, t);
+		cusp::blas::axpby(b, t, r, ValueType(1), ValueType(-1));
+		ValueType r_comp_norm = cusp::blas::nrm2(r);
+
+		cusp::multiply(A, x_min, t);
+		cusp::blas::axpby(b, t, r, ValueType(1), ValueType(-1));
+		ValueType r_comp_min_norm = cusp::blas::nrm2(r);
+
+		if (r_comp_norm < r_comp_min_norm) {
+			monitor.updateResidual(r_comp_norm);
+		} else {
+			cusp::blas::copy(x_min, x);
+			monitor.updateResidual(r_comp_min_norm);
+		}
+	}
+}
+
+
+
+} // namespace sap
+
+
+
+#endif
@@ -0,0 +1,489 @@
+/** \file low_rank.h
+ *  \brief Low-rank compression of the spike blocks and solution of the
+ *         truncated reduced system in compressed form.
+ */
+
+#ifndef SAP_LOW_RANK_H
+#define SAP_LOW_RANK_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include <sap/common.h>
+
+#include <cusp/array1d.h>
+
+#include <omp.h>
+
+namespace sap {
+
+/// Truncated SPIKE reduced matrix with low-rank compressed spike blocks.
+/**
+ * Each diagonal block of the truncated reduced matrix has the form
+ *       [ I_k  |  X  ]
+ * R_i = [------+-----]
+ *       [  Y   | I_k ]
+ * where X (bottom of the right spike) and Y (top of the left spike) are
+ * typically numerically low-rank. This class stores every spike block as
+ * U * W (U of size k x r, W of size r x k), obtained with a truncated QR
+ * factorization with column pivoting, and solves with R_i through the
+ * Sherman-Morrison-Woodbury formula:
+ *   b = (I - Y X)^{-1} (g - Y f),   a = f - X b,
+ *   (I - Uy M Wx)^{-1} = I + Uy S^{-1} M Wx,  M = Wy Ux,  S = I - M Wx Uy.
+ * Both the storage and the cost of a solve are O(k (rx + ry)) per interface
+ * instead of O(k^2).
+ *
+ * All data is kept in host memory; the interfaces are processed in parallel.
+ *
+ * \tparam T is the floating point type.
+ */
+template <typename T>
+class CompressedSpikes
+{
+public:
+    typedef typename cusp::array1d<T, cusp::host_memory>    VectorH;
+    typedef typename cusp::array1d<int, cusp::host_memory>  IntVectorH;
+
+    CompressedSpikes() : m_k(0), m_numInterfaces(0) {}
+
+    template <typename Array>
+    void build(const Array& WV, int k, int numInterfaces, T tol);
+
+    void solve(VectorH& v, VectorH& work) const;
+
+    void clear();
+
+    int    getNumInterfaces() const  {return m_numInterfaces;}
+    size_t getNumEntries() const     {return m_values.size();}
+    double getAverageRank() const;
+
+    size_t getWorkSize(int numThreads) const  {return 2 * (size_t) m_k * numThreads;}
+
+private:
+    int         m_k;
+    int         m_numInterfaces;
+
+    IntVectorH  m_ranks;          // ranks of X and Y for each interface
+    IntVectorH  m_offsets;        // offset of the data of each interface in m_values
+    IntVectorH  m_pivOffsets;     // offset of the pivots of each interface in m_pivots
+    IntVectorH  m_pivots;         // pivots of the LU factors of the matrices S
+    VectorH     m_values;         // Ux, Wx, Uy, Wy, M and the LU factors of S
+
+    static int  compress(const T* A, int k, T tol, std::vector<T>& U, std::vector<T>& W);
+    static void luFactor(T* S, int r, int* piv);
+    static void luSolve(const T* S, int r, const int* piv, T* x);
+};
+
+
+/**
+ * This function compresses the spike blocks stored in WV (2*k*k values per
+ * interface: X followed by Y, both column-major, as placed in the reduced
+ * matrix by device::assembleReducedMat()) to the relative tolerance
+ * tol and assembles the compressed reduced blocks. The capacitance matrices
+ * S are LU factorized here, so no separate factorization step is required.
+ */
+template <typename T>
+template <typename Array>
+void
+CompressedSpikes<T>::build(const Array&  WV,
+                           int           k,
+                           int           numInterfaces,
+                           T             tol)
+{
+    m_k = k;
+    m_numInterfaces = numInterfaces;
+
+    VectorH WV_h = WV;
+
+    std::vector<std::vector<T> > data(numInterfaces);
+    std::vector<int>             rx(numInterfaces), ry(numInterfaces);
+
+    const size_t k2 = (size_t) k * k;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < numInterfaces; i++) {
+        const T* X = thrust::raw_pointer_cast(&WV_h[0]) + 2 * k2 * i;
+        const T* Y = X + k2;
+
+        std::vector<T> Ux, Wx, Uy, Wy;
+
+        int r_x = compress(X, k, tol, Ux, Wx);
+        int r_y = compress(Y, k, tol, Uy, Wy);
+
+        // M = Wy * Ux (r_y x r_x) and S = I - M * (Wx * Uy) (r_y x r_y),
+        // all column-major.
+        std::vector<T> M((size_t) r_y * r_x, T(0));
+        std::vector<T> WxUy((size_t) r_x * r_y, T(0));
+        std::vector<T> S((size_t) r_y * r_y, T(0));
+
+        for (int c = 0; c < r_x; c++)
+            for (int l = 0; l < k; l++) {
+                T u = Ux[(size_t) c * k + l];
+                for (int r = 0; r < r_y; r++)
+                    M[(size_t) c * r_y + r] += Wy[(size_t) l * r_y + r] * u;
+            }
+
+        for (int c = 0; c < r_y; c++)
+            for (int l = 0; l < k; l++) {
+                T u = Uy[(size_t) c * k + l];
+                for (int r = 0; r < r_x; r++)
+                    WxUy[(size_t) c * r_x + r] += Wx[(size_t) l * r_x + r] * u;
+            }
+
+        for (int c = 0; c < r_y; c++) {
+            S[(size_t) c * r_y + c] = T(1);
+            for (int l = 0; l < r_x; l++) {
+                T w = WxUy[(size_t) c * r_x + l];
+                for (int r = 0; r < r_y; r++)
+                    S[(size_t) c * r_y + r] -= M[(size_t) l * r_y + r] * w;
+            }
+        }
+
+        std::vector<T>& d = data[i];
+        d.reserve(Ux.size() + Wx.size() + Uy.size() + Wy.size() + M.size() + S.size());
+        d.insert(d.end(), Ux.begin(), Ux.end());
+        d.insert(d.end(), Wx.begin(), Wx.end());
+        d.insert(d.end(), Uy.begin(), Uy.end());
+        d.insert(d.end(), Wy.begin(), Wy.end());
+        d.insert(d.end(), M.begin(), M.end());
+        d.insert(d.end(), S.begin(), S.end());
+
+        rx[i] = r_x;
+        ry[i] = r_y;
+    }
+
+    m_ranks.resize(2 * numInterfaces);
+    m_offsets.resize(numInterfaces + 1);
+    m_pivOffsets.resize(numInterfaces + 1);
+    m_offsets[0] = 0;
+    m_pivOffsets[0] = 0;
+
+    for (int i = 0; i < numInterfaces; i++) {
+        m_ranks[2 * i]     = rx[i];
+        m_ranks[2 * i + 1] = ry[i];
+        m_offsets[i + 1]    = m_offsets[i] + (int) data[i].size();
+        m_pivOffsets[i + 1] = m_pivOffsets[i] + ry[i];
+    }
+
+    m_values.resize(m_offsets[numInterfaces]);
+    m_pivots.resize(m_pivOffsets[numInterfaces]);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < numInterfaces; i++) {
+        if (data[i].empty())
+            continue;
+
+        T* p = thrust::raw_pointer_cast(&m_values[0]) + m_offsets[i];
+        std::copy(data[i].begin(), data[i].end(), p);
+
+        int r_x = rx[i], r_y = ry[i];
+        T*  S   = p + 2 * (size_t) k * (r_x + r_y) + (size_t) r_y * r_x;
+
+        if (r_y > 0)
+            luFactor(S, r_y, thrust::raw_pointer_cast(&m_pivots[0]) + m_pivOffsets[i]);
+    }
+}
+
+/**
+ * This function solves, in place, with all diagonal blocks of the reduced
+ * matrix. The vector v holds 2*k values per interface: the last k entries
+ * of the partition above the interface followed by the first k entries of
+ * the partition below it. The work array provides 2*k values per thread
+ * (see getWorkSize()); it is only resized if it is too small, so repeated
+ * solves with the same work array do not allocate.
+ */
+template <typename T>
+void
+CompressedSpikes<T>::solve(VectorH& v,
+                           VectorH& work) const
+{
+    const int k = m_k;
+
+    // All spike blocks are negligible: R is the identity.
+    if (m_values.size() == 0)
+        return;
+
+    int numThreads = omp_get_max_threads();
+
+    if (work.size() < getWorkSize(numThreads))
+        work.resize(getWorkSize(numThreads));
+
+    // Every thread uses its own slice of the work array, so that solve() can
+    // be called concurrently with distinct work arrays.
+#pragma omp parallel num_threads(numThreads)
+    {
+        T* t = thrust::raw_pointer_cast(&work[0]) + 2 * (size_t) k * omp_get_thread_num();
+        T* z = t + k;
+
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < m_numInterfaces; i++) {
+            int r_x = m_ranks[2 * i];
+            int r_y = m_ranks[2 * i + 1];
+
+            const T* Ux = thrust::raw_pointer_cast(&m_values[0]) + m_offsets[i];
+            const T* Wx = Ux + (size_t) k * r_x;
+            const T* Uy = Wx + (size_t) k * r_x;
+            const T* Wy = Uy + (size_t) k * r_y;
+            const T* M  = Wy + (size_t) k * r_y;
+            const T* S  = M + (size_t) r_y * r_x;
+
+            T* f = thrust::raw_pointer_cast(&v[0]) + 2 * (size_t) k * i;
+            T* g = f + k;
+
+            // g <- g - Uy * (Wy * f)
+            for (int r = 0; r < r_y; r++) {
+                T s = 0;
+                for (int l = 0; l < k; l++)
+                    s += Wy[(size_t) l * r_y + r] * f[l];
+                z[r] = s;
+            }
+            for (int r = 0; r < r_y; r++)
+                for (int l = 0; l < k; l++)
+                    g[l] -= Uy[(size_t) r * k + l] * z[r];
+
+            // g <- g + Uy * S^{-1} * M * (Wx * g)
+            if (r_x > 0 && r_y > 0) {
+                for (int r = 0; r < r_x; r++) {
+                    T s = 0;
+                    for (int l = 0; l < k; l++)
+                        s += Wx[(size_t) l * r_x + r] * g[l];
+                    t[r] = s;
+                }
+                for (int r = 0; r < r_y; r++) {
+                    T s = 0;
+                    for (int l = 0; l < r_x; l++)
+                        s += M[(size_t) l * r_y + r] * t[l];
+                    z[r] = s;
+                }
+
+                luSolve(S, r_y, thrust::raw_pointer_cast(&m_pivots[0]) + m_pivOffsets[i], z);
+
+                for (int r = 0; r < r_y; r++)
+                    for (int l = 0; l < k; l++)
+                        g[l] += Uy[(size_t) r * k + l] * z[r];
+            }
+
+            // f <- f - Ux * (Wx * g)
+            for (int r = 0; r < r_x; r++) {
+                T s = 0;
+                for (int l = 0; l < k; l++)
+                    s += Wx[(size_t) l * r_x + r] * g[l];
+                t[r] = s;
+            }
+            for (int r = 0; r < r_x; r++)
+                for (int l = 0; l < k; l++)
+                    f[l] -= Ux[(size_t) r * k + l] * t[r];
+        }
+    }
+}
+
+template <typename T>
+void
+CompressedSpikes<T>::clear()
+{
+    m_k = 0;
+    m_numInterfaces = 0;
+    m_ranks.clear();
+    m_offsets.clear();
+    m_pivOffsets.clear();
+    m_pivots.clear();
+    m_values.clear();
+}
+
+/**
+ * This function returns the average rank of the compressed spike blocks.
+ */
+template <typename T>
+double
+CompressedSpikes<T>::getAverageRank() const
+{
+    if (m_numInterfaces == 0)
+        return 0;
+
+    double sum = 0;
+    for (int i = 0; i < 2 * m_numInterfaces; i++)
+        sum += m_ranks[i];
+
+    return sum / (2 * m_numInterfaces);
+}
+
+/**
+ * This function computes the truncated QR factorization with column
+ * pivoting A * P = Q * R of the k x k column-major matrix A, stopping as
+ * soon as the Frobenius norm of the trailing block falls below tol times
+ * the Frobenius norm of A. On return, A ~ U * W, with U = Q(:, 1:r) of size
+ * k x r and W = R(1:r, :) * P^T of size r x k (both column-major), and the
+ * rank r is returned.
+ */
+template <typename T>
+int
+CompressedSpikes<T>::compress(const T*         A,
+                              int              k,
+                              T                tol,
+                              std::vector<T>&  U,
+                              std::vector<T>&  W)
+{
+    std::vector<T>   QR(A, A + (size_t) k * k);
+    std::vector<T>   norms(k);
+    std::vector<T>   beta(k);
+    std::vector<int> perm(k);
+
+    T total = 0;
+    for (int j = 0; j < k; j++) {
+        T s = 0;
+        for (int l = 0; l < k; l++)
+            s += A[(size_t) j * k + l] * A[(size_t) j * k + l];
+        norms[j] = s;
+        total += s;
+        perm[j] = j;
+    }
+
+    int r = 0;
+
+    for (; r < k; r++) {
+        // Squared norms of the trailing columns (recomputed to avoid the
+        // cancellation of downdating).
+        T   rest = 0;
+        int piv  = r;
+        for (int j = r; j < k; j++) {
+            T  s   = 0;
+            T* col = &QR[(size_t) j * k];
+            for (int l = r; l < k; l++)
+                s += col[l] * col[l];
+            norms[j] = s;
+            rest += s;
+            if (s > norms[piv])
+                piv = j;
+        }
+
+        if (rest <= tol * tol * total)
+            break;
+
+        if (piv != r) {
+            std::swap_ranges(QR.begin() + (size_t) r * k, QR.begin() + (size_t) (r + 1) * k, QR.begin() + (size_t) piv * k);
+            std::swap(perm[r], perm[piv]);
+            std::swap(norms[r], norms[piv]);
+        }
+
+        // Householder reflector H = I - beta * v * v^T with v(r) = 1 that
+        // annihilates QR(r+1:k, r).
+        T* col   = &QR[(size_t) r * k];
+        T  alpha = std::sqrt(norms[r]);
+        if (col[r] > 0)
+            alpha = -alpha;
+
+        T v0 = col[r] - alpha;
+        for (int l = r + 1; l < k; l++)
+            col[l] /= v0;
+        beta[r] = -v0 / alpha;
+        col[r]  = alpha;
+
+        for (int j = r + 1; j < k; j++) {
+            T* cj = &QR[(size_t) j * k];
+            T  s  = cj[r];
+            for (int l = r + 1; l < k; l++)
+                s += col[l] * cj[l];
+            s *= beta[r];
+            cj[r] -= s;
+            for (int l = r + 1; l < k; l++)
+                cj[l] -= s * col[l];
+        }
+    }
+
+    // W = R(1:r, :) * P^T
+    W.assign((size_t) r * k, T(0));
+    for (int j = 0; j < k; j++) {
+        int top = std::min(j + 1, r);
+        for (int l = 0; l < top; l++)
+            W[(size_t) perm[j] * r + l] = QR[(size_t) j * k + l];
+    }
+
+    // U = H_0 * ... * H_{r-1} * I(:, 1:r)
+    U.assign((size_t) k * r, T(0));
+    for (int j = 0; j < r; j++)
+        U[(size_t) j * k + j] = T(1);
+
+    for (int h = r - 1; h >= 0; h--) {
+        const T* v = &QR[(size_t) h * k];
+        for (int j = h; j < r; j++) {
+            T* uj = &U[(size_t) j * k];
+            T  s  = uj[h];
+            for (int l = h + 1; l < k; l++)
+                s += v[l] * uj[l];
+            s *= beta[h];
+            uj[h] -= s;
+            for (int l = h + 1; l < k; l++)
+                uj[l] -= s * v[l];
+        }
+    }
+
+    return r;
+}
+
+/**
+ * This function performs the in-place LU factorization with partial
+ * pivoting of the r x r column-major matrix S.
+ */
+template <typename T>
+void
+CompressedSpikes<T>::luFactor(T*    S,
+                              int   r,
+                              int*  piv)
+{
+    for (int j = 0; j < r; j++) {
+        int p = j;
+        for (int l = j + 1; l < r; l++)
+            if (std::abs(S[(size_t) j * r + l]) > std::abs(S[(size_t) j * r + p]))
+                p = l;
+        piv[j] = p;
+
+        if (p != j)
+            for (int c = 0; c < r; c++)
+                std::swap(S[(size_t) c * r + j], S[(size_t) c * r + p]);
+
+        T d = S[(size_t) j * r + j];
+        if (d == T(0))
+            d = S[(size_t) j * r + j] = T(BURST_VALUE);
+
+        for (int l = j + 1; l < r; l++)
+            S[(size_t) j * r + l] /= d;
+
+        for (int c = j + 1; c < r; c++) {
+            T s = S[(size_t) c * r + j];
+            for (int l = j + 1; l < r; l++)
+                S[(size_t) c * r + l] -= S[(size_t) j * r + l] * s;
+        }
+    }
+}
+
+/**
+ * This function solves S * x = b in place, using the LU factors computed by
+ * luFactor().
+ */
+template <typename T>
+void
+CompressedSpikes<T>::luSolve(const T*    S,
+                             int         r,
+                             const int*  piv,
+                             T*          x)
+{
+    for (int j = 0; j < r; j++) {
+        std::swap(x[j], x[piv[j]]);
+        for (int l = j + 1; l < r; l++)
+            x[l] -= S[(size_t) j * r + l] * x[j];
+    }
+
+    for (int j = r - 1; j >= 0; j--) {
+        x[j] /= S[(size_t) j * r + j];
+        for (int l = 0; l < j; l++)
+            x[l] -= S[(size_t) j * r + l] * x[j];
+    }
+}
+
+
+} // namespace sap
+
+
+#endif
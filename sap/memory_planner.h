@@ -0,0 +1,249 @@
+/** \file memory_planner.h
+ *  \brief Prediction of the memory footprint of the SaP preconditioner setup.
+ */
+
+#ifndef SAP_MEMORY_PLANNER_H
+#define SAP_MEMORY_PLANNER_H
+
+#include <algorithm>
+#include <cstddef>
+
+#include <sap/common.h>
+
+namespace sap {
+
+/// Predicted memory footprint of a preconditioner setup.
+/**
+ * All sizes are in bytes. The persistent arrays live for as long as the
+ * preconditioner does; the temporary arrays are only alive during one of the
+ * setup stages, so the peak is given by the persistent arrays plus the largest
+ * set of temporaries alive at the same time.
+ */
+struct MemoryPlan
+{
+    MemoryPlan()
+    :   bandedMat(0),
+        offDiags(0),
+        spikes(0),
+        reducedMat(0),
+        ulCopy(0),
+        spikeTemporaries(0),
+        peak(0)
+    {}
+
+    size_t  bandedMat;          /**< Banded matrix B (LU or Cholesky factors). */
+    size_t  offDiags;           /**< Off-diagonal blocks of the original banded matrix. */
+    size_t  spikes;             /**< Spike blocks W and V (freed at the end of the setup). */
+    size_t  reducedMat;         /**< Diagonal blocks of the reduced matrix R. */
+    size_t  ulCopy;             /**< Copy of B used for the UL factorization (LU_UL only). */
+    size_t  spikeTemporaries;   /**< Work arrays used while calculating the spikes. */
+    size_t  peak;               /**< Predicted peak usage of the setup. */
+
+    size_t  persistent() const {return bandedMat + offDiags + reducedMat;}
+};
+
+
+/// Memory planner for the preconditioner setup.
+/**
+ * This class predicts the peak memory of every setup stage from the problem
+ * size n, the half-bandwidth k, the number of partitions P, the factorization
+ * method and the storage mode. Given a memory budget, it adjusts the setup
+ * parameters (in order of increasing impact on the preconditioner quality)
+ * so that the setup fits before any allocation is made.
+ */
+class MemoryPlanner
+{
+public:
+    MemoryPlanner(size_t  valueSize,
+                  size_t  budget)
+    :   m_valueSize(valueSize),
+        m_budget(budget)
+    {}
+
+    bool hasBudget() const                 {return m_budget > 0;}
+    bool fits(const MemoryPlan& plan) const {return m_budget == 0 || plan.peak <= m_budget;}
+
+    MemoryPlan predict(int                  n,
+                       int                  k,
+                       int                  numPartitions,
+                       FactorizationMethod  factMethod,
+                       PreconditionerType   precondType,
+                       bool                 saveMem,
+                       bool                 variableBandwidth,
+                       int                  overlap = 0) const;
+
+    bool adjust(int                  n,
+                int&                 k,
+                int&                 numPartitions,
+                FactorizationMethod& factMethod,
+                PreconditionerType&  precondType,
+                bool&                saveMem,
+                bool                 isSPD,
+                bool                 variableBandwidth,
+                MemoryPlan&          plan,
+                int                  overlap = 0) const;
+
+private:
+    size_t  m_valueSize;
+    size_t  m_budget;
+
+    size_t  bandedSize(int n, int k, bool saveMem) const {
+        return (size_t)((saveMem ? 1 : 2) * k + 1) * n * m_valueSize;
+    }
+};
+
+
+/**
+ * This function predicts the sizes of the arrays allocated by
+ * Precond::setup() for the specified configuration.
+ */
+inline
+MemoryPlan
+MemoryPlanner::predict(int                  n,
+                       int                  k,
+                       int                  numPartitions,
+                       FactorizationMethod  factMethod,
+                       PreconditionerType   precondType,
+                       bool                 saveMem,
+                       bool                 variableBandwidth,
+                       int                  overlap) const
+{
+    MemoryPlan plan;
+
+    // The polynomial and approximate inverse preconditioners only keep
+    // sparse matrices.
+    if (precondType == None || precondType == Polynomial || precondType == SPAI)
+        return plan;
+
+    plan.bandedMat = bandedSize(n, k, saveMem);
+
+    if (precondType == Block || numPartitions <= 1 || k == 0) {
+        plan.peak = plan.bandedMat;
+        return plan;
+    }
+
+    // The Schwarz blocks (all of the size of the largest extended partition)
+    // are assembled from, and replace, the banded matrix.
+    if (precondType == Schwarz) {
+        int     ext       = 2 * (overlap > 0 ? overlap : k);
+        size_t  blockSize = (size_t) std::min(n / numPartitions + 1 + ext, n);
+
+        plan.bandedMat = bandedSize((int) (blockSize * numPartitions), k, false);
+        plan.peak      = plan.bandedMat + bandedSize(n, k, false);
+        return plan;
+    }
+
+    size_t  numSpikes = (size_t)(numPartitions - 1);
+
+    plan.offDiags   = 2 * (size_t)k * k * numSpikes * m_valueSize;
+    plan.spikes     = 2 * (size_t)k * k * numSpikes * m_valueSize;
+    plan.reducedMat = 4 * (size_t)k * k * numSpikes * m_valueSize;
+
+    if (variableBandwidth) {
+        // calculateSpikes_var() works on an extended WV array and a buffer of
+        // the same size, each holding (at most) 2k columns of length n.
+        plan.spikeTemporaries = 2 * (2 * (size_t)k * n) * m_valueSize + (size_t)k * k * m_valueSize;
+    } else if (factMethod == LU_UL) {
+        // The UL factors are computed in a full copy of B, which is then
+        // compressed into compB2 and combined with B into partialB.
+        plan.ulCopy           = bandedSize(n, k, false);
+        plan.spikeTemporaries = (size_t)(2 * k + 1) * (2 * k) * numSpikes * m_valueSize
+                              + (size_t)2 * (2 * k + 1) * (k + 1) * numSpikes * m_valueSize;
+    }
+
+    plan.peak = plan.persistent() + plan.spikes + plan.ulCopy + plan.spikeTemporaries;
+
+    return plan;
+}
+
+/**
+ * This function adjusts the setup parameters so that the predicted peak fits
+ * in the memory budget. The following changes are tried, in this order, until
+ * the setup fits:
+ *   (1) use LU_only instead of LU_UL (no copy of B, no UL temporaries);
+ *   (2) for SPD matrices, use the half-band storage;
+ *   (3) reduce the number of partitions (smaller spikes and reduced matrix);
+ *   (4) use the block-diagonal preconditioner (no spikes or overlapping blocks);
+ *   (5) reduce the half-bandwidth (i.e. drop off more elements).
+ * The function returns false if the setup cannot fit even with a diagonal
+ * preconditioner; in that case the parameters describe the smallest setup.
+ */
+inline
+bool
+MemoryPlanner::adjust(int                  n,
+                      int&                 k,
+                      int&                 numPartitions,
+                      FactorizationMethod& factMethod,
+                      PreconditionerType&  precondType,
+                      bool&                saveMem,
+                      bool                 isSPD,
+                      bool                 variableBandwidth,
+                      MemoryPlan&          plan,
+                      int                  overlap) const
+{
+    plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+
+    if (fits(plan))
+        return true;
+
+    if (factMethod == LU_UL) {
+        factMethod = LU_only;
+        plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+        if (fits(plan))
+            return true;
+    }
+
+    if (isSPD && !saveMem && precondType != Schwarz) {
+        saveMem = true;
+        plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+        if (fits(plan))
+            return true;
+    }
+
+    if (precondType == Spike) {
+        // The spike-related arrays scale with (P-1), so we can directly
+        // compute the largest number of partitions which still fits.
+        MemoryPlan  twoParts = predict(n, k, 2, factMethod, precondType, saveMem, variableBandwidth);
+        size_t      fixed    = twoParts.bandedMat + twoParts.ulCopy + (variableBandwidth ? twoParts.spikeTemporaries : 0);
+        size_t      perSpike = twoParts.peak - fixed;
+
+        if (perSpike > 0 && m_budget > fixed) {
+            int  maxNumPartitions = (int) std::min((size_t) numPartitions, (m_budget - fixed) / perSpike + 1);
+
+            if (maxNumPartitions >= 2) {
+                numPartitions = maxNumPartitions;
+                plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+                if (fits(plan))
+                    return true;
+            }
+        }
+
+        precondType = Block;
+        plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+        if (fits(plan))
+            return true;
+    }
+
+    if (precondType == Schwarz) {
+        precondType = Block;
+        plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+        if (fits(plan))
+            return true;
+    }
+
+    // Only the banded matrix is left; find the largest half-bandwidth for
+    // which it fits.
+    size_t  maxEntries = m_budget / m_valueSize / std::max(n, 1);
+    int     maxK       = (maxEntries == 0) ? 0 : (int)((maxEntries - 1) / (saveMem ? 1 : 2));
+
+    k = std::max(0, std::min(k, maxK));
+    plan = predict(n, k, numPartitions, factMethod, precondType, saveMem, variableBandwidth, overlap);
+
+    return fits(plan);
+}
+
+
+} // namespace sap
+
+
+#endif
@@ -0,0 +1,303 @@
+/** \file memory_pool.h
+ *  \brief Definition of a pooled host allocator for the reordering temporaries.
+ */
+
+#ifndef SAP_MEMORY_POOL_H
+#define SAP_MEMORY_POOL_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <limits>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#include <thrust/host_vector.h>
+
+
+namespace sap {
+
+/// Pool of host memory blocks.
+/**
+ * This class caches the host blocks released by the pooled vectors so that
+ * later requests of the same (or a slightly smaller) size are served without
+ * going back to the operating system. Blocks of at least hugePageSize bytes
+ * are aligned to a huge-page boundary and marked as candidates for
+ * transparent huge pages (Linux only).
+ *
+ * Only the host work vectors of the graph reordering (Graph::IntWorkVector
+ * and Graph::BoolWorkVector) are pooled. The large host and device arrays of
+ * the preconditioner (the banded matrix, its host CSR copy, the spike
+ * blocks) use the regular thrust/cusp allocators, so neither the pool nor
+ * the huge-page hint applies to them.
+ *
+ * All blocks handed out by a pool must be returned before the pool is
+ * destroyed; in SaP, a pool is owned by a Solver and only serves temporaries
+ * whose lifetime is bounded by a Solver call.
+ */
+class MemoryPool
+{
+public:
+    static const size_t hugePageSize = 2 * 1024 * 1024;
+
+    MemoryPool()
+    :   m_numSystemAllocs(0),
+        m_numRequests(0),
+        m_bytesReserved(0)
+    {}
+
+    ~MemoryPool() {release();}
+
+    void*   allocate(size_t bytes);
+    void    deallocate(void* ptr);
+    void    release();
+
+    int     getNumSystemAllocs() const  {return m_numSystemAllocs;}
+    int     getNumRequests() const      {return m_numRequests;}
+    size_t  getBytesReserved() const    {return m_bytesReserved;}
+
+    static MemoryPool*  current()       {return currentRef();}
+
+    /// Scope guard which makes a pool the current one.
+    /**
+     * Pooled vectors created by the calling thread while a Scope is alive
+     * draw their memory from the corresponding pool; other threads are not
+     * affected, so that solvers can be used concurrently from different
+     * threads. Scopes can be nested.
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(MemoryPool& pool)
+        :   m_prev(currentRef())
+        {
+            currentRef() = &pool;
+        }
+
+        // A null pool makes pooled vectors use the system allocator.
+        explicit Scope(MemoryPool* pool)
+        :   m_prev(currentRef())
+        {
+            currentRef() = pool;
+        }
+
+        ~Scope() {currentRef() = m_prev;}
+
+    private:
+        MemoryPool*  m_prev;
+
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+    };
+
+private:
+    typedef std::multimap<size_t, void*>  FreeBlocks;
+    typedef std::map<void*, size_t>       UsedBlocks;
+
+    FreeBlocks  m_free;
+    UsedBlocks  m_used;
+
+    int         m_numSystemAllocs;
+    int         m_numRequests;
+    size_t      m_bytesReserved;
+
+    static MemoryPool*& currentRef() {
+        static thread_local MemoryPool* pool = 0;
+        return pool;
+    }
+
+    static void*  systemAllocate(size_t bytes);
+    static void   systemFree(void* ptr);
+
+    MemoryPool(const MemoryPool&);
+    MemoryPool& operator=(const MemoryPool&);
+};
+
+
+/// Allocator drawing from a MemoryPool.
+/**
+ * This allocator captures the current MemoryPool at construction and can be
+ * used as the allocator of any thrust host vector. If no pool is current, it
+ * falls back to plain malloc/free.
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T               value_type;
+    typedef T*              pointer;
+    typedef const T*        const_pointer;
+    typedef T&              reference;
+    typedef const T&        const_reference;
+    typedef std::size_t     size_type;
+    typedef std::ptrdiff_t  difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    PoolAllocator() : m_pool(MemoryPool::current()) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : m_pool(other.getPool()) {}
+
+    pointer allocate(size_type n, const void* = 0) {
+        size_t bytes = n * sizeof(T);
+        void*  ptr   = m_pool ? m_pool->allocate(bytes) : std::malloc(bytes);
+        if (ptr == 0 && bytes > 0)
+            throw std::bad_alloc();
+        return static_cast<pointer>(ptr);
+    }
+
+    void deallocate(pointer p, size_type) {
+        if (m_pool)
+            m_pool->deallocate(p);
+        else
+            std::free(p);
+    }
+
+    void construct(pointer p, const T& val) {new (static_cast<void*>(p)) T(val);}
+    void destroy(pointer p)                 {p->~T();}
+
+    size_type max_size() const  {return std::numeric_limits<size_type>::max() / sizeof(T);}
+
+    pointer       address(reference x) const        {return &x;}
+    const_pointer address(const_reference x) const  {return &x;}
+
+    MemoryPool*   getPool() const {return m_pool;}
+
+private:
+    MemoryPool*  m_pool;
+};
+
+template <typename T, typename U>
+inline bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {return a.getPool() == b.getPool();}
+
+template <typename T, typename U>
+inline bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {return a.getPool() != b.getPool();}
+
+
+/// Host vector whose storage comes from the current MemoryPool.
+template <typename T>
+struct PooledVector
+{
+    typedef thrust::host_vector<T, PoolAllocator<T> >  type;
+};
+
+
+/**
+ * This function returns a block of at least the specified size. A cached
+ * block is reused if it is no more than twice as large as requested;
+ * otherwise a new block is obtained from the system.
+ */
+inline
+void*
+MemoryPool::allocate(size_t bytes)
+{
+    if (bytes == 0)
+        return 0;
+
+    void* ptr = 0;
+
+#pragma omp critical (sap_memory_pool)
+    {
+        m_numRequests++;
+
+        FreeBlocks::iterator it = m_free.lower_bound(bytes);
+
+        if (it != m_free.end() && it->first <= 2 * bytes) {
+            ptr = it->second;
+            m_used[ptr] = it->first;
+            m_free.erase(it);
+        } else {
+            size_t blockSize = (bytes >= hugePageSize)
+                             ? (bytes + hugePageSize - 1) / hugePageSize * hugePageSize
+                             : bytes;
+
+            ptr = systemAllocate(blockSize);
+
+            if (ptr) {
+                m_used[ptr] = blockSize;
+                m_numSystemAllocs++;
+                m_bytesReserved += blockSize;
+            }
+        }
+    }
+
+    return ptr;
+}
+
+/**
+ * This function returns a block to the pool. Pointers which were not
+ * obtained from this pool are ignored.
+ */
+inline
+void
+MemoryPool::deallocate(void* ptr)
+{
+    if (ptr == 0)
+        return;
+
+#pragma omp critical (sap_memory_pool)
+    {
+        UsedBlocks::iterator it = m_used.find(ptr);
+
+        if (it != m_used.end()) {
+            m_free.insert(FreeBlocks::value_type(it->second, ptr));
+            m_used.erase(it);
+        }
+    }
+}
+
+/**
+ * This function gives all cached (i.e. currently unused) blocks back to
+ * the system.
+ */
+inline
+void
+MemoryPool::release()
+{
+#pragma omp critical (sap_memory_pool)
+    {
+        for (FreeBlocks::iterator it = m_free.begin(); it != m_free.end(); ++it) {
+            systemFree(it->second);
+            m_bytesReserved -= it->first;
+        }
+        m_free.clear();
+    }
+}
+
+inline
+void*
+MemoryPool::systemAllocate(size_t bytes)
+{
+#ifndef WIN32
+    if (bytes >= hugePageSize) {
+        void* ptr = 0;
+        if (posix_memalign(&ptr, hugePageSize, bytes) != 0)
+            return 0;
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+        return ptr;
+    }
+#endif
+    return std::malloc(bytes);
+}
+
+inline
+void
+MemoryPool::systemFree(void* ptr)
+{
+    std::free(ptr);
+}
+
+
+} // namespace sap
+
+
+#endif
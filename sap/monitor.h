@@ -42,6 +42,7 @@ public:
 	//   (2) the given residual has norm below the tolerance (code = 1)
 	//   (3) the given residual has norm NaN (code = -2)
 	//   (4) the iteration limit was reached (code = -1)
+	//   (5) the cancel flag was set (code = -4)
 	// Otherwise, return false (code = 0) to continue iterations.
 	virtual bool finished(const SolverVector& r);
 	virtual bool finished(SolverValueType rNorm);
@@ -55,6 +56,10 @@ public:
 		m_message = message;
 	}
 
+	// Shared flag which, once set (to a nonzero value) by another thread,
+	// makes the solver stop with code -4. Used to cancel concurrent solves.
+	virtual void setCancelFlag(int* flag) {m_cancel = flag;}
+
 	// Increment the iteration count by the specified value.
 	virtual void increment(float incr) {m_iterations += incr;}
 
@@ -68,6 +73,10 @@ public:
 	virtual SolverValueType    getTolerance() const       {return m_absTol + m_relTol * m_rhsNorm;}
 	virtual SolverValueType    getRHSNorm() const         {return m_rhsNorm;}
 
+	// Inner product and norm used for all reductions in the Krylov solver.
+	virtual SolverValueType    dot(const SolverVector& a, const SolverVector& b) const {return cusp::blas::dotc(a, b);}
+	virtual SolverValueType    norm(const SolverVector& v) const                    {return cusp::blas::nrm2(v);}
+
 	virtual bool               converged() const          {return m_code > 0;}
 	virtual size_t             iteration_count()  const   {return (size_t)(m_iterations + 0.5f);}
 	virtual float              getNumIterations() const   {return m_iterations;}
@@ -87,6 +96,17 @@ private:
 
 	int              m_code;
 	std::string      m_message;
+
+	int*             m_cancel;
+
+	bool cancelled() const {
+		if (!m_cancel)
+			return false;
+		int flag;
+#pragma omp atomic read
+		flag = *m_cancel;
+		return flag != 0;
+	}
 };
 
 
@@ -103,7 +123,8 @@ Monitor<SolverVector>::Monitor(const int              maxIterations,
 	m_absTol(absTol),
 	m_iterations(0),
 	m_code(0),
-	m_message("")
+	m_message(""),
+	m_cancel(0)
 {
 }
 
@@ -114,7 +135,7 @@ template <typename SolverVector>
 inline void
 Monitor<SolverVector>::init(const SolverVector& rhs)
 {
-	m_rhsNorm = cusp::blas::nrm2(rhs);
+	m_rhsNorm = norm(rhs);
 	m_iterations = 0;
 	m_code = 0;
 	m_message = "";
@@ -127,7 +148,7 @@ template <typename SolverVector>
 inline bool
 Monitor<SolverVector>::finished(const SolverVector& r)
 {
-	return finished(cusp::blas::nrm2(r));
+	return finished(norm(r));
 }
 
 template <typename SolverVector>
@@ -142,6 +163,7 @@ Monitor<SolverVector>::finished(SolverValueType rNorm)
 	if (isnan(m_rNorm))                      stop(-2, "Residual norm is NaN");
 	else if (m_rNorm <= getTolerance())      stop( 1, "Converged");
 	else if (m_iterations > m_maxIterations) stop(-1, "Maximum number of iterations was reached");
+	else if (cancelled())                    stop(-4, "Cancelled");
 
 	return m_code != 0;
 }
@@ -171,6 +193,7 @@ public:
 	//   (2) the given residual has norm below the tolerance (code = 1)
 	//   (3) the given residual has norm NaN (code = -2)
 	//   (4) the iteration limit was reached (code = -1)
+	//   (5) the cancel flag was set (code = -4)
 	// Otherwise, return false (code = 0) to continue iterations.
 	virtual bool finished(const SolverVector& r);
 	virtual bool finished(SolverValueType rNorm);
@@ -180,6 +203,7 @@ public:
         }
         
         if (m_iterations > m_maxIterations) stop(-1, "Maximum number of iterations was reached");
+        else if (cancelled())               stop(-4, "Cancelled");
         return m_code != 0;
     }
 
@@ -195,6 +219,10 @@ public:
 		m_message = message;
 	}
 
+	// Shared flag which, once set (to a nonzero value) by another thread,
+	// makes the solver stop with code -4. Used to cancel concurrent solves.
+	virtual void setCancelFlag(int* flag) {m_cancel = flag;}
+
 	// Increment the iteration count by the specified value.
 	virtual void increment(float incr) {m_iterations += incr;}
 
@@ -238,6 +266,17 @@ private:
 
 	int              m_code;
 	std::string      m_message;
+
+	int*             m_cancel;
+
+	bool cancelled() const {
+		if (!m_cancel)
+			return false;
+		int flag;
+#pragma omp atomic read
+		flag = *m_cancel;
+		return flag != 0;
+	}
 };
 
 
@@ -259,7 +298,8 @@ BiCGStabLMonitor<SolverVector>::BiCGStabLMonitor(const int              maxItera
 	m_absTol(absTol),
 	m_iterations(0),
 	m_code(0),
-	m_message("")
+	m_message(""),
+	m_cancel(0)
 {
 }
 
@@ -299,6 +339,7 @@ BiCGStabLMonitor<SolverVector>::finished(SolverValueType rNorm)
 	if (isnan(m_rNorm))                      stop(-2, "Residual norm is NaN");
 	else if (m_rNorm <= getTolerance())      stop( 1, "Converged");
 	else if (m_iterations > m_maxIterations) stop(-1, "Maximum number of iterations was reached");
+	else if (cancelled())                    stop(-4, "Cancelled");
     else {
         if (m_stag >= m_maxStagSteps && m_moreSteps == 0) {
             m_stag = 0;
@@ -0,0 +1,258 @@
+/** \file multishift.h
+ *  \brief Multi-shift BiCGStab solver for families of shifted linear systems.
+ */
+
+#ifndef SAP_MULTISHIFT_H
+#define SAP_MULTISHIFT_H
+
+#include <vector>
+#include <cmath>
+
+#ifdef   USE_OLD_CUSP
+#include <cusp/blas.h>
+#else
+#include <cusp/blas/blas.h>
+#endif
+#include <cusp/multiply.h>
+#include <cusp/array1d.h>
+#include <cusp/linear_operator.h>
+
+#include <thrust/for_each.h>
+#include <thrust/iterator/zip_iterator.h>
+
+#include <sap/monitor.h>
+
+
+namespace sap {
+
+/// Shifted linear operator.
+/**
+ * This class implements the operator v -> Op*v + shift*v, where Op is any
+ * operator that can be applied through cusp::multiply() (an SPMV functor or
+ * a preconditioner).
+ *
+ * \tparam Operator is the type of the underlying operator.
+ * \tparam Vector is the vector type the operator is applied to.
+ */
+template <typename Operator, typename Vector>
+class ShiftedOperator : public cusp::linear_operator<typename Vector::value_type, typename Vector::memory_space>
+{
+public:
+	typedef typename cusp::linear_operator<typename Vector::value_type, typename Vector::memory_space> Parent;
+	typedef typename Vector::value_type  ValueType;
+
+	ShiftedOperator(Operator& op, int n, ValueType shift)
+	:	Parent(n, n),
+		m_op(op),
+		m_shift(shift)
+	{}
+
+	ValueType getShift() const  {return m_shift;}
+
+	template <typename Array>
+	void operator()(const Array& v,
+	                Array&       Av)
+	{
+		cusp::multiply(m_op, v, Av);
+		if (m_shift != ValueType(0))
+			cusp::blas::axpy(v, Av, m_shift);
+	}
+
+private:
+	Operator&  m_op;
+	ValueType  m_shift;
+};
+
+
+namespace detail {
+
+/**
+ * This functor performs the updates of one shifted system in a single pass
+ * over the tuple (x, p, r, r_old, s):
+ *   x <- x + a * p + cs * s,
+ *   p <- b * p + cr * r + co * r_old + cq * s.
+ */
+template <typename ValueType>
+struct ShiftedUpdate
+{
+	ValueType m_a, m_cs, m_b, m_cr, m_co, m_cq;
+
+	ShiftedUpdate(ValueType a, ValueType cs, ValueType b, ValueType cr, ValueType co, ValueType cq)
+	:	m_a(a), m_cs(cs), m_b(b), m_cr(cr), m_co(co), m_cq(cq) {}
+
+	template <typename Tuple>
+	__host__ __device__
+	void operator() (Tuple t) const
+	{
+		ValueType p = thrust::get<1>(t);
+		ValueType s = thrust::get<4>(t);
+
+		thrust::get<0>(t) += m_a * p + m_cs * s;
+		thrust::get<1>(t)  = m_b * p + m_cr * thrust::get<2>(t) + m_co * thrust::get<3>(t) + m_cq * s;
+	}
+};
+
+} // namespace detail
+
+
+/// Multi-shift BiCGStab method
+/**
+ * This function solves the family of systems (K + shifts[i] * I) x[i] = b,
+ * i = 0, ..., shifts.size()-1, with a single BiCGStab iteration on the seed
+ * system K * x = b. BiCGStab residuals of shifted systems are collinear with
+ * the seed residuals (the stabilizing polynomials are chosen accordingly),
+ * so each shifted system only costs scalar recurrences and one fused vector
+ * update per iteration; the operator K is applied twice per iteration,
+ * regardless of the number of shifts.
+ *
+ * A shifted system stops being updated as soon as its (recursively computed)
+ * residual norm is below the monitor tolerance; the iteration stops when all
+ * systems have converged. Each x[i] is resized and its initial guess is zero.
+ *
+ * \tparam LinearOperator is the seed operator K.
+ * \tparam Vector is the vector type for the linear system solutions.
+ * \tparam Monitor is the convergence test object.
+ */
+template <typename LinearOperator, typename Vector, typename Monitor>
+void bicgstabShifted(LinearOperator&                                     K,
+                     std::vector<Vector>&                                x,
+                     const Vector&                                       b,
+                     const std::vector<typename Vector::value_type>&     shifts,
+                     Monitor&                                            monitor)
+{
+	typedef typename Vector::value_type   ValueType;
+	typedef typename Vector::memory_space MemorySpace;
+
+	typedef typename cusp::array1d<ValueType, MemorySpace>  WorkVector;
+
+	int  n  = b.size();
+	int  ns = shifts.size();
+
+	x.resize(ns);
+
+	std::vector<WorkVector>  p(ns);
+
+	for (int i = 0; i < ns; i++) {
+		x[i].resize(n);
+		cusp::blas::fill(x[i], ValueType(0));
+		p[i] = b;
+	}
+
+	// Scalars of the shifted systems: pi_n = R_n(-shift) is the value of the
+	// BiCG residual polynomial, theta_n the value of the stabilizing
+	// polynomial; the residual of system i is r / (theta[i] * pi[i]).
+	std::vector<ValueType>  pi(ns, ValueType(1));
+	std::vector<ValueType>  pi_old(ns, ValueType(1));
+	std::vector<ValueType>  theta(ns, ValueType(1));
+	std::vector<bool>       active(ns, true);
+
+	WorkVector  r(b);
+	WorkVector  r_old(n);
+	WorkVector  sp(b);
+	WorkVector  s(n);
+	WorkVector  v(n);
+	WorkVector  t(n);
+
+	ValueType rho     = cusp::blas::dotc(b, r);
+	ValueType alpha_old = ValueType(1);
+	ValueType beta_old  = ValueType(0);
+	ValueType r_norm  = cusp::blas::nrm2(r);
+	ValueType res_max = r_norm;
+
+	while (!monitor.finished(res_max)) {
+		// v <- K * p
+		cusp::multiply(K, sp, v);
+
+		ValueType rv = cusp::blas::dotc(b, v);
+
+		if (rv == 0) {
+			monitor.stop(-10, "Breakdown: (r0, Kp) is zero");
+			break;
+		}
+
+		ValueType alpha = rho / rv;
+
+		// s <- r - alpha * v,   t <- K * s
+		cusp::blas::axpby(r, v, s, ValueType(1), -alpha);
+		cusp::multiply(K, s, t);
+
+		ValueType tt = cusp::blas::dotc(t, t);
+
+		if (tt == 0) {
+			monitor.stop(-11, "Breakdown: Ks is zero");
+			break;
+		}
+
+		ValueType omega = cusp::blas::dotc(t, s) / tt;
+
+		// r <- s - omega * t
+		cusp::blas::copy(r, r_old);
+		cusp::blas::axpby(s, t, r, ValueType(1), -omega);
+
+		ValueType rho_new = cusp::blas::dotc(b, r);
+		ValueType beta    = (alpha / omega) * (rho_new / rho);
+
+		r_norm  = cusp::blas::nrm2(r);
+		res_max = 0;
+
+		for (int i = 0; i < ns; i++) {
+			if (!active[i])
+				continue;
+
+			ValueType sigma = shifts[i];
+			ValueType c     = alpha * beta_old / alpha_old;
+			ValueType pi_new = (1 + c + alpha * sigma) * pi[i] - c * pi_old[i];
+
+			if (pi_new == 0) {
+				monitor.stop(-12, "Breakdown of a shifted system");
+				break;
+			}
+
+			ValueType alpha_s   = alpha * pi[i] / pi_new;
+			ValueType beta_s    = beta * (pi[i] / pi_new) * (pi[i] / pi_new);
+			ValueType omega_s   = omega / (1 + omega * sigma);
+			ValueType theta_new = theta[i] * (1 + omega * sigma);
+
+			// x_i <- x_i + alpha_s * p_i + omega_s * s_i
+			// p_i <- r_i + beta_s * (p_i - omega_s * (r_old_i - s_i) / alpha_s)
+			// where r_i, r_old_i and s_i are the (scaled) seed vectors.
+			ValueType cs = omega_s / (theta[i] * pi_new);
+			ValueType cr = 1 / (theta_new * pi_new);
+			ValueType co = -beta_s * omega_s / (alpha_s * theta[i] * pi[i]);
+			ValueType cq =  beta_s * omega_s / (alpha_s * theta[i] * pi_new);
+
+			thrust::for_each(thrust::make_zip_iterator(thrust::make_tuple(x[i].begin(), p[i].begin(), r.begin(), r_old.begin(), s.begin())),
+			                 thrust::make_zip_iterator(thrust::make_tuple(x[i].end(), p[i].end(), r.end(), r_old.end(), s.end())),
+			                 detail::ShiftedUpdate<ValueType>(alpha_s, cs, beta_s, cr, co, cq));
+
+			pi_old[i] = pi[i];
+			pi[i]     = pi_new;
+			theta[i]  = theta_new;
+
+			ValueType res = r_norm / std::abs(theta_new * pi_new);
+
+			if (res <= monitor.getTolerance())
+				active[i] = false;
+			else if (res > res_max || std::isnan(res))
+				res_max = res;
+		}
+
+		// p <- r + beta * (p - omega * v)
+		cusp::blas::axpby(sp, v, sp, ValueType(1), -omega);
+		cusp::blas::axpby(r, sp, sp, ValueType(1), beta);
+
+		rho       = rho_new;
+		alpha_old = alpha;
+		beta_old  = beta;
+
+		++monitor;
+	}
+}
+
+
+
+} // namespace sap
+
+
+
+#endif
@@ -6,8 +6,11 @@
 #define SAP_PRECOND_CUH
 
 #include <sap/banded_matrix.h>
+#include <sap/assembler.h>
 #include <sap/common.h>
 #include <sap/graph.h>
+#include <sap/low_rank.h>
+#include <sap/memory_planner.h>
 #include <sap/strided_range.h>
 #include <sap/segmented_matrix.h>
 #include <sap/timer.h>
@@ -19,6 +22,8 @@
 #include <sap/device/inner_product.cuh>
 #include <sap/device/shuffle.cuh>
 #include <sap/device/data_transfer.cuh>
+#include <sap/device/polynomial.cuh>
+#include <sap/device/schwarz.cuh>
 
 #ifdef   USE_OLD_CUSP
 #include <cusp/blas.h>
@@ -28,13 +33,20 @@
 #include <cusp/format_utils.h>
 #endif
 
+#include <cusp/multiply.h>
 #include <cusp/print.h>
+#include <cusp/transpose.h>
 
 #include <thrust/logical.h>
 #include <thrust/functional.h>
+#include <thrust/reduce.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/discard_iterator.h>
+#include <thrust/iterator/transform_iterator.h>
 
 #include <omp.h>
 #include <queue>
+#include <random>
 #include <vector>
 #include <functional>
 #include <stdlib.h>
@@ -100,7 +112,21 @@ public:
             bool                trackReordering,
             bool                use_bcr,
             int                 ilu_level,
-            PrecValueType       tolerance);
+            PrecValueType       tolerance,
+            size_t              memoryBudget = 0,
+            PolynomialType      polyType = Chebyshev,
+            int                 polyDegree = 8,
+            int                 polyEigSteps = 10,
+            int                 overlap = 0,
+            int                 iluSweeps = 0,
+            int                 iluTriSweeps = 0,
+            bool                iluMulticolor = false,
+            bool                hostCholesky = false,
+            double              spikeTol = 0,
+            bool                dropOffPerPartition = false,
+            bool                hostSpikes = false,
+            bool                supervariables = false,
+            bool                sparseRHS = false);
 
     Precond(const Precond&  prec);
 
@@ -132,6 +158,7 @@ public:
     double gettimeAssembly() const        {return m_time_assembly;}
     double getTimeFullLU() const          {return m_time_fullLU;}
     double getTimeShuffle() const         {return m_time_shuffle;}
+    double getTimeSecondLevel() const     {return m_time_secondLevel;}
 
     double getTimeBCRLU() const           {return m_time_bcr_lu;}
     double getTimeBCRSweepDeflation() const {return m_time_bcr_sweep_deflation;}
@@ -140,14 +167,27 @@ public:
     double getTimeBCRMVInflation() const  {return m_time_bcr_mv_inflation;}
 
     int    getBandwidthReordering() const {return m_k_reorder;}
+    int    getNumSupervariables() const   {return m_numSupervariables;}
     int    getBandwidthDB() const       {return m_k_db;}
     int    getBandwidth() const           {return m_k;}
 
+    PreconditionerType getPrecondType() const {return m_precondType;}
     int    getNumPartitions() const       {return m_numPartitions;}
     double getActualDropOff() const       {return (double) m_dropOff_actual;}
+    bool   isExact() const;
 
     int    getActualNumNonZeros() const   {return m_actual_nnz;}
 
+    double getPolyLambdaMin() const       {return m_polyLambdaMin;}
+    double getPolyLambdaMax() const       {return m_polyLambdaMax;}
+
+    int    getNumColors() const           {return m_colorOffsets.size() > 0 ? (int) m_colorOffsets.size() - 1 : 0;}
+
+    double getAverageSpikeRank() const    {return m_compressedSpikes.getAverageRank();}
+
+    const MemoryPlan& getMemoryPlan() const {return m_memPlan;}
+    size_t getMemoryPeak() const          {return m_mem_peak;}
+
     //// NOTE:  Matrix here will usually be PrecMatrixCooH, except
     ////        when there's a single component when it will be whatever
     ////        the user passes to Solver::setup().
@@ -155,12 +195,54 @@ public:
     void   setup(const Matrix&  A);
 
     void   update(const PrecVector& entries);
+    void   update(const ElementAssembler<PrecValueType>& assembler);
+
+    template <typename Matrix>
+    void   setupAssembler(const Matrix&                     A,
+                          const IntVectorH&                 connectivity,
+                          int                               nodesPerElement,
+                          ElementAssembler<PrecValueType>&  assembler);
 
     void   solve(PrecVector& v, PrecVector& z);
 
     template <typename SolverVector>
     void   operator()(const SolverVector& v, SolverVector& z);
 
+    void   solveTranspose(PrecVector& v, PrecVector& z);
+
+    template <typename SolverVector>
+    void   applyTranspose(const SolverVector& v, SolverVector& z);
+
+    bool   hasTranspose() const;
+
+    bool   canApplyConcurrently() const;
+    void   reserveWorkspaces(int numWorkspaces);
+
+    /// Scope guard selecting the workspace of the calling thread.
+    /**
+     * While a WorkspaceScope is alive, the applies of any preconditioner of
+     * this type on the calling thread use the specified workspace, which
+     * must have been allocated with reserveWorkspaces(). Threads applying
+     * the same preconditioner concurrently must select different ones.
+     */
+    class WorkspaceScope
+    {
+    public:
+        explicit WorkspaceScope(int index)
+        :   m_prev(currentWorkspace())
+        {
+            currentWorkspace() = index;
+        }
+
+        ~WorkspaceScope() {currentWorkspace() = m_prev;}
+
+    private:
+        int  m_prev;
+
+        WorkspaceScope(const WorkspaceScope&);
+        WorkspaceScope& operator=(const WorkspaceScope&);
+    };
+
 private:
     int                  m_numPartitions;
     int                  m_n;
@@ -176,6 +258,7 @@ private:
     bool                 m_dbFirstStageOnly;
     bool                 m_scale;
     PrecValueType        m_dropOff_frac;
+    bool                 m_dropOffPerPartition;   // spend the drop-off budget separately on each diagonal block?
     int                  m_maxBandwidth;
     int                  m_gpuCount;
     FactorizationMethod  m_factMethod;
@@ -187,12 +270,54 @@ private:
 
     int                  m_ilu_level;
     PrecValueType        m_tolerance;
+    int                  m_iluSweeps;             // sweeps of the iterative ILU(0) (0 for the exact factorization)
+    int                  m_iluTriSweeps;          // Jacobi iterations per triangular solve (0 for exact sweeps)
+    PrecVectorH          m_iluFactors;            // iterative ILU(0): L and U (unscaled) from the last factorization
+    IntVectorH           m_iluMap;                // iterative ILU(0): position in m_Acsrh of every matrix entry
+    bool                 m_iluMulticolor;         // use the multicolor ordering (instead of Sloan) for ILU(0)?
+    IntVectorH           m_colorOffsets;          // multicolor ordering: first row of every color (plus the end)
+
+    bool                 m_hostCholesky;          // factor and sweep SPD banded matrices (half storage) on the host?
+    bool                 m_hostSpikes;            // calculate the sparse spikes (ILU-SPIKE) on the host?
+    bool                 m_supervariables;        // reorder the graph of the supervariables (rows with identical patterns)?
+    int                  m_numSupervariables;     // number of supervariables reordered (0 if not compressed)
+
+    bool                 m_sparseRHS;             // skip the partitions not reached by the right-hand side in the sweeps?
+
+    PrecValueType        m_spikeTol;              // relative tolerance of the spike compression (0 if not compressed)
+    CompressedSpikes<PrecValueType>  m_compressedSpikes;  // compressed reduced matrix (replaces m_R)
+    IntVector            m_interfaceRows;         // rows of the reduced system, 2*k per interface
+
+    size_t               m_memoryBudget;          // memory budget for setup (0 if unlimited)
+    MemoryPlan           m_memPlan;               // predicted memory use of setup
+    size_t               m_mem_free_start;        // free device memory when setup started
+    size_t               m_mem_peak;              // measured peak device memory used by setup
+
+    // Used by the polynomial preconditioner only
+    PolynomialType       m_polyType;              // Chebyshev or Neumann polynomial
+    int                  m_polyDegree;            // polynomial degree (number of SpMVs per apply)
+    int                  m_polyEigSteps;          // number of Arnoldi steps for the spectral bounds
+    double               m_polyLambdaMin;         // estimated lower bound of the spectrum of D^{-1} A
+    double               m_polyLambdaMax;         // estimated upper bound of the spectrum of D^{-1} A
+    PrecMatrixCsr        m_polyA;                 // reordered and scaled matrix
+    PrecVector           m_polyDinv;              // inverse of the diagonal of m_polyA
+
+    // Used by the restricted additive Schwarz preconditioner only
+    int                  m_overlap;               // requested overlap (number of rows on either side)
+    int                  m_schwarzN;              // size of the system of overlapping blocks
+    IntVector            m_schwarzExtMap;         // row of the original system for every row of the blocks
+    IntVector            m_schwarzResMap;         // row of the blocks owning every row of the original system
+
+    // Used by the approximate inverse preconditioner only
+    PrecMatrixCsr        m_aiM;                   // SPAI: M ~ inv(A);  FSAI: G, with G^T G ~ inv(A)
+    PrecMatrixCsr        m_aiMt;                  // FSAI: G^T
 
     MatrixMap            m_offDiagMap;
     MatrixMap            m_WVMap;
     MatrixMap            m_typeMap;
     MatrixMap            m_bandedMatMap;
     MatrixMapF           m_scaleMap;
+    IntVectorH           m_nonzeroMap;            // position, after dropping explicit zeros, of every entry of the setup matrix (-1 if zero)
 
     // Used in variable-bandwidth method only, host versions
     IntVectorH           m_ks_host;
@@ -232,8 +357,6 @@ private:
     PrecVector           m_dbRowScale;            // DB row scaling
     PrecVector           m_dbColScale;            // DB col scaling
 
-    PrecVector           m_buffer;
-    PrecVector           m_buffer2;
     std::vector<PrecVector>   m_buffers;
 
     std::vector<PrecVector>   m_all_Bs;               // For multi-GPU only
@@ -252,7 +375,7 @@ private:
 
     PrecVector           m_B;                     // banded matrix (LU factors)
     PrecVector           m_B2;                    // banded matrix (LU factors)
-    PrecVectorH          m_Bh;                    // FIXME: currently for hacking purpose only, to be removed
+    PrecVectorH          m_Bh;                    // host copy of the banded factors (host LDL^T factorization)
     PrecVector           m_offDiags;              // contains the off-diagonal blocks of the original banded matrix
     PrecVector           m_R;                     // diagonal blocks in the reduced matrix (LU factors)
     PrecMatrixCsrH       m_Acsrh;
@@ -279,8 +402,44 @@ private:
     void updateRHS(PrecVector& rhs, bool upper) const;
 
     // Temporary vectors used in preconditioner solve (to support mixed-precision).
-    PrecVector           m_vp;                    // copy of specified RHS vector
-    PrecVector           m_zp;                    // copy of solution vector
+    // The factors are only read by an apply, so concurrent applies are safe
+    // as long as each uses its own workspace (see WorkspaceScope).
+    struct Workspace
+    {
+        PrecVector       vp;                      // copy of specified RHS vector
+        PrecVector       zp;                      // copy of solution vector
+        PrecVector       buffer2;
+        PrecVectorH      vh;                      // host copy of the vector swept on the host
+        PrecVectorH      jacobiB;                 // Jacobi triangular solves: right-hand side
+        PrecVectorH      jacobiY;                 // Jacobi triangular solves: next iterate
+        PrecVector       interfaceBuf;            // values of the reduced system unknowns
+        PrecVectorH      interfaceBufH;           // host copy of interfaceBuf
+        PrecVectorH      spikeWork;               // per-thread work space of CompressedSpikes::solve()
+        IntVector        rhsPartMask;             // sparse RHS: partitions with a nonzero right-hand side
+        IntVector        rhsInterfaceMask;        // sparse RHS: interfaces with a nonzero reduced right-hand side
+        IntVector        rhsPurifiedMask;         // sparse RHS: partitions with a nonzero purified right-hand side
+        PrecVector       polyR;                   // work vectors for the polynomial apply
+        PrecVector       polyD;
+        PrecVector       polyD2;
+        PrecVector       schwarzBuffer;           // right-hand side / solution of the overlapping blocks
+        PrecVector       aiBuffer;                // work vector for the FSAI apply
+    };
+
+    std::vector<Workspace>  m_workspaces;         // m_workspaces[0] is also used by setup()
+
+    Workspace&  workspace()  {return m_workspaces[currentWorkspace()];}
+
+    static int& currentWorkspace() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    // Thread count for the host loops of setup and apply: all processors, or
+    // the calling racer's share (see Solver::raceKrylov()) inside a parallel
+    // region. Passed as a num_threads clause so the global ICV is untouched.
+    static int hostThreads() {
+        return omp_in_parallel() ? omp_get_max_threads() : omp_get_num_procs();
+    }
 
     GPUTimer             m_timer;
     double               m_time_DB;               // CPU time for DB reordering
@@ -303,6 +462,7 @@ private:
     double               m_time_assembly;         // GPU time for assembling the reduced matrix
     double               m_time_fullLU;           // GPU time for LU factorization of reduced matrix
     double               m_time_shuffle;          // cumulative GPU time for permutation and scaling
+    double               m_time_secondLevel;      // CPU time for second-level reordering (part of m_time_reorder)
 
     double               m_time_bcr_lu;
     double               m_time_bcr_sweep_deflation;
@@ -310,6 +470,12 @@ private:
     double               m_time_bcr_sweep_inflation;
     double               m_time_bcr_mv_inflation;
 
+    template <typename Matrix>
+    void toHostCsr(const Matrix& A, PrecMatrixCsrH& Acsrh, IntVectorH* nonzeroMap = 0, bool dropZeros = true);
+
+    bool hasSpikeCoupling() const;
+    void refactorize(PrecVector& mat_WV);
+
     template <typename Matrix>
     void transformToBandedMatrix(const Matrix&  A) {
         transformToBandedMatrix(A, A);
@@ -333,6 +499,60 @@ private:
     template <typename Matrix, typename Array>
     void convertToBandedMatrix(const Matrix&  A, const BandedMatrix<Array>&);
 
+    template <typename Matrix>
+    void setupPolynomial(const Matrix&  A) {
+        setupPolynomial(A, A);
+    }
+
+    template <typename Matrix>
+    void setupPolynomial(const Matrix&  A, const DoubleMatrixCsr&);
+
+    // The polynomial preconditioner needs the sparse matrix; for a matrix
+    // given in banded format, fall back to the block-diagonal preconditioner.
+    template <typename Matrix, typename Array>
+    void setupPolynomial(const Matrix&  A, const BandedMatrix<Array>&) {
+        m_precondType = Block;
+        if (m_reorder)
+            transformToBandedMatrix(A);
+        else
+            convertToBandedMatrix(A);
+    }
+
+    template <typename Matrix>
+    bool loadSparseMatrix(const Matrix& A, PrecMatrixCsrH& Acsrh);
+
+    void estimateSpectrum();
+    void polynomialSolve(PrecVector& rhs, PrecVector& sol);
+
+    template <typename Matrix>
+    void setupApproxInverse(const Matrix&  A) {
+        setupApproxInverse(A, A);
+    }
+
+    template <typename Matrix>
+    void setupApproxInverse(const Matrix&  A, const DoubleMatrixCsr&);
+
+    // The approximate inverse also needs the sparse matrix; for a matrix
+    // given in banded format, fall back to the block-diagonal preconditioner.
+    template <typename Matrix, typename Array>
+    void setupApproxInverse(const Matrix&  A, const BandedMatrix<Array>&) {
+        m_precondType = Block;
+        if (m_reorder)
+            transformToBandedMatrix(A);
+        else
+            convertToBandedMatrix(A);
+    }
+
+    void approxInverseSolve(PrecVector& rhs, PrecVector& sol);
+
+    static bool spaiRow(const PrecMatrixCsrH& A, int i, std::vector<int>& cols, std::vector<double>& work, PrecValueType* values);
+    static bool fsaiRow(const PrecMatrixCsrH& A, const std::vector<int>& cols, std::vector<double>& work, PrecValueType* values);
+
+    void assembleSchwarzBlocks();
+    void schwarzSolve(PrecVector& rhs, PrecVector& sol);
+
+    static void symmetricEigenRange(std::vector<double>& H, int m, double& lambdaMin, double& lambdaMax);
+
     void extractOffDiagonal(PrecVector& mat_WV);
 
     void partBandedLU();
@@ -347,6 +567,8 @@ private:
     );
 
     void partBlockedBandedCholesky_one();
+    bool useHostCholesky() const;
+    void partBandedCholeskyH();
     void partBlockedBandedCholesky_var(
         int                     n,
         int                     num_partitions,
@@ -383,9 +605,9 @@ private:
 
     void partBandedUL(PrecVector& B);
     void partBlockedBandedUL(PrecVector& B);
-    void sparseFactorization();
+    void sparseFactorization(bool warmStart = false);
 
-    void partBandedFwdSweep(PrecVector& v);
+    void partBandedFwdSweep(PrecVector& v, const int* active = 0);
     void partBandedFwdSweep_const(
         PrecVector&  v,
         int          n,
@@ -399,10 +621,11 @@ private:
         int          num_partitions,
         PrecVector&  B,
         IntVector&   ks,
-        IntVector&   b_offsets
+        IntVector&   b_offsets,
+        const int*   active = 0
     );
 
-    void partBandedBckSweep(PrecVector& v);
+    void partBandedBckSweep(PrecVector& v, const int* active = 0);
     void partBandedBckSweep_const(
         PrecVector&  v,
         int          n,
@@ -416,11 +639,15 @@ private:
         int          num_partitions,
         PrecVector&  B,
         IntVector&   ks,
-        IntVector&   b_offsets
+        IntVector&   b_offsets,
+        const int*   active = 0
     );
 
     void partBandedSweepsH(PrecVector& v);
+    void partBandedCholeskySweepsH(PrecVector& v);
     void sparseSweep(PrecVector& v, PrecVector& w);
+    void jacobiTriSolve(PrecVectorH& x, bool lower);
+    void multicolorSweep(PrecVectorH& x);
 
     void partFullLU();
     void partFullLU_const();
@@ -428,6 +655,8 @@ private:
     void partBlockedFullLU_var();
 
     void ILU0(PrecMatrixCsrH& Acsrh);
+    bool ILU0Row(int i, const IntVectorH& row_offsets, const IntVectorH& column_indices, PrecVectorH& values);
+    void iterativeILU0(PrecMatrixCsrH& Acsrh, bool warmStart);
     void ILUT(PrecMatrixCsrH& Acsrh, int p, PrecValueType tau);
     void ILUULT(PrecMatrixCsrH& Acsrh, PrecMatrixCsrH& Acsrh2, int p, PrecValueType tau);
     void ILUTP(PrecMatrixCsrH&    Acsrh,
@@ -437,9 +666,16 @@ private:
                IntVectorH&        perm,
                IntVectorH&        reordering);
 
-    void partFullFwdSweep(PrecVector& v);
-    void partFullBckSweep(PrecVector& v);
-    void purifyRHS(PrecVector& v, PrecVector& res);
+    void partFullFwdSweep(PrecVector& v, const int* active = 0);
+    void partFullBckSweep(PrecVector& v, const int* active = 0);
+    void purifyRHS(PrecVector& v, PrecVector& res, const int* active = 0);
+
+    bool useRHSMasks() const;
+    void computeRHSMasks(const PrecVector& v);
+
+    void partBandedSweepsTranspose(PrecVector& v);
+    void partFullSweepsTranspose(PrecVector& v);
+    void purifyRHSTranspose(PrecVector& v, PrecVector& res);
 
     void calculateSpikes(PrecVector& WV);
     void calculateSpikes_const(PrecVector& WV);
@@ -462,12 +698,16 @@ private:
         int                 left_count,
         int                 left_offset
     );
+    void spikeSweepsH(int leftOffDiagWidth, int rightOffDiagWidth, PrecVectorH& WV);
     void calculateSpikes_var_old(PrecVector& WV);
     void calculateSpikes(PrecVector& B2, PrecVector& WV);
 
     int adjustNumThreads(int inNumThreads);
 
     void assembleReducedMat(PrecVector& WV);
+    bool useCompressedSpikes() const;
+    void compressSpikes(PrecVector& WV);
+    void partFullSolve(PrecVector& v, const int* active = 0);
 
     void copyLastPartition(PrecVector& B2);
 
@@ -479,14 +719,19 @@ private:
         bool                       from
     );
 
-    void leftTrans(PrecVector& v, PrecVector& z);
-    void rightTrans(PrecVector& v, PrecVector& z);
+    template <typename VectorIn>
+    void leftTrans(const VectorIn& v, PrecVector& z);
+    template <typename VectorOut>
+    void rightTrans(PrecVector& v, VectorOut& z);
+    template <typename VectorOut>
+    void leftTransTranspose(PrecVector& v, VectorOut& z);
+    template <typename VectorIn>
+    void rightTransTranspose(const VectorIn& v, PrecVector& z);
     void permute(PrecVector& v, IntVector& perm, PrecVector& w);
-    void permuteAndScale(PrecVector& v, IntVector& perm, PrecVector& scale, PrecVector& w);
-    void scaleAndPermute(PrecVector& v, IntVector& perm, PrecVector& scale, PrecVector& w);
 
     void combinePermutation(IntVector& perm, IntVector& perm2, IntVector& finalPerm);
     void getSRev(PrecVector& rhs, PrecVector& sol);
+    void getSRevTranspose(PrecVector& rhs, PrecVector& sol);
 
     bool hasZeroPivots(const PrecVectorIterator& start_B,
                        const PrecVectorIterator& end_B,
@@ -500,6 +745,10 @@ private:
                     const PrecHIterator&         vend,
                     int                          p);
 
+    bool planMemory(int& maxBandwidth);
+    void startMemoryTracking();
+    void trackMemory();
+
     void saveCurDevice() {
         cudaGetDevice(&m_cur_device);
     }
@@ -510,15 +759,46 @@ private:
 };
 
 
+/// Transposed SaP preconditioner.
+/**
+ * This class wraps a Precond object so that cusp::multiply() applies the
+ * transposed preconditioner (see Precond::applyTranspose()). It allows the
+ * Krylov solvers to be used unchanged for systems with the transposed matrix.
+ *
+ * \tparam PrecondType is the type of the wrapped preconditioner.
+ */
+template <typename PrecondType>
+class PrecondTranspose
+{
+public:
+    typedef typename PrecondType::memory_space  memory_space;
+    typedef typename PrecondType::value_type    value_type;
+    typedef typename cusp::unknown_format       format;
+
+    PrecondTranspose(PrecondType& precond) : m_precond(precond) {}
+
+    template <typename SolverVector>
+    void operator()(const SolverVector& v, SolverVector& z)
+    {
+        m_precond.applyTranspose(v, z);
+    }
+
+private:
+    PrecondType&  m_precond;
+};
+
+
 // Functor objects 
 // 
 // TODO:  figure out why I cannot make these private to Precond...
 template<typename T>
 struct Multiply: public thrust::unary_function<T, T>
 {
+    // The factors are converted to T (they may be of a different precision).
+    template <typename Tuple>
     __host__ __device__
-    T operator() (thrust::tuple<T, T> tu) {
-        return thrust::get<0>(tu) * thrust::get<1>(tu);
+    T operator() (const Tuple& tu) const {
+        return T(thrust::get<0>(tu)) * T(thrust::get<1>(tu));
     }
 };
 
@@ -533,6 +813,29 @@ struct SmallerThan : public thrust::unary_function<T, bool>
     T  m_threshold;
 };
 
+template <typename T>
+struct IsNonzero : public thrust::unary_function<T, int>
+{
+    __host__ __device__
+    int operator()(T val) const {return val != T(0);}
+};
+
+// Maps a row index to its partition (the first 'remainder' partitions have
+// partSize + 1 rows, the others partSize rows).
+struct PartitionOf : public thrust::unary_function<int, int>
+{
+    PartitionOf(int partSize, int remainder) : m_partSize(partSize), m_remainder(remainder) {}
+
+    __host__ __device__
+    int operator()(int i) const {
+        int first = m_remainder * (m_partSize + 1);
+        return (i < first) ? i / (m_partSize + 1) : m_remainder + (i - first) / m_partSize;
+    }
+
+    int  m_partSize;
+    int  m_remainder;
+};
+
 
 /**
  * This is the constructor for the Precond class.
@@ -556,7 +859,21 @@ Precond<PrecVector>::Precond(int                 numPart,
                              bool                trackReordering,
                              bool                use_bcr,
                              int                 ilu_level,
-                             PrecValueType       tolerance)
+                             PrecValueType       tolerance,
+                             size_t              memoryBudget,
+                             PolynomialType      polyType,
+                             int                 polyDegree,
+                             int                 polyEigSteps,
+                             int                 overlap,
+                             int                 iluSweeps,
+                             int                 iluTriSweeps,
+                             bool                iluMulticolor,
+                             bool                hostCholesky,
+                             double              spikeTol,
+                             bool                dropOffPerPartition,
+                             bool                hostSpikes,
+                             bool                supervariables,
+                             bool                sparseRHS)
 :   m_numPartitions(numPart),
     m_isSPD(isSPD),
     m_saveMem(saveMem),
@@ -566,6 +883,7 @@ Precond<PrecVector>::Precond(int                 numPart,
     m_dbFirstStageOnly(dbFirstStageOnly),
     m_scale(scale),
     m_dropOff_frac((PrecValueType)dropOff_frac),
+    m_dropOffPerPartition(dropOffPerPartition),
     m_maxBandwidth(maxBandwidth),
     m_gpuCount(gpuCount),
     m_factMethod(factMethod),
@@ -576,6 +894,25 @@ Precond<PrecVector>::Precond(int                 numPart,
     m_use_bcr(use_bcr),
     m_ilu_level(ilu_level),
     m_tolerance(tolerance),
+    m_memoryBudget(memoryBudget),
+    m_mem_free_start(0),
+    m_mem_peak(0),
+    m_polyType(polyType),
+    m_polyDegree(polyDegree),
+    m_polyEigSteps(polyEigSteps),
+    m_polyLambdaMin(0),
+    m_polyLambdaMax(0),
+    m_overlap(overlap),
+    m_schwarzN(0),
+    m_iluSweeps(iluSweeps),
+    m_iluTriSweeps(iluTriSweeps),
+    m_iluMulticolor(iluMulticolor),
+    m_hostCholesky(hostCholesky),
+    m_hostSpikes(hostSpikes),
+    m_supervariables(supervariables),
+    m_numSupervariables(0),
+    m_sparseRHS(sparseRHS),
+    m_spikeTol(spikeTol),
     m_k_reorder(0),
     m_k_db(0),
     m_k(0),
@@ -597,12 +934,23 @@ Precond<PrecVector>::Precond(int                 numPart,
     m_time_assembly(0),
     m_time_fullLU(0),
     m_time_shuffle(0),
+    m_time_secondLevel(0),
     m_time_bcr_lu(0),
     m_time_bcr_sweep_deflation(0),
     m_time_bcr_mat_mul_deflation(0),
     m_time_bcr_sweep_inflation(0),
-    m_time_bcr_mv_inflation(0)
+    m_time_bcr_mv_inflation(0),
+    m_workspaces(1)
 {
+    // The overlapping blocks of the Schwarz preconditioner are factored with
+    // the constant-bandwidth banded LU on a single device.
+    if (m_precondType == Schwarz) {
+        m_saveMem = false;
+        m_variableBandwidth = false;
+        m_use_bcr = false;
+        m_ilu_level = -1;
+        m_gpuCount = 1;
+    }
 }
 
 /**
@@ -624,6 +972,26 @@ Precond<PrecVector>::Precond()
     m_dropOff_actual(0),
     m_maxBandwidth(std::numeric_limits<int>::max()),
     m_gpuCount(1),
+    m_memoryBudget(0),
+    m_mem_free_start(0),
+    m_mem_peak(0),
+    m_polyType(Chebyshev),
+    m_polyDegree(8),
+    m_polyEigSteps(10),
+    m_polyLambdaMin(0),
+    m_polyLambdaMax(0),
+    m_overlap(0),
+    m_schwarzN(0),
+    m_iluSweeps(0),
+    m_iluTriSweeps(0),
+    m_iluMulticolor(false),
+    m_hostCholesky(false),
+    m_hostSpikes(false),
+    m_supervariables(false),
+    m_numSupervariables(0),
+    m_sparseRHS(false),
+    m_spikeTol(0),
+    m_dropOffPerPartition(false),
     m_time_reorder(0),
     m_time_DB(0),
     m_time_DB_pre(0),
@@ -640,11 +1008,13 @@ Precond<PrecVector>::Precond()
     m_time_assembly(0),
     m_time_fullLU(0),
     m_time_shuffle(0),
+    m_time_secondLevel(0),
     m_time_bcr_lu(0),
     m_time_bcr_sweep_deflation(0),
     m_time_bcr_mat_mul_deflation(0),
     m_time_bcr_sweep_inflation(0),
-    m_time_bcr_mv_inflation(0)
+    m_time_bcr_mv_inflation(0),
+    m_workspaces(1)
 {
 }
 
@@ -653,7 +1023,11 @@ Precond<PrecVector>::Precond()
  */
 template <typename PrecVector>
 Precond<PrecVector>::Precond(const Precond<PrecVector> &prec)
-:   m_k_reorder(0),
+:   m_mem_free_start(0),
+    m_mem_peak(0),
+    m_polyLambdaMin(0),
+    m_polyLambdaMax(0),
+    m_k_reorder(0),
     m_k_db(0),
     m_k(0),
     m_dropOff_actual(0),
@@ -673,11 +1047,13 @@ Precond<PrecVector>::Precond(const Precond<PrecVector> &prec)
     m_time_assembly(0),
     m_time_fullLU(0),
     m_time_shuffle(0),
+    m_time_secondLevel(0),
     m_time_bcr_lu(0),
     m_time_bcr_sweep_deflation(0),
     m_time_bcr_mat_mul_deflation(0),
     m_time_bcr_sweep_inflation(0),
-    m_time_bcr_mv_inflation(0)
+    m_time_bcr_mv_inflation(0),
+    m_workspaces(1)
 {
     m_numPartitions      = prec.m_numPartitions;
 
@@ -689,6 +1065,7 @@ Precond<PrecVector>::Precond(const Precond<PrecVector> &prec)
     m_dbFirstStageOnly   = prec.m_dbFirstStageOnly;
     m_scale              = prec.m_scale;
     m_dropOff_frac       = prec.m_dropOff_frac;
+    m_dropOffPerPartition = prec.m_dropOffPerPartition;
     m_maxBandwidth       = prec.m_maxBandwidth;
     m_gpuCount           = prec.m_gpuCount;
     m_factMethod         = prec.m_factMethod;
@@ -698,6 +1075,20 @@ Precond<PrecVector>::Precond(const Precond<PrecVector> &prec)
     m_trackReordering    = prec.m_trackReordering;
     m_ilu_level          = prec.m_ilu_level;
     m_tolerance          = prec.m_tolerance;
+    m_memoryBudget       = prec.m_memoryBudget;
+    m_polyType           = prec.m_polyType;
+    m_polyDegree         = prec.m_polyDegree;
+    m_polyEigSteps       = prec.m_polyEigSteps;
+    m_overlap            = prec.m_overlap;
+    m_iluSweeps          = prec.m_iluSweeps;
+    m_iluTriSweeps       = prec.m_iluTriSweeps;
+    m_iluMulticolor      = prec.m_iluMulticolor;
+    m_hostCholesky       = prec.m_hostCholesky;
+    m_hostSpikes         = prec.m_hostSpikes;
+    m_supervariables     = prec.m_supervariables;
+    m_numSupervariables  = prec.m_numSupervariables;
+    m_sparseRHS          = prec.m_sparseRHS;
+    m_spikeTol           = prec.m_spikeTol;
     m_actual_nnz         = prec.m_actual_nnz;
 }
 
@@ -715,6 +1106,7 @@ Precond<PrecVector>::operator=(const Precond<PrecVector>& prec)
     m_dbFirstStageOnly   = prec.m_dbFirstStageOnly;
     m_scale              = prec.m_scale;
     m_dropOff_frac       = prec.m_dropOff_frac;
+    m_dropOffPerPartition = prec.m_dropOffPerPartition;
     m_maxBandwidth       = prec.m_maxBandwidth;
     m_gpuCount           = prec.m_gpuCount;
     m_factMethod         = prec.m_factMethod;
@@ -724,6 +1116,20 @@ Precond<PrecVector>::operator=(const Precond<PrecVector>& prec)
     m_trackReordering    = prec.m_trackReordering;
     m_ilu_level          = prec.m_ilu_level;
     m_tolerance          = prec.m_tolerance;
+    m_memoryBudget       = prec.m_memoryBudget;
+    m_polyType           = prec.m_polyType;
+    m_polyDegree         = prec.m_polyDegree;
+    m_polyEigSteps       = prec.m_polyEigSteps;
+    m_overlap            = prec.m_overlap;
+    m_iluSweeps          = prec.m_iluSweeps;
+    m_iluTriSweeps       = prec.m_iluTriSweeps;
+    m_iluMulticolor      = prec.m_iluMulticolor;
+    m_hostCholesky       = prec.m_hostCholesky;
+    m_hostSpikes         = prec.m_hostSpikes;
+    m_supervariables     = prec.m_supervariables;
+    m_numSupervariables  = prec.m_numSupervariables;
+    m_sparseRHS          = prec.m_sparseRHS;
+    m_spikeTol           = prec.m_spikeTol;
     m_actual_nnz         = prec.m_actual_nnz;
 
     m_k                        = prec.m_k;
@@ -754,6 +1160,33 @@ Precond<PrecVector>::update(const PrecVector& entries)
 {
     m_time_reorder = 0.0;
 
+    // With an ILU factorization, only the iterative ILU(0) can be updated:
+    // it is warm-started from the current factors.
+    if (m_ilu_level >= 0) {
+        if (m_iluMap.size() == 0)
+            throw system_error(system_error::Illegal_update, "Illegal call to update() with an ILU factorization other than the iterative ILU(0) on a single partition.");
+
+        CPUTimer    loc_timer;
+        PrecVectorH entries_h = entries;
+        MatrixMapFH scale_h   = m_scaleMap;
+
+        loc_timer.Start();
+        for (size_t e = 0; e < m_iluMap.size(); e++)
+            if (m_iluMap[e] >= 0)
+                m_Acsrh.values[m_iluMap[e]] = entries_h[e] * scale_h[e];
+        loc_timer.Stop();
+        m_time_cpu_assemble = loc_timer.getElapsed();
+
+        m_time_transfer = 0.0;
+
+        loc_timer.Start();
+        sparseFactorization(true);
+        loc_timer.Stop();
+        m_time_bandLU = loc_timer.getElapsed();
+
+        return;
+    }
+
     m_timer.Start();
 
 
@@ -771,11 +1204,89 @@ Precond<PrecVector>::update(const PrecVector& entries)
 
     m_time_transfer = 0.0;
 
+    // With Spike coupling, also extract the off-diagonal blocks into the
+    // array m_offDiags and the right-hand sides of the spikes into mat_WV.
+    PrecVector mat_WV;
+
+    if (hasSpikeCoupling()) {
+        mat_WV.resize(2 * m_k * m_k * (m_numPartitions-1));
+        cusp::blas::fill(m_offDiags, (PrecValueType) 0);
+
+        m_timer.Start();
+
+        thrust::scatter_if(
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.begin(), m_scaleMap.begin())), Multiply<PrecValueType>()),
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.end(), m_scaleMap.end())), Multiply<PrecValueType>()),
+                m_offDiagMap.begin(),
+                m_typeMap.begin(),
+                m_offDiags.begin(),
+                thrust::logical_not<int>()
+                );
+
+        thrust::scatter_if(
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.begin(), m_scaleMap.begin())), Multiply<PrecValueType>()),
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.end(), m_scaleMap.end())), Multiply<PrecValueType>()),
+                m_WVMap.begin(),
+                m_typeMap.begin(),
+                mat_WV.begin(),
+                thrust::logical_not<int>()
+                );
+        m_timer.Stop();
+        m_time_offDiags = m_timer.getElapsed();
+    }
+
+    refactorize(mat_WV);
+}
+
+/**
+ * This function indicates whether the preconditioner is (up to rounding) the
+ * exact inverse of the matrix used in setup(): a banded LU (or Cholesky) of a
+ * single partition from which nothing was dropped.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::isExact() const
+{
+    return (m_precondType == Spike || m_precondType == Block) && m_numPartitions == 1
+        && m_ilu_level < 0 && m_dropOff_actual == 0;
+}
+
+/**
+ * This function indicates whether the diagonal blocks are coupled through
+ * the truncated Spike reduced matrix, in which case the off-diagonal blocks
+ * are needed by the factorization.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::hasSpikeCoupling() const
+{
+    return m_k > 0 && m_numPartitions > 1 && m_precondType != Block && m_precondType != Schwarz;
+}
+
+/**
+ * This function recomputes the factorization after an update of the banded
+ * matrix m_B and, with Spike coupling, of the off-diagonal blocks m_offDiags
+ * and of the right-hand sides of the spikes mat_WV.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::refactorize(PrecVector&  mat_WV)
+{
     ////cusp::io::write_matrix_market_file(m_B, "B.mtx");
     if (m_k == 0) {
         return;
     }
 
+    if (m_precondType == Schwarz && m_numPartitions > 1) {
+        m_timer.Start();
+        assembleSchwarzBlocks();
+        partBlockedBandedLU_const(m_schwarzN, m_k, m_numPartitions, m_B);
+        m_timer.Stop();
+        m_time_bandLU = m_timer.getElapsed();
+
+        return;
+    }
+
     // If we are using a single partition, perform the LU factorization
     // of the banded matrix and return.
     if (m_precondType == Block || m_numPartitions == 1) {
@@ -792,36 +1303,7 @@ Precond<PrecVector>::update(const PrecVector& entries)
     
     // We are using more than one partition, so we must assemble the
     // truncated Spike reduced matrix R.
-    m_R.resize((2 * m_k) * (2 * m_k) * (m_numPartitions - 1));
-
-    // Extract off-diagonal blocks from the banded matrix and store them
-    // in the array m_offDiags.
-    PrecVector mat_WV;
-    mat_WV.resize(2 * m_k * m_k * (m_numPartitions-1));
-    cusp::blas::fill(m_offDiags, (PrecValueType) 0);
-
-    m_timer.Start();
-
-    thrust::scatter_if(
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.begin(), m_scaleMap.begin())), Multiply<PrecValueType>()),
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.end(), m_scaleMap.end())), Multiply<PrecValueType>()),
-            m_offDiagMap.begin(),
-            m_typeMap.begin(),
-            m_offDiags.begin(),
-            thrust::logical_not<int>()
-            );
-
-    thrust::scatter_if(
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.begin(), m_scaleMap.begin())), Multiply<PrecValueType>()),
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(entries.end(), m_scaleMap.end())), Multiply<PrecValueType>()),
-            m_WVMap.begin(),
-            m_typeMap.begin(),
-            mat_WV.begin(),
-            thrust::logical_not<int>()
-            );
-    m_timer.Stop();
-    m_time_offDiags = m_timer.getElapsed();
-
+    m_R.resize(useCompressedSpikes() ? 0 : (2 * m_k) * (2 * m_k) * (m_numPartitions - 1));
 
     switch (m_factMethod) {
     case LU_only:
@@ -899,6 +1381,130 @@ Precond<PrecVector>::update(const PrecVector& entries)
     ////cusp::io::write_matrix_market_file(m_R, "R_lu.mtx");
 }
 
+/**
+ * This function updates the preconditioner from the storage assembled by
+ * the specified element assembler (see setupAssembler()). The assembled
+ * banded matrix and off-diagonal blocks are copied as they are, so the
+ * scatter performed by update(entries) is skipped.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::update(const ElementAssembler<PrecValueType>&  assembler)
+{
+    if (m_ilu_level >= 0 || assembler.m_B.size() != m_B.size())
+        throw system_error(system_error::Illegal_update, "Illegal call to update() with an element assembler not set up for this preconditioner.");
+
+    m_time_reorder = 0.0;
+    m_time_cpu_assemble = 0.0;
+    m_time_offDiags = 0.0;
+
+    PrecVector mat_WV;
+
+    m_timer.Start();
+    thrust::copy(assembler.m_B.begin(), assembler.m_B.end(), m_B.begin());
+    if (hasSpikeCoupling()) {
+        thrust::copy(assembler.m_offDiags.begin(), assembler.m_offDiags.end(), m_offDiags.begin());
+        mat_WV = assembler.m_WV;
+    }
+    m_timer.Stop();
+    m_time_transfer = m_timer.getElapsed();
+
+    refactorize(mat_WV);
+}
+
+/**
+ * This function prepares the specified element assembler. The matrix A must
+ * have the sparsity pattern of the matrix used in setup(), with its entries
+ * in the same order (its values are not used), and setup() must have been
+ * performed with reordering tracking. For every entry of every element
+ * matrix, the position of the corresponding matrix entry is looked up in A
+ * (explicit zeros included) and mapped through the removal of the explicit
+ * zeros of the setup matrix; the result is composed with the reordering maps
+ * tracked during setup, giving its destination in the banded matrix or in
+ * the off-diagonal blocks, and its DB scaling factor. As with update(entries),
+ * entries which were explicitly zero in the setup matrix are not tracked and
+ * are not assembled.
+ */
+template <typename PrecVector>
+template <typename Matrix>
+void
+Precond<PrecVector>::setupAssembler(const Matrix&                     A,
+                                    const IntVectorH&                 connectivity,
+                                    int                               nodesPerElement,
+                                    ElementAssembler<PrecValueType>&  assembler)
+{
+    if (m_ilu_level >= 0 || m_typeMap.size() == 0)
+        throw system_error(system_error::Illegal_update, "Illegal call to setupAssembler() without tracked reordering of a banded preconditioner.");
+
+    PrecMatrixCsrH Acsrh;
+    toHostCsr(A, Acsrh, 0, false);
+
+    if ((size_t) Acsrh.num_entries != m_nonzeroMap.size())
+        throw system_error(system_error::Illegal_update, "Illegal call to setupAssembler() with a matrix pattern different from the one used in setup().");
+
+    MatrixMapH   typeMap      = m_typeMap;
+    MatrixMapH   bandedMatMap = m_bandedMatMap;
+    MatrixMapH   offDiagMap   = m_offDiagMap;
+    MatrixMapH   WVMap        = m_WVMap;
+    MatrixMapFH  scaleMap     = m_scaleMap;
+    const IntVectorH& nonzeroMap = m_nonzeroMap;
+
+    bool   coupling    = hasSpikeCoupling();
+    int    m           = nodesPerElement;
+    int    numElements = (m > 0 ? (int) (connectivity.size() / m) : 0);
+    size_t numEntries  = (size_t) numElements * m * m;
+
+    assembler.m_numElements     = numElements;
+    assembler.m_nodesPerElement = m;
+
+    assembler.m_destB.resize(numEntries);
+    assembler.m_destOffDiag.resize(numEntries);
+    assembler.m_destWV.resize(numEntries);
+    assembler.m_scale.resize(numEntries);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int e = 0; e < numElements; e++) {
+        for (int b = 0; b < m; b++) {
+            int col = connectivity[(size_t) e * m + b];
+
+            for (int a = 0; a < m; a++) {
+                int    row = connectivity[(size_t) e * m + a];
+                size_t idx = ((size_t) e * m + b) * m + a;
+
+                assembler.m_destB[idx]       = -1;
+                assembler.m_destOffDiag[idx] = -1;
+                assembler.m_destWV[idx]      = -1;
+                assembler.m_scale[idx]       = 0;
+
+                int l = Acsrh.row_offsets[row];
+                while (l < Acsrh.row_offsets[row + 1] && Acsrh.column_indices[l] != col)
+                    l++;
+
+                if (l == Acsrh.row_offsets[row + 1] || nonzeroMap[l] < 0)
+                    continue;
+
+                int p = nonzeroMap[l];
+
+                assembler.m_scale[idx] = scaleMap[p];
+
+                if (typeMap[p])
+                    assembler.m_destB[idx] = bandedMatMap[p];
+                else if (coupling) {
+                    assembler.m_destOffDiag[idx] = offDiagMap[p];
+                    assembler.m_destWV[idx]      = WVMap[p];
+                }
+            }
+        }
+    }
+
+    assembler.m_B.resize(m_B.size());
+    assembler.m_offDiags.resize(coupling ? m_offDiags.size() : 0);
+    assembler.m_WV.resize(coupling ? 2 * m_k * m_k * (m_numPartitions - 1) : 0);
+    assembler.zero();
+
+    assembler.color(connectivity, m_n);
+}
+
 /**
  * This function performs the initial preconditioner setup, based on the
  * specified matrix:
@@ -914,27 +1520,43 @@ Precond<PrecVector>::setup(const Matrix&  A)
 {
     m_n = A.num_rows;
 
+    m_time_secondLevel = 0;
+
     if (m_precondType == None)
         return;
 
+    startMemoryTracking();
+
     // Form the banded matrix based on the specified matrix, either through
     // transformation (reordering and drop-off) or straight conversion.
-    if (m_reorder)
+    // Note that the memory plan is made (and, if a memory budget was given,
+    // the setup parameters are adjusted) as soon as the half-bandwidth is known.
+    // The polynomial and approximate inverse preconditioners only need the
+    // (reordered and scaled) sparse matrix.
+    if (m_precondType == Polynomial)
+        setupPolynomial(A);
+    else if (m_precondType == SPAI)
+        setupApproxInverse(A);
+    else if (m_reorder)
         transformToBandedMatrix(A);
     else
         convertToBandedMatrix(A);
 
+    trackMemory();
+
     // Allocate space for vectors used to interface the Krylov solver to 
     // the preconditioner solve function (while allowing for different types).
-    m_vp.resize(m_n);
-    m_zp.resize(m_n);
-    m_buffer.resize(m_n);
-    m_buffer2.resize(m_n);
+    workspace().vp.resize(m_n);
+    workspace().zp.resize(m_n);
+    workspace().buffer2.resize(m_n);
 
     // For DB test only, directly exit
     if (m_testDB)
         return;
 
+    if (m_precondType == Polynomial || m_precondType == SPAI)
+        return;
+
     ////cusp::io::write_matrix_market_file(m_B, "B.mtx");
     if (m_k == 0) {
         m_actual_nnz = (2 * m_k + 1) * m_n - thrust::count(m_B.begin(), m_B.end(), 0.0);
@@ -952,7 +1574,7 @@ Precond<PrecVector>::setup(const Matrix&  A)
 
         // We are using more than one partition, so we must assemble the
         // truncated Spike reduced matrix R.
-        m_R.resize((2 * m_k) * (2 * m_k) * (m_numPartitions - 1));
+        m_R.resize(useCompressedSpikes() ? 0 : (2 * m_k) * (2 * m_k) * (m_numPartitions - 1));
 
         // Extract off-diagonal blocks from the banded matrix and store them
         // in the array m_offDiags.
@@ -1210,6 +1832,24 @@ Precond<PrecVector>::setup(const Matrix&  A)
         }
     }
 
+    // For the Schwarz preconditioner, extend the partitions by the overlap
+    // and factor the resulting blocks independently.
+    if (m_precondType == Schwarz && m_numPartitions > 1) {
+        m_timer.Start();
+        assembleSchwarzBlocks();
+        m_timer.Stop();
+        m_time_assembly = m_timer.getElapsed();
+
+        trackMemory();
+
+        m_timer.Start();
+        partBlockedBandedLU_const(m_schwarzN, m_k, m_numPartitions, m_B);
+        m_actual_nnz = (2 * m_k + 1) * m_schwarzN - thrust::count(m_B.begin(), m_B.end(), 0.0);
+        m_timer.Stop();
+        m_time_bandLU = m_timer.getElapsed();
+        return;
+    }
+
     // If we are using a single partition, perform the LU factorization
     // of the banded matrix and return.
     if (m_precondType == Block || m_numPartitions == 1) {
@@ -1242,7 +1882,7 @@ Precond<PrecVector>::setup(const Matrix&  A)
     try {
         // We are using more than one partition, so we must assemble the
         // truncated Spike reduced matrix R.
-        m_R.resize((2 * m_k) * (2 * m_k) * (m_numPartitions - 1));
+        m_R.resize(useCompressedSpikes() ? 0 : (2 * m_k) * (2 * m_k) * (m_numPartitions - 1));
 
         // Extract off-diagonal blocks from the banded matrix and store them
         // in the array m_offDiags.
@@ -1252,6 +1892,8 @@ Precond<PrecVector>::setup(const Matrix&  A)
         extractOffDiagonal(mat_WV);
         m_timer.Stop();
         m_time_offDiags = m_timer.getElapsed();
+
+        trackMemory();
     } catch (const std::bad_alloc& ) {
         m_precondType = Block;
         m_timer.Start();
@@ -1303,6 +1945,8 @@ Precond<PrecVector>::setup(const Matrix&  A)
         {
             PrecVector B2 = m_B;
 
+            trackMemory();
+
             cudaDeviceSetCacheConfig(cudaFuncCachePreferL1);
 
             m_timer.Start();
@@ -1359,6 +2003,8 @@ Precond<PrecVector>::setup(const Matrix&  A)
     partFullLU();
     m_timer.Stop();
     m_time_fullLU = m_timer.getElapsed();
+
+    trackMemory();
 }
 
 /**
@@ -1379,10 +2025,24 @@ Precond<PrecVector>::operator()(const SolverVector& v,
         return;
     }
 
-    // Invoke the preconditioner solve function.
-    cusp::blas::copy(v, m_vp);
-    solve(m_vp, m_zp);
-    cusp::blas::copy(m_zp, z);
+    Workspace& ws = workspace();
+
+    // Bring v into the work vector vp of the calling thread's workspace,
+    // fusing the precision conversion with the left transformation (if any).
+    // getSRev() uses vp as work space and leaves the solution in zp, which is
+    // brought into z with the right transformation. No vector is allocated
+    // here.
+    if (m_reorder)
+        leftTrans(v, ws.vp);
+    else
+        cusp::blas::copy(v, ws.vp);
+
+    getSRev(ws.vp, ws.zp);
+
+    if (m_reorder)
+        rightTrans(ws.zp, z);
+    else
+        cusp::blas::copy(ws.zp, z);
 }
 
 /**
@@ -1394,79 +2054,276 @@ void
 Precond<PrecVector>::solve(PrecVector&  v,
                            PrecVector&  z)
 {
-    if (m_reorder) {
-        leftTrans(v, z);
-        getSRev(z, m_buffer);
-        rightTrans(m_buffer, z);
-    } else {
-        cusp::blas::copy(v, z);
-        PrecVector buffer = z;
-        getSRev(buffer, z);
-    }
+    (*this)(v, z);
 }
 
 /**
- * This function gets a rough solution of the input RHS.
+ * This is the wrapper around the transposed preconditioner solve function,
+ * i.e. it applies the transpose of the operator applied by operator().
+ * Like operator(), it is templatized by the SolverVector type to implement
+ * mixed-precision.
  */
 template <typename PrecVector>
+template <typename SolverVector>
 void
-Precond<PrecVector>::getSRev(PrecVector&  rhs,
-                             PrecVector&  sol)
+Precond<PrecVector>::applyTranspose(const SolverVector& v,
+                                    SolverVector& z)
 {
-    if (m_k == 0) {
-        thrust::transform(rhs.begin(), rhs.end(), m_B.begin(), sol.begin(), thrust::divides<PrecValueType>());
+    if (m_precondType == None) {
+        cusp::blas::copy(v, z);
         return;
     }
 
-    if (m_ilu_level >= 0) {
-        if (m_numPartitions > 1 && m_precondType == Spike) {
-            if (m_variableBandwidth) {
-                permute(rhs, m_secondReordering,m_buffer2);
-                // Calculate modified RHS
-                sparseSweep(rhs, rhs);
+    Workspace& ws = workspace();
 
-                permute(rhs, m_secondReordering, sol);
+    // As in operator(), the precision conversions are fused with the
+    // (transposed) transformations.
+    if (m_reorder)
+        rightTransTranspose(v, ws.vp);
+    else
+        cusp::blas::copy(v, ws.vp);
 
-                // Solve reduced system
-                partFullFwdSweep(sol);
-                partFullBckSweep(sol);
+    getSRevTranspose(ws.vp, ws.zp);
 
-                purifyRHS(sol, m_buffer2);
-                permute(m_buffer2, m_secondPerm, sol);
-            } else {
-                sol = rhs;
-                // Calculate modified RHS
-                sparseSweep(rhs, rhs);
+    if (m_reorder)
+        leftTransTranspose(ws.zp, z);
+    else
+        cusp::blas::copy(ws.zp, z);
+}
 
-                // Solve reduced system
-                partFullFwdSweep(rhs);
-                partFullBckSweep(rhs);
+/**
+ * This function solves the system M^T z = v, for a specified vector v, where
+ * M is the implicitly defined preconditioner matrix. The factors computed in
+ * setup() are reused: the reordering and scaling transformations are applied
+ * in reverse order and the sweeps are performed with the transposed factors.
+ * This function must only be called if hasTranspose() returns true.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::solveTranspose(PrecVector&  v,
+                                    PrecVector&  z)
+{
+    applyTranspose(v, z);
+}
 
-                // Purify RHS
-                purifyRHS(rhs, sol);
-            }
-        } else 
-            sol = rhs;
+/**
+ * This function returns true if the transposed preconditioner can be applied
+ * with the current factorization. This is the case for symmetric
+ * preconditioners and for (block-)diagonal, Block and Spike preconditioners
+ * with LU factors of the diagonal blocks stored on a single device.
+ * Polynomial, SPAI, Schwarz, ILU-based and BCR-based preconditioners, as well
+ * as the LU-UL variant of the Spike preconditioner, are not supported.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::hasTranspose() const
+{
+    if (m_precondType == None)
+        return true;
+
+    if (m_precondType == Polynomial || m_precondType == SPAI)
+        return false;
+
+    if (m_k == 0)
+        return true;
+
+    bool multiSpike = (m_precondType == Spike && m_numPartitions > 1);
+
+    if (m_isSPD && !multiSpike)
+        return true;
+
+    if (m_precondType == Schwarz && m_numPartitions > 1)
+        return false;
+
+    if (m_ilu_level >= 0 || m_use_bcr || m_gpuCount > 1 || m_saveMem)
+        return false;
+
+    if (multiSpike && !m_variableBandwidth && m_factMethod != LU_only)
+        return false;
+
+    if (multiSpike && useCompressedSpikes())
+        return false;
+
+    return true;
+}
+
+/**
+ * This function returns true if the preconditioner can be applied by several
+ * threads at once, each with its own workspace (see WorkspaceScope). Apart
+ * from the workspaces, an apply only reads the preconditioner, except on
+ * multiple GPUs and with BCR, which use shared per-device buffers.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::canApplyConcurrently() const
+{
+    return m_gpuCount == 1 && !m_use_bcr;
+}
+
+/**
+ * This function provides the specified number of workspaces for concurrent
+ * applies, all sized like workspace 0 (the one set up by setup()). It must
+ * be called after setup() and before the concurrent applies start.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::reserveWorkspaces(int numWorkspaces)
+{
+    m_workspaces.resize(1);
+    m_workspaces.resize(std::max(numWorkspaces, 1), m_workspaces[0]);
+}
+
+/**
+ * This function applies the transpose of the operator implemented by
+ * getSRev(). With the Spike preconditioner written as
+ *   M^{-1} = D^{-1} - D^{-1} P^T C R^{-1} P D^{-1},
+ * where D is the block-diagonal matrix, P the (optional) second-stage
+ * permutation, R the truncated reduced matrix and C the coupling blocks,
+ * the transposed operator is evaluated as
+ *   M^{-T} v = w - D^{-T} P^T R^{-T} C^T P w,  with w = D^{-T} v.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::getSRevTranspose(PrecVector&  rhs,
+                                      PrecVector&  sol)
+{
+    Workspace& ws = workspace();
+
+    if (m_k == 0) {
+        thrust::transform(rhs.begin(), rhs.end(), m_B.begin(), sol.begin(), thrust::divides<PrecValueType>());
+        return;
+    }
+
+    if (m_isSPD && !(m_precondType == Spike && m_numPartitions > 1)) {
+        getSRev(rhs, sol);
+        return;
+    }
+
+    partBandedSweepsTranspose(rhs);
+
+    if (m_numPartitions == 1 || m_precondType != Spike) {
+        sol.swap(rhs);
+        return;
+    }
+
+    if (m_variableBandwidth)
+        permute(rhs, m_secondReordering, ws.buffer2);
+    else
+        ws.buffer2 = rhs;
+
+    sol.resize(m_n);
+    cusp::blas::fill(sol, PrecValueType(0));
+
+    // Solve the transposed reduced system
+    purifyRHSTranspose(ws.buffer2, sol);
+    partFullSweepsTranspose(sol);
+
+    if (m_variableBandwidth)
+        permute(sol, m_secondPerm, ws.buffer2);
+    else
+        ws.buffer2 = sol;
+
+    // Get the corrected solution
+    partBandedSweepsTranspose(ws.buffer2);
+    cusp::blas::axpby(rhs, ws.buffer2, sol, PrecValueType(1), PrecValueType(-1));
+}
+
+/**
+ * This function gets a rough solution of the input RHS.
+ * The vector rhs is used as work space: on return, its contents are
+ * undefined (its storage may have been exchanged with that of sol).
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::getSRev(PrecVector&  rhs,
+                             PrecVector&  sol)
+{
+    Workspace& ws = workspace();
+
+    if (m_precondType == Polynomial) {
+        polynomialSolve(rhs, sol);
+        return;
+    }
+
+    if (m_precondType == SPAI) {
+        approxInverseSolve(rhs, sol);
+        return;
+    }
+
+    if (m_k == 0) {
+        thrust::transform(rhs.begin(), rhs.end(), m_B.begin(), sol.begin(), thrust::divides<PrecValueType>());
+        return;
+    }
+
+    if (m_precondType == Schwarz && m_numPartitions > 1) {
+        schwarzSolve(rhs, sol);
+        return;
+    }
+
+    if (m_ilu_level >= 0) {
+        if (m_numPartitions > 1 && m_precondType == Spike) {
+            if (m_variableBandwidth) {
+                permute(rhs, m_secondReordering,ws.buffer2);
+                // Calculate modified RHS
+                sparseSweep(rhs, rhs);
+
+                permute(rhs, m_secondReordering, sol);
+
+                // Solve reduced system
+                partFullSolve(sol);
+
+                purifyRHS(sol, ws.buffer2);
+                permute(ws.buffer2, m_secondPerm, sol);
+            } else {
+                sol = rhs;
+                // Calculate modified RHS
+                sparseSweep(rhs, rhs);
+
+                // Solve reduced system
+                partFullSolve(rhs);
+
+                // Purify RHS
+                purifyRHS(rhs, sol);
+            }
+
+            sparseSweep(sol, sol);
+        } else
+            sparseSweep(rhs, sol);
 
-        sparseSweep(sol, sol);
         return;
     }
 
+    // With sparse right-hand sides, only the partitions (and interfaces)
+    // reached by the right-hand side are processed.
+    const int* partMask      = 0;
+    const int* interfaceMask = 0;
+    const int* purifiedMask  = 0;
+
+    if (useRHSMasks()) {
+        computeRHSMasks(rhs);
+        partMask      = thrust::raw_pointer_cast(&ws.rhsPartMask[0]);
+        interfaceMask = thrust::raw_pointer_cast(&ws.rhsInterfaceMask[0]);
+        purifiedMask  = thrust::raw_pointer_cast(&ws.rhsPurifiedMask[0]);
+    }
+
+    const int* solMask = partMask;
+
     if (m_numPartitions > 1 && m_precondType == Spike) {
         if (m_variableBandwidth) {
-            permute(rhs, m_secondReordering,m_buffer2);
+            permute(rhs, m_secondReordering,ws.buffer2);
             // Calculate modified RHS
-            partBandedFwdSweep(rhs);
-            partBandedBckSweep(rhs);
+            partBandedFwdSweep(rhs, partMask);
+            partBandedBckSweep(rhs, partMask);
 
             permute(rhs, m_secondReordering, sol);
 
             // Solve reduced system
-            partFullFwdSweep(sol);
-            partFullBckSweep(sol);
+            partFullSolve(sol, interfaceMask);
+
+            purifyRHS(sol, ws.buffer2, interfaceMask);
+            permute(ws.buffer2, m_secondPerm, sol);
 
-            purifyRHS(sol, m_buffer2);
-            permute(m_buffer2, m_secondPerm, sol);
+            solMask = purifiedMask;
         } else {
             sol = rhs;
             // Calculate modified RHS
@@ -1474,14 +2331,14 @@ Precond<PrecVector>::getSRev(PrecVector&  rhs,
             partBandedBckSweep(rhs);
 
             // Solve reduced system
-            partFullFwdSweep(rhs);
-            partFullBckSweep(rhs);
+            partFullSolve(rhs);
 
             // Purify RHS
             purifyRHS(rhs, sol);
         }
     } else {
-        sol = rhs;
+        // The sweeps below are performed in place.
+        sol.swap(rhs);
     }
 
     // Get purified solution
@@ -1519,9 +2376,11 @@ Precond<PrecVector>::getSRev(PrecVector&  rhs,
             );
             recoverCurDevice();
         }
+    } else if (useHostCholesky()) {
+        partBandedCholeskySweepsH(sol);
     } else {
-        partBandedFwdSweep(sol);
-        partBandedBckSweep(sol);
+        partBandedFwdSweep(sol, solMask);
+        partBandedBckSweep(sol, solMask);
     }
     // } else
         // partBandedSweepsH(sol);
@@ -1530,94 +2389,150 @@ Precond<PrecVector>::getSRev(PrecVector&  rhs,
 /**
  * This function left transforms the system. We first apply the DB row
  * scaling and permutation (or only the DB row permutation) after which we
- * apply the RCM row permutation.
+ * apply the RCM row permutation. The input vector may be of a different
+ * precision; the conversion is performed in the same pass.
  */
 template <typename PrecVector>
+template <typename VectorIn>
 void
-Precond<PrecVector>::leftTrans(PrecVector&  v,
-                               PrecVector&  z)
+Precond<PrecVector>::leftTrans(const VectorIn&  v,
+                               PrecVector&      z)
 {
+    // Concurrent applies (see WorkspaceScope) are only timed on workspace 0.
+    bool timed = (currentWorkspace() == 0);
+
+    if (timed)
+        m_timer.Start();
+
     if (m_scale)
-        scaleAndPermute(v, m_optPerm, m_dbRowScale, z);
+        thrust::scatter(
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.begin(), m_dbRowScale.begin())), Multiply<PrecValueType>()),
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.end(), m_dbRowScale.end())), Multiply<PrecValueType>()),
+                m_optPerm.begin(),
+                z.begin()
+                );
     else
-        permute(v, m_optPerm, z);
+        thrust::scatter(v.begin(), v.end(), m_optPerm.begin(), z.begin());
+
+    if (timed) {
+        m_timer.Stop();
+        m_time_shuffle += m_timer.getElapsed();
+    }
 }
 
 /**
  * This function right transforms the system. We apply the RCM column 
- * permutation and, if needed, the DB column scaling.
+ * permutation and, if needed, the DB column scaling. The output vector may
+ * be of a different precision; the conversion is performed in the same pass.
  */
 template <typename PrecVector>
+template <typename VectorOut>
 void
 Precond<PrecVector>::rightTrans(PrecVector&  v,
-                                PrecVector&  z)
+                                VectorOut&   z)
 {
+    bool timed = (currentWorkspace() == 0);
+
+    if (timed)
+        m_timer.Start();
+
     if (m_scale)
-        permuteAndScale(v, m_optReordering, m_dbColScale, z);
+        thrust::scatter(
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.begin(), thrust::make_permutation_iterator(m_dbColScale.begin(), m_optReordering.begin()))), Multiply<PrecValueType>()),
+                thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.end(), thrust::make_permutation_iterator(m_dbColScale.end(), m_optReordering.end()))), Multiply<PrecValueType>()),
+                m_optReordering.begin(),
+                z.begin()
+                );
     else
-        permute(v, m_optReordering, z);
+        thrust::scatter(v.begin(), v.end(), m_optReordering.begin(), z.begin());
+
+    if (timed) {
+        m_timer.Stop();
+        m_time_shuffle += m_timer.getElapsed();
+    }
 }
 
 /**
- * This function transforms the input vector 'v' into the output vector 'w' by
- * applying the permutation 'perm'.
+ * This function applies the transpose of the left transformation, i.e. the
+ * inverse row permutation followed by the DB row scaling (if needed).
  */
 template <typename PrecVector>
+template <typename VectorOut>
 void
-Precond<PrecVector>::permute(PrecVector&   v,
-                             IntVector&    perm,
-                             PrecVector&   w)
+Precond<PrecVector>::leftTransTranspose(PrecVector&  v,
+                                        VectorOut&   z)
 {
-    m_timer.Start();
-    thrust::scatter(v.begin(), v.end(), perm.begin(), w.begin());
-    m_timer.Stop();
-    m_time_shuffle += m_timer.getElapsed();
+    bool timed = (currentWorkspace() == 0);
+
+    if (timed)
+        m_timer.Start();
+
+    if (m_scale)
+        thrust::transform(thrust::make_permutation_iterator(v.begin(), m_optPerm.begin()),
+                          thrust::make_permutation_iterator(v.begin(), m_optPerm.end()),
+                          m_dbRowScale.begin(),
+                          z.begin(),
+                          thrust::multiplies<PrecValueType>());
+    else
+        thrust::gather(m_optPerm.begin(), m_optPerm.end(), v.begin(), z.begin());
+
+    if (timed) {
+        m_timer.Stop();
+        m_time_shuffle += m_timer.getElapsed();
+    }
 }
 
 /**
- * This function transforms the input vector 'v' into the output vector 'w' by
- * applying the permutation 'perm' followed by the scaling 'scale'.
+ * This function applies the transpose of the right transformation, i.e. the
+ * DB column scaling (if needed) followed by the inverse column permutation.
  */
 template <typename PrecVector>
+template <typename VectorIn>
 void
-Precond<PrecVector>::permuteAndScale(PrecVector&   v,
-                                     IntVector&    perm,
-                                     PrecVector&   scale,
-                                     PrecVector&   w)
+Precond<PrecVector>::rightTransTranspose(const VectorIn&  v,
+                                         PrecVector&      z)
 {
-    m_timer.Start();
+    bool timed = (currentWorkspace() == 0);
 
-    thrust::scatter(
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.begin(), thrust::make_permutation_iterator(scale.begin(), perm.begin()))), Multiply<PrecValueType>()),
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.end(), thrust::make_permutation_iterator(scale.end(), perm.end()))), Multiply<PrecValueType>()),
-            perm.begin(),
-            w.begin()
-            );
+    if (timed)
+        m_timer.Start();
 
-    m_timer.Stop();
-    m_time_shuffle += m_timer.getElapsed();
+    if (m_scale)
+        thrust::transform(thrust::make_permutation_iterator(v.begin(), m_optReordering.begin()),
+                          thrust::make_permutation_iterator(v.begin(), m_optReordering.end()),
+                          thrust::make_permutation_iterator(m_dbColScale.begin(), m_optReordering.begin()),
+                          z.begin(),
+                          thrust::multiplies<PrecValueType>());
+    else
+        thrust::gather(m_optReordering.begin(), m_optReordering.end(), v.begin(), z.begin());
+
+    if (timed) {
+        m_timer.Stop();
+        m_time_shuffle += m_timer.getElapsed();
+    }
 }
 
 /**
  * This function transforms the input vector 'v' into the output vector 'w' by
- * applying the scaling 'scale' followed by the permutation 'perm'.
- */ 
+ * applying the permutation 'perm'.
+ */
 template <typename PrecVector>
 void
-Precond<PrecVector>::scaleAndPermute(PrecVector&   v,
-                                     IntVector&    perm,
-                                     PrecVector&   scale,
-                                     PrecVector&   w)
+Precond<PrecVector>::permute(PrecVector&   v,
+                             IntVector&    perm,
+                             PrecVector&   w)
 {
-    m_timer.Start();
-    thrust::scatter(
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.begin(), scale.begin())), Multiply<PrecValueType>()),
-            thrust::make_transform_iterator(thrust::make_zip_iterator(thrust::make_tuple(v.end(), scale.end())), Multiply<PrecValueType>()),
-            perm.begin(),
-            w.begin()
-            );
-    m_timer.Stop();
-    m_time_shuffle += m_timer.getElapsed();
+    bool timed = (currentWorkspace() == 0);
+
+    if (timed)
+        m_timer.Start();
+
+    thrust::scatter(v.begin(), v.end(), perm.begin(), w.begin());
+
+    if (timed) {
+        m_timer.Stop();
+        m_time_shuffle += m_timer.getElapsed();
+    }
 }
 
 /**
@@ -1637,35 +2552,21 @@ Precond<PrecVector>::combinePermutation(IntVector&  perm,
 
 
 /**
- * This function applies the reordering and element drop-off algorithms to
- * obtain the banded matrix for the Spike method. On return, the following
- * member variables are set:
- *   m_B
- *       banded matrix after reordering and drop-off. This matrix is stored
- *       column-wise, band after band, in a contiguous 1-D array.
- *   m_k
- *       half band-width of the matrix m_B (after reordering and drop-off)
- *   m_optReordering
- *   m_optPerm
- *       permutation arrays obtained from the symmetric RCM algorithm
- *       row and column permutations obtained from the DB algorithm
- *   dbRowScale
- *   dbColScale
- *       row and column scaling factors obtained from the DB algorithm
+ * This function converts the specified matrix to CSR format on the host
+ * and, if dropZeros is true, removes its explicit zeros. The entries of the
+ * resulting matrix are the ones tracked by the reordering maps used in
+ * update(). If nonzeroMap is given, it receives, for every entry of the CSR
+ * matrix before the zeros are removed, its position after the removal (-1
+ * for the removed entries).
  */
 template <typename PrecVector>
 template <typename Matrix>
 void
-Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatrixCsr&)
+Precond<PrecVector>::toHostCsr(const Matrix&    A,
+                               PrecMatrixCsrH&  Acsrh,
+                               IntVectorH*      nonzeroMap,
+                               bool             dropZeros)
 {
-    CPUTimer reorder_timer, assemble_timer, transfer_timer;
-
-    transfer_timer.Start();
-
-    // Reorder the matrix and apply drop-off. For this, we convert the
-    // input matrix to CSR format and copy it on the host.
-    PrecMatrixCsrH Acsrh;
-
 #ifdef USE_OLD_CUSP
     Acsrh = A;
 #else
@@ -1692,6 +2593,12 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
     }
 #endif
 
+    if (!dropZeros)
+        return;
+
+    if (nonzeroMap)
+        nonzeroMap->resize(Acsrh.num_entries);
+
     {
         int num_entries = 0;
         IntVectorH   row_offsets(Acsrh.num_rows + 1, 0);
@@ -1703,14 +2610,51 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
                         Acsrh.column_indices[num_entries] = Acsrh.column_indices[j];
                         Acsrh.values[num_entries] = Acsrh.values[j];
                     }
+                    if (nonzeroMap)
+                        (*nonzeroMap)[j] = num_entries;
                     num_entries ++;
-                }
+                } else if (nonzeroMap)
+                    (*nonzeroMap)[j] = -1;
             }
             row_offsets[i + 1] = num_entries;
         }
         Acsrh.resize(Acsrh.num_rows, Acsrh.num_rows, num_entries);
         thrust::copy(row_offsets.begin(), row_offsets.end(), Acsrh.row_offsets.begin());
     }
+}
+
+/**
+ * This function applies the reordering and element drop-off algorithms to
+ * obtain the banded matrix for the Spike method. On return, the following
+ * member variables are set:
+ *   m_B
+ *       banded matrix after reordering and drop-off. This matrix is stored
+ *       column-wise, band after band, in a contiguous 1-D array.
+ *   m_k
+ *       half band-width of the matrix m_B (after reordering and drop-off)
+ *   m_optReordering
+ *   m_optPerm
+ *       permutation arrays obtained from the symmetric RCM algorithm
+ *       row and column permutations obtained from the DB algorithm
+ *   dbRowScale
+ *   dbColScale
+ *       row and column scaling factors obtained from the DB algorithm
+ */
+template <typename PrecVector>
+template <typename Matrix>
+void
+Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatrixCsr&)
+{
+    CPUTimer reorder_timer, assemble_timer, transfer_timer;
+
+    transfer_timer.Start();
+
+    // Reorder the matrix and apply drop-off. For this, we convert the
+    // input matrix to CSR format and copy it on the host.
+    PrecMatrixCsrH Acsrh;
+    IntVectorH     nonzeroMap;
+
+    toHostCsr(A, Acsrh, m_trackReordering ? &nonzeroMap : 0);
 
     transfer_timer.Stop();
     m_time_transfer = transfer_timer.getElapsed();
@@ -1736,11 +2680,16 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
 
     const int    BANDWIDTH_THRESHOLD = 64;
     bool         doRCM   = (m_ilu_level < 0 && (m_maxBandwidth > BANDWIDTH_THRESHOLD));
-    bool         doSloan = (m_ilu_level >= 0);
+    bool         doColoring = (m_ilu_level == 0 && m_iluMulticolor);
+    bool         doSloan = (m_ilu_level >= 0 && !doColoring);
     reorder_timer.Start();
-    m_k_reorder = graph.reorder(Acsrh, m_testDB, m_doDB, m_dbFirstStageOnly, m_scale, doRCM, doSloan, optReordering, optPerm, dbRowPerm, m_dbRowScale, m_dbColScale, scaleMap, m_k_db);
+    m_k_reorder = graph.reorder(Acsrh, m_testDB, m_doDB, m_dbFirstStageOnly, m_scale, doRCM, doSloan, doColoring, m_supervariables, optReordering, optPerm, dbRowPerm, m_dbRowScale, m_dbColScale, scaleMap, m_k_db);
     reorder_timer.Stop();
 
+    m_numSupervariables = graph.getNumSupervariables();
+
+    m_colorOffsets = graph.getColorOffsets();
+
     m_time_DB        = graph.getTimeDB();
     m_time_DB_pre    = graph.getTimeDBPre();
     m_time_DB_first  = graph.getTimeDBFirst();
@@ -1755,10 +2704,26 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
     if (m_testDB)
         return;
     
-    if (m_k_reorder > m_maxBandwidth || m_dropOff_frac > 0) {
+    // The per-partition drop-off works on the diagonal blocks of the
+    // variable-bandwidth method; dropped entries cannot be tracked for update().
+    bool partDropOff = (m_dropOffPerPartition && m_dropOff_frac > 0 && m_variableBandwidth && m_numPartitions > 1
+                        && m_ilu_level < 0 && !m_trackReordering);
+
+    // The multicolor ordering does not produce a banded matrix, so no
+    // elements are dropped and the rows are not partitioned.
+    if (doColoring) {
+        m_dropOff_actual = 0;
+        m_time_dropOff = 0;
+        m_k = m_k_reorder;
+        m_numPartitions = 1;
+    }
+    else if (m_k_reorder > m_maxBandwidth || m_dropOff_frac > 0) {
+        // With the per-partition drop-off, only the maximum bandwidth is
+        // enforced here; the drop-off fraction is spent on the diagonal
+        // blocks once the partitions are known.
         CPUTimer loc_timer;
         loc_timer.Start();
-        m_k = graph.dropOff(m_dropOff_frac, m_maxBandwidth, m_dropOff_actual);
+        m_k = graph.dropOff(partDropOff ? 0 : m_dropOff_frac, m_maxBandwidth, m_dropOff_actual);
         loc_timer.Stop();
 
         m_time_dropOff = loc_timer.getElapsed();
@@ -1777,11 +2742,48 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
     int maxNumPartitions = std::max(m_n / (m_k + 1), 1);
     m_numPartitions = std::min(m_numPartitions, maxNumPartitions);
 
+    // Plan the memory use of the remaining setup stages. If the banded matrix
+    // alone does not fit in the memory budget, drop off more elements.
+    {
+        int  maxK = m_k;
+        bool fits = planMemory(maxK);
+
+        if (maxK < m_k) {
+            CPUTimer loc_timer;
+            PrecValueType dropOff_extra = 0;
+
+            loc_timer.Start();
+            m_k = graph.dropOff(0, maxK, dropOff_extra);
+            loc_timer.Stop();
+
+            m_time_dropOff += loc_timer.getElapsed();
+            m_dropOff_actual = 1 - (1 - m_dropOff_actual) * (1 - dropOff_extra);
+            fits = planMemory(maxK);
+        }
+
+        if (!fits)
+            throw system_error(system_error::Memory_budget, "The preconditioner setup does not fit in the memory budget.");
+    }
+
     // If there is just one partition, force using constant bandwidth method.
     if (m_numPartitions == 1 || m_k == 0) {
         m_variableBandwidth = false;
     }
 
+    // Without partitions, the per-partition drop-off becomes a global one.
+    if (partDropOff && !m_variableBandwidth) {
+        CPUTimer loc_timer;
+        PrecValueType dropOff_extra = 0;
+
+        loc_timer.Start();
+        m_k = graph.dropOff(m_dropOff_frac, m_k, dropOff_extra);
+        loc_timer.Stop();
+
+        m_time_dropOff += loc_timer.getElapsed();
+        m_dropOff_actual = 1 - (1 - m_dropOff_actual) * (1 - dropOff_extra);
+        partDropOff = false;
+    }
+
     // Assemble the banded matrix.
     if (m_variableBandwidth) {
         assemble_timer.Start();
@@ -1793,6 +2795,18 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
         graph.secondLevelReordering(m_k, m_numPartitions, secondReorder, secondPerm, m_first_rows_host);
         reorder_timer.Stop();
         m_time_reorder += reorder_timer.getElapsed();
+        m_time_secondLevel = reorder_timer.getElapsed();
+
+        if (partDropOff) {
+            CPUTimer loc_timer;
+
+            loc_timer.Start();
+            PrecValueType dropOff_part = graph.dropOffPartitions(m_dropOff_frac, m_numPartitions);
+            loc_timer.Stop();
+
+            m_time_dropOff += loc_timer.getElapsed();
+            m_dropOff_actual = 1 - (1 - m_dropOff_actual) * (1 - dropOff_part);
+        }
 
         assemble_timer.Start();
         PrecMatrixCooH Acooh;
@@ -2009,10 +3023,31 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
             graph.get_csr_matrix(m_Acsrh, m_numPartitions);
             m_timer.Stop();
             m_time_toBanded = m_timer.getElapsed();
-        }
-    }
 
-    transfer_timer.Start();
+            // The iterative ILU(0) can be warm-started by update(), which
+            // needs the position in m_Acsrh of every entry of the matrix.
+            m_iluMap.clear();
+
+            if (m_trackReordering && m_ilu_level == 0 && m_iluSweeps > 0 && m_numPartitions == 1 && !doColoring) {
+                const int* cols  = thrust::raw_pointer_cast(&m_Acsrh.column_indices[0]);
+                int        width = 2 * m_k + 1;
+
+                m_iluMap.resize(typeMap.size(), -1);
+
+                for (size_t e = 0; e < typeMap.size(); e++) {
+                    if (!typeMap[e])
+                        continue;
+
+                    int col = bandedMatMap[e] / width;
+                    int row = col + bandedMatMap[e] % width - m_k;
+
+                    m_iluMap[e] = (int) (std::lower_bound(cols + m_Acsrh.row_offsets[row], cols + m_Acsrh.row_offsets[row+1], col) - cols);
+                }
+            }
+        }
+    }
+
+    transfer_timer.Start();
 
     // Copy the banded matrix and permutation data to the device.
     m_optReordering = optReordering;
@@ -2094,6 +3129,7 @@ Precond<PrecVector>::transformToBandedMatrix(const Matrix&  A, const DoubleMatri
         m_typeMap      = typeMap;
         m_bandedMatMap = bandedMatMap;
         m_scaleMap     = scaleMap;
+        m_nonzeroMap.swap(nonzeroMap);
     }
 
     transfer_timer.Stop();
@@ -2116,6 +3152,16 @@ Precond<PrecVector>::convertToBandedMatrix(const Matrix&  A, const BandedMatrix<
     int  maxNumPartitions = std::max(1, m_n / std::max(m_k + 1, 2 * m_k));
     m_numPartitions = std::min(m_numPartitions, maxNumPartitions);
 
+    // Plan the memory use of the setup. Without reordering we cannot drop off
+    // elements, so only the factorization method, the storage mode, the
+    // number of partitions and the preconditioner type may be adjusted.
+    {
+        int maxK = m_k;
+
+        if (!planMemory(maxK) || maxK < m_k)
+            throw system_error(system_error::Memory_budget, "The banded matrix does not fit in the memory budget (elements can only be dropped off with reordering).");
+    }
+
     // If there is just one partition, force using constant-bandwidth method.
     if (m_numPartitions == 1) {
         m_variableBandwidth = false;
@@ -2256,110 +3302,866 @@ Precond<PrecVector>::convertToBandedMatrix(const Matrix&  A, const DoubleMatrixC
         m_k = cusp::blas::nrmmax(buffer);
     }
 
-    // Verify that the required number of partitions is consistent with the
-    // problem size and half-bandwidth.  If 'n' is the smallest partition size,
-    // the following two conditions must be satisfied:
-    //   (1)  K+1 <= n   (for Spike algorithm)
-    //   (2)  2*K <= n   (for current implementation of UL)
-    // These imply a maximum allowable number of partitions.
-    int  maxNumPartitions = std::max(1, m_n / std::max(m_k + 1, 2 * m_k));
-    m_numPartitions = std::min(m_numPartitions, maxNumPartitions);
+    // Verify that the required number of partitions is consistent with the
+    // problem size and half-bandwidth.  If 'n' is the smallest partition size,
+    // the following two conditions must be satisfied:
+    //   (1)  K+1 <= n   (for Spike algorithm)
+    //   (2)  2*K <= n   (for current implementation of UL)
+    // These imply a maximum allowable number of partitions.
+    int  maxNumPartitions = std::max(1, m_n / std::max(m_k + 1, 2 * m_k));
+    m_numPartitions = std::min(m_numPartitions, maxNumPartitions);
+
+    // Plan the memory use of the setup. Without reordering we cannot drop off
+    // elements, so only the factorization method, the storage mode, the
+    // number of partitions and the preconditioner type may be adjusted.
+    {
+        int maxK = m_k;
+
+        if (!planMemory(maxK) || maxK < m_k)
+            throw system_error(system_error::Memory_budget, "The banded matrix does not fit in the memory budget (elements can only be dropped off with reordering).");
+    }
+
+    // If there is just one partition, force using constant-bandwidth method.
+    if (m_numPartitions == 1)
+        m_variableBandwidth = false;
+
+    if (m_gpuCount > m_numPartitions) {
+        m_gpuCount = m_numPartitions;
+    }
+
+    // Set the size and load the banded matrix into m_B.
+    m_B.resize((2*m_k+1)*n);
+
+    int blockX = nnz, gridX = 1, gridY = 1;
+    kernelConfigAdjust(blockX, gridX, gridY, BLOCK_SIZE, MAX_GRID_DIMENSION);
+    dim3 grids(gridX, gridY);
+
+    int*           d_rows = thrust::raw_pointer_cast(&(Acoo.row_indices[0]));
+    int*           d_cols = thrust::raw_pointer_cast(&(Acoo.column_indices[0]));
+    PrecValueType* d_vals = thrust::raw_pointer_cast(&(Acoo.values[0]));
+    PrecValueType* dB     = thrust::raw_pointer_cast(&m_B[0]);
+
+    m_timer.Start();
+    device::copyFromCOOMatrixToBandedMatrix<<<grids, blockX>>>(nnz, m_k, d_rows, d_cols, d_vals, dB, 0, m_saveMem);
+
+    if (m_gpuCount > 1) {
+        saveCurDevice();
+        int rows_per_partition = m_n / m_numPartitions;
+        int rows_remainder = m_n % m_numPartitions;
+        int partitions_per_device = m_numPartitions / m_gpuCount;
+        int part_remainder = m_numPartitions % m_gpuCount;
+
+        int partBegin = 0, partEnd;
+        int rowBegin = 0;
+        int cur_b_offset = 0;
+
+        m_all_Bs.resize(m_gpuCount);
+        m_all_BOffsets.resize(m_gpuCount);
+        m_all_ks.resize(m_gpuCount);
+        m_all_BOffsets_host.resize(m_gpuCount);
+        m_all_ks_host.resize(m_gpuCount);
+        m_all_num_rows.resize(m_gpuCount);
+        m_all_num_partitions.resize(m_gpuCount);
+        m_all_ks_col_host.resize(m_gpuCount);
+
+        for (int i = 0; i < m_gpuCount; i++) {
+            cudaSetDevice(i);
+
+            int total_b_offset = 0;
+
+            if (i < part_remainder) {
+                partEnd = partBegin + (partitions_per_device + 1);
+            } else {
+                partEnd = partBegin + partitions_per_device;
+            }
+
+            int r_begin = rowBegin;
+            int rowEnd;
+
+            m_all_ks_host[i].resize(partEnd - partBegin);
+            m_all_BOffsets_host[i].resize(partEnd - partBegin + 1);
+            m_all_BOffsets_host[i][0] = 0;
+
+            for (int j = partBegin; j < partEnd; j++) {
+                if (j < rows_remainder) {
+                    rowEnd = r_begin + (rows_per_partition + 1);
+                    total_b_offset += (rows_per_partition + 1) * (2 * m_k + 1);
+                    m_all_BOffsets_host[i][j - partBegin + 1] = m_all_BOffsets_host[i][j - partBegin] + (rows_per_partition + 1) * (2 * m_k + 1);
+                } else {
+                    rowEnd = r_begin + rows_per_partition;
+                    total_b_offset += (rows_per_partition) * (2 * m_k + 1);
+                    m_all_BOffsets_host[i][j - partBegin + 1] = m_all_BOffsets_host[i][j - partBegin] + (rows_per_partition) * (2 * m_k + 1);
+                }
+                m_all_ks_host[i][j - partBegin] = m_k;
+
+                r_begin = rowEnd;
+            }
+            m_all_ks_col_host[i].resize(rowEnd - rowBegin, m_k);
+
+            m_all_Bs[i].resize(m_all_BOffsets_host[i][partEnd - partBegin]);
+            thrust::copy(m_B.begin() + cur_b_offset, m_B.begin() + (cur_b_offset + total_b_offset), m_all_Bs[i].begin());
+            cur_b_offset += total_b_offset;
+
+            m_all_ks[i] = m_all_ks_host[i];
+            m_all_BOffsets[i] = m_all_BOffsets_host[i];
+            m_all_num_rows[i] = rowEnd - rowBegin;
+            m_all_num_partitions[i] = partEnd - partBegin;
+
+            rowBegin = rowEnd;
+            partBegin = partEnd;
+        }
+
+        recoverCurDevice();
+        m_B.clear();
+    }
+    m_timer.Stop();
+    m_time_toBanded = m_timer.getElapsed();
+}
+
+
+/**
+ * This function loads the specified matrix into the host CSR matrix Acsrh
+ * for the preconditioners working directly on the sparse matrix. If
+ * reordering is enabled, the DB reordering (and scaling) is applied; no
+ * bandwidth reduction is needed, so only the DB row permutation is kept.
+ * DB is skipped for FSAI (SPAI with an SPD matrix), which relies on the
+ * symmetry that the DB row permutation and scaling destroy.
+ * The function returns false if only the DB reordering was to be tested.
+ */
+template <typename PrecVector>
+template <typename Matrix>
+bool
+Precond<PrecVector>::loadSparseMatrix(const Matrix&    A,
+                                      PrecMatrixCsrH&  Acsrh)
+{
+    CPUTimer reorder_timer, transfer_timer;
+
+    transfer_timer.Start();
+
+#ifdef USE_OLD_CUSP
+    Acsrh = A;
+#else
+    {
+        PrecMatrixCooH Acooh = A;
+
+        if (!Acooh.is_sorted_by_row())
+            Acooh.sort_by_row();
+
+        Acsrh = Acooh;
+    }
+#endif
+
+    transfer_timer.Stop();
+    m_time_transfer = transfer_timer.getElapsed();
+
+    m_k = 0;
+
+    if (m_reorder) {
+        IntVectorH   optReordering;
+        IntVectorH   optPerm;
+        IntVector    dbRowPerm(m_n);
+        MatrixMapFH  scaleMap;
+
+        Graph<PrecValueType>  graph(false);
+
+        bool doDB = m_doDB && !(m_isSPD && m_precondType == SPAI);
+
+        reorder_timer.Start();
+        m_k_reorder = graph.reorder(Acsrh, m_testDB, doDB, m_dbFirstStageOnly, m_scale, false, false, false, false, optReordering, optPerm, dbRowPerm, m_dbRowScale, m_dbColScale, scaleMap, m_k_db);
+        graph.get_csr_matrix(Acsrh, 1);
+        reorder_timer.Stop();
+
+        m_time_DB        = graph.getTimeDB();
+        m_time_DB_pre    = graph.getTimeDBPre();
+        m_time_DB_first  = graph.getTimeDBFirst();
+        m_time_DB_second = graph.getTimeDBSecond();
+        m_time_DB_post   = graph.getTimeDBPost();
+        m_d_p1           = graph.getDP1();
+        m_diag_dom       = graph.getDiagDominance();
+        m_d_p1_ori       = graph.getDP1(true);
+        m_diag_dom_ori   = graph.getDiagDominance(true);
+        m_time_reorder  += reorder_timer.getElapsed();
+
+        if (m_testDB)
+            return false;
+
+        // Without bandwidth reduction, only the DB row permutation is left.
+        m_optPerm       = dbRowPerm;
+        m_optReordering = optReordering;
+    }
+
+    return true;
+}
+
+/**
+ * This function sets up the polynomial preconditioner. The (reordered and
+ * scaled) sparse matrix and the inverse of its diagonal are stored on the
+ * device, and the bounds of the spectrum of the Jacobi-scaled matrix are
+ * estimated.
+ */
+template <typename PrecVector>
+template <typename Matrix>
+void
+Precond<PrecVector>::setupPolynomial(const Matrix&  A, const DoubleMatrixCsr&)
+{
+    CPUTimer transfer_timer;
+
+    PrecMatrixCsrH Acsrh;
+
+    if (!loadSparseMatrix(A, Acsrh))
+        return;
+
+    // Extract the inverse of the diagonal.
+    PrecVectorH  dinv(m_n);
+
+    for (int i = 0; i < m_n; i++) {
+        PrecValueType diag = 0;
+
+        for (int l = Acsrh.row_offsets[i]; l < Acsrh.row_offsets[i+1]; l++)
+            if (Acsrh.column_indices[l] == i)
+                diag = Acsrh.values[l];
+
+        if (diag == 0)
+            throw system_error(system_error::Zero_pivoting, "Zero diagonal found in polynomial preconditioner.");
+
+        dinv[i] = (PrecValueType) 1 / diag;
+    }
+
+    transfer_timer.Start();
+    m_polyA    = Acsrh;
+    m_polyDinv = dinv;
+    workspace().polyR.resize(m_n);
+    workspace().polyD.resize(m_n);
+    workspace().polyD2.resize(m_n);
+    transfer_timer.Stop();
+    m_time_transfer += transfer_timer.getElapsed();
+
+    m_timer.Start();
+    estimateSpectrum();
+    m_timer.Stop();
+    m_time_assembly = m_timer.getElapsed();
+}
+
+/**
+ * This function estimates the bounds of the spectrum of D^{-1} A, where A is
+ * the matrix of the polynomial preconditioner and D its diagonal, using a few
+ * Arnoldi steps (Lanczos, in exact arithmetic, for SPD matrices). The bounds
+ * are taken from the extreme eigenvalues of the symmetric part of the
+ * Hessenberg matrix (i.e. from the field of values restricted to the Krylov
+ * subspace). The upper bound is enlarged by 10%, since Chebyshev polynomials
+ * grow quickly outside of the interval; the lower bound is kept no smaller
+ * than 1/30 of the upper bound.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::estimateSpectrum()
+{
+    int m = std::max(1, std::min(m_polyEigSteps, m_n));
+
+    std::vector<PrecVector>  V(m + 1);
+    std::vector<double>      H((m + 1) * m, 0.0);
+    PrecVector               w(m_n);
+
+    {
+        // Fixed seed, local generator: the setup is reproducible and does not
+        // disturb the global random state of the application.
+        PrecVectorH                             v0(m_n);
+        std::mt19937                            gen(1);
+        std::uniform_real_distribution<double>  unif(0.5, 1.5);
+        for (int i = 0; i < m_n; i++)
+            v0[i] = (PrecValueType) unif(gen);
+        V[0] = v0;
+        cusp::blas::scal(V[0], (PrecValueType) (1 / cusp::blas::nrm2(V[0])));
+    }
+
+    int steps = m;
+
+    for (int j = 0; j < m; j++) {
+        cusp::multiply(m_polyA, V[j], w);
+        thrust::transform(w.begin(), w.end(), m_polyDinv.begin(), w.begin(), thrust::multiplies<PrecValueType>());
+
+        for (int i = 0; i <= j; i++) {
+            double h = cusp::blas::dot(V[i], w);
+            H[i + j * (m + 1)] = h;
+            cusp::blas::axpy(V[i], w, (PrecValueType) (-h));
+        }
+
+        double hnext = cusp::blas::nrm2(w);
+        H[(j + 1) + j * (m + 1)] = hnext;
+
+        // Stop if an invariant subspace was found.
+        if (hnext <= 1e-12 * std::fabs(H[j + j * (m + 1)])) {
+            steps = j + 1;
+            break;
+        }
+
+        if (j + 1 < m) {
+            V[j + 1] = w;
+            cusp::blas::scal(V[j + 1], (PrecValueType) (1 / hnext));
+        }
+    }
+
+    // Symmetric part of the (square) Hessenberg matrix.
+    std::vector<double>  S(steps * steps);
+
+    for (int i = 0; i < steps; i++)
+        for (int j = 0; j < steps; j++)
+            S[i + j * steps] = 0.5 * (H[i + j * (m + 1)] + H[j + i * (m + 1)]);
+
+    double lambdaMin, lambdaMax;
+    symmetricEigenRange(S, steps, lambdaMin, lambdaMax);
+
+    // If the estimate is useless (the field of values is not in the right
+    // half-plane), fall back to the interval of a diagonally dominant matrix.
+    if (lambdaMax <= 0)
+        lambdaMax = 1;
+
+    m_polyLambdaMax = 1.1 * lambdaMax;
+    m_polyLambdaMin = std::max(lambdaMin, m_polyLambdaMax / 30);
+
+    if (m_polyLambdaMin >= m_polyLambdaMax)
+        m_polyLambdaMin = m_polyLambdaMax / 2;
+}
+
+/**
+ * This function computes the smallest and largest eigenvalues of the
+ * symmetric m x m matrix H (stored column-wise and overwritten), using the
+ * cyclic Jacobi method.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::symmetricEigenRange(std::vector<double>&  H,
+                                         int                   m,
+                                         double&               lambdaMin,
+                                         double&               lambdaMax)
+{
+    const int MAX_NUM_SWEEPS = 50;
+
+    for (int sweep = 0; sweep < MAX_NUM_SWEEPS; sweep++) {
+        double off = 0, diag = 0;
+
+        for (int i = 0; i < m; i++) {
+            diag += H[i + i * m] * H[i + i * m];
+            for (int j = i + 1; j < m; j++)
+                off += H[i + j * m] * H[i + j * m];
+        }
+
+        if (off <= 1e-24 * diag)
+            break;
+
+        for (int p = 0; p < m; p++) {
+            for (int q = p + 1; q < m; q++) {
+                double apq = H[p + q * m];
+
+                if (apq == 0)
+                    continue;
+
+                double app   = H[p + p * m];
+                double aqq   = H[q + q * m];
+                double theta = (aqq - app) / (2 * apq);
+                double t     = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                double c     = 1 / std::sqrt(t * t + 1);
+                double s     = t * c;
+
+                for (int k = 0; k < m; k++) {
+                    if (k == p || k == q)
+                        continue;
+
+                    double akp = H[k + p * m];
+                    double akq = H[k + q * m];
+
+                    H[k + p * m] = H[p + k * m] = c * akp - s * akq;
+                    H[k + q * m] = H[q + k * m] = s * akp + c * akq;
+                }
+
+                H[p + p * m] = app - t * apq;
+                H[q + q * m] = aqq + t * apq;
+                H[p + q * m] = H[q + p * m] = 0;
+            }
+        }
+    }
+
+    lambdaMin = lambdaMax = H[0];
+
+    for (int i = 1; i < m; i++) {
+        lambdaMin = std::min(lambdaMin, H[i + i * m]);
+        lambdaMax = std::max(lambdaMax, H[i + i * m]);
+    }
+}
+
+/**
+ * This function applies the polynomial preconditioner, i.e. it computes
+ * sol = p(D^{-1} A) D^{-1} rhs, where p is a polynomial of degree m_polyDegree.
+ * For the Chebyshev polynomial, this is m_polyDegree steps of the Chebyshev
+ * iteration on the interval [m_polyLambdaMin, m_polyLambdaMax]; for the
+ * Neumann polynomial, it is the truncated Neumann series of the damped
+ * Jacobi iteration (with the damping factor centering the same interval at
+ * 1). Each step is a single kernel which fuses the SpMV with the vector
+ * updates.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::polynomialSolve(PrecVector&  rhs,
+                                     PrecVector&  sol)
+{
+    Workspace& ws = workspace();
+
+    int blockX = m_n, gridX = 1, gridY = 1;
+    kernelConfigAdjust(blockX, gridX, gridY, BLOCK_SIZE, MAX_GRID_DIMENSION);
+    dim3 grids(gridX, gridY);
+
+    const int*           d_offsets = thrust::raw_pointer_cast(&m_polyA.row_offsets[0]);
+    const int*           d_cols    = thrust::raw_pointer_cast(&m_polyA.column_indices[0]);
+    const PrecValueType* d_vals    = thrust::raw_pointer_cast(&m_polyA.values[0]);
+    const PrecValueType* d_dinv    = thrust::raw_pointer_cast(&m_polyDinv[0]);
+
+    PrecValueType theta = (PrecValueType) ((m_polyLambdaMax + m_polyLambdaMin) / 2);
+    PrecValueType delta = (PrecValueType) ((m_polyLambdaMax - m_polyLambdaMin) / 2);
+
+    // Degree-0 term: sol = D^{-1} rhs / theta.
+    thrust::transform(rhs.begin(), rhs.end(), m_polyDinv.begin(), sol.begin(), thrust::multiplies<PrecValueType>());
+    cusp::blas::scal(sol, (PrecValueType) 1 / theta);
+
+    if (m_polyType == Chebyshev) {
+        cusp::blas::copy(rhs, ws.polyR);
+        cusp::blas::copy(sol, ws.polyD);
+
+        PrecValueType* d_old = thrust::raw_pointer_cast(&ws.polyD[0]);
+        PrecValueType* d_new = thrust::raw_pointer_cast(&ws.polyD2[0]);
+        PrecValueType* d_r   = thrust::raw_pointer_cast(&ws.polyR[0]);
+        PrecValueType* d_x   = thrust::raw_pointer_cast(&sol[0]);
+
+        PrecValueType sigma = theta / delta;
+        PrecValueType rho   = 1 / sigma;
+
+        for (int i = 0; i < m_polyDegree; i++) {
+            PrecValueType rho_new = 1 / (2 * sigma - rho);
+
+            device::chebyshevStep<<<grids, blockX>>>(m_n, d_offsets, d_cols, d_vals, d_dinv, d_old, d_new, d_r, d_x, rho_new * rho, 2 * rho_new / delta);
+
+            std::swap(d_old, d_new);
+            rho = rho_new;
+        }
+    } else {
+        PrecValueType* d_b   = thrust::raw_pointer_cast(&rhs[0]);
+        PrecValueType* x_old = thrust::raw_pointer_cast(&sol[0]);
+        PrecValueType* x_new = thrust::raw_pointer_cast(&ws.polyD[0]);
+
+        for (int i = 0; i < m_polyDegree; i++) {
+            device::neumannStep<<<grids, blockX>>>(m_n, d_offsets, d_cols, d_vals, d_dinv, d_b, x_old, x_new, 1 / theta);
+            std::swap(x_old, x_new);
+        }
+
+        if (m_polyDegree % 2 == 1)
+            cusp::blas::copy(ws.polyD, sol);
+    }
+}
+
+/**
+ * This function sets up the approximate inverse preconditioner. For SPD
+ * matrices, this is the factorized sparse approximate inverse (FSAI): a lower
+ * triangular G, with the pattern of the lower triangle of A, such that
+ * G A G^T is close to the identity. Otherwise, it is the sparse approximate
+ * inverse (SPAI) M, with the pattern of A, which minimizes ||I - M A||_F.
+ * Either way, every row is the solution of a small independent dense problem,
+ * so the rows are computed in parallel on the host.
+ */
+template <typename PrecVector>
+template <typename Matrix>
+void
+Precond<PrecVector>::setupApproxInverse(const Matrix&  A, const DoubleMatrixCsr&)
+{
+    CPUTimer transfer_timer, ai_timer;
+
+    PrecMatrixCsrH Acsrh;
+
+    if (!loadSparseMatrix(A, Acsrh))
+        return;
+
+    PrecMatrixCsrH    Mh;
+    std::vector<char> rowOK(m_n, 1);
+
+    ai_timer.Start();
+
+    if (m_isSPD) {
+        // The pattern of G is the lower triangle of A, plus the diagonal.
+        std::vector<int> pattern;
+
+        Mh.resize(m_n, m_n, 0);
+        Mh.row_offsets[0] = 0;
+
+        for (int i = 0; i < m_n; i++) {
+            size_t rowBegin = pattern.size();
+
+            for (int l = Acsrh.row_offsets[i]; l < Acsrh.row_offsets[i+1]; l++)
+                if (Acsrh.column_indices[l] < i)
+                    pattern.push_back(Acsrh.column_indices[l]);
+
+            std::sort(pattern.begin() + rowBegin, pattern.end());
+            pattern.erase(std::unique(pattern.begin() + rowBegin, pattern.end()), pattern.end());
+            pattern.push_back(i);
+
+            Mh.row_offsets[i+1] = (int) pattern.size();
+        }
+
+        Mh.resize(m_n, m_n, (int) pattern.size());
+        thrust::copy(pattern.begin(), pattern.end(), Mh.column_indices.begin());
+
+#pragma omp parallel
+        {
+            std::vector<int>    cols;
+            std::vector<double> work;
+
+#pragma omp for schedule(dynamic, 64)
+            for (int i = 0; i < m_n; i++) {
+                int begin = Mh.row_offsets[i];
+                int end   = Mh.row_offsets[i+1];
+
+                cols.assign(Mh.column_indices.begin() + begin, Mh.column_indices.begin() + end);
+                rowOK[i] = fsaiRow(Acsrh, cols, work, &Mh.values[begin]);
+            }
+        }
+
+        // If a local problem is not SPD, use the Jacobi row for it.
+        for (int i = 0; i < m_n; i++) {
+            if (rowOK[i])
+                continue;
+
+            PrecValueType diag = 0;
+            for (int l = Acsrh.row_offsets[i]; l < Acsrh.row_offsets[i+1]; l++)
+                if (Acsrh.column_indices[l] == i)
+                    diag += Acsrh.values[l];
+
+            if (diag <= 0)
+                throw system_error(system_error::Zero_pivoting, "Non-positive diagonal found in FSAI preconditioner.");
+
+            thrust::fill(Mh.values.begin() + Mh.row_offsets[i], Mh.values.begin() + Mh.row_offsets[i+1], (PrecValueType) 0);
+            Mh.values[Mh.row_offsets[i+1] - 1] = (PrecValueType) (1 / std::sqrt((double) diag));
+        }
+    } else {
+        // The pattern of M is the pattern of A.
+        Mh = Acsrh;
+
+#pragma omp parallel
+        {
+            std::vector<int>    cols;
+            std::vector<double> work;
+
+#pragma omp for schedule(dynamic, 64)
+            for (int i = 0; i < m_n; i++)
+                rowOK[i] = spaiRow(Acsrh, i, cols, work, &Mh.values[Mh.row_offsets[i]]);
+        }
+
+        // If a local least-squares problem is rank deficient, use the Jacobi
+        // row for it.
+        for (int i = 0; i < m_n; i++) {
+            if (rowOK[i])
+                continue;
+
+            PrecValueType diag = 0;
+            for (int l = Acsrh.row_offsets[i]; l < Acsrh.row_offsets[i+1]; l++)
+                if (Acsrh.column_indices[l] == i)
+                    diag += Acsrh.values[l];
+
+            if (diag == 0)
+                throw system_error(system_error::Zero_pivoting, "Zero diagonal found in SPAI preconditioner.");
+
+            for (int l = Mh.row_offsets[i]; l < Mh.row_offsets[i+1]; l++)
+                Mh.values[l] = (Mh.column_indices[l] == i) ? (PrecValueType) 1 / diag : (PrecValueType) 0;
+        }
+    }
+
+    ai_timer.Stop();
+    m_time_bandLU = ai_timer.getElapsed();
+
+    m_actual_nnz = Mh.num_entries;
+
+    transfer_timer.Start();
+    m_aiM = Mh;
+    if (m_isSPD) {
+        PrecMatrixCsrH Mth;
+        cusp::transpose(Mh, Mth);
+        m_aiMt = Mth;
+        workspace().aiBuffer.resize(m_n);
+    }
+    transfer_timer.Stop();
+    m_time_transfer += transfer_timer.getElapsed();
+}
+
+/**
+ * This function computes row i of the SPAI preconditioner, i.e. the values
+ * m (on the pattern J of row i of A) minimizing ||e_i^T - m^T A(J,:)||. Only
+ * the columns I of A(J,:) which are not identically zero matter, so this is a
+ * dense |I| x |J| least-squares problem, solved with a Householder QR
+ * factorization. The function returns false if the problem is rank deficient.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::spaiRow(const PrecMatrixCsrH&  A,
+                             int                    i,
+                             std::vector<int>&      cols,
+                             std::vector<double>&   work,
+                             PrecValueType*         values)
+{
+    int begin = A.row_offsets[i];
+    int numJ  = A.row_offsets[i+1] - begin;
+
+    cols.clear();
+    for (int l = begin; l < begin + numJ; l++) {
+        int j = A.column_indices[l];
+        for (int t = A.row_offsets[j]; t < A.row_offsets[j+1]; t++)
+            cols.push_back(A.column_indices[t]);
+    }
+
+    std::sort(cols.begin(), cols.end());
+    cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+
+    int numI = (int) cols.size();
+
+    if (numJ == 0 || numI < numJ)
+        return false;
+
+    // Column-major C = A(J, I)^T and right-hand side e_i(I).
+    work.assign((size_t) numI * numJ + numI, 0);
+    double* C = &work[0];
+    double* e = &work[(size_t) numI * numJ];
+
+    for (int c = 0; c < numJ; c++) {
+        int j = A.column_indices[begin + c];
+        for (int t = A.row_offsets[j]; t < A.row_offsets[j+1]; t++) {
+            int r = (int) (std::lower_bound(cols.begin(), cols.end(), A.column_indices[t]) - cols.begin());
+            C[r + (size_t) c * numI] += A.values[t];
+        }
+    }
+
+    {
+        std::vector<int>::iterator it = std::lower_bound(cols.begin(), cols.end(), i);
+        if (it == cols.end() || *it != i)
+            return false;
+        e[it - cols.begin()] = 1;
+    }
+
+    // Householder QR, applying the reflections to e at the same time.
+    double tol = 0;
+
+    for (int c = 0; c < numJ; c++) {
+        double* x   = C + c + (size_t) c * numI;
+        int     len = numI - c;
+
+        double norm = 0;
+        for (int r = 0; r < len; r++)
+            norm += x[r] * x[r];
+        norm = std::sqrt(norm);
+
+        if (c == 0)
+            tol = norm * numI * std::numeric_limits<double>::epsilon();
+        if (norm <= tol)
+            return false;
+
+        double alpha  = (x[0] > 0) ? -norm : norm;
+        double vnorm2 = (x[0] - alpha) * (x[0] - alpha) + norm * norm - x[0] * x[0];
+
+        x[0] -= alpha;
+
+        for (int c2 = c + 1; c2 <= numJ; c2++) {
+            double* y = (c2 < numJ) ? (C + c + (size_t) c2 * numI) : (e + c);
+
+            double dot = 0;
+            for (int r = 0; r < len; r++)
+                dot += x[r] * y[r];
+
+            double f = 2 * dot / vnorm2;
+            for (int r = 0; r < len; r++)
+                y[r] -= f * x[r];
+        }
+
+        x[0] = alpha;
+    }
+
+    // Back substitution with R.
+    for (int c = numJ - 1; c >= 0; c--) {
+        double sum = e[c];
+        for (int c2 = c + 1; c2 < numJ; c2++)
+            sum -= C[c + (size_t) c2 * numI] * e[c2];
+        e[c] = sum / C[c + (size_t) c * numI];
+        values[c] = (PrecValueType) e[c];
+    }
+
+    return true;
+}
+
+/**
+ * This function computes a row of the FSAI factor G, whose pattern is given
+ * by the (sorted) column indices cols, the last one being the row index i:
+ * with S = A(cols, cols), solve S y = e_i and scale y by 1/sqrt(y_i). The
+ * dense SPD system is solved with a Cholesky factorization; the function
+ * returns false if S is not positive definite.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::fsaiRow(const PrecMatrixCsrH&    A,
+                             const std::vector<int>&  cols,
+                             std::vector<double>&     work,
+                             PrecValueType*           values)
+{
+    int m = (int) cols.size();
+
+    work.assign((size_t) m * m + m, 0);
+    double* S = &work[0];
+    double* y = &work[(size_t) m * m];
+
+    for (int a = 0; a < m; a++) {
+        int j = cols[a];
+        for (int t = A.row_offsets[j]; t < A.row_offsets[j+1]; t++) {
+            std::vector<int>::const_iterator it = std::lower_bound(cols.begin(), cols.end(), A.column_indices[t]);
+            if (it != cols.end() && *it == A.column_indices[t])
+                S[a + (size_t) (it - cols.begin()) * m] += A.values[t];
+        }
+    }
+
+    // In-place Cholesky factorization S = L L^T (lower triangle).
+    for (int c = 0; c < m; c++) {
+        double d = S[c + (size_t) c * m];
+        for (int p = 0; p < c; p++)
+            d -= S[c + (size_t) p * m] * S[c + (size_t) p * m];
+
+        if (d <= 0)
+            return false;
+
+        d = std::sqrt(d);
+        S[c + (size_t) c * m] = d;
+
+        for (int r = c + 1; r < m; r++) {
+            double sum = S[r + (size_t) c * m];
+            for (int p = 0; p < c; p++)
+                sum -= S[r + (size_t) p * m] * S[c + (size_t) p * m];
+            S[r + (size_t) c * m] = sum / d;
+        }
+    }
+
+    // Solve L L^T y = e_i.
+    y[m - 1] = 1;
+    for (int r = 0; r < m; r++) {
+        for (int p = 0; p < r; p++)
+            y[r] -= S[r + (size_t) p * m] * y[p];
+        y[r] /= S[r + (size_t) r * m];
+    }
+    for (int r = m - 1; r >= 0; r--) {
+        for (int p = r + 1; p < m; p++)
+            y[r] -= S[p + (size_t) r * m] * y[p];
+        y[r] /= S[r + (size_t) r * m];
+    }
 
-    // If there is just one partition, force using constant-bandwidth method.
-    if (m_numPartitions == 1)
-        m_variableBandwidth = false;
+    double scale = 1 / std::sqrt(y[m - 1]);
+    for (int a = 0; a < m; a++)
+        values[a] = (PrecValueType) (y[a] * scale);
 
-    if (m_gpuCount > m_numPartitions) {
-        m_gpuCount = m_numPartitions;
-    }
+    return true;
+}
 
-    // Set the size and load the banded matrix into m_B.
-    m_B.resize((2*m_k+1)*n);
+/**
+ * This function applies the approximate inverse preconditioner: one SpMV
+ * with M for SPAI, two SpMVs (with G and G^T) for FSAI.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::approxInverseSolve(PrecVector&  rhs,
+                                        PrecVector&  sol)
+{
+    Workspace& ws = workspace();
 
-    int blockX = nnz, gridX = 1, gridY = 1;
-    kernelConfigAdjust(blockX, gridX, gridY, BLOCK_SIZE, MAX_GRID_DIMENSION);
-    dim3 grids(gridX, gridY);
+    if (m_isSPD) {
+        cusp::multiply(m_aiM, rhs, ws.aiBuffer);
+        cusp::multiply(m_aiMt, ws.aiBuffer, sol);
+    } else
+        cusp::multiply(m_aiM, rhs, sol);
+}
 
-    int*           d_rows = thrust::raw_pointer_cast(&(Acoo.row_indices[0]));
-    int*           d_cols = thrust::raw_pointer_cast(&(Acoo.column_indices[0]));
-    PrecValueType* d_vals = thrust::raw_pointer_cast(&(Acoo.values[0]));
-    PrecValueType* dB     = thrust::raw_pointer_cast(&m_B[0]);
+/**
+ * This function assembles the blocks of the restricted additive Schwarz
+ * preconditioner from the banded matrix m_B. Every partition is extended by
+ * m_overlap rows on either side (the half-bandwidth, if m_overlap is not
+ * positive) and all blocks are padded to the same size, so that they can be
+ * factored and solved with the constant-bandwidth partitioned kernels. On
+ * return, m_B holds the m_numPartitions blocks of the system of size
+ * m_schwarzN. Only the first m_n columns of m_B are read, so this function can
+ * also be used by update() after the new entries were scattered into m_B.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::assembleSchwarzBlocks()
+{
+    int overlap   = (m_overlap > 0) ? m_overlap : m_k;
+    int partSize  = m_n / m_numPartitions;
+    int remainder = m_n % m_numPartitions;
 
-    m_timer.Start();
-    device::copyFromCOOMatrixToBandedMatrix<<<grids, blockX>>>(nnz, m_k, d_rows, d_cols, d_vals, dB, 0, m_saveMem);
+    // Find the size of the largest extended block and build the maps
+    // between the rows of the original system and those of the blocks.
+    int blockSize = 0;
+    for (int i = 0; i < m_numPartitions; i++) {
+        int begin = i * partSize + std::min(i, remainder);
+        int end   = begin + partSize + (i < remainder ? 1 : 0);
+        blockSize = std::max(blockSize, std::min(end + overlap, m_n) - std::max(begin - overlap, 0));
+    }
 
-    if (m_gpuCount > 1) {
-        saveCurDevice();
-        int rows_per_partition = m_n / m_numPartitions;
-        int rows_remainder = m_n % m_numPartitions;
-        int partitions_per_device = m_numPartitions / m_gpuCount;
-        int part_remainder = m_numPartitions % m_gpuCount;
+    m_schwarzN = blockSize * m_numPartitions;
 
-        int partBegin = 0, partEnd;
-        int rowBegin = 0;
-        int cur_b_offset = 0;
+    IntVectorH  extMap(m_schwarzN);
+    IntVectorH  resMap(m_n);
 
-        m_all_Bs.resize(m_gpuCount);
-        m_all_BOffsets.resize(m_gpuCount);
-        m_all_ks.resize(m_gpuCount);
-        m_all_BOffsets_host.resize(m_gpuCount);
-        m_all_ks_host.resize(m_gpuCount);
-        m_all_num_rows.resize(m_gpuCount);
-        m_all_num_partitions.resize(m_gpuCount);
-        m_all_ks_col_host.resize(m_gpuCount);
+    for (int i = 0; i < m_numPartitions; i++) {
+        int begin = i * partSize + std::min(i, remainder);
+        int end   = begin + partSize + (i < remainder ? 1 : 0);
+        int lo    = std::max(begin - overlap, 0);
+        int hi    = std::min(end + overlap, m_n);
 
-        for (int i = 0; i < m_gpuCount; i++) {
-            cudaSetDevice(i);
+        // Padding rows are decoupled from the block, so the entry of the
+        // right-hand side they pick up does not matter.
+        for (int j = 0; j < blockSize; j++)
+            extMap[i * blockSize + j] = (j < hi - lo) ? (lo + j) : lo;
 
-            int total_b_offset = 0;
+        // Restriction: every row takes its value from the block owning it.
+        for (int j = begin; j < end; j++)
+            resMap[j] = i * blockSize + (j - lo);
+    }
 
-            if (i < part_remainder) {
-                partEnd = partBegin + (partitions_per_device + 1);
-            } else {
-                partEnd = partBegin + partitions_per_device;
-            }
+    m_schwarzExtMap = extMap;
+    m_schwarzResMap = resMap;
+    workspace().schwarzBuffer.resize(m_schwarzN);
 
-            int r_begin = rowBegin;
-            int rowEnd;
+    PrecVector Bext((size_t) (2 * m_k + 1) * m_schwarzN);
 
-            m_all_ks_host[i].resize(partEnd - partBegin);
-            m_all_BOffsets_host[i].resize(partEnd - partBegin + 1);
-            m_all_BOffsets_host[i][0] = 0;
+    int gridX = m_schwarzN, gridY = 1;
+    kernelConfigAdjust(gridX, gridY, MAX_GRID_DIMENSION);
+    dim3 grids(gridX, gridY);
 
-            for (int j = partBegin; j < partEnd; j++) {
-                if (j < rows_remainder) {
-                    rowEnd = r_begin + (rows_per_partition + 1);
-                    total_b_offset += (rows_per_partition + 1) * (2 * m_k + 1);
-                    m_all_BOffsets_host[i][j - partBegin + 1] = m_all_BOffsets_host[i][j - partBegin] + (rows_per_partition + 1) * (2 * m_k + 1);
-                } else {
-                    rowEnd = r_begin + rows_per_partition;
-                    total_b_offset += (rows_per_partition) * (2 * m_k + 1);
-                    m_all_BOffsets_host[i][j - partBegin + 1] = m_all_BOffsets_host[i][j - partBegin] + (rows_per_partition) * (2 * m_k + 1);
-                }
-                m_all_ks_host[i][j - partBegin] = m_k;
+    device::assembleOverlapBlocks<PrecValueType><<<grids, std::min(2 * m_k + 1, 512)>>>(
+            m_n, m_k, m_numPartitions, overlap, blockSize,
+            thrust::raw_pointer_cast(&m_B[0]),
+            thrust::raw_pointer_cast(&Bext[0]));
 
-                r_begin = rowEnd;
-            }
-            m_all_ks_col_host[i].resize(rowEnd - rowBegin, m_k);
+    m_B.swap(Bext);
+}
 
-            m_all_Bs[i].resize(m_all_BOffsets_host[i][partEnd - partBegin]);
-            thrust::copy(m_B.begin() + cur_b_offset, m_B.begin() + (cur_b_offset + total_b_offset), m_all_Bs[i].begin());
-            cur_b_offset += total_b_offset;
+/**
+ * This function applies the restricted additive Schwarz preconditioner: the
+ * right-hand side is extended to the overlapping blocks, all blocks are
+ * solved independently (one thread block per partition) and every row of the
+ * solution is taken from the block which owns it.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::schwarzSolve(PrecVector&  rhs,
+                                  PrecVector&  sol)
+{
+    Workspace& ws = workspace();
 
-            m_all_ks[i] = m_all_ks_host[i];
-            m_all_BOffsets[i] = m_all_BOffsets_host[i];
-            m_all_num_rows[i] = rowEnd - rowBegin;
-            m_all_num_partitions[i] = partEnd - partBegin;
+    thrust::gather(m_schwarzExtMap.begin(), m_schwarzExtMap.end(), rhs.begin(), ws.schwarzBuffer.begin());
 
-            rowBegin = rowEnd;
-            partBegin = partEnd;
-        }
+    partBandedFwdSweep_const(ws.schwarzBuffer, m_schwarzN, m_k, m_numPartitions, m_B);
+    partBandedBckSweep_const(ws.schwarzBuffer, m_schwarzN, m_k, m_numPartitions, m_B);
 
-        recoverCurDevice();
-        m_B.clear();
-    }
-    m_timer.Stop();
-    m_time_toBanded = m_timer.getElapsed();
+    thrust::gather(m_schwarzResMap.begin(), m_schwarzResMap.end(), ws.schwarzBuffer.begin(), sol.begin());
 }
 
 
@@ -2413,6 +4215,10 @@ template <typename PrecVector>
 void
 Precond<PrecVector>::partFullLU()
 {
+    // The compressed reduced blocks are factored by compressSpikes().
+    if (useCompressedSpikes())
+        return;
+
 #if 0
     if (m_variableBandwidth || m_ilu_level >= 0)
         partBlockedFullLU_var();
@@ -3399,6 +5205,9 @@ Precond<PrecVector>::ILUULT(PrecMatrixCsrH &Acsrh, PrecMatrixCsrH &Acsrh2, int p
 }
 
 /*! \brief This function does ILU0 to the provided CSR matrix.
+ *
+ * With the multicolor ordering, the rows of each color are only coupled to
+ * rows of the preceding colors and are therefore factored in parallel.
  */
 template <typename PrecVector>
 void
@@ -3408,50 +5217,165 @@ Precond<PrecVector>::ILU0(PrecMatrixCsrH& Acsrh)
     IntVectorH&  column_indices = m_Acsrh.column_indices;
     PrecVectorH& values         = m_Acsrh.values;
 
-    for (int i = 1; i < m_n; i++) {
-        int start_idx = row_offsets[i];
-        int end_idx = row_offsets[i+1];
+    if (m_colorOffsets.size() > 1) {
+        int numColors = (int) m_colorOffsets.size() - 1;
 
-        for (int l = start_idx; l < end_idx; l++) {
-            int cur_k = column_indices[l];
-            if (cur_k >= i)
-                break;
+        for (int c = 0; c < numColors; c++) {
+            int  begin  = m_colorOffsets[c];
+            int  end    = m_colorOffsets[c+1];
+            bool failed = false;
+
+#pragma omp parallel for num_threads(hostThreads()) schedule(dynamic, 64) reduction(||: failed)
+            for (int i = begin; i < end; i++)
+                if (!ILU0Row(i, row_offsets, column_indices, values))
+                    failed = true;
+
+            if (failed)
+                throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (ilu).");
+        }
 
-            int start_k_idx = row_offsets[cur_k];
-            int end_k_idx = row_offsets[cur_k+1];
+        return;
+    }
 
-            int l2;
-            PrecValueType val_i_k = 0.0;
+    for (int i = 1; i < m_n; i++)
+        if (!ILU0Row(i, row_offsets, column_indices, values))
+            throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (ilu).");
+}
 
-            for (l2 = start_k_idx; l2 < end_k_idx; l2++) {
-                int pivot = column_indices[l2];
-                if (pivot > cur_k) 
-                    throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (ilu).");
-                else if (pivot == cur_k) {
-                    val_i_k = (values[l] /= values[l2]);
+/*! \brief This function eliminates row i in ILU0, assuming all rows it
+ * depends on are already factored. It returns false if a zero pivot is met.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::ILU0Row(int                i,
+                             const IntVectorH&  row_offsets,
+                             const IntVectorH&  column_indices,
+                             PrecVectorH&       values)
+{
+    int start_idx = row_offsets[i];
+    int end_idx = row_offsets[i+1];
+
+    for (int l = start_idx; l < end_idx; l++) {
+        int cur_k = column_indices[l];
+        if (cur_k >= i)
+            break;
+
+        int start_k_idx = row_offsets[cur_k];
+        int end_k_idx = row_offsets[cur_k+1];
+
+        int l2;
+        PrecValueType val_i_k = 0.0;
+
+        for (l2 = start_k_idx; l2 < end_k_idx; l2++) {
+            int pivot = column_indices[l2];
+            if (pivot > cur_k) 
+                return false;
+            else if (pivot == cur_k) {
+                val_i_k = (values[l] /= values[l2]);
+                break;
+            }
+        }
+
+        if (l2 >= end_k_idx)
+            return false;
+
+        int l3 = l + 1;
+        for (l2++; l2 < end_k_idx; l2++) {
+            int tar_j = column_indices[l2];
+            for (; l3 < end_idx; l3++) {
+                int tmp_j = column_indices[l3];
+                if (tmp_j > tar_j) break;
+                else if (tmp_j == tar_j) {
+                    values[l3] -= values[l2] * val_i_k;
+                    l3 ++;
                     break;
                 }
             }
+            if (l3 >= end_idx) break;
+        }
+    }
 
-            if (l2 >= end_k_idx)
-                throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (ilu).");
+    return true;
+}
+
+/*! \brief This function does the fine-grained iterative ILU0 to the
+ * provided CSR matrix.
+ *
+ * The L and U factors (on the pattern of A, L with unit diagonal) are the
+ * fixed point of
+ *     l_ij = (a_ij - sum_{k<j} l_ik u_kj) / u_jj,   i > j
+ *     u_ij =  a_ij - sum_{k<i} l_ik u_kj,           i <= j
+ * and m_iluSweeps sweeps of this iteration are performed, with all entries
+ * updated in parallel and in place (i.e. asynchronously, as proposed by Chow
+ * and Patel). The iteration starts from the scaled lower and upper parts of
+ * A or, if warmStart is set, from the factors of the previous call. On
+ * return, Acsrh holds the factors in the same format as ILU0().
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::iterativeILU0(PrecMatrixCsrH&  Acsrh,
+                                   bool             warmStart)
+{
+    int          nnz = Acsrh.num_entries;
+    PrecVectorH  a   = Acsrh.values;
+
+    const int*   row_offsets    = thrust::raw_pointer_cast(&Acsrh.row_offsets[0]);
+    const int*   column_indices = thrust::raw_pointer_cast(&Acsrh.column_indices[0]);
+
+    // Locate the diagonal entries.
+    IntVectorH diag(m_n);
+
+    for (int i = 0; i < m_n; i++) {
+        const int* it = std::lower_bound(column_indices + row_offsets[i], column_indices + row_offsets[i+1], i);
+
+        if (it == column_indices + row_offsets[i+1] || *it != i)
+            throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (iterative ilu).");
+
+        diag[i] = (int) (it - column_indices);
+    }
+
+    if (!warmStart || (int) m_iluFactors.size() != nnz) {
+        m_iluFactors = a;
+
+        for (int i = 0; i < m_n; i++)
+            for (int l = row_offsets[i]; l < diag[i]; l++)
+                m_iluFactors[l] = a[l] / a[diag[column_indices[l]]];
+    }
 
-            int l3 = l + 1;
-            for (l2++; l2 < end_k_idx; l2++) {
-                int tar_j = column_indices[l2];
-                for (; l3 < end_idx; l3++) {
-                    int tmp_j = column_indices[l3];
-                    if (tmp_j > tar_j) break;
-                    else if (tmp_j == tar_j) {
-                        values[l3] -= values[l2] * val_i_k;
-                        l3 ++;
+    PrecValueType*        f      = thrust::raw_pointer_cast(&m_iluFactors[0]);
+    const PrecValueType*  a_vals = thrust::raw_pointer_cast(&a[0]);
+    const int*            d_pos  = thrust::raw_pointer_cast(&diag[0]);
+    int                   n      = m_n;
+
+    for (int sweep = 0; sweep < m_iluSweeps; sweep++) {
+#pragma omp parallel for num_threads(hostThreads()) schedule(dynamic, 64)
+        for (int i = 0; i < n; i++) {
+            for (int l = row_offsets[i]; l < row_offsets[i+1]; l++) {
+                int           j    = column_indices[l];
+                int           kMax = std::min(i, j);
+                PrecValueType sum  = a_vals[l];
+
+                // sum_k l_ik u_kj, looking up u_kj in the upper part of row k.
+                for (int l2 = row_offsets[i]; l2 < row_offsets[i+1]; l2++) {
+                    int k = column_indices[l2];
+                    if (k >= kMax)
                         break;
-                    }
+
+                    const int* it = std::lower_bound(column_indices + d_pos[k], column_indices + row_offsets[k+1], j);
+                    if (it != column_indices + row_offsets[k+1] && *it == j)
+                        sum -= f[l2] * f[it - column_indices];
                 }
-                if (l3 >= end_idx) break;
+
+                f[l] = (i > j) ? sum / f[d_pos[j]] : sum;
             }
         }
-    } 
+    }
+
+    for (int i = 0; i < m_n; i++)
+        if (f[diag[i]] == 0)
+            throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (iterative ilu).");
+
+    thrust::copy(m_iluFactors.begin(), m_iluFactors.end(), Acsrh.values.begin());
 }
 
 /*! \brief This function does incomplete LU with pivoting 
@@ -3781,11 +5705,12 @@ Precond<PrecVector>::ILUTP(PrecMatrixCsrH&    Acsrh,
 }
 
 /** This function does sparse factorization to the provided
- * CSR matrix.
+ * CSR matrix. With warmStart, the iterative ILU(0) factorization starts
+ * from the factors of the previous call.
  */
 template <typename PrecVector>
 void
-Precond<PrecVector>::sparseFactorization()
+Precond<PrecVector>::sparseFactorization(bool warmStart)
 {
     m_pivots.resize(m_n);
     m_pivots_ul.resize(m_n);
@@ -3795,9 +5720,12 @@ Precond<PrecVector>::sparseFactorization()
         IntVectorH pivotPerm, pivotReordering;
 
         // Do ILU here, now only ILU0 is implemented
-        if (m_ilu_level == 0)
-            ILU0(m_Acsrh);
-        else {
+        if (m_ilu_level == 0) {
+            if (m_iluSweeps > 0)
+                iterativeILU0(m_Acsrh, warmStart);
+            else
+                ILU0(m_Acsrh);
+        } else {
             if (m_safeFactorization)
                 ILUTP(m_Acsrh, m_ilu_level, m_tolerance, (PrecValueType)0.1, pivotPerm, pivotReordering);
             else
@@ -3883,6 +5811,11 @@ template <typename PrecVector>
 void
 Precond<PrecVector>::partBandedLU()
 {
+    if (useHostCholesky()) {
+        partBandedCholeskyH();
+        return;
+    }
+
     if (m_variableBandwidth) {
         // Variable bandwidth method. Note that in this situation, there
         // must be more than one partition.
@@ -4229,6 +6162,106 @@ Precond<PrecVector>::partBlockedBandedCholesky_one()
     }
 }
 
+/**
+ * This function indicates whether the banded factorization and the sweeps
+ * are performed on the host. This requires an SPD matrix in half storage
+ * (saveMem) on a single device, factored either as a single partition or
+ * as independent diagonal blocks (i.e. without Spike coupling).
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::useHostCholesky() const
+{
+    return m_hostCholesky && m_isSPD && m_saveMem && m_gpuCount == 1 && m_k > 0
+        && m_ilu_level < 0 && !m_use_bcr
+        && (m_precondType == Block || m_numPartitions == 1);
+}
+
+/**
+ * This function performs the LDL^T factorization of each diagonal block of
+ * the SPD banded matrix on the host. Only the lower half of the band is
+ * stored (column width k+1, diagonal first); on output, the diagonal holds
+ * D and the strictly lower part the unit lower triangular factor L. Both
+ * the storage and the flops are half of those of the banded LU.
+ *
+ * Partitions are factored in parallel. With a single (wide) partition, the
+ * updates of the trailing columns are distributed among the threads
+ * instead, within one parallel region for the whole factorization. The
+ * innermost loops run over contiguous column segments and are vectorized.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::partBandedCholeskyH()
+{
+    m_Bh = m_B;
+
+    PrecValueType* p_B = thrust::raw_pointer_cast(&m_Bh[0]);
+
+    int numPartitions = m_numPartitions;
+    int partSize  = m_n / numPartitions;
+    int remainder = m_n % numPartitions;
+
+#pragma omp parallel for if (numPartitions > 1) schedule(dynamic)
+    for (int p = 0; p < numPartitions; p++) {
+        int start_idx = 0, end_idx = 0;
+
+        if (p < remainder) {
+            start_idx = p * (partSize + 1);
+            end_idx = start_idx + (partSize + 1);
+        } else {
+            start_idx = p * partSize + remainder;
+            end_idx = start_idx + partSize;
+        }
+
+        int            k         = (m_variableBandwidth ? m_ks_host[p] : m_k);
+        int            col_width = k + 1;
+        int            n_p       = end_idx - start_idx;
+        PrecValueType* B         = p_B + (m_variableBandwidth ? (size_t) m_BOffsets_host[p] : (size_t) start_idx * col_width);
+        bool           parUpdate = (numPartitions == 1 && k >= HOST_CHOLESKY_THRESHOLD);
+
+        // A single parallel region spans the whole column loop; the pivot
+        // and the scaling of column j are done by one thread, the barriers
+        // of 'single' and 'for' order the steps.
+#pragma omp parallel if (parUpdate)
+        for (int j = 0; j < n_p; j++) {
+            PrecValueType* col_j = B + (size_t) j * col_width;
+            int            len   = std::min(k, n_p - 1 - j);
+
+#pragma omp single
+            {
+                PrecValueType d = col_j[0];
+
+                if (d > -BURST_VALUE && d < BURST_VALUE) {
+                    d = (d < 0 ? -BURST_VALUE : BURST_VALUE);
+                    col_j[0] = d;
+                }
+
+                PrecValueType inv_d = PrecValueType(1) / d;
+
+#pragma omp simd
+                for (int t = 1; t <= len; t++)
+                    col_j[t] *= inv_d;
+            }
+
+            PrecValueType d = col_j[0];
+
+            // Update the columns j+1, ..., j+len with L(:,j) * d * L(:,j)^T.
+#pragma omp for
+            for (int c = 1; c <= len; c++) {
+                PrecValueType*       col_c = col_j + (size_t) c * col_width;
+                const PrecValueType* l     = col_j + c;
+                PrecValueType        tmp   = l[0] * d;
+
+#pragma omp simd
+                for (int t = 0; t <= len - c; t++)
+                    col_c[t] -= l[t] * tmp;
+            }
+        }
+    }
+
+    m_B = m_Bh;
+}
+
 template <typename PrecVector>
 void
 Precond<PrecVector>::partBandedLU_const()
@@ -4352,7 +6385,7 @@ Precond<PrecVector>::partBlockedBandedLU_const(
     int n_eff = n;
     int numPart_eff = num_partitions;
 
-    if (m_factMethod == LU_UL && num_partitions > 1 && m_precondType != Block) {
+    if (m_factMethod == LU_UL && num_partitions > 1 && m_precondType != Block && m_precondType != Schwarz) {
         n_eff -= n / num_partitions;
         numPart_eff--;
     }
@@ -4405,7 +6438,7 @@ Precond<PrecVector>::partBlockedBandedLU_const(
         throw system_error(system_error::Zero_pivoting, "Found a pivot equal to zero (partBandedLU_const).");
 
 
-    if (num_partitions == 1 || m_precondType == Block) {
+    if (num_partitions == 1 || m_precondType == Block || m_precondType == Schwarz) {
         int  gridX = n;
         int  gridY = 1;
         kernelConfigAdjust(gridX, gridY, MAX_GRID_DIMENSION);
@@ -4854,7 +6887,8 @@ Precond<PrecVector>::partBlockedBandedUL(PrecVector& B)
  */
 template <typename PrecVector>
 void 
-Precond<PrecVector>::partBandedFwdSweep(PrecVector&  v)
+Precond<PrecVector>::partBandedFwdSweep(PrecVector&  v,
+                                        const int*   active)
 {
     if (m_variableBandwidth) {
         if (m_gpuCount == 1) {
@@ -4864,7 +6898,8 @@ Precond<PrecVector>::partBandedFwdSweep(PrecVector&  v)
                 m_numPartitions,
                 m_B,
                 m_ks,
-                m_BOffsets
+                m_BOffsets,
+                active
             );
         } else {
             omp_set_num_threads(m_gpuCount);
@@ -4967,7 +7002,7 @@ Precond<PrecVector>::partBandedFwdSweep_const(
     int partSize  = n / num_partitions;
     int remainder = n % num_partitions;
 
-    if (m_precondType == Block || m_factMethod == LU_only || num_partitions == 1) {
+    if (m_precondType == Block || m_precondType == Schwarz || m_factMethod == LU_only || num_partitions == 1) {
         if (m_saveMem) {
             if (k > 1024)
                 device::fwdElim_sol_forSPD<PrecValueType> <<<num_partitions, 512>>>(n, k, p_B, p_v, partSize, remainder);
@@ -4999,7 +7034,8 @@ Precond<PrecVector>::partBandedFwdSweep_var(
     int          num_partitions,
     PrecVector&  B,
     IntVector&   ks,
-    IntVector&   b_offsets
+    IntVector&   b_offsets,
+    const int*   active
 )
 {
     PrecValueType* p_B        = thrust::raw_pointer_cast(&B[0]);
@@ -5013,18 +7049,18 @@ Precond<PrecVector>::partBandedFwdSweep_var(
 
     if (m_saveMem)
         if (tmp_k > 1024)
-            device::var::fwdElimCholesky_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::fwdElimCholesky_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else if (tmp_k > 32)
-            device::var::fwdElimCholesky_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::fwdElimCholesky_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else
-            device::var::fwdElimCholesky_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::fwdElimCholesky_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
     else {
         if (tmp_k > 1024)
-            device::var::fwdElim_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::fwdElim_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else if (tmp_k > 32)
-            device::var::fwdElim_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::fwdElim_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else
-            device::var::fwdElim_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::fwdElim_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
     }
 }
 
@@ -5036,7 +7072,8 @@ Precond<PrecVector>::partBandedFwdSweep_var(
  */
 template <typename PrecVector>
 void 
-Precond<PrecVector>::partBandedBckSweep(PrecVector&  v)
+Precond<PrecVector>::partBandedBckSweep(PrecVector&  v,
+                                        const int*   active)
 {
     if (m_variableBandwidth) {
         if (m_gpuCount == 1) {
@@ -5046,7 +7083,8 @@ Precond<PrecVector>::partBandedBckSweep(PrecVector&  v)
                 m_numPartitions,
                 m_B,
                 m_ks,
-                m_BOffsets
+                m_BOffsets,
+                active
             );
         } else {
             omp_set_num_threads(m_gpuCount);
@@ -5154,7 +7192,7 @@ Precond<PrecVector>::partBandedBckSweep_const(
         thrust::transform(v.begin(), v.end(), diag.begin(), v.begin(), thrust::divides<PrecValueType>());
     }
 
-    if (m_precondType == Block || m_factMethod == LU_only || num_partitions == 1) {
+    if (m_precondType == Block || m_precondType == Schwarz || m_factMethod == LU_only || num_partitions == 1) {
         if (num_partitions > 1) {
             if (k > 1024)
                 device::backwardElimU_general<PrecValueType><<<num_partitions, 512>>>(n, k, p_B, p_v, partSize, remainder);
@@ -5195,7 +7233,8 @@ Precond<PrecVector>::partBandedBckSweep_var(
     int          num_partitions,
     PrecVector&  B,
     IntVector&   ks,
-    IntVector&   b_offsets
+    IntVector&   b_offsets,
+    const int*   active
 )
 {
     PrecValueType* p_B        = thrust::raw_pointer_cast(&B[0]);
@@ -5210,23 +7249,23 @@ Precond<PrecVector>::partBandedBckSweep_var(
     int gridX = 1, blockX = partSize + 1;
     kernelConfigAdjust(blockX, gridX, BLOCK_SIZE);
     dim3 grids(gridX, num_partitions);
-    device::var::preBck_sol_divide<PrecValueType><<<grids, blockX>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, m_saveMem);
+    device::var::preBck_sol_divide<PrecValueType><<<grids, blockX>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, m_saveMem, active);
 
     if (m_saveMem) {
         if (tmp_k > 1024)
-            device::var::bckElimCholesky_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::bckElimCholesky_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else if (tmp_k > 32) 
-            device::var::bckElimCholesky_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::bckElimCholesky_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else
-            device::var::bckElimCholesky_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::bckElimCholesky_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
     }
     else {
         if (tmp_k > 1024)
-            device::var::bckElim_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::bckElim_sol<PrecValueType><<<num_partitions, 512>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else if (tmp_k > 32) 
-            device::var::bckElim_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::bckElim_sol_medium<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
         else
-            device::var::bckElim_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+            device::var::bckElim_sol_narrow<PrecValueType><<<num_partitions, tmp_k>>>(n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, active);
     }
 }
 
@@ -5310,6 +7349,81 @@ Precond<PrecVector>::partBandedSweepsH(PrecVector& v)
     v = sol_h;
 }
 
+/**
+ * This function performs the forward and backward sweeps with the LDL^T
+ * factors computed by partBandedCholeskyH(), on the host. Partitions are
+ * processed in parallel; the forward sweep updates contiguous segments of
+ * the solution, while the backward sweep uses vectorized dot products.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::partBandedCholeskySweepsH(PrecVector& v)
+{
+    Workspace& ws = workspace();
+
+    PrecVectorH& sol_h = ws.vh;
+
+    sol_h.resize(m_n);
+    thrust::copy(v.begin(), v.end(), sol_h.begin());
+
+    const PrecValueType* p_B   = thrust::raw_pointer_cast(&m_Bh[0]);
+    PrecValueType*       p_sol = thrust::raw_pointer_cast(&sol_h[0]);
+
+    int numPartitions = m_numPartitions;
+    int partSize  = m_n / numPartitions;
+    int remainder = m_n % numPartitions;
+
+#pragma omp parallel for if (numPartitions > 1) schedule(dynamic)
+    for (int p = 0; p < numPartitions; p++) {
+        int start_idx = 0, end_idx = 0;
+
+        if (p < remainder) {
+            start_idx = p * (partSize + 1);
+            end_idx = start_idx + (partSize + 1);
+        } else {
+            start_idx = p * partSize + remainder;
+            end_idx = start_idx + partSize;
+        }
+
+        int                  k         = (m_variableBandwidth ? m_ks_host[p] : m_k);
+        int                  col_width = k + 1;
+        int                  n_p       = end_idx - start_idx;
+        const PrecValueType* B         = p_B + (m_variableBandwidth ? (size_t) m_BOffsets_host[p] : (size_t) start_idx * col_width);
+        PrecValueType*       x         = p_sol + start_idx;
+
+        // Forward sweep with L.
+        for (int j = 0; j < n_p - 1; j++) {
+            const PrecValueType* col_j = B + (size_t) j * col_width;
+            PrecValueType        x_j   = x[j];
+            int                  len   = std::min(k, n_p - 1 - j);
+
+#pragma omp simd
+            for (int t = 1; t <= len; t++)
+                x[j + t] -= col_j[t] * x_j;
+        }
+
+        // Diagonal scaling with D.
+#pragma omp simd
+        for (int j = 0; j < n_p; j++)
+            x[j] /= B[(size_t) j * col_width];
+
+        // Backward sweep with L^T.
+        for (int j = n_p - 2; j >= 0; j--) {
+            const PrecValueType* col_j = B + (size_t) j * col_width;
+            PrecValueType        sum   = 0;
+            int                  len   = std::min(k, n_p - 1 - j);
+
+#pragma omp simd reduction(+:sum)
+            for (int t = 1; t <= len; t++)
+                sum += col_j[t] * x[j + t];
+
+            x[j] -= sum;
+        }
+    }
+
+    thrust::copy(sol_h.begin(), sol_h.end(), v.begin());
+}
+
 /**
  * This function performs forward elimination and backward substitution
  * sweep for the given sparse matrix Acsr and vector v.
@@ -5319,15 +7433,42 @@ void
 Precond<PrecVector>::sparseSweep(PrecVector&  v,
                                  PrecVector&  w)
 {
-    PrecVectorH sol_h = v;
+    Workspace& ws = workspace();
+
+    PrecVectorH& sol_h = ws.vh;
+
+    sol_h.resize(m_n);
+    thrust::copy(v.begin(), v.end(), sol_h.begin());
 
     int numPartitions = m_numPartitions;
     int partSize  = m_n / numPartitions;
     int remainder = m_n % numPartitions;
-    omp_set_num_threads(std::min(16, numPartitions));
 
     bool last_partition_reverse = (m_numPartitions > 1 && !m_variableBandwidth);
 
+    // Approximate triangular solves with Jacobi iterations, parallel over
+    // the rows of all partitions. These are not available when the last
+    // partition holds UL factors.
+    if (m_iluTriSweeps > 0 && !last_partition_reverse) {
+        jacobiTriSolve(sol_h, true);
+        thrust::transform(sol_h.begin(), sol_h.end(), m_pivots.begin(), sol_h.begin(), thrust::divides<PrecValueType>());
+        jacobiTriSolve(sol_h, false);
+
+        thrust::copy(sol_h.begin(), sol_h.end(), w.begin());
+        return;
+    }
+
+    // With the multicolor ordering, the sweeps are parallel over the rows of
+    // each color.
+    if (m_colorOffsets.size() > 1) {
+        multicolorSweep(sol_h);
+
+        thrust::copy(sol_h.begin(), sol_h.end(), w.begin());
+        return;
+    }
+
+    omp_set_num_threads(std::min(16, numPartitions));
+
 #pragma omp parallel for shared (numPartitions, remainder, partSize, sol_h)
     for (int p = 0; p < numPartitions; p++) {
         int start_row = 0, end_row = 0;
@@ -5408,7 +7549,98 @@ Precond<PrecVector>::sparseSweep(PrecVector&  v,
         }
     }
 
-    w = sol_h;
+    thrust::copy(sol_h.begin(), sol_h.end(), w.begin());
+}
+
+/**
+ * This function performs the forward elimination and backward substitution
+ * sweeps with the ILU factors in m_Acsrh for a multicolor-ordered matrix. In
+ * the forward (backward) sweep, the rows of one color only depend on rows of
+ * the preceding (following) colors, so the colors are processed in order and
+ * the rows within a color in parallel. On entry, x holds the right-hand side.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::multicolorSweep(PrecVectorH&  x)
+{
+    int numColors = (int) m_colorOffsets.size() - 1;
+
+    for (int c = 1; c < numColors; c++) {
+        int begin = m_colorOffsets[c];
+        int end   = m_colorOffsets[c+1];
+
+#pragma omp parallel for num_threads(hostThreads()) schedule(static)
+        for (int i = begin; i < end; i++) {
+            int start_idx = m_Acsrh.row_offsets[i], end_idx = m_Acsrh.row_offsets[i+1];
+            PrecValueType tmp_val = x[i];
+            for (int l = start_idx; l < end_idx; l++) {
+                int cur_k = m_Acsrh.column_indices[l];
+                if (cur_k >= i)
+                    break;
+                tmp_val -= x[cur_k] * m_Acsrh.values[l];
+            }
+            x[i] = tmp_val;
+        }
+    }
+
+    thrust::transform(x.begin(), x.end(), m_pivots.begin(), x.begin(), thrust::divides<PrecValueType>());
+
+    for (int c = numColors - 2; c >= 0; c--) {
+        int begin = m_colorOffsets[c];
+        int end   = m_colorOffsets[c+1];
+
+#pragma omp parallel for num_threads(hostThreads()) schedule(static)
+        for (int i = begin; i < end; i++) {
+            int start_idx = m_Acsrh.row_offsets[i], end_idx = m_Acsrh.row_offsets[i+1];
+            PrecValueType tmp_val = x[i];
+            for (int l = end_idx - 1; l >= start_idx; l--) {
+                int cur_k = m_Acsrh.column_indices[l];
+                if (cur_k <= i)
+                    break;
+                tmp_val -= x[cur_k] * m_Acsrh.values[l];
+            }
+            x[i] = tmp_val;
+        }
+    }
+}
+
+/**
+ * This function approximately solves L x = b (lower = true) or U x = b
+ * (lower = false) with m_iluTriSweeps Jacobi iterations, where L and U are
+ * the unit triangular factors stored in m_Acsrh. On entry, x holds b.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::jacobiTriSolve(PrecVectorH&  x,
+                                    bool          lower)
+{
+    Workspace& ws = workspace();
+
+    PrecVectorH& b = ws.jacobiB;
+    PrecVectorH& y = ws.jacobiY;
+
+    b.resize(m_n);
+    y.resize(m_n);
+    thrust::copy(x.begin(), x.end(), b.begin());
+
+    int n = m_n;
+
+    for (int sweep = 0; sweep < m_iluTriSweeps; sweep++) {
+#pragma omp parallel for num_threads(hostThreads()) schedule(static)
+        for (int i = 0; i < n; i++) {
+            PrecValueType tmp_val = b[i];
+
+            for (int l = m_Acsrh.row_offsets[i]; l < m_Acsrh.row_offsets[i+1]; l++) {
+                int cur_k = m_Acsrh.column_indices[l];
+                if (lower ? (cur_k < i) : (cur_k > i))
+                    tmp_val -= x[cur_k] * m_Acsrh.values[l];
+            }
+
+            y[i] = tmp_val;
+        }
+
+        x.swap(y);
+    }
 }
 
 /**
@@ -5417,7 +7649,8 @@ Precond<PrecVector>::sparseSweep(PrecVector&  v,
  */
 template <typename PrecVector>
 void 
-Precond<PrecVector>::partFullFwdSweep(PrecVector&  v)
+Precond<PrecVector>::partFullFwdSweep(PrecVector&  v,
+                                      const int*   active)
 {
     PrecValueType* p_R = thrust::raw_pointer_cast(&m_R[0]);
     PrecValueType* p_v = thrust::raw_pointer_cast(&v[0]);
@@ -5440,9 +7673,9 @@ Precond<PrecVector>::partFullFwdSweep(PrecVector&  v)
         int* p_spike_ks = thrust::raw_pointer_cast(&m_spike_ks[0]);
 
         if (m_k > 512)
-            device::var::fwdElim_full<PrecValueType><<<grids, 512>>>(m_n, p_spike_ks,  p_ROffsets, p_R, p_v, partSize, remainder);
+            device::var::fwdElim_full<PrecValueType><<<grids, 512>>>(m_n, p_spike_ks,  p_ROffsets, p_R, p_v, partSize, remainder, active);
         else
-            device::var::fwdElim_full_narrow<PrecValueType><<<grids, m_k>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
+            device::var::fwdElim_full_narrow<PrecValueType><<<grids, m_k>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder, active);
     }
 }
 
@@ -5453,7 +7686,8 @@ Precond<PrecVector>::partFullFwdSweep(PrecVector&  v)
  */
 template <typename PrecVector>
 void 
-Precond<PrecVector>::partFullBckSweep(PrecVector&  v)
+Precond<PrecVector>::partFullBckSweep(PrecVector&  v,
+                                      const int*   active)
 {
     PrecValueType* p_R = thrust::raw_pointer_cast(&m_R[0]);
     PrecValueType* p_v = thrust::raw_pointer_cast(&v[0]);
@@ -5476,12 +7710,12 @@ Precond<PrecVector>::partFullBckSweep(PrecVector&  v)
         int* p_spike_ks = thrust::raw_pointer_cast(&m_spike_ks[0]);
 
         if (m_k > 512) {
-            device::var::preBck_full_divide<PrecValueType><<<m_numPartitions-1, 512>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
-            device::var::bckElim_full<PrecValueType><<<grids, 512>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
+            device::var::preBck_full_divide<PrecValueType><<<m_numPartitions-1, 512>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder, active);
+            device::var::bckElim_full<PrecValueType><<<grids, 512>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder, active);
         }
         else {
-            device::var::preBck_full_divide_narrow<PrecValueType><<<m_numPartitions-1, m_k>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
-            device::var::bckElim_full_narrow<PrecValueType><<<grids, 2*m_k-1>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
+            device::var::preBck_full_divide_narrow<PrecValueType><<<m_numPartitions-1, m_k>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder, active);
+            device::var::bckElim_full_narrow<PrecValueType><<<grids, 2*m_k-1>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder, active);
         }
     }
 }
@@ -5494,7 +7728,8 @@ Precond<PrecVector>::partFullBckSweep(PrecVector&  v)
 template <typename PrecVector>
 void 
 Precond<PrecVector>::purifyRHS(PrecVector&  v,
-                               PrecVector&  res)
+                               PrecVector&  res,
+                               const int*   active)
 {
     PrecValueType* p_offDiags = thrust::raw_pointer_cast(&m_offDiags[0]);
     PrecValueType* p_v        = thrust::raw_pointer_cast(&v[0]);
@@ -5519,13 +7754,106 @@ Precond<PrecVector>::purifyRHS(PrecVector&  v,
         int* p_spike_ks  = thrust::raw_pointer_cast(&m_spike_ks[0]);
         
         if (m_k > 256)
-            device::innerProductBCX_var_bandwidth_g256<PrecValueType><<<grids, 256>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder);
+            device::innerProductBCX_var_bandwidth_g256<PrecValueType><<<grids, 256>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder, active);
         else if (m_k > 64)
-            device::innerProductBCX_var_bandwidth_g64<PrecValueType><<<grids, 256>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder);
+            device::innerProductBCX_var_bandwidth_g64<PrecValueType><<<grids, 256>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder, active);
         else if (m_k > 32)
-            device::innerProductBCX_var_bandwidth_g32<PrecValueType><<<grids, 64>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder);
+            device::innerProductBCX_var_bandwidth_g32<PrecValueType><<<grids, 64>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder, active);
         else
-            device::innerProductBCX_var_bandwidth<PrecValueType><<<grids, 32>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder);
+            device::innerProductBCX_var_bandwidth<PrecValueType><<<grids, 32>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder, active);
+    }
+}
+
+/**
+ * This function solves (LU)^T x = v with the LU factors of the diagonal
+ * blocks (stored as L * D * U, with L and U unit triangular) by performing
+ * the sweeps with U^T, the diagonal scaling and the sweeps with L^T.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::partBandedSweepsTranspose(PrecVector&  v)
+{
+    PrecValueType* p_B = thrust::raw_pointer_cast(&m_B[0]);
+    PrecValueType* p_v = thrust::raw_pointer_cast(&v[0]);
+
+    int partSize  = m_n / m_numPartitions;
+    int remainder = m_n % m_numPartitions;
+
+    if (m_variableBandwidth) {
+        int* p_ks       = thrust::raw_pointer_cast(&m_ks[0]);
+        int* p_BOffsets = thrust::raw_pointer_cast(&m_BOffsets[0]);
+
+        int tmp_k      = cusp::blas::nrmmax(m_ks);
+        int numThreads = std::max(1, std::min(tmp_k, 512));
+
+        device::var::fwdElimTrans_sol<PrecValueType><<<m_numPartitions, numThreads>>>(m_n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+
+        int gridX = 1, blockX = partSize + 1;
+        kernelConfigAdjust(blockX, gridX, BLOCK_SIZE);
+        dim3 grids(gridX, m_numPartitions);
+        device::var::preBck_sol_divide<PrecValueType><<<grids, blockX>>>(m_n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder, false);
+
+        device::var::bckElimTrans_sol<PrecValueType><<<m_numPartitions, numThreads>>>(m_n, p_ks, p_BOffsets, p_B, p_v, partSize, remainder);
+    } else {
+        int numThreads = std::max(1, std::min(m_k, 512));
+
+        device::fwdElimTrans_sol<PrecValueType><<<m_numPartitions, numThreads>>>(m_n, m_k, p_B, p_v, partSize, remainder);
+
+        {
+            strided_range<typename PrecVector::iterator> diag(m_B.begin() + m_k, m_B.end(), 2 * m_k + 1);
+            thrust::transform(v.begin(), v.end(), diag.begin(), v.begin(), thrust::divides<PrecValueType>());
+        }
+
+        device::bckElimTrans_sol<PrecValueType><<<m_numPartitions, numThreads>>>(m_n, m_k, p_B, p_v, partSize, remainder);
+    }
+}
+
+/**
+ * This function solves R^T x = v with the LU factors of the reduced matrix R,
+ * where only the entries of v corresponding to the reduced system are used.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::partFullSweepsTranspose(PrecVector&  v)
+{
+    PrecValueType* p_R        = thrust::raw_pointer_cast(&m_R[0]);
+    PrecValueType* p_v        = thrust::raw_pointer_cast(&v[0]);
+    int*           p_ROffsets = thrust::raw_pointer_cast(&m_ROffsets[0]);
+    int*           p_spike_ks = thrust::raw_pointer_cast(&m_spike_ks[0]);
+
+    int partSize   = m_n / m_numPartitions;
+    int remainder  = m_n % m_numPartitions;
+    int numThreads = std::max(1, std::min(2 * m_k, 512));
+
+    device::var::fwdElimTrans_full<PrecValueType><<<m_numPartitions-1, numThreads>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
+    device::var::bckElimTrans_full<PrecValueType><<<m_numPartitions-1, numThreads>>>(m_n, p_spike_ks, p_ROffsets, p_R, p_v, partSize, remainder);
+}
+
+/**
+ * This function applies the transpose of the coupling blocks used in
+ * purifyRHS() to the vector 'v'. Only the entries of 'res' corresponding to
+ * the reduced system are overwritten.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::purifyRHSTranspose(PrecVector&  v,
+                                        PrecVector&  res)
+{
+    PrecValueType* p_offDiags = thrust::raw_pointer_cast(&m_offDiags[0]);
+    PrecValueType* p_v        = thrust::raw_pointer_cast(&v[0]);
+    PrecValueType* p_res      = thrust::raw_pointer_cast(&res[0]);
+
+    int partSize   = m_n / m_numPartitions;
+    int remainder  = m_n % m_numPartitions;
+    int numThreads = std::max(1, std::min(m_k, 256));
+
+    if (!m_variableBandwidth) {
+        device::innerProductBCXTrans<PrecValueType><<<m_numPartitions-1, numThreads>>>(p_offDiags, p_v, p_res, m_n, m_k, partSize, m_numPartitions, remainder);
+    } else {
+        int* p_WVOffsets = thrust::raw_pointer_cast(&m_WVOffsets[0]);
+        int* p_spike_ks  = thrust::raw_pointer_cast(&m_spike_ks[0]);
+
+        device::innerProductBCXTrans_var_bandwidth<PrecValueType><<<m_numPartitions-1, numThreads>>>(p_offDiags, p_v, p_res, m_n, p_spike_ks, p_WVOffsets, partSize, m_numPartitions, remainder);
     }
 }
 
@@ -5996,6 +8324,8 @@ Precond<PrecVector>::calculateSpikes_var(PrecVector&  WV)
         dim3 gridsPermute(permuteGridX, permuteGridY, permuteGridZ);
 
         buffer.resize((size_t)(leftOffDiagWidth + rightOffDiagWidth) * n_eff);
+
+        trackMemory();
         
         PrecValueType* p_buffer = thrust::raw_pointer_cast(&buffer[0]);
 
@@ -6008,7 +8338,12 @@ Precond<PrecVector>::calculateSpikes_var(PrecVector&  WV)
             device::columnPermute<PrecValueType><<<gridsPermute, permuteBlockX>>>(n_eff, leftOffDiagWidth+rightOffDiagWidth, p_extWV, p_buffer, p_secondPerm);
         }
 
-        if (m_gpuCount == 1) {
+        if (m_gpuCount == 1 && m_hostSpikes && m_ilu_level >= 0) {
+            PrecVectorH buffer_h = buffer;
+
+            spikeSweepsH(leftOffDiagWidth, rightOffDiagWidth, buffer_h);
+            buffer = buffer_h;
+        } else if (m_gpuCount == 1) {
             spikeSweeps (
                 leftOffDiagWidth,
                 rightOffDiagWidth,
@@ -6201,6 +8536,135 @@ Precond<PrecVector>::spikeSweeps (
     }
 }
 
+/**
+ * This function performs the sweeps of the sparse spikes (ILU-SPIKE) on the
+ * host, with the ILU factors in m_Acsrh. WV holds one row of width
+ * leftOffDiagWidth + rightOffDiagWidth per matrix row, the right spikes in
+ * the first columns and the left spikes in the last ones.
+ *
+ * Unlike the device kernels, which traverse the factors once per spike
+ * column, every row of the factors is traversed once per block of columns
+ * and the update of the whole block is vectorized. The tasks (a partition,
+ * a spike and a block of its columns) are independent and are distributed
+ * among the OpenMP threads.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::spikeSweepsH(int           leftOffDiagWidth,
+                                  int           rightOffDiagWidth,
+                                  PrecVectorH&  WV)
+{
+    const int SPIKE_COLUMN_BLOCK = 64;
+
+    int width     = leftOffDiagWidth + rightOffDiagWidth;
+    int partSize  = m_n / m_numPartitions;
+    int remainder = m_n % m_numPartitions;
+
+    if (width == 0)
+        return;
+
+    // The forward sweeps of the right spikes start at their first nonzero
+    // row; the backward sweeps only need to reach the first row that the
+    // second-level reordering maps to the bottom block of the partition.
+    IntVectorH  fwd_first_rows = m_first_rows_host;
+
+    {
+        int last_row = 0;
+        for (int i = 0; i < m_numPartitions - 1; i++) {
+            last_row += partSize + (i < remainder ? 1 : 0);
+            m_first_rows_host[i] = thrust::reduce(m_secondPerm_host.begin()+(last_row-m_k), m_secondPerm_host.begin()+last_row, last_row, thrust::minimum<int>());
+        }
+    }
+
+    // Tasks: (partition, first column, last column, is right spike).
+    std::vector<int>  task_part, task_col_begin, task_col_end, task_right;
+
+    for (int p = 0; p < m_numPartitions; p++) {
+        if (p < m_numPartitions - 1)
+            for (int c = 0; c < m_offDiagWidths_right_host[p]; c += SPIKE_COLUMN_BLOCK) {
+                task_part.push_back(p);
+                task_col_begin.push_back(c);
+                task_col_end.push_back(std::min(c + SPIKE_COLUMN_BLOCK, (int) m_offDiagWidths_right_host[p]));
+                task_right.push_back(1);
+            }
+        if (p > 0)
+            for (int c = width - m_offDiagWidths_left_host[p-1]; c < width; c += SPIKE_COLUMN_BLOCK) {
+                task_part.push_back(p);
+                task_col_begin.push_back(c);
+                task_col_end.push_back(std::min(c + SPIKE_COLUMN_BLOCK, width));
+                task_right.push_back(0);
+            }
+    }
+
+    const int*           row_offsets    = thrust::raw_pointer_cast(&m_Acsrh.row_offsets[0]);
+    const int*           column_indices = thrust::raw_pointer_cast(&m_Acsrh.column_indices[0]);
+    const PrecValueType* values         = thrust::raw_pointer_cast(&m_Acsrh.values[0]);
+    const PrecValueType* pivots         = thrust::raw_pointer_cast(&m_pivots[0]);
+    PrecValueType*       p_WV           = thrust::raw_pointer_cast(&WV[0]);
+
+    int numTasks = task_part.size();
+
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < numTasks; t++) {
+        int p          = task_part[t];
+        int col_begin  = task_col_begin[t];
+        int numCols    = task_col_end[t] - col_begin;
+        int part_begin = p * partSize + std::min(p, remainder);
+        int part_end   = part_begin + partSize + (p < remainder ? 1 : 0);
+        int fwd_first  = task_right[t] ? fwd_first_rows[p] : part_begin;
+        int bck_first  = task_right[t] ? m_first_rows_host[p] : part_begin;
+
+        // Forward sweep with the unit lower triangular factor.
+        for (int i = fwd_first + 1; i < part_end; i++) {
+            PrecValueType* row = p_WV + (size_t) i * width + col_begin;
+
+            for (int l = row_offsets[i]; l < row_offsets[i+1]; l++) {
+                int cur_k = column_indices[l];
+                if (cur_k >= i)
+                    break;
+                if (cur_k < fwd_first)
+                    continue;
+
+                const PrecValueType* src = p_WV + (size_t) cur_k * width + col_begin;
+                PrecValueType        val = values[l];
+#pragma omp simd
+                for (int c = 0; c < numCols; c++)
+                    row[c] -= val * src[c];
+            }
+        }
+
+        // Divide by the pivots.
+        for (int i = part_begin; i < part_end; i++) {
+            PrecValueType* row = p_WV + (size_t) i * width + col_begin;
+            PrecValueType  pivot = pivots[i];
+#pragma omp simd
+            for (int c = 0; c < numCols; c++)
+                row[c] /= pivot;
+        }
+
+        // Backward sweep with the unit upper triangular factor.
+        for (int i = part_end - 2; i >= bck_first; i--) {
+            PrecValueType* row = p_WV + (size_t) i * width + col_begin;
+
+            for (int l = row_offsets[i+1] - 1; l >= row_offsets[i]; l--) {
+                int cur_k = column_indices[l];
+                if (cur_k <= i)
+                    break;
+                if (cur_k >= part_end)
+                    continue;
+
+                const PrecValueType* src = p_WV + (size_t) cur_k * width + col_begin;
+                PrecValueType        val = values[l];
+#pragma omp simd
+                for (int c = 0; c < numCols; c++)
+                    row[c] -= val * src[c];
+            }
+        }
+    }
+
+    m_first_rows = m_first_rows_host;
+}
+
 /**
  * This function adjust the number of threads used for kernels which can take
  * any number of threads.
@@ -6253,6 +8717,8 @@ Precond<PrecVector>::calculateSpikes(PrecVector&  B2,
     // Combine 'B' and 'compB2' into 'partialB'.
     PrecVector partialB(2*(two_k+1)*(m_k+1)*(m_numPartitions-1));
 
+    trackMemory();
+
     PrecValueType* p_B        = thrust::raw_pointer_cast(&m_B[0]);
     PrecValueType* p_partialB = thrust::raw_pointer_cast(&partialB[0]);
 
@@ -6293,6 +8759,11 @@ template <typename PrecVector>
 void
 Precond<PrecVector>::assembleReducedMat(PrecVector&  WV)
 {
+    if (useCompressedSpikes()) {
+        compressSpikes(WV);
+        return;
+    }
+
     PrecValueType* p_WV = thrust::raw_pointer_cast(&WV[0]);
     PrecValueType* p_R  = thrust::raw_pointer_cast(&m_R[0]);
 
@@ -6319,6 +8790,131 @@ Precond<PrecVector>::assembleReducedMat(PrecVector&  WV)
     }
 }
 
+/**
+ * This function indicates whether the sweeps of getSRev() are restricted to
+ * the partitions reached by the right-hand side (see computeRHSMasks()).
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::useRHSMasks() const
+{
+    return m_sparseRHS && m_numPartitions > 1 && m_variableBandwidth && m_gpuCount == 1 && !m_use_bcr && m_ilu_level < 0;
+}
+
+/**
+ * This function computes, from the right-hand side v, the masks of the
+ * partitions and interfaces which have to be processed by getSRev(); all
+ * others only hold zeros, which the sweeps would leave unchanged. With a
+ * truncated Spike reduced matrix, an interface is reached if either of its
+ * partitions is, and the purified right-hand side of a partition is nonzero
+ * if the partition or one of its interfaces is reached. The masks stay on
+ * the device, so no synchronization is required.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::computeRHSMasks(const PrecVector&  v)
+{
+    Workspace& ws = workspace();
+
+    int partSize  = m_n / m_numPartitions;
+    int remainder = m_n % m_numPartitions;
+
+    ws.rhsPartMask.resize(m_numPartitions);
+    ws.rhsInterfaceMask.resize(m_numPartitions - 1);
+    ws.rhsPurifiedMask.resize(m_numPartitions);
+
+    thrust::reduce_by_key(
+            thrust::make_transform_iterator(thrust::make_counting_iterator(0), PartitionOf(partSize, remainder)),
+            thrust::make_transform_iterator(thrust::make_counting_iterator(m_n), PartitionOf(partSize, remainder)),
+            thrust::make_transform_iterator(v.begin(), IsNonzero<PrecValueType>()),
+            thrust::make_discard_iterator(),
+            ws.rhsPartMask.begin(),
+            thrust::equal_to<int>(),
+            thrust::maximum<int>()
+            );
+
+    thrust::transform(ws.rhsPartMask.begin(), ws.rhsPartMask.end() - 1, ws.rhsPartMask.begin() + 1, ws.rhsInterfaceMask.begin(), thrust::maximum<int>());
+
+    thrust::copy(ws.rhsPartMask.begin(), ws.rhsPartMask.end(), ws.rhsPurifiedMask.begin());
+    thrust::transform(ws.rhsPurifiedMask.begin(), ws.rhsPurifiedMask.end() - 1, ws.rhsInterfaceMask.begin(), ws.rhsPurifiedMask.begin(), thrust::maximum<int>());
+    thrust::transform(ws.rhsPurifiedMask.begin() + 1, ws.rhsPurifiedMask.end(), ws.rhsInterfaceMask.begin(), ws.rhsPurifiedMask.begin() + 1, thrust::maximum<int>());
+}
+
+/**
+ * This function indicates whether the spike blocks are compressed, in which
+ * case the reduced matrix is never assembled in dense form.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::useCompressedSpikes() const
+{
+    return m_spikeTol > 0 && m_precondType == Spike && m_numPartitions > 1 && !m_use_bcr;
+}
+
+/**
+ * This function compresses the spike blocks in WV (see CompressedSpikes)
+ * and sets up the map from the unknowns of the reduced system to the rows
+ * of the full system: interface i covers the last k rows of partition i and
+ * the first k rows of partition i+1. The spikes are still computed in dense
+ * form, so WV is released here, but the peak memory of the setup, reached
+ * while WV is computed, is unchanged.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::compressSpikes(PrecVector&  WV)
+{
+    int numInterfaces = m_numPartitions - 1;
+
+    m_compressedSpikes.build(WV, m_k, numInterfaces, m_spikeTol);
+
+    WV.clear();
+    WV.shrink_to_fit();
+
+    int partSize  = m_n / m_numPartitions;
+    int remainder = m_n % m_numPartitions;
+
+    IntVectorH rows(2 * m_k * numInterfaces);
+
+    for (int i = 0; i < numInterfaces; i++) {
+        int first = (i + 1) * partSize + std::min(i + 1, remainder) - m_k;
+        for (int j = 0; j < 2 * m_k; j++)
+            rows[2 * m_k * i + j] = first + j;
+    }
+
+    m_interfaceRows = rows;
+    workspace().interfaceBuf.resize(rows.size());
+    workspace().spikeWork.resize(m_compressedSpikes.getWorkSize(omp_get_max_threads()));
+}
+
+/**
+ * This function solves, in place, with the truncated reduced matrix R on
+ * the unknowns of the reduced system. With compressed spikes, these are
+ * gathered, solved for on the host and scattered back; otherwise the LU
+ * factors of R are used.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::partFullSolve(PrecVector&  v,
+                                   const int*   active)
+{
+    if (!useCompressedSpikes()) {
+        partFullFwdSweep(v, active);
+        partFullBckSweep(v, active);
+        return;
+    }
+
+    Workspace& ws = workspace();
+
+    thrust::gather(m_interfaceRows.begin(), m_interfaceRows.end(), v.begin(), ws.interfaceBuf.begin());
+
+    ws.interfaceBufH.resize(ws.interfaceBuf.size());
+    thrust::copy(ws.interfaceBuf.begin(), ws.interfaceBuf.end(), ws.interfaceBufH.begin());
+    m_compressedSpikes.solve(ws.interfaceBufH, ws.spikeWork);
+    thrust::copy(ws.interfaceBufH.begin(), ws.interfaceBufH.end(), ws.interfaceBuf.begin());
+
+    thrust::scatter(ws.interfaceBuf.begin(), ws.interfaceBuf.end(), m_interfaceRows.begin(), v.begin());
+}
+
 /**
  * This function copies the last partition from B2, which contains the UL results,
  * to m_B.
@@ -6330,6 +8926,74 @@ Precond<PrecVector>::copyLastPartition(PrecVector &B2) {
 }
 
 
+/**
+ * This function predicts the memory used by the setup for the current
+ * parameters. If a memory budget was specified, it also adjusts the number of
+ * partitions, the factorization method, the storage mode and the
+ * preconditioner type so that the setup fits. On return, maxBandwidth is the
+ * largest half-bandwidth for which the banded matrix fits in the budget. The
+ * function returns false if the setup does not fit even with a block-diagonal
+ * preconditioner of half-bandwidth maxBandwidth.
+ */
+template <typename PrecVector>
+bool
+Precond<PrecVector>::planMemory(int& maxBandwidth)
+{
+    MemoryPlanner  planner(sizeof(PrecValueType), m_memoryBudget);
+
+    // ILU-based preconditioners do not use the dense banded storage.
+    if (m_ilu_level >= 0 || !planner.hasBudget()) {
+        m_memPlan = planner.predict(m_n, m_k, m_numPartitions, m_factMethod, m_precondType, m_saveMem, m_variableBandwidth, m_overlap);
+        return true;
+    }
+
+    int k = m_k;
+
+    bool fits = planner.adjust(m_n, k, m_numPartitions, m_factMethod, m_precondType, m_saveMem, m_isSPD, m_variableBandwidth, m_memPlan, m_overlap);
+
+    maxBandwidth = k;
+
+    return fits;
+}
+
+/**
+ * This function records the free device memory at the beginning of the setup,
+ * used as the reference for measuring the peak memory of the setup. The
+ * measurement relies on cudaMemGetInfo(), which reports the free memory of
+ * the whole device: allocations and releases by other processes or threads
+ * during the setup distort it, and so does the caching of the CUDA runtime.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::startMemoryTracking()
+{
+    size_t free_size = 0, total_size = 0;
+
+    m_mem_peak = 0;
+    m_mem_free_start = 0;
+
+    if (cudaMemGetInfo(&free_size, &total_size) == cudaSuccess)
+        m_mem_free_start = free_size;
+}
+
+/**
+ * This function samples the free device memory and updates the measured peak
+ * memory of the setup. It is called right after each of the large allocations
+ * made during the setup.
+ */
+template <typename PrecVector>
+void
+Precond<PrecVector>::trackMemory()
+{
+    size_t free_size = 0, total_size = 0;
+
+    if (m_mem_free_start == 0 || cudaMemGetInfo(&free_size, &total_size) != cudaSuccess)
+        return;
+
+    if (free_size < m_mem_free_start)
+        m_mem_peak = std::max(m_mem_peak, m_mem_free_start - free_size);
+}
+
 /**
  * This function checks the diagonal of the specified banded matrix for any 
  * elements that are smaller in absolute value than a threshold value
@@ -6421,7 +9085,12 @@ Precond<PrecVector>::findPthMax(const IntHIterator&          ibegin,
         return;
     }
 
-    int x1 = rand() % dist, x2 = rand() % dist, x3 = rand() % dist;
+    // Median of three random candidates. The (small) generator is local, so
+    // that concurrent calls neither race on nor reseed the global state.
+    std::minstd_rand                    gen(dist);
+    std::uniform_int_distribution<int>  pick(0, dist - 1);
+
+    int x1 = pick(gen), x2 = pick(gen), x3 = pick(gen);
     if (fabs(*(vbegin + x1)) > fabs(*(vbegin + x2))) {
         x1 ^= x2;
         x2 ^= x1;
@@ -0,0 +1,585 @@
+/** \file sgmres.h
+ *  \brief s-step GMRES preconditioned iterative Krylov solver.
+ */
+
+#ifndef SAP_SGMRES_H
+#define SAP_SGMRES_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#ifdef   USE_OLD_CUSP
+#include <cusp/blas.h>
+#else
+#include <cusp/blas/blas.h>
+#endif
+#include <cusp/multiply.h>
+#include <cusp/array1d.h>
+
+#include <thrust/copy.h>
+#include <thrust/for_each.h>
+#include <thrust/functional.h>
+#include <thrust/reduce.h>
+#include <thrust/transform.h>
+#include <thrust/iterator/constant_iterator.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/discard_iterator.h>
+#include <thrust/iterator/transform_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
+
+#include <sap/monitor.h>
+
+
+namespace sap {
+
+namespace detail {
+
+struct SstepSegment : public thrust::unary_function<size_t, size_t>
+{
+	size_t m_n;
+	SstepSegment(size_t n) : m_n(n) {}
+	__host__ __device__
+	size_t operator() (size_t t) const {return t / m_n;}
+};
+
+/**
+ * This functor calculates the products needed for the inner products of the
+ * columns of a block A with the columns of a block B (both stored column
+ * after column, with n rows). Entry t of the flattened index space is the
+ * product, at row t % n, of column (t / n) / nb of A and column (t / n) % nb
+ * of B.
+ */
+template <typename ValueType>
+struct SstepBlockProduct : public thrust::unary_function<size_t, ValueType>
+{
+	const ValueType*  m_A;
+	const ValueType*  m_B;
+	size_t            m_n;
+	size_t            m_nb;
+
+	SstepBlockProduct(const ValueType* A, const ValueType* B, size_t n, size_t nb)
+	:	m_A(A), m_B(B), m_n(n), m_nb(nb) {}
+
+	__host__ __device__
+	ValueType operator() (size_t t) const
+	{
+		size_t p   = t / m_n;
+		size_t row = t - p * m_n;
+
+		return m_A[(p / m_nb) * m_n + row] * m_B[(p % m_nb) * m_n + row];
+	}
+};
+
+/**
+ * This functor calculates Y <- beta * Y + A * S, where A is a block with n
+ * rows and k columns (stored column after column) and S is a small k x m
+ * matrix (column-major). It is applied to the tuples (Y[t], t).
+ */
+template <typename ValueType>
+struct SstepBlockUpdate
+{
+	const ValueType*  m_A;
+	const ValueType*  m_S;
+	size_t            m_n;
+	int               m_k;
+	ValueType         m_beta;
+
+	SstepBlockUpdate(const ValueType* A, const ValueType* S, size_t n, int k, ValueType beta)
+	:	m_A(A), m_S(S), m_n(n), m_k(k), m_beta(beta) {}
+
+	template <typename Tuple>
+	__host__ __device__
+	void operator() (Tuple tu) const
+	{
+		size_t t   = thrust::get<1>(tu);
+		size_t j   = t / m_n;
+		size_t row = t - j * m_n;
+
+		ValueType sum = 0;
+		for (int i = 0; i < m_k; i++)
+			sum += m_A[i * m_n + row] * m_S[j * m_k + i];
+
+		if (m_beta == ValueType(0))
+			thrust::get<0>(tu) = sum;
+		else
+			thrust::get<0>(tu) = m_beta * thrust::get<0>(tu) + sum;
+	}
+};
+
+/**
+ * This function calculates all inner products of the na columns of the block
+ * starting at A with the nb columns of the block starting at B (n rows each)
+ * with a single segmented reduction. On return, G[i * nb + j] = (A_i, B_j).
+ */
+template <typename Array, typename ValueType>
+void sstepBlockDots(const ValueType*         A,
+                    int                      na,
+                    const ValueType*         B,
+                    int                      nb,
+                    size_t                   n,
+                    Array&                   sums,
+                    std::vector<ValueType>&  G)
+{
+	size_t np = (size_t) na * nb;
+
+	if (sums.size() < np)
+		sums.resize(np);
+	G.resize(np);
+
+	thrust::counting_iterator<size_t> first(0);
+
+	thrust::reduce_by_key(thrust::make_transform_iterator(first, SstepSegment(n)),
+	                      thrust::make_transform_iterator(first, SstepSegment(n)) + n * np,
+	                      thrust::make_transform_iterator(first, SstepBlockProduct<ValueType>(A, B, n, nb)),
+	                      thrust::make_discard_iterator(),
+	                      sums.begin());
+
+	thrust::copy(sums.begin(), sums.begin() + np, G.begin());
+}
+
+/**
+ * This function calculates Y <- beta * Y + A * S, where Y (n x m) and A
+ * (n x k) are blocks stored column after column and S is a small k x m
+ * column-major matrix given on the host (copied into the work array coefs).
+ */
+template <typename Iterator, typename Array, typename ValueType>
+void sstepBlockUpdate(Iterator                       Y,
+                      int                            m,
+                      const ValueType*               A,
+                      int                            k,
+                      const std::vector<ValueType>&  S,
+                      size_t                         n,
+                      ValueType                      beta,
+                      Array&                         coefs)
+{
+	if (coefs.size() < S.size())
+		coefs.resize(S.size());
+	thrust::copy(S.begin(), S.end(), coefs.begin());
+
+	const ValueType* p_S = thrust::raw_pointer_cast(&coefs[0]);
+
+	thrust::counting_iterator<size_t> first(0);
+
+	thrust::for_each(thrust::make_zip_iterator(thrust::make_tuple(Y, first)),
+	                 thrust::make_zip_iterator(thrust::make_tuple(Y + n * m, first + n * m)),
+	                 SstepBlockUpdate<ValueType>(A, p_S, n, k, beta));
+}
+
+/**
+ * This function calculates the Cholesky factor R (upper triangular, row-major)
+ * of the s x s matrix G (row-major). It returns false if G is not numerically
+ * positive definite.
+ */
+template <typename ValueType>
+bool sstepCholesky(const std::vector<ValueType>&  G,
+                   int                            s,
+                   std::vector<ValueType>&        R)
+{
+	R.assign(s * s, ValueType(0));
+
+	for (int j = 0; j < s; j++) {
+		ValueType d = G[j * s + j];
+		for (int i = 0; i < j; i++)
+			d -= R[i * s + j] * R[i * s + j];
+
+		if (!(d > std::numeric_limits<ValueType>::epsilon() * std::abs(G[j * s + j])))
+			return false;
+
+		R[j * s + j] = std::sqrt(d);
+
+		for (int l = j + 1; l < s; l++) {
+			ValueType v = G[j * s + l];
+			for (int i = 0; i < j; i++)
+				v -= R[i * s + j] * R[i * s + l];
+			R[j * s + l] = v / R[j * s + j];
+		}
+	}
+
+	return true;
+}
+
+/**
+ * This function calculates the inverse of the s x s upper triangular matrix
+ * R (row-major) and returns it in Rinv (row-major).
+ */
+template <typename ValueType>
+void sstepTriangularInverse(const std::vector<ValueType>&  R,
+                            int                            s,
+                            std::vector<ValueType>&        Rinv)
+{
+	Rinv.assign(s * s, ValueType(0));
+
+	for (int j = 0; j < s; j++) {
+		Rinv[j * s + j] = 1 / R[j * s + j];
+		for (int i = j - 1; i >= 0; i--) {
+			ValueType v = 0;
+			for (int l = i + 1; l <= j; l++)
+				v += R[i * s + l] * Rinv[l * s + j];
+			Rinv[i * s + j] = -v / R[i * s + i];
+		}
+	}
+}
+
+/**
+ * This function solves the small least-squares problem min ||beta*e1 - H*y||,
+ * where H has the given number of rows and columns and is stored column-major
+ * with leading dimension ld, using Householder reflections. It returns the
+ * norm of the residual.
+ */
+template <typename ValueType>
+ValueType sstepLeastSquares(const std::vector<ValueType>&  H,
+                            int                            ld,
+                            int                            rows,
+                            int                            cols,
+                            ValueType                      beta,
+                            std::vector<ValueType>&        y)
+{
+	std::vector<ValueType> A(H.begin(), H.begin() + (size_t) ld * cols);
+	std::vector<ValueType> g(rows, ValueType(0));
+	std::vector<ValueType> v(rows);
+
+	g[0] = beta;
+
+	int nr = std::min(rows, cols);
+
+	for (int j = 0; j < nr; j++) {
+		ValueType* a = &A[(size_t) j * ld];
+
+		ValueType norm = 0;
+		for (int i = j; i < rows; i++)
+			norm += a[i] * a[i];
+		norm = std::sqrt(norm);
+
+		if (norm == 0)
+			continue;
+
+		ValueType alpha = (a[j] > 0) ? -norm : norm;
+
+		ValueType vv = 0;
+		for (int i = j; i < rows; i++) {
+			v[i] = a[i];
+			if (i == j)
+				v[i] -= alpha;
+			vv += v[i] * v[i];
+		}
+
+		if (vv == 0)
+			continue;
+
+		for (int l = j; l < cols; l++) {
+			ValueType* c = &A[(size_t) l * ld];
+			ValueType  t = 0;
+			for (int i = j; i < rows; i++)
+				t += v[i] * c[i];
+			t *= 2 / vv;
+			for (int i = j; i < rows; i++)
+				c[i] -= t * v[i];
+		}
+
+		ValueType t = 0;
+		for (int i = j; i < rows; i++)
+			t += v[i] * g[i];
+		t *= 2 / vv;
+		for (int i = j; i < rows; i++)
+			g[i] -= t * v[i];
+	}
+
+	y.assign(cols, ValueType(0));
+
+	for (int j = nr - 1; j >= 0; j--) {
+		ValueType d = A[(size_t) j * ld + j];
+		if (d == 0)
+			continue;
+		ValueType v = g[j];
+		for (int l = j + 1; l < nr; l++)
+			v -= A[(size_t) l * ld + j] * y[l];
+		y[j] = v / d;
+	}
+
+	ValueType res = 0;
+	for (int i = nr; i < rows; i++)
+		res += g[i] * g[i];
+
+	return std::sqrt(res);
+}
+
+} // namespace detail
+
+
+/// Preconditioned s-step GMRES Krylov method
+/**
+ * This is a restarted, right-preconditioned s-step (communication-avoiding)
+ * GMRES. Each outer step generates s basis vectors with s consecutive
+ * preconditioner applies and matrix-vector products (monomial basis, no
+ * inner products in between), and then orthonormalizes the new block against
+ * the current basis and within itself. The block orthogonalization uses the
+ * Pythagorean variant of block classical Gram-Schmidt with Cholesky QR: all
+ * inner products of one pass ([Q K]^T K) are computed by a single fused
+ * reduction, and two passes are performed for stability. Therefore an outer
+ * step only requires two global reductions, instead of the O(s*m) of GMRES
+ * with modified Gram-Schmidt. If the Cholesky factorization fails (the block
+ * is numerically rank deficient), the block is orthonormalized column by
+ * column instead and the cycle ends at the first dependent column.
+ *
+ * With Q the orthonormal basis and Z the (non-orthogonal) vectors the
+ * operator was applied to, A*P*Z = Q*H for a small matrix H which is not
+ * Hessenberg; the least-squares problem for the correction is solved on the
+ * host after every outer step, which gives the residual norm estimate. The
+ * iteration count is incremented by the number of basis vectors generated.
+ *
+ * \tparam LinearOperator is a functor class for sparse matrix-vector product.
+ * \tparam Vector is the vector type for the linear system solution.
+ * \tparam Monitor is the convergence test object.
+ * \tparam Preconditioner is the preconditioner.
+ */
+template <typename LinearOperator, typename Vector, typename Monitor, typename Preconditioner>
+void sgmres(LinearOperator&  A,
+            Vector&          x,
+            const Vector&    b,
+            const int        restart,
+            const int        s,
+            Monitor&         monitor,
+            Preconditioner&  P)
+{
+	typedef typename Vector::value_type   ValueType;
+	typedef typename Vector::memory_space MemorySpace;
+
+	typedef typename cusp::array1d<ValueType, MemorySpace>  WorkVector;
+
+	size_t  n  = b.size();
+	int     m  = std::max(restart, 1);
+	int     ss = std::max(std::min(s, m), 1);
+	int     ld = m + 1;
+
+	// The basis is stored column after column in a single array, so that
+	// blocks of columns can be used in the fused reductions and updates.
+	WorkVector  basis(n * (m + 1));
+	WorkVector  block(n * ss);
+	WorkVector  sums;
+	WorkVector  coefs;
+	WorkVector  r(n);
+	WorkVector  u(n);
+
+	ValueType* p_basis = thrust::raw_pointer_cast(&basis[0]);
+
+	// H and W (column-major, leading dimension m+1) hold the coordinates in
+	// the basis Q of A*P*Z and Z, respectively.
+	std::vector<ValueType>  H(ld * m);
+	std::vector<ValueType>  W(ld * m);
+	std::vector<ValueType>  G, R, R2, Rinv, S, y, w;
+
+	while (true) {
+		// r <- b - A * x
+		cusp::multiply(A, x, r);
+		cusp::blas::axpby(b, r, r, ValueType(1), ValueType(-1));
+
+		ValueType beta = cusp::blas::nrm2(r);
+
+		if (monitor.finished(beta))
+			break;
+
+		// q_0 <- r / beta
+		cusp::blas::scal(r, ValueType(1) / beta);
+		thrust::copy(r.begin(), r.end(), basis.begin());
+
+		std::fill(H.begin(), H.end(), ValueType(0));
+		std::fill(W.begin(), W.end(), ValueType(0));
+
+		int  nq   = 1;
+		int  cols = 0;
+		bool done = false;
+
+		while (cols < m && !done) {
+			int sb = std::min(ss, m - cols);
+
+			// Matrix powers: k_j <- A * P * k_{j-1}, with k_0 = q_{nq-1}.
+			thrust::copy(basis.begin() + (nq - 1) * n, basis.begin() + nq * n, r.begin());
+			for (int j = 0; j < sb; j++) {
+				cusp::multiply(P, r, u);
+				cusp::multiply(A, u, r);
+				thrust::copy(r.begin(), r.end(), basis.begin() + (nq + j) * n);
+			}
+
+			ValueType* p_K = p_basis + nq * n;
+
+			// Block orthonormalization: K = Q * C + K' * R.
+			std::vector<ValueType> C(nq * sb, ValueType(0));
+			R.assign(sb * sb, ValueType(0));
+			for (int j = 0; j < sb; j++)
+				R[j * sb + j] = 1;
+
+			int  sbUsed    = sb;
+			bool blockDone = false;
+
+			for (int pass = 0; pass < 2 && !blockDone; pass++) {
+				// [Q K]^T K with one reduction.
+				detail::sstepBlockDots(p_basis, nq + sb, p_K, sb, n, sums, G);
+
+				// G <- K^T K - C^T C
+				std::vector<ValueType> Gk(sb * sb);
+				for (int i = 0; i < sb; i++)
+					for (int j = 0; j < sb; j++) {
+						ValueType v = G[(nq + i) * sb + j];
+						for (int l = 0; l < nq; l++)
+							v -= G[l * sb + i] * G[l * sb + j];
+						Gk[i * sb + j] = v;
+					}
+
+				if (!detail::sstepCholesky(Gk, sb, R2))
+					break;
+
+				detail::sstepTriangularInverse(R2, sb, Rinv);
+
+				// K <- (K - Q * Cp) * R2^{-1}, i.e. [Q K] * [-Cp*R2^{-1}; R2^{-1}]
+				S.assign((nq + sb) * sb, ValueType(0));
+				for (int j = 0; j < sb; j++) {
+					for (int l = 0; l < nq; l++) {
+						ValueType v = 0;
+						for (int i = 0; i <= j; i++)
+							v += G[l * sb + i] * Rinv[i * sb + j];
+						S[j * (nq + sb) + l] = -v;
+					}
+					for (int i = 0; i <= j; i++)
+						S[j * (nq + sb) + nq + i] = Rinv[i * sb + j];
+				}
+
+				detail::sstepBlockUpdate(block.begin(), sb, (const ValueType*) p_basis, nq + sb, S, n, ValueType(0), coefs);
+				thrust::copy(block.begin(), block.begin() + sb * n, basis.begin() + nq * n);
+
+				// Accumulate the coordinates: C <- C + Cp * R, R <- R2 * R
+				for (int l = 0; l < nq; l++)
+					for (int j = 0; j < sb; j++) {
+						ValueType v = 0;
+						for (int i = 0; i <= j; i++)
+							v += G[l * sb + i] * R[i * sb + j];
+						C[l * sb + j] += v;
+					}
+
+				std::vector<ValueType> RR(sb * sb, ValueType(0));
+				for (int i = 0; i < sb; i++)
+					for (int j = i; j < sb; j++)
+						for (int l = i; l <= j; l++)
+							RR[i * sb + j] += R2[i * sb + l] * R[l * sb + j];
+				R.swap(RR);
+
+				if (pass == 1)
+					blockDone = true;
+			}
+
+			if (!blockDone) {
+				// Cholesky QR failed: orthonormalize the (partially processed)
+				// block column by column with classical Gram-Schmidt applied
+				// twice, stopping at the first dependent column.
+				std::vector<ValueType> Rc(sb * sb, ValueType(0));
+				std::vector<ValueType> Cc(nq * sb, ValueType(0));
+
+				for (int j = 0; j < sb; j++) {
+					ValueType* p_kj = p_K + j * n;
+					int        np   = nq + j;
+					std::vector<ValueType> h(np, ValueType(0));
+
+					detail::sstepBlockDots(p_kj, 1, p_kj, 1, n, sums, G);
+					ValueType norm0 = std::sqrt(std::abs(G[0]));
+
+					for (int pass = 0; pass < 2; pass++) {
+						detail::sstepBlockDots(p_basis, np, p_kj, 1, n, sums, G);
+						for (int i = 0; i < np; i++) {
+							h[i] += G[i];
+							G[i] = -G[i];
+						}
+						detail::sstepBlockUpdate(basis.begin() + np * n, 1, (const ValueType*) p_basis, np, G, n, ValueType(1), coefs);
+					}
+
+					detail::sstepBlockDots(p_kj, 1, p_kj, 1, n, sums, G);
+					ValueType norm = std::sqrt(std::abs(G[0]));
+
+					// Coordinates of the current column in terms of [Q K'].
+					for (int l = 0; l < nq; l++)
+						Cc[l * sb + j] = h[l];
+					for (int i = 0; i < j; i++)
+						Rc[i * sb + j] = h[nq + i];
+
+					if (!(norm > std::sqrt(std::numeric_limits<ValueType>::epsilon()) * norm0)) {
+						sbUsed = j;
+						break;
+					}
+
+					Rc[j * sb + j] = norm;
+					thrust::transform(basis.begin() + np * n, basis.begin() + (np + 1) * n,
+					                  thrust::make_constant_iterator(ValueType(1) / norm),
+					                  basis.begin() + np * n,
+					                  thrust::multiplies<ValueType>());
+				}
+
+				// Combine with the coordinates of the completed passes:
+				// K = Q*C + Kp*R and Kp = Q*Cc + K'*Rc.
+				for (int l = 0; l < nq; l++)
+					for (int j = 0; j < sb; j++) {
+						ValueType v = C[l * sb + j];
+						for (int i = 0; i <= j; i++)
+							v += Cc[l * sb + i] * R[i * sb + j];
+						C[l * sb + j] = v;
+					}
+
+				std::vector<ValueType> RR(sb * sb, ValueType(0));
+				for (int i = 0; i < sb; i++)
+					for (int j = i; j < sb; j++)
+						for (int l = i; l <= j; l++)
+							RR[i * sb + j] += Rc[i * sb + l] * R[l * sb + j];
+				R.swap(RR);
+			}
+
+			// Update the coordinates: Z_0 = q_{nq-1}, Z_j = k_j, A*P*Z_j = k_{j+1}.
+			int numZ = (sbUsed < sb) ? sbUsed + 1 : sb;
+
+			for (int j = 0; j < numZ; j++) {
+				ValueType* h = &H[(cols + j) * ld];
+				ValueType* z = &W[(cols + j) * ld];
+
+				for (int l = 0; l < nq; l++)
+					h[l] = C[l * sb + j];
+				for (int i = 0; i <= j && i < sbUsed; i++)
+					h[nq + i] = R[i * sb + j];
+
+				if (j == 0)
+					z[nq - 1] = 1;
+				else {
+					for (int l = 0; l < nq; l++)
+						z[l] = C[l * sb + j - 1];
+					for (int i = 0; i < j; i++)
+						z[nq + i] = R[i * sb + j - 1];
+				}
+			}
+
+			nq   += sbUsed;
+			cols += numZ;
+
+			ValueType res = detail::sstepLeastSquares(H, ld, nq, cols, beta, y);
+
+			monitor.increment((float) numZ);
+
+			if (sbUsed < sb || monitor.finished(res))
+				done = true;
+		}
+
+		// x <- x + P * Q * (W * y)
+		w.assign(nq, ValueType(0));
+		for (int j = 0; j < cols; j++)
+			for (int l = 0; l < nq; l++)
+				w[l] += W[j * ld + l] * y[j];
+
+		detail::sstepBlockUpdate(r.begin(), 1, (const ValueType*) p_basis, nq, w, n, ValueType(0), coefs);
+		cusp::multiply(P, r, u);
+		cusp::blas::axpy(u, x, ValueType(1));
+	}
+}
+
+
+
+} // namespace sap
+
+
+
+#endif
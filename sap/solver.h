@@ -6,15 +6,25 @@
 #define SAP_SOLVER_H
 
 #include <limits>
+#include <algorithm>
 #include <vector>
+#include <deque>
 #include <string>
+#include <exception>
+
+#include <omp.h>
 
 #include <sap/common.h>
 #include <sap/monitor.h>
 #include <sap/precond.h>
+#include <sap/memory_pool.h>
 #include <sap/bicgstab2.h>
 #include <sap/bicgstab.h>
 #include <sap/minres.h>
+#include <sap/idrs.h>
+#include <sap/sgmres.h>
+#include <sap/cg.h>
+#include <sap/multishift.h>
 #include <sap/timer.h>
 
 #include <cusp/csr_matrix.h>
@@ -54,20 +64,27 @@ struct Options
     Options();
 
     KrylovSolverType    solverType;           /**< Krylov method to use; default: BiCGStab2 */
+    std::vector<KrylovSolverType> fallbackSolvers; /**< Krylov methods tried in turn if the previous one does not converge, each continuing from the best iterate so far; default: empty */
+    bool                raceSolvers;          /**< Run the Krylov method and the fallback methods concurrently, keeping the first to converge and cancelling the others; default: false */
+    int                 idrS;                 /**< (IDR(s) only) Dimension of the shadow space; default: 4 */
+    int                 sStep;                /**< (s-step GMRES only) Number of basis vectors generated per block orthogonalization; default: 4 */
+    int                 restart;              /**< (s-step GMRES only) Restart length; default: 48 */
     int                 maxNumIterations;     /**< Maximum number of iterations; default: 100 */
     double              relTol;               /**< Relative tolerance; default: 1e-6 */
     double              absTol;               /**< Absolute tolerance; default: 0 */
+    int                 solutionHistory;      /**< Number of previous solutions used to build the initial guess of solve() by projection, 0 meaning disabled; default: 0 */
 
     bool                testDB;               /**< Indicate that we are running the test for DB*/
     bool                isSPD;                /**< Indicate whether the matrix is symmetric positive definitive; default: false*/
     bool                saveMem;                /**< (For SPD matrix only) Indicate whether to use memory-saving yet slower mode or not; default: false*/
     bool                performReorder;       /**< Perform matrix reorderings? default: true */
-    bool                performDB;            /**< Perform DB reordering? default: true */
+    bool                performDB;            /**< Perform DB reordering? Ignored by the SPAI preconditioner with isSPD (FSAI), which needs the symmetric matrix; default: true */
     bool                dbFirstStageOnly;     /**< In DB, only the first stage is to be performed? default: false*/
     bool                applyScaling;         /**< Apply DB scaling? default: true */
     int                 maxBandwidth;         /**< Maximum half-bandwidth; default: INT_MAX */
     int                 gpuCount;             /**< Number of GPU expected to use; default: 1 */
     double              dropOffFraction;      /**< Maximum fraction of the element-wise matrix 1-norm that can be dropped-off; default: 0 */
+    bool                dropOffPerPartition;  /**< (Variable bandwidth only) Spend the drop-off fraction separately on each diagonal block, choosing per-partition bandwidths; default: false */
 
     FactorizationMethod factMethod;           /**< Diagonal block factorization method; default: LU_only */
     PreconditionerType  precondType;          /**< Preconditioner type; default: Spike */
@@ -78,6 +95,22 @@ struct Options
     bool                useBCR;
 
     int                 ilu_level;            /**< Indicate the level of ILU, a minus value means complete LU is applied; default: -1*/
+    int                 iluSweeps;            /**< (ILU(0) only) Number of sweeps of the fine-grained iterative factorization, 0 meaning the exact factorization; default: 0 */
+    int                 iluTriSweeps;         /**< (ILU only) Number of Jacobi iterations replacing each triangular solve, 0 meaning exact sweeps; default: 0 */
+    bool                iluMulticolor;        /**< (ILU(0) only) Use a multicolor ordering instead of Sloan, so that factorization and sweeps are parallel within each color; default: false */
+    bool                hostCholesky;         /**< (SPD with saveMem only) Perform the banded LDL^T factorization and sweeps on the host, with OpenMP. Every factorization copies the banded matrix to the host and back, and every apply copies the vector to the host and back; default: false */
+    bool                hostSpikes;           /**< (ILU-based SPIKE only) Calculate the sparse spikes on the host, with OpenMP; default: false */
+    bool                supervariables;       /**< Apply the bandwidth-reducing reordering to the graph of the supervariables (rows with identical patterns), keeping their rows contiguous. Not applied if DB permutes the rows, since the row patterns then no longer describe the graph nodes; default: false */
+    bool                sparseRHS;            /**< (Variable bandwidth on a single GPU only) Skip, in the preconditioner sweeps, the partitions not reached by the right-hand side; default: false */
+    double              spikeTol;             /**< (Spike only) Relative tolerance of the low-rank compression of the spike blocks, 0 meaning a dense reduced matrix. The spikes themselves are still computed densely (2*k^2 values per interface), so only the storage kept after setup shrinks, not its peak; default: 0 */
+
+    size_t              memoryBudget;         /**< Maximum memory (in bytes) the preconditioner setup may use, 0 meaning unlimited. The setup throws system_error::Memory_budget if it cannot be made to fit; default: 0 */
+
+    PolynomialType      polyType;             /**< (Polynomial preconditioner only) Polynomial to apply; default: Chebyshev */
+    int                 polyDegree;           /**< (Polynomial preconditioner only) Polynomial degree, i.e. number of SpMVs per apply; default: 8 */
+    int                 polyEigSteps;         /**< (Polynomial preconditioner only) Number of Arnoldi steps used to estimate the spectral bounds; default: 10 */
+
+    int                 overlap;              /**< (Schwarz preconditioner only) Number of rows by which each partition is extended on either side, 0 meaning the half-bandwidth; default: 0 */
 };
 
 
@@ -113,6 +146,7 @@ struct Stats
     double      time_bandUL;            /**< Time for UL factorization of diagonal blocks(in LU_UL method only). */
     double      time_fullLU;            /**< Time for LU factorization of the reduced matrix R. */
     double      time_assembly;          /**< Time for assembling off-diagonal matrices (including solving multiple RHS) */
+    double      time_secondLevel;       /**< Time for the second-level (per-partition) reordering; included in time_reorder. */
 
     double      time_shuffle;           /**< Total time to do vector reordering and scaling. */
 
@@ -123,6 +157,7 @@ struct Stats
     double      time_bcr_mv_inflation;
 
     int         bandwidthReorder;       /**< Half-bandwidth after reordering. */
+    int         numSupervariables;      /**< Number of supervariables reordered (0 if the graph was not compressed). */
     int         bandwidthDB;            /**< Half-bandwidth after DB. */
     int         bandwidth;              /**< Half-bandwidth after reordering and drop-off. */
     double      nuKf;                   /**< Non-uniform K factor. Indicates whether the K changes a lot from row to row. */
@@ -137,6 +172,30 @@ struct Stats
     double      relResidualNorm;        /**< Final relative residual norm (i.e. ||b-Ax||_2 / ||b||_2)*/
 
     int         actual_nnz;
+
+    size_t      memBanded;              /**< Predicted memory (bytes) for the banded matrix B. */
+    size_t      memOffDiags;            /**< Predicted memory (bytes) for the off-diagonal blocks. */
+    size_t      memSpikes;              /**< Predicted memory (bytes) for the spike blocks W and V. */
+    size_t      memReduced;             /**< Predicted memory (bytes) for the reduced matrix R. */
+    size_t      memULCopy;              /**< Predicted memory (bytes) for the copy of B used by the UL factorization. */
+    size_t      memSpikeTemporaries;    /**< Predicted memory (bytes) for the work arrays of the spike calculation. */
+    size_t      memPredictedPeak;       /**< Predicted peak memory (bytes) of the setup. */
+    size_t      memMeasuredPeak;        /**< Measured peak device memory (bytes) of the setup, from the device-wide free memory (distorted by other users of the device). */
+
+    int         numPoolAllocs;          /**< Number of host blocks the solver memory pool (reordering temporaries only) obtained from the system (over all setups). */
+    size_t      memPoolReserved;        /**< Host memory (bytes) currently held by the solver memory pool (reordering temporaries only). */
+
+    double      polyLambdaMin;          /**< (Polynomial preconditioner only) Lower bound of the spectrum of the Jacobi-scaled matrix. */
+    double      polyLambdaMax;          /**< (Polynomial preconditioner only) Upper bound of the spectrum of the Jacobi-scaled matrix. */
+
+    int         numColors;              /**< (Multicolor ILU(0) only) Number of colors of the ordering. */
+
+    double      avgSpikeRank;           /**< (Compressed spikes only) Average rank of the compressed spike blocks. */
+
+    int         numShiftsRefined;       /**< (Shifted solve only) Number of shifts solved separately: those the multi-shift iteration did not solve to the tolerance, or all of them if the preconditioner is not exact (see Solver::solveShifted()). */
+
+    int         numHistoryGuess;        /**< Number of previous solutions used to improve the initial guess of the last solve. */
+    int         numFallbacks;           /**< Number of fallback Krylov methods run by the last solve (all of them if they were raced). */
 };
 
 
@@ -173,21 +232,41 @@ public:
     template <typename Array1>
     bool update(const Array1& entries);
 
+    template <typename Matrix, typename Array1>
+    void setupAssembler(const Matrix&                     A,
+                        const Array1&                     connectivity,
+                        int                               nodesPerElement,
+                        ElementAssembler<PrecValueType>&  assembler);
+
+    bool update(const ElementAssembler<PrecValueType>& assembler);
+
     template <typename SpmvOperator>
     bool solve(SpmvOperator&  spmv,
                const Array&   b,
                Array&         x);
 
+    template <typename SpmvOperator>
+    bool solveTranspose(SpmvOperator&  spmvT,
+                        const Array&   c,
+                        Array&         y);
+
+    template <typename SpmvOperator>
+    bool solveShifted(SpmvOperator&                                   spmv,
+                      const Array&                                    b,
+                      const std::vector<typename Array::value_type>&  shifts,
+                      std::vector<Array>&                             X,
+                      typename Array::value_type                      refShift = 0);
+
     /// Extract solver statistics.
     const Stats&       getStats() const          {return m_stats;}
     int                getMonitorCode() const    {
-        if (m_p_monitor != NULL) {
+        if (!usesBiCGStabLMonitor(m_lastSolver)) {
             return m_p_monitor -> getCode();
         }
         return m_p_bicgstabl_monitor->getCode();
     }
     const std::string& getMonitorMessage() const {
-        if (m_p_monitor != NULL) {
+        if (!usesBiCGStabLMonitor(m_lastSolver)) {
             return m_p_monitor -> getMessage();
         }
         return m_p_bicgstabl_monitor->getMessage();
@@ -205,12 +284,62 @@ private:
 
     typedef typename cusp::coo_matrix<int, PrecValueType, cusp::host_memory>  PrecMatrixCooH;
 
+    template <typename SpmvOperator, typename Preconditioner>
+    bool solveWith(SpmvOperator&    spmv,
+                   const Array&     b,
+                   Array&           x,
+                   Preconditioner&  P);
+
+    template <typename SpmvOperator, typename Preconditioner>
+    bool raceKrylov(SpmvOperator&    spmv,
+                    SolverVector&    x,
+                    SolverVector&    b,
+                    Preconditioner&  P);
+
+    template <typename SpmvOperator, typename Preconditioner>
+    void runKrylov(KrylovSolverType                 method,
+                   SpmvOperator&                    spmv,
+                   SolverVector&                    x,
+                   SolverVector&                    b,
+                   Preconditioner&                  P,
+                   Monitor<SolverVector>*           monitor,
+                   BiCGStabLMonitor<SolverVector>*  bicgstablMonitor,
+                   std::vector<SolverVector>&       work);
+
+    bool recordKrylov(KrylovSolverType method);
+
+    static bool usesBiCGStabLMonitor(KrylovSolverType method) {
+        return method == BiCGStab1 || method == BiCGStab2 || method == IDRs;
+    }
+
+    template <typename SpmvOperator>
+    int  historyGuess(SpmvOperator&  spmv,
+                      const Array&   b,
+                      Array&         x);
+    void pushHistory(const Array& x);
+
+    MemoryPool                          m_pool;
 
     KrylovSolverType                    m_solver;
+    std::vector<KrylovSolverType>       m_fallbackSolvers;
+    bool                                m_raceSolvers;
+    KrylovSolverType                    m_lastSolver;
+    int                                 m_idrS;
+    int                                 m_sStep;
+    int                                 m_restart;
+    int                                 m_maxNumIterations;
+    SolverValueType                     m_relTol;
+    SolverValueType                     m_absTol;
     Monitor<SolverVector>*              m_p_monitor;
     BiCGStabLMonitor<SolverVector>*     m_p_bicgstabl_monitor;
     Precond<PrecVector>                 m_precond;
 
+    std::vector<SolverVector>           m_work;
+
+    int                                 m_historySize;
+    std::deque<SolverVector>            m_history;
+    std::vector<SolverVector>           m_historyWork;
+
     int                                 m_n;
     int                                 m_nnz;
     bool                                m_trackReordering;
@@ -232,10 +361,15 @@ public:
 inline
 Options::Options()
 :   solverType(BiCGStab2),
+    raceSolvers(false),
+    idrS(4),
+    sStep(4),
+    restart(48),
     maxNumIterations(100),
     gpuCount(1),
     relTol(1e-6),
     absTol(0),
+    solutionHistory(0),
     testDB(false),
     isSPD(false),
     saveMem(false),
@@ -245,13 +379,27 @@ Options::Options()
     applyScaling(true),
     maxBandwidth(std::numeric_limits<int>::max()),
     dropOffFraction(0),
+    dropOffPerPartition(false),
     factMethod(LU_only),
     precondType(Spike),
     safeFactorization(false),
     variableBandwidth(true),
     trackReordering(false),
     useBCR(false),
-    ilu_level(-1)
+    ilu_level(-1),
+    iluSweeps(0),
+    iluTriSweeps(0),
+    iluMulticolor(false),
+    hostCholesky(false),
+    hostSpikes(false),
+    supervariables(false),
+    sparseRHS(false),
+    spikeTol(0),
+    memoryBudget(0),
+    polyType(Chebyshev),
+    polyDegree(8),
+    polyEigSteps(10),
+    overlap(0)
 {
 }
 
@@ -278,8 +426,10 @@ Stats::Stats()
     time_bandUL(0),
     time_assembly(0),
     time_fullLU(0),
+    time_secondLevel(0),
     time_shuffle(0),
     bandwidthReorder(0),
+    numSupervariables(0),
     bandwidthDB(0),
     bandwidth(0),
     nuKf(0),
@@ -289,7 +439,24 @@ Stats::Stats()
     numIterations(0),
     rhsNorm(std::numeric_limits<double>::max()),
     residualNorm(std::numeric_limits<double>::max()),
-    relResidualNorm(std::numeric_limits<double>::max())
+    relResidualNorm(std::numeric_limits<double>::max()),
+    memBanded(0),
+    memOffDiags(0),
+    memSpikes(0),
+    memReduced(0),
+    memULCopy(0),
+    memSpikeTemporaries(0),
+    memPredictedPeak(0),
+    memMeasuredPeak(0),
+    numPoolAllocs(0),
+    memPoolReserved(0),
+    polyLambdaMin(0),
+    polyLambdaMax(0),
+    numColors(0),
+    avgSpikeRank(0),
+    numShiftsRefined(0),
+    numHistoryGuess(0),
+    numFallbacks(0)
 {
 }
 
@@ -304,21 +471,48 @@ Solver<Array, PrecValueType>::Solver(int             numPartitions,
                                      const Options&  opts)
 :   m_precond(numPartitions, opts.isSPD, opts.saveMem, opts.performReorder, opts.testDB, opts.performDB, opts.dbFirstStageOnly, opts.applyScaling,
               opts.dropOffFraction, opts.maxBandwidth, opts.gpuCount, opts.factMethod, opts.precondType, 
-              opts.safeFactorization, opts.variableBandwidth, opts.trackReordering, opts.useBCR, opts.ilu_level, opts.relTol),
+              opts.safeFactorization, opts.variableBandwidth, opts.trackReordering, opts.useBCR, opts.ilu_level, opts.relTol,
+              opts.memoryBudget, opts.polyType, opts.polyDegree, opts.polyEigSteps, opts.overlap,
+              opts.iluSweeps, opts.iluTriSweeps, opts.iluMulticolor, opts.hostCholesky, opts.spikeTol,
+              opts.dropOffPerPartition, opts.hostSpikes, opts.supervariables, opts.sparseRHS),
     m_solver(opts.solverType),
+    m_fallbackSolvers(opts.fallbackSolvers),
+    m_raceSolvers(opts.raceSolvers),
+    m_lastSolver(opts.solverType),
+    m_idrS(opts.idrS),
+    m_sStep(opts.sStep),
+    m_restart(opts.restart),
+    m_maxNumIterations(opts.maxNumIterations),
+    m_relTol(opts.relTol),
+    m_absTol(opts.absTol),
+    m_historySize(std::max(opts.solutionHistory, 0)),
     m_trackReordering(opts.trackReordering),
     m_setupDone(false)
 {
-    if (m_solver == BiCGStab1 || m_solver == BiCGStab2) {
-        m_p_monitor = NULL;
+    // Create the convergence monitors required by the main Krylov method and
+    // by the fallback methods.
+    bool needMonitor = !usesBiCGStabLMonitor(m_solver);
+    bool needBiCGStabLMonitor = usesBiCGStabLMonitor(m_solver);
+
+    for (size_t i = 0; i < m_fallbackSolvers.size(); i++) {
+        if (usesBiCGStabLMonitor(m_fallbackSolvers[i]))
+            needBiCGStabLMonitor = true;
+        else
+            needMonitor = true;
+    }
+
+    m_p_monitor = NULL;
+    m_p_bicgstabl_monitor = NULL;
+
+    if (needBiCGStabLMonitor) {
         m_p_bicgstabl_monitor = new BiCGStabLMonitor<SolverVector>(
             opts.maxNumIterations,
             8,
             opts.relTol,
             opts.absTol
         );
-    } else {
-        m_p_bicgstabl_monitor = NULL;
+    }
+    if (needMonitor) {
         m_p_monitor = new Monitor<SolverVector>(
             opts.maxNumIterations,
             opts.relTol,
@@ -348,13 +542,22 @@ Solver<Array, PrecValueType>::setup(const Matrix& A)
 
     timer.Start();
 
-    m_precond.setup(A);
+    {
+        // Host temporaries of the reordering stage are drawn from the solver
+        // memory pool, so that repeated setups reuse the same blocks.
+        MemoryPool::Scope poolScope(m_pool);
+
+        m_precond.setup(A);
+    }
 
     timer.Stop();
 
     m_stats.timeSetup = timer.getElapsed();
+    m_stats.numPoolAllocs = m_pool.getNumSystemAllocs();
+    m_stats.memPoolReserved = m_pool.getBytesReserved();
 
     m_stats.bandwidthReorder = m_precond.getBandwidthReordering();
+    m_stats.numSupervariables = m_precond.getNumSupervariables();
     m_stats.bandwidth = m_precond.getBandwidth();
     m_stats.bandwidthDB= m_precond.getBandwidthDB();
     m_stats.nuKf = (double) cusp::blas::nrm1(m_precond.m_ks_row_host) + cusp::blas::nrm1(m_precond.m_ks_col_host);
@@ -385,9 +588,29 @@ Solver<Array, PrecValueType>::setup(const Matrix& A)
     m_stats.time_bandUL = m_precond.getTimeBandUL();
     m_stats.time_assembly = m_precond.gettimeAssembly();
     m_stats.time_fullLU = m_precond.getTimeFullLU();
+    m_stats.time_secondLevel = m_precond.getTimeSecondLevel();
+
+    m_stats.polyLambdaMin = m_precond.getPolyLambdaMin();
+    m_stats.polyLambdaMax = m_precond.getPolyLambdaMax();
+
+    m_stats.numColors = m_precond.getNumColors();
+    m_stats.avgSpikeRank = m_precond.getAverageSpikeRank();
 
     m_stats.actual_nnz  = m_precond.getActualNumNonZeros();
 
+    {
+        const MemoryPlan& plan = m_precond.getMemoryPlan();
+
+        m_stats.memBanded           = plan.bandedMat;
+        m_stats.memOffDiags         = plan.offDiags;
+        m_stats.memSpikes           = plan.spikes;
+        m_stats.memReduced          = plan.reducedMat;
+        m_stats.memULCopy           = plan.ulCopy;
+        m_stats.memSpikeTemporaries = plan.spikeTemporaries;
+        m_stats.memPredictedPeak    = plan.peak;
+        m_stats.memMeasuredPeak     = m_precond.getMemoryPeak();
+    }
+
     if (m_stats.bandwidth == 0)
         m_stats.nuKf = 0.0;
     else
@@ -398,6 +621,7 @@ Solver<Array, PrecValueType>::setup(const Matrix& A)
     else
         m_stats.flops_LU /= m_stats.time_bandLU * 1e6;
 
+    m_history.clear();
     m_setupDone = true;
 
     return true;
@@ -430,6 +654,9 @@ Solver<Array, PrecValueType>::update(const Array1& entries)
     if (!m_trackReordering)
         throw system_error(system_error::Illegal_update, "Illegal call to update() with reordering tracking disabled.");
 
+    if (m_precond.getPrecondType() == Polynomial || m_precond.getPrecondType() == SPAI)
+        throw system_error(system_error::Illegal_update, "Illegal call to update() with a preconditioner not based on the banded matrix.");
+
     // If the matrix pattern has actually changed, FIXME: do we need more checking?
     if (entries.size() != m_nnz)
         return false;
@@ -461,12 +688,100 @@ Solver<Array, PrecValueType>::update(const Array1& entries)
     return true;
 }
 
+/// Element assembler setup.
+/**
+ * This function prepares an element assembler (see sap::ElementAssembler)
+ * which accumulates element matrices directly into the reordered and scaled
+ * banded storage of the preconditioner. The matrix A must have the same
+ * sparsity pattern, with the entries in the same order, as the matrix passed
+ * to Solver::setup() (its values are not used); connectivity lists, for each
+ * element, the nodesPerElement (zero-based) unknowns of the element. Entries
+ * which were explicitly zero in the matrix passed to Solver::setup() are not
+ * assembled.
+ *
+ * An exception is thrown under the same conditions as for Solver::update(),
+ * or if the preconditioner uses an ILU factorization.
+ *
+ * 	param Matrix is the sparse matrix type used in setup().
+ * 	param Array1 is the integer vector type of the connectivity.
+ */
+template <typename Array, typename PrecValueType>
+template <typename Matrix, typename Array1>
+void
+Solver<Array, PrecValueType>::setupAssembler(const Matrix&                     A,
+                                             const Array1&                     connectivity,
+                                             int                               nodesPerElement,
+                                             ElementAssembler<PrecValueType>&  assembler)
+{
+    if (!m_setupDone)
+        throw system_error(system_error::Illegal_update, "Illegal call to setupAssembler() before setup().");
+
+    if (!m_trackReordering)
+        throw system_error(system_error::Illegal_update, "Illegal call to setupAssembler() with reordering tracking disabled.");
+
+    if (m_precond.getPrecondType() == Polynomial || m_precond.getPrecondType() == SPAI)
+        throw system_error(system_error::Illegal_update, "Illegal call to setupAssembler() with a preconditioner not based on the banded matrix.");
+
+    if (A.num_entries != m_nnz)
+        throw system_error(system_error::Illegal_update, "Illegal call to setupAssembler() with a matrix pattern different from the one used in setup().");
+
+    IntVectorH conn = connectivity;
+
+    m_precond.setupAssembler(A, conn, nodesPerElement, assembler);
+}
+
+/// Preconditioner update from an element assembler.
+/**
+ * This function updates the preconditioner from the banded storage assembled
+ * by the specified element assembler, which must have been prepared by
+ * Solver::setupAssembler(). Unlike Solver::update(entries), no sparse matrix
+ * entries are scattered: the assembled storage is copied to the device as is.
+ */
+template <typename Array, typename PrecValueType>
+bool
+Solver<Array, PrecValueType>::update(const ElementAssembler<PrecValueType>& assembler)
+{
+    if (!m_setupDone)
+        throw system_error(system_error::Illegal_update, "Illegal call to update() before setup().");
+
+    if (!m_trackReordering)
+        throw system_error(system_error::Illegal_update, "Illegal call to update() with reordering tracking disabled.");
+
+    if (m_precond.getPrecondType() == Polynomial || m_precond.getPrecondType() == SPAI)
+        throw system_error(system_error::Illegal_update, "Illegal call to update() with a preconditioner not based on the banded matrix.");
+
+    CPUTimer timer;
+    timer.Start();
+
+    m_precond.update(assembler);
+
+    timer.Stop();
+
+    m_stats.timeUpdate = timer.getElapsed();
+
+    m_stats.time_reorder = 0;
+    m_stats.time_cpu_assemble = m_precond.getTimeCPUAssemble();
+    m_stats.time_transfer = m_precond.getTimeTransfer();
+    m_stats.time_toBanded = m_precond.getTimeToBanded();
+    m_stats.time_offDiags = m_precond.getTimeCopyOffDiags();
+    m_stats.time_bandLU = m_precond.getTimeBandLU();
+    m_stats.time_bandUL = m_precond.getTimeBandUL();
+    m_stats.time_assembly = m_precond.gettimeAssembly();
+    m_stats.time_fullLU = m_precond.getTimeFullLU();
+
+    return true;
+}
+
 
 /// Linear system solve
 /**
  * This function solves the system Ax=b, for given matrix A and right-handside
  * vector b.
  *
+ * If Options::solutionHistory is positive, the initial guess x is first
+ * improved with the previous solutions (see Solver::historyGuess()), and the
+ * computed solution is added to the history.
+ *
  * An exception is throw if this call was not preceeded by a call to
  * Solver::setup().
  *
@@ -485,80 +800,652 @@ Solver<Array, PrecValueType>::solve(SpmvOperator&       spmv,
     if (!m_setupDone)
         throw system_error(system_error::Illegal_solve, "Illegal call to solve() before setup().");
 
+    int numGuess = 0;
+    if (m_historySize > 0)
+        numGuess = historyGuess(spmv, b, x);
+
+    bool converged = solveWith(spmv, b, x, m_precond);
+
+    m_stats.numHistoryGuess = numGuess;
+    if (m_historySize > 0)
+        pushHistory(x);
+
+    return converged;
+}
+
+
+/// Transposed linear system solve
+/**
+ * This function solves the system A^T y = c, for given right-handside vector
+ * c, reusing the preconditioner computed in Solver::setup() for the matrix A:
+ * the Krylov solver is preconditioned with the transpose of the SaP
+ * preconditioner, applied from the existing factors (no new factorization is
+ * performed). This is useful for adjoint and sensitivity computations, where
+ * systems with A and A^T must be solved.
+ *
+ * An exception is throw if this call was not preceeded by a call to
+ * Solver::setup() or if the transpose of the preconditioner cannot be
+ * applied (see Precond::hasTranspose()).
+ *
+ * \tparam SpmvOperator is a functor class which implements the operator()
+ *         to calculate sparse matrix-vector product with A^T.
+ */
+template <typename Array, typename PrecValueType>
+template <typename SpmvOperator>
+bool
+Solver<Array, PrecValueType>::solveTranspose(SpmvOperator&       spmvT,
+                                             const Array&        c,
+                                             Array&              y)
+{
+    // Check if this call to solveTranspose() is legal.
+    if (!m_setupDone)
+        throw system_error(system_error::Illegal_solve, "Illegal call to solveTranspose() before setup().");
+
+    if (!m_precond.hasTranspose())
+        throw system_error(system_error::Illegal_solve, "The transpose of this preconditioner is not available.");
+
+    PrecondTranspose<Precond<PrecVector> >  precondT(m_precond);
+
+    return solveWith(spmvT, c, y, precondT);
+}
+
+
+/**
+ * This function implements Solver::solve() and Solver::solveTranspose(): it
+ * runs the configured Krylov method with the given preconditioner and
+ * collects the solver statistics.
+ *
+ * If the Krylov method does not converge (breakdown, stagnation or maximum
+ * number of iterations reached) and fallback methods were specified in
+ * Options::fallbackSolvers, these are run in turn until one converges. Each
+ * fallback method starts from the last iterate of the previous one, unless
+ * the true residual of that iterate is larger than the one of the initial
+ * guess, so that the work of a failed attempt is not lost. The reported
+ * number of iterations is the total over all attempts.
+ *
+ * With Options::raceSolvers, the methods are instead run concurrently (see
+ * Solver::raceKrylov()) if the preconditioner supports concurrent applies;
+ * the reported number of iterations is then the one of the method kept.
+ */
+template <typename Array, typename PrecValueType>
+template <typename SpmvOperator, typename Preconditioner>
+bool
+Solver<Array, PrecValueType>::solveWith(SpmvOperator&    spmv,
+                                        const Array&     b,
+                                        Array&           x,
+                                        Preconditioner&  P)
+{
     SolverVector b_vector = b;
     SolverVector x_vector = x;
 
+    int   numAttempts   = 1 + m_fallbackSolvers.size();
+    float numIterations = 0;
+    bool  converged     = false;
 
-    // Solve the linear system.
-    if (m_p_monitor != NULL) {
-        m_p_monitor -> init(b_vector);
-    } else {
-        m_p_bicgstabl_monitor -> init(b_vector);
-    }
+    m_stats.numFallbacks = 0;
 
     CPUTimer timer;
 
     timer.Start();
 
-    switch(m_solver)
+    if (numAttempts > 1 && m_raceSolvers && m_precond.canApplyConcurrently()) {
+        m_stats.numFallbacks = numAttempts - 1;
+        converged = raceKrylov(spmv, x_vector, b_vector, P);
+        numIterations = m_stats.numIterations;
+    } else {
+        SolverVector    x0;
+        SolverVector    r;
+        SolverValueType r0Norm = 0;
+
+        if (numAttempts > 1) {
+            x0 = x_vector;
+            r.resize(b_vector.size());
+            cusp::multiply(spmv, x0, r);
+            cusp::blas::axpby(b_vector, r, r, SolverValueType(1), SolverValueType(-1));
+            r0Norm = cusp::blas::nrm2(r);
+        }
+
+        for (int attempt = 0; attempt < numAttempts; attempt++) {
+            KrylovSolverType method = (attempt == 0 ? m_solver : m_fallbackSolvers[attempt - 1]);
+
+            if (attempt > 0) {
+                m_stats.numFallbacks++;
+
+                // Continue from the last iterate if it improves on the initial guess.
+                cusp::multiply(spmv, x_vector, r);
+                cusp::blas::axpby(b_vector, r, r, SolverValueType(1), SolverValueType(-1));
+
+                if (!(cusp::blas::nrm2(r) < r0Norm))
+                    cusp::blas::copy(x0, x_vector);
+            }
+
+            runKrylov(method, spmv, x_vector, b_vector, P, m_p_monitor, m_p_bicgstabl_monitor, m_work);
+            converged = recordKrylov(method);
+            numIterations += m_stats.numIterations;
+
+            if (converged)
+                break;
+        }
+    }
+
+    thrust::copy(x_vector.begin(), x_vector.end(), x.begin());
+    timer.Stop();
+
+    m_stats.timeSolve = timer.getElapsed();
+    m_stats.numIterations = numIterations;
+
+    m_stats.time_shuffle = m_precond.getTimeShuffle();
+
+    m_stats.time_bcr_lu = m_precond.getTimeBCRLU();
+    m_stats.time_bcr_sweep_deflation = m_precond.getTimeBCRSweepDeflation();
+    m_stats.time_bcr_mat_mul_deflation = m_precond.getTimeBCRMatMulDeflation();
+    m_stats.time_bcr_sweep_inflation = m_precond.getTimeBCRSweepInflation();
+    m_stats.time_bcr_mv_inflation = m_precond.getTimeBCRMVInflation();
+
+    return converged;
+}
+
+/**
+ * This function runs the main Krylov method and the fallback methods
+ * concurrently, all starting from the initial guess x, and returns true if
+ * one of them converged. Every method runs on its own OpenMP thread, with its
+ * own monitors and its own preconditioner workspace (the factors are shared,
+ * see Precond::WorkspaceScope), and gets an equal share of the host threads
+ * for its nested parallel regions. The first method to converge sets a flag
+ * which the monitors of the others check at every convergence test, so that
+ * they stop with code -4. If no method converges, the iterate with the
+ * smallest true residual is kept, unless it does not improve on the initial
+ * guess.
+ *
+ * The SpMV operator must support concurrent calls (as sap::SpmvCusp does).
+ * The GPU work of every method is issued on the default stream of its host
+ * thread; the examples are compiled with nvcc --default-stream per-thread
+ * (see SBELUtils.cmake), which makes these streams independent. Without that
+ * flag all methods share the legacy default stream and their kernels are
+ * serialized.
+ */
+template <typename Array, typename PrecValueType>
+template <typename SpmvOperator, typename Preconditioner>
+bool
+Solver<Array, PrecValueType>::raceKrylov(SpmvOperator&    spmv,
+                                         SolverVector&    x_vector,
+                                         SolverVector&    b_vector,
+                                         Preconditioner&  P)
+{
+    int numRacers = 1 + m_fallbackSolvers.size();
+
+    std::vector<KrylovSolverType>                 methods(numRacers, m_solver);
+    std::vector<SolverVector>                     xs(numRacers, x_vector);
+    std::vector<Monitor<SolverVector> >           monitors(numRacers, Monitor<SolverVector>(m_maxNumIterations, m_relTol, m_absTol));
+    std::vector<BiCGStabLMonitor<SolverVector> >  bicgstablMonitors(numRacers, BiCGStabLMonitor<SolverVector>(m_maxNumIterations, 8, m_relTol, m_absTol));
+    std::vector<std::vector<SolverVector> >       works(numRacers);
+    std::vector<std::exception_ptr>               errors(numRacers);
+
+    std::copy(m_fallbackSolvers.begin(), m_fallbackSolvers.end(), methods.begin() + 1);
+
+    int cancel = 0;
+    int winner = -1;
+
+    m_precond.reserveWorkspaces(numRacers);
+
+    int threadsPerRacer = std::max(1, omp_get_max_threads() / numRacers);
+    int maxLevels       = omp_get_max_active_levels();
+
+    omp_set_max_active_levels(std::max(maxLevels, 2));
+
+#pragma omp parallel for num_threads(numRacers) schedule(static, 1)
+    for (int i = 0; i < numRacers; i++) {
+        typename Precond<PrecVector>::WorkspaceScope workspaceScope(i);
+
+        omp_set_num_threads(threadsPerRacer);
+
+        monitors[i].setCancelFlag(&cancel);
+        bicgstablMonitors[i].setCancelFlag(&cancel);
+
+        // Exceptions cannot leave the parallel region; they are rethrown
+        // below if no method completed.
+        try {
+            runKrylov(methods[i], spmv, xs[i], b_vector, P, &monitors[i], &bicgstablMonitors[i], works[i]);
+        } catch (...) {
+            errors[i] = std::current_exception();
+            continue;
+        }
+
+        bool converged = usesBiCGStabLMonitor(methods[i]) ? bicgstablMonitors[i].converged() : monitors[i].converged();
+
+        if (converged) {
+#pragma omp critical (sap_race)
+            {
+                if (winner < 0)
+                    winner = i;
+            }
+
+#pragma omp atomic write
+            cancel = 1;
+        }
+    }
+
+    omp_set_max_active_levels(maxLevels);
+
+    // Without a winner, keep the iterate with the smallest true residual if
+    // it improves on the initial guess.
+    int  chosen = winner;
+    bool improved = true;
+
+    if (chosen < 0) {
+        SolverVector    r(b_vector.size());
+        SolverValueType r0Norm, bestNorm = 0;
+
+        cusp::multiply(spmv, x_vector, r);
+        cusp::blas::axpby(b_vector, r, r, SolverValueType(1), SolverValueType(-1));
+        r0Norm = cusp::blas::nrm2(r);
+
+        for (int i = 0; i < numRacers; i++) {
+            if (errors[i])
+                continue;
+
+            cusp::multiply(spmv, xs[i], r);
+            cusp::blas::axpby(b_vector, r, r, SolverValueType(1), SolverValueType(-1));
+
+            SolverValueType rNorm = cusp::blas::nrm2(r);
+
+            if (chosen < 0 || rNorm < bestNorm) {
+                chosen   = i;
+                bestNorm = rNorm;
+            }
+        }
+
+        if (chosen < 0)
+            std::rethrow_exception(errors[0]);
+
+        improved = (bestNorm < r0Norm);
+    }
+
+    if (improved)
+        cusp::blas::copy(xs[chosen], x_vector);
+
+    if (usesBiCGStabLMonitor(methods[chosen])) {
+        *m_p_bicgstabl_monitor = bicgstablMonitors[chosen];
+        m_p_bicgstabl_monitor -> setCancelFlag(0);
+    } else {
+        *m_p_monitor = monitors[chosen];
+        m_p_monitor -> setCancelFlag(0);
+    }
+
+    return recordKrylov(methods[chosen]);
+}
+
+/**
+ * This function runs the specified Krylov method, starting from the initial
+ * guess x, with the given convergence monitors (only the one used by the
+ * method must be valid) and work vectors.
+ */
+template <typename Array, typename PrecValueType>
+template <typename SpmvOperator, typename Preconditioner>
+void
+Solver<Array, PrecValueType>::runKrylov(KrylovSolverType                 method,
+                                        SpmvOperator&                    spmv,
+                                        SolverVector&                    x_vector,
+                                        SolverVector&                    b_vector,
+                                        Preconditioner&                  P,
+                                        Monitor<SolverVector>*           monitor,
+                                        BiCGStabLMonitor<SolverVector>*  bicgstablMonitor,
+                                        std::vector<SolverVector>&       work)
+{
+    if (!usesBiCGStabLMonitor(method)) {
+        monitor -> init(b_vector);
+    } else {
+        bicgstablMonitor -> init(b_vector);
+    }
+
+    switch(method)
     {
         // CUSP Krylov solvers
         case BiCGStab_C:
-            cusp::krylov::bicgstab(spmv, x_vector, b_vector, *m_p_monitor, m_precond);
+            cusp::krylov::bicgstab(spmv, x_vector, b_vector, *monitor, P);
             break;
         case GMRES_C:
-            cusp::krylov::gmres(spmv, x_vector, b_vector, 50, *m_p_monitor, m_precond);
+            cusp::krylov::gmres(spmv, x_vector, b_vector, 50, *monitor, P);
             break;
         case CG_C:
-            cusp::krylov::cg(spmv, x_vector, b_vector, *m_p_monitor, m_precond);
+            cusp::krylov::cg(spmv, x_vector, b_vector, *monitor, P);
             break;
         case CR_C:
-            cusp::krylov::cr(spmv, x_vector, b_vector, *m_p_monitor, m_precond);
+            cusp::krylov::cr(spmv, x_vector, b_vector, *monitor, P);
             break;
 
         // SaP Krylov solvers
         case BiCGStab1:
-            sap::bicgstab1(spmv, x_vector, b_vector, *m_p_bicgstabl_monitor, m_precond);
+            sap::bicgstab1(spmv, x_vector, b_vector, *bicgstablMonitor, P);
             break;
         case BiCGStab2:
-            sap::bicgstab2(spmv, x_vector, b_vector, *m_p_bicgstabl_monitor, m_precond);
+            sap::bicgstab2(spmv, x_vector, b_vector, *bicgstablMonitor, P);
             break;
         case BiCGStab:
-            sap::bicgstab(spmv, x_vector, b_vector, *m_p_monitor, m_precond);
+            sap::bicgstab(spmv, x_vector, b_vector, *monitor, P);
             break;
         case MINRES:
-            sap::minres(spmv, x_vector, b_vector, *m_p_monitor, m_precond);
+            sap::minres(spmv, x_vector, b_vector, *monitor, P);
+            break;
+        case IDRs:
+            sap::idrs(spmv, x_vector, b_vector, *bicgstablMonitor, P, m_idrS);
+            break;
+        case CG:
+            sap::cg(spmv, x_vector, b_vector, *monitor, P, work);
+            break;
+        case SGMRES:
+            sap::sgmres(spmv, x_vector, b_vector, m_restart, m_sStep, *monitor, P);
             break;
     }
+}
 
-    thrust::copy(x_vector.begin(), x_vector.end(), x.begin());
-    timer.Stop();
+/**
+ * This function stores the convergence information of the solver monitor
+ * used by the specified Krylov method in the solver statistics, and makes
+ * it the one reported by getMonitorCode(). It returns true if the method
+ * converged.
+ */
+template <typename Array, typename PrecValueType>
+bool
+Solver<Array, PrecValueType>::recordKrylov(KrylovSolverType method)
+{
+    m_lastSolver = method;
 
-    m_stats.timeSolve = timer.getElapsed();
-    if (m_p_monitor != NULL) {
+    if (!usesBiCGStabLMonitor(method)) {
         m_stats.rhsNorm = m_p_monitor -> getRHSNorm();
         m_stats.residualNorm = m_p_monitor -> getResidualNorm();
         m_stats.relResidualNorm = m_p_monitor -> getRelResidualNorm();
         m_stats.numIterations = m_p_monitor -> getNumIterations();
-    } else {
-        m_stats.rhsNorm = m_p_bicgstabl_monitor -> getRHSNorm();
-        m_stats.residualNorm = m_p_bicgstabl_monitor -> getResidualNorm();
-        m_stats.relResidualNorm = m_p_bicgstabl_monitor -> getRelResidualNorm();
-        m_stats.numIterations = m_p_bicgstabl_monitor -> getNumIterations();
+        return m_p_monitor -> converged();
     }
 
-    m_stats.time_shuffle = m_precond.getTimeShuffle();
+    m_stats.rhsNorm = m_p_bicgstabl_monitor -> getRHSNorm();
+    m_stats.residualNorm = m_p_bicgstabl_monitor -> getResidualNorm();
+    m_stats.relResidualNorm = m_p_bicgstabl_monitor -> getRelResidualNorm();
+    m_stats.numIterations = m_p_bicgstabl_monitor -> getNumIterations();
+    return m_p_bicgstabl_monitor -> converged();
+}
 
-    m_stats.time_bcr_lu = m_precond.getTimeBCRLU();
-    m_stats.time_bcr_sweep_deflation = m_precond.getTimeBCRSweepDeflation();
-    m_stats.time_bcr_mat_mul_deflation = m_precond.getTimeBCRMatMulDeflation();
-    m_stats.time_bcr_sweep_inflation = m_precond.getTimeBCRSweepInflation();
-    m_stats.time_bcr_mv_inflation = m_precond.getTimeBCRMVInflation();
 
-    if (m_p_monitor != NULL) {
-        return m_p_monitor -> converged();
+/**
+ * This function improves the initial guess x of Solver::solve() with the
+ * solutions of the previous solves. With X the matrix whose columns are the
+ * stored solutions, the correction X*c minimizing ||b - A*(x + X*c)||_2 is
+ * added to x (a Galerkin projection of the residual onto the span of A*X).
+ * This subsumes polynomial extrapolation from the previous solutions, which
+ * produces a guess in the same span. The cost is one SpMV per stored
+ * solution, plus one for the residual of the given guess.
+ *
+ * The columns of A*X are orthonormalized with modified Gram-Schmidt (the
+ * same combinations being applied to the columns of X), and columns which
+ * are numerically dependent on the previous ones are discarded. The function
+ * returns the number of stored solutions used.
+ */
+template <typename Array, typename PrecValueType>
+template <typename SpmvOperator>
+int
+Solver<Array, PrecValueType>::historyGuess(SpmvOperator&  spmv,
+                                           const Array&   b,
+                                           Array&         x)
+{
+    int m = m_history.size();
+
+    if (m == 0 || m_history[0].size() != b.size())
+        return 0;
+
+    if ((int) m_historyWork.size() < 2 * m + 1)
+        m_historyWork.resize(2 * m + 1);
+    for (int j = 0; j < 2 * m + 1; j++)
+        m_historyWork[j].resize(m_n);
+
+    // r <- b - A * x
+    SolverVector& r = m_historyWork[2 * m];
+    SolverVector  x_vector = x;
+    SolverVector  b_vector = b;
+
+    cusp::multiply(spmv, x_vector, r);
+    cusp::blas::axpby(b_vector, r, r, SolverValueType(1), SolverValueType(-1));
+
+    SolverValueType rNorm = cusp::blas::nrm2(r);
+
+    if (rNorm == 0)
+        return 0;
+
+    // V <- X,  W <- A * X, with the columns of W orthonormalized.
+    int numUsed = 0;
+
+    for (int j = 0; j < m; j++) {
+        SolverVector& v = m_historyWork[numUsed];
+        SolverVector& w = m_historyWork[m + numUsed];
+
+        cusp::blas::copy(m_history[j], v);
+        cusp::multiply(spmv, v, w);
+
+        SolverValueType wNorm0 = cusp::blas::nrm2(w);
+
+        for (int i = 0; i < numUsed; i++) {
+            SolverValueType h = cusp::blas::dotc(m_historyWork[m + i], w);
+            cusp::blas::axpy(m_historyWork[m + i], w, -h);
+            cusp::blas::axpy(m_historyWork[i], v, -h);
+        }
+
+        SolverValueType wNorm = cusp::blas::nrm2(w);
+
+        if (!(wNorm > std::sqrt(std::numeric_limits<SolverValueType>::epsilon()) * wNorm0))
+            continue;
+
+        cusp::blas::scal(w, SolverValueType(1) / wNorm);
+        cusp::blas::scal(v, SolverValueType(1) / wNorm);
+        numUsed++;
     }
-    return m_p_bicgstabl_monitor -> converged();
+
+    // x <- x + V * (W^T * r)
+    for (int j = 0; j < numUsed; j++) {
+        SolverValueType c = cusp::blas::dotc(m_historyWork[m + j], r);
+        cusp::blas::axpy(m_historyWork[j], x_vector, c);
+    }
+
+    thrust::copy(x_vector.begin(), x_vector.end(), x.begin());
+
+    return numUsed;
+}
+
+/**
+ * This function adds the solution x to the history used by
+ * Solver::historyGuess(), dropping the oldest one if the history is full.
+ */
+template <typename Array, typename PrecValueType>
+void
+Solver<Array, PrecValueType>::pushHistory(const Array& x)
+{
+    SolverVector sol;
+
+    if ((int) m_history.size() >= m_historySize) {
+        sol.swap(m_history.front());
+        m_history.pop_front();
+    }
+
+    sol.resize(x.size());
+    thrust::copy(x.begin(), x.end(), sol.begin());
+    m_history.push_back(SolverVector());
+    m_history.back().swap(sol);
+}
+
+
+/// Solve a family of shifted systems
+/**
+ * This function solves the systems (A + shifts[i] * I) X[i] = b for all
+ * given shifts, where A is the matrix implemented by spmv. The preconditioner
+ * must have been set up with the matrix A + refShift * I.
+ *
+ * With P the SaP preconditioner (an approximation of (A + refShift * I)^{-1})
+ * and c = shifts[i] - refShift, the system for shift i is rewritten as
+ * (I + c * P) y = b, x = P * y, which in turn is the shifted system
+ * (P + I/c) z = b, y = z/c, in the operator P. All these systems share one
+ * Krylov basis and are solved by a single multi-shift BiCGStab iteration
+ * (see sap::bicgstabShifted), seeded with the shift farthest from refShift.
+ * The iteration only applies the preconditioner (twice per iteration); the
+ * solutions are then recovered with one preconditioner apply per shift.
+ *
+ * The rewriting is exact only if P is the exact inverse of A + refShift * I,
+ * i.e. a banded factorization of a single partition without drop-off (see
+ * Precond::isExact()), computed in the precision of the solver. Otherwise
+ * (several partitions, drop-off, a factorization in lower precision, ...)
+ * the multi-shift iteration would solve perturbed systems, whose solutions
+ * miss the tolerance and would need a full solve each anyway; the shifts
+ * are then solved one after the other, each with the configured Krylov
+ * method preconditioned by P. With an exact P, the true residual of every
+ * shift is still checked at the end, and a shift which has not converged
+ * (e.g. because of rounding) is solved separately, using the multi-shift
+ * solution as initial guess. The number of shifts solved separately is
+ * reported in Stats::numShiftsRefined.
+ *
+ * An exception is throw if this call was not preceeded by a call to
+ * Solver::setup().
+ *
+ * \tparam SpmvOperator is a functor class which implements the operator()
+ *         to calculate sparse matrix-vector product with A.
+ */
+template <typename Array, typename PrecValueType>
+template <typename SpmvOperator>
+bool
+Solver<Array, PrecValueType>::solveShifted(SpmvOperator&                                   spmv,
+                                           const Array&                                    b,
+                                           const std::vector<typename Array::value_type>&  shifts,
+                                           std::vector<Array>&                             X,
+                                           typename Array::value_type                      refShift)
+{
+    typedef ShiftedOperator<Precond<PrecVector>, SolverVector>  ShiftedPrecond;
+    typedef ShiftedOperator<SpmvOperator, SolverVector>         ShiftedSpmv;
+
+    // Check if this call to solveShifted() is legal.
+    if (!m_setupDone)
+        throw system_error(system_error::Illegal_solve, "Illegal call to solveShifted() before setup().");
+
+    int ns = shifts.size();
+
+    X.resize(ns);
+
+    SolverVector b_vector = b;
+    SolverVector x_vector(m_n);
+    SolverVector y_vector(m_n);
+
+    CPUTimer timer;
+
+    timer.Start();
+
+    // With an inexact preconditioner, solve the shifts one after the other.
+    if (!m_precond.isExact() || sizeof(PrecValueType) < sizeof(SolverValueType)) {
+        SolverValueType rhsNorm       = cusp::blas::nrm2(b_vector);
+        SolverValueType resMax        = 0;
+        float           numIterations = 0;
+        bool            success       = true;
+
+        for (int i = 0; i < ns; i++) {
+            ShiftedSpmv  Ai(spmv, m_n, shifts[i]);
+
+            X[i].resize(m_n);
+            thrust::fill(X[i].begin(), X[i].end(), SolverValueType(0));
+
+            success = solveWith(Ai, b, X[i], m_precond) && success;
+            numIterations += m_stats.numIterations;
+            resMax = std::max(resMax, (SolverValueType) m_stats.residualNorm);
+        }
+
+        timer.Stop();
+
+        m_stats.numShiftsRefined = ns;
+        m_stats.timeSolve        = timer.getElapsed();
+        m_stats.numIterations    = numIterations;
+        m_stats.rhsNorm          = rhsNorm;
+        m_stats.residualNorm     = resMax;
+        m_stats.relResidualNorm  = resMax / rhsNorm;
+
+        return success;
+    }
+
+    // Pick the seed: the shift farthest from the reference shift (i.e. the
+    // smallest shift 1/c in the operator P). Shifts equal to the reference
+    // shift need no iteration (x = P * b).
+    int seed = -1;
+    for (int i = 0; i < ns; i++) {
+        SolverValueType c = shifts[i] - refShift;
+        if (c != 0 && (seed < 0 || std::abs(c) > std::abs(shifts[seed] - refShift)))
+            seed = i;
+    }
+
+    std::vector<SolverVector>     Z;
+    std::vector<SolverValueType>  relShifts;
+    std::vector<int>              index(ns, -1);
+    float                         numIterations = 0;
+
+    if (seed >= 0) {
+        SolverValueType mu_seed = 1 / (shifts[seed] - refShift);
+
+        for (int i = 0; i < ns; i++) {
+            SolverValueType c = shifts[i] - refShift;
+            if (c != 0) {
+                index[i] = relShifts.size();
+                relShifts.push_back(1 / c - mu_seed);
+            }
+        }
+
+        ShiftedPrecond         K(m_precond, m_n, mu_seed);
+        Monitor<SolverVector>  monitor(m_maxNumIterations, m_relTol, m_absTol);
+
+        monitor.init(b_vector);
+        sap::bicgstabShifted(K, Z, b_vector, relShifts, monitor);
+        numIterations = monitor.getNumIterations();
+    }
+
+    // Recover the solutions (x = P * y, with y = z/c or y = b) and check the
+    // true residuals; shifts which have not converged are solved separately.
+    SolverValueType rhsNorm  = cusp::blas::nrm2(b_vector);
+    SolverValueType tol      = m_absTol + m_relTol * rhsNorm;
+    SolverValueType resMax   = 0;
+    bool            success  = true;
+
+    m_stats.numShiftsRefined = 0;
+
+    for (int i = 0; i < ns; i++) {
+        if (index[i] < 0) {
+            cusp::blas::copy(b_vector, y_vector);
+        } else {
+            cusp::blas::copy(Z[index[i]], y_vector);
+            cusp::blas::scal(y_vector, 1 / (shifts[i] - refShift));
+        }
+
+        cusp::multiply(m_precond, y_vector, x_vector);
+
+        ShiftedSpmv  Ai(spmv, m_n, shifts[i]);
+
+        cusp::multiply(Ai, x_vector, y_vector);
+        cusp::blas::axpby(b_vector, y_vector, y_vector, SolverValueType(1), SolverValueType(-1));
+
+        SolverValueType resNorm = cusp::blas::nrm2(y_vector);
+
+        X[i].resize(m_n);
+        thrust::copy(x_vector.begin(), x_vector.end(), X[i].begin());
+
+        if (!(resNorm <= tol)) {
+            m_stats.numShiftsRefined++;
+            success = solveWith(Ai, b, X[i], m_precond) && success;
+            numIterations += m_stats.numIterations;
+            resNorm = m_stats.residualNorm;
+        }
+
+        resMax = std::max(resMax, resNorm);
+    }
+
+    timer.Stop();
+
+    m_stats.timeSolve       = timer.getElapsed();
+    m_stats.numIterations   = numIterations;
+    m_stats.rhsNorm         = rhsNorm;
+    m_stats.residualNorm    = resMax;
+    m_stats.relResidualNorm = resMax / rhsNorm;
+
+    return success;
 }
 
 
@@ -6,7 +6,13 @@
 #define SAP_SPMV_H
 
 
+#include <vector>
+
 #include <cusp/multiply.h>
+#include <cusp/csr_matrix.h>
+
+#include <thrust/transform.h>
+#include <thrust/iterator/counting_iterator.h>
 
 #include <sap/common.h>
 #include <sap/timer.h>
@@ -263,6 +269,167 @@ private:
 	}
 };
 
+/**
+ * This functor calculates one entry of the product of a symmetric matrix,
+ * stored as its upper half U (including the diagonal), with a vector. The
+ * entries of the strictly lower half are gathered from U through the
+ * transposed pattern, so no atomic updates are needed.
+ */
+template <typename ValueType>
+struct SymmetricRowProduct : public thrust::unary_function<int, ValueType>
+{
+	const int*        m_offsets;
+	const int*        m_cols;
+	const ValueType*  m_vals;
+	const int*        m_tOffsets;
+	const int*        m_tRows;
+	const int*        m_tPerm;
+	const ValueType*  m_v;
+
+	SymmetricRowProduct(const int* offsets, const int* cols, const ValueType* vals,
+	                    const int* tOffsets, const int* tRows, const int* tPerm,
+	                    const ValueType* v)
+	:	m_offsets(offsets), m_cols(cols), m_vals(vals),
+		m_tOffsets(tOffsets), m_tRows(tRows), m_tPerm(tPerm), m_v(v) {}
+
+	__host__ __device__
+	ValueType operator() (int i) const
+	{
+		ValueType sum = 0;
+		for (int k = m_offsets[i]; k < m_offsets[i + 1]; k++)
+			sum += m_vals[k] * m_v[m_cols[k]];
+		for (int k = m_tOffsets[i]; k < m_tOffsets[i + 1]; k++)
+			sum += m_vals[m_tPerm[k]] * m_v[m_tRows[k]];
+		return sum;
+	}
+};
+
+/// Symmetric SPMV functor class.
+/**
+ * This class implements the SPMV functor for a symmetric sparse matrix,
+ * keeping only the upper half of the matrix (in CSR format) plus the index
+ * arrays of its transposed pattern. The matrix values are thus stored only
+ * once, which roughly halves the memory of the values. They are not read
+ * only once, though: every off-diagonal value is read a second time, through
+ * an indirect gather, for the strictly lower half, so the memory traffic of
+ * the product is not reduced by the same amount. The matrix passed to the
+ * constructor must be symmetric; only its upper half is used.
+ *
+ * \tparam Matrix is the type of the (full) sparse matrix.
+ */
+template <typename Matrix>
+class SpmvSymmetric : public cusp::linear_operator<typename Matrix::value_type, typename Matrix::memory_space, typename Matrix::index_type>
+{
+public:
+	typedef typename cusp::linear_operator<typename Matrix::value_type, typename Matrix::memory_space, typename Matrix::index_type> Parent;
+
+	typedef typename Matrix::value_type    ValueType;
+	typedef typename Matrix::memory_space  MemorySpace;
+
+	SpmvSymmetric(const Matrix& A);
+
+	/// Cummulative time for all SPMV calls (ms).
+	double getTime() const   {return m_time;}
+
+	/// Total number of calls to the SPMV functor.
+	double getCount() const  {return m_count;}
+
+	/// Average GFLOP/s over all SPMV calls.
+	double getGFlops() const {return 0;}
+
+	/// Number of stored (upper half) entries.
+	int    getNumStored() const {return m_vals.size();}
+
+	/// Implementation of the SPMV functor.
+	template <typename Array>
+	void operator()(const Array& v,
+	                Array&       Av)
+	{
+		SymmetricRowProduct<ValueType> op(thrust::raw_pointer_cast(m_offsets.data()),
+		                                  thrust::raw_pointer_cast(m_cols.data()),
+		                                  thrust::raw_pointer_cast(m_vals.data()),
+		                                  thrust::raw_pointer_cast(m_tOffsets.data()),
+		                                  thrust::raw_pointer_cast(m_tRows.data()),
+		                                  thrust::raw_pointer_cast(m_tPerm.data()),
+		                                  thrust::raw_pointer_cast(&v[0]));
+
+		thrust::transform(thrust::counting_iterator<int>(0), thrust::counting_iterator<int>(m_n), Av.begin(), op);
+	}
+
+private:
+	typedef typename cusp::array1d<int, MemorySpace>        IntVector;
+	typedef typename cusp::array1d<ValueType, MemorySpace>  ValueVector;
+
+	int          m_n;
+
+	IntVector    m_offsets;     // upper half U (CSR)
+	IntVector    m_cols;
+	ValueVector  m_vals;
+	IntVector    m_tOffsets;    // strictly upper half of U, transposed (CSR pattern)
+	IntVector    m_tRows;
+	IntVector    m_tPerm;       // index in m_vals of each transposed entry
+
+	double       m_time;
+	int          m_count;
+};
+
+template <typename Matrix>
+SpmvSymmetric<Matrix>::SpmvSymmetric(const Matrix& A)
+:	Parent(A.num_rows, A.num_cols),
+	m_n(A.num_rows),
+	m_time(0),
+	m_count(0)
+{
+	cusp::csr_matrix<int, ValueType, cusp::host_memory> Ah(A);
+
+	std::vector<int>        offsets(m_n + 1, 0);
+	std::vector<int>        tOffsets(m_n + 1, 0);
+
+	for (int i = 0; i < m_n; i++) {
+		for (int k = Ah.row_offsets[i]; k < Ah.row_offsets[i + 1]; k++) {
+			int j = Ah.column_indices[k];
+			if (j < i)
+				continue;
+			offsets[i + 1]++;
+			if (j > i)
+				tOffsets[j + 1]++;
+		}
+	}
+
+	for (int i = 0; i < m_n; i++) {
+		offsets[i + 1] += offsets[i];
+		tOffsets[i + 1] += tOffsets[i];
+	}
+
+	std::vector<int>        cols(offsets[m_n]);
+	std::vector<ValueType>  vals(offsets[m_n]);
+	std::vector<int>        tRows(tOffsets[m_n]);
+	std::vector<int>        tPerm(tOffsets[m_n]);
+	std::vector<int>        tPos(tOffsets.begin(), tOffsets.end() - 1);
+
+	for (int i = 0, cnt = 0; i < m_n; i++) {
+		for (int k = Ah.row_offsets[i]; k < Ah.row_offsets[i + 1]; k++) {
+			int j = Ah.column_indices[k];
+			if (j < i)
+				continue;
+			cols[cnt] = j;
+			vals[cnt] = Ah.values[k];
+			if (j > i) {
+				tRows[tPos[j]] = i;
+				tPerm[tPos[j]++] = cnt;
+			}
+			cnt++;
+		}
+	}
+
+	m_offsets.assign(offsets.begin(), offsets.end());
+	m_cols.assign(cols.begin(), cols.end());
+	m_vals.assign(vals.begin(), vals.end());
+	m_tOffsets.assign(tOffsets.begin(), tOffsets.end());
+	m_tRows.assign(tRows.begin(), tRows.end());
+	m_tPerm.assign(tPerm.begin(), tPerm.end());
+}
+
 } // namespace sap
 
 
@@ -0,0 +1,516 @@
+/** \file tuner.h
+ *  \brief Automatic selection of the SaP solver options.
+ */
+
+#ifndef SAP_TUNER_H
+#define SAP_TUNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <exception>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cusp/csr_matrix.h>
+
+#include <sap/common.h>
+#include <sap/solver.h>
+#include <sap/timer.h>
+
+
+namespace sap {
+
+/// Structural fingerprint of a matrix.
+/**
+ * The tuner uses these features to recognize matrices for which it already
+ * found a good configuration. Matrices with the same key (i.e. with features
+ * in the same logarithmic buckets) are considered similar.
+ */
+struct MatrixFeatures
+{
+    MatrixFeatures()
+    :   n(0),
+        nnz(0),
+        halfBandwidth(0),
+        maxRowNnz(0),
+        patternSymmetry(0),
+        diagDominantRows(0),
+        isSPD(false)
+    {}
+
+    int     n;                  /**< Number of rows. */
+    int     nnz;                /**< Number of nonzeros. */
+    int     halfBandwidth;      /**< Half-bandwidth of the matrix as given (no reordering). */
+    int     maxRowNnz;          /**< Largest number of nonzeros in a row. */
+    double  patternSymmetry;    /**< Fraction of the off-diagonal entries (i,j) for which (j,i) is also an entry. */
+    double  diagDominantRows;   /**< Fraction of the rows which are diagonally dominant. */
+    bool    isSPD;              /**< The matrix was declared SPD (through Options::isSPD). */
+
+    template <typename Matrix>
+    static MatrixFeatures  compute(const Matrix& A, bool isSPD);
+
+    std::string  key() const;
+};
+
+
+/// Automatic configuration tuner.
+/**
+ * This class selects the number of partitions and the solver options for a
+ * given matrix. It first looks up the matrix fingerprint in an on-disk
+ * database; if no similar matrix was tuned before, it runs short trial setups
+ * and solves over a pruned search space, keeping the better half of the
+ * candidates after every round (successive halving) while doubling the
+ * iteration budget of the trial solves. Candidates are ranked by their
+ * estimated time to solution. The winner is saved in the database.
+ *
+ * \tparam Array is the array type for the linear system solution (a
+ *         cusp::array1d, as the trial solves allocate their own solution).
+ * \tparam PrecValueType is the floating point type used in the preconditioner.
+ */
+template <typename Array, typename PrecValueType>
+class Tuner
+{
+public:
+    Tuner(const std::string&  dbFile = "sap_tuner.db",
+          int                 trialIterations = 10);
+
+    template <typename Matrix, typename SpmvOperator>
+    bool    tune(const Matrix&   A,
+                 SpmvOperator&   spmv,
+                 const Array&    b,
+                 int&            numPartitions,
+                 Options&        opts);
+
+    bool    lookup(const MatrixFeatures&  features,
+                   int&                   numPartitions,
+                   Options&               opts) const;
+    void    store(const MatrixFeatures&  features,
+                  int                    numPartitions,
+                  const Options&         opts,
+                  double                 timeToSolution) const;
+
+    const MatrixFeatures&  getFeatures() const      {return m_features;}
+    bool                   fromDatabase() const     {return m_fromDatabase;}
+    int                    getNumTrials() const     {return m_numTrials;}
+    double                 getTimeTuning() const    {return m_timeTuning;}
+
+private:
+    struct Candidate {
+        int      numPartitions;
+        Options  opts;
+        double   score;
+    };
+
+    std::string     m_dbFile;
+    int             m_trialIterations;
+
+    MatrixFeatures  m_features;
+    bool            m_fromDatabase;
+    int             m_numTrials;
+    double          m_timeTuning;
+
+    void    buildCandidates(int                     maxPartitions,
+                            const Options&          opts,
+                            std::vector<Candidate>& candidates) const;
+
+    template <typename Matrix, typename SpmvOperator>
+    double  trial(const Matrix&     A,
+                  SpmvOperator&     spmv,
+                  const Array&      b,
+                  const Candidate&  candidate,
+                  int               maxIterations);
+
+    static bool  compareScores(const Candidate& a, const Candidate& b) {return a.score < b.score;}
+};
+
+
+/**
+ * This function calculates the features of the specified matrix (which is
+ * copied to the host in CSR format).
+ */
+template <typename Matrix>
+MatrixFeatures
+MatrixFeatures::compute(const Matrix&  A,
+                        bool           isSPD)
+{
+    typedef typename cusp::csr_matrix<int, double, cusp::host_memory> MatrixCsrH;
+
+    MatrixCsrH      Acsrh = A;
+    MatrixFeatures  features;
+
+    features.n     = (int) Acsrh.num_rows;
+    features.nnz   = (int) Acsrh.num_entries;
+    features.isSPD = isSPD;
+
+    int  offDiag = 0, symmetric = 0, dominant = 0;
+
+    for (int i = 0; i < features.n; i++) {
+        int     start_idx = Acsrh.row_offsets[i];
+        int     end_idx   = Acsrh.row_offsets[i+1];
+        double  diag = 0, offSum = 0;
+
+        features.maxRowNnz = std::max(features.maxRowNnz, end_idx - start_idx);
+
+        for (int l = start_idx; l < end_idx; l++) {
+            int j = Acsrh.column_indices[l];
+
+            features.halfBandwidth = std::max(features.halfBandwidth, std::abs(i - j));
+
+            if (j == i) {
+                diag = std::fabs(Acsrh.values[l]);
+                continue;
+            }
+
+            offSum += std::fabs(Acsrh.values[l]);
+            offDiag++;
+
+            int  j_start = Acsrh.row_offsets[j], j_end = Acsrh.row_offsets[j+1];
+            bool found   = false;
+            for (int l2 = j_start; l2 < j_end && !found; l2++)
+                found = (Acsrh.column_indices[l2] == i);
+            if (found)
+                symmetric++;
+        }
+
+        if (diag >= offSum)
+            dominant++;
+    }
+
+    features.patternSymmetry  = (offDiag > 0 ? (double) symmetric / offDiag : 1.0);
+    features.diagDominantRows = (features.n > 0 ? (double) dominant / features.n : 0.0);
+
+    return features;
+}
+
+/**
+ * This function returns the database key of the matrix: the number of rows,
+ * the average number of nonzeros per row and the half-bandwidth relative to
+ * the matrix size in logarithmic buckets, together with coarse indicators of
+ * the pattern symmetry and diagonal dominance.
+ */
+inline
+std::string
+MatrixFeatures::key() const
+{
+    double avgRowNnz = (n > 0 ? (double) nnz / n : 0.0);
+    double relBand   = (n > 0 ? (double) (halfBandwidth + 1) / n : 1.0);
+
+    std::ostringstream out;
+    out << "n" << (int) std::floor(std::log((double) std::max(n, 1)) / std::log(2.0))
+        << "_r" << (int) std::floor(2 * std::log(std::max(avgRowNnz, 1.0)) / std::log(2.0))
+        << "_k" << (int) std::floor(-std::log(relBand) / std::log(2.0))
+        << "_s" << (patternSymmetry > 0.99 ? 1 : 0)
+        << "_d" << (int) std::floor(4 * diagDominantRows + 0.5)
+        << (isSPD ? "_spd" : "");
+
+    return out.str();
+}
+
+
+/**
+ * This is the constructor for the Tuner class. The best configurations are
+ * kept in the text file dbFile; trialIterations is the iteration limit of the
+ * trial solves in the first round of the search.
+ */
+template <typename Array, typename PrecValueType>
+Tuner<Array, PrecValueType>::Tuner(const std::string&  dbFile,
+                                   int                 trialIterations)
+:   m_dbFile(dbFile),
+    m_trialIterations(std::max(trialIterations, 1)),
+    m_fromDatabase(false),
+    m_numTrials(0),
+    m_timeTuning(0)
+{
+}
+
+/**
+ * This function selects the number of partitions and the solver options for
+ * the specified matrix. On entry, opts holds the base options (tolerances,
+ * iteration limit, SPD flag, and all options which are not tuned); on return,
+ * numPartitions and opts hold the selected configuration. The tuned options
+ * are numPartitions, precondType, factMethod, variableBandwidth,
+ * dropOffFraction, ilu_level and solverType. The function returns false (and
+ * leaves its arguments unchanged) if no trial configuration succeeded.
+ */
+template <typename Array, typename PrecValueType>
+template <typename Matrix, typename SpmvOperator>
+bool
+Tuner<Array, PrecValueType>::tune(const Matrix&   A,
+                                  SpmvOperator&   spmv,
+                                  const Array&    b,
+                                  int&            numPartitions,
+                                  Options&        opts)
+{
+    CPUTimer timer;
+    timer.Start();
+
+    m_features     = MatrixFeatures::compute(A, opts.isSPD);
+    m_fromDatabase = false;
+    m_numTrials    = 0;
+
+    if (lookup(m_features, numPartitions, opts)) {
+        m_fromDatabase = true;
+        timer.Stop();
+        m_timeTuning = timer.getElapsed();
+        return true;
+    }
+
+    // Partitions smaller than this are not worth trying.
+    const int MIN_PARTITION_SIZE = 1000;
+
+    std::vector<Candidate> candidates;
+    buildCandidates(std::max(m_features.n / MIN_PARTITION_SIZE, 1), opts, candidates);
+
+    // Successive halving: evaluate all remaining candidates, then keep the
+    // better half, doubling the trial iteration budget at every round.
+    int maxIterations = std::min(m_trialIterations, opts.maxNumIterations);
+
+    while (true) {
+        for (size_t i = 0; i < candidates.size(); i++)
+            candidates[i].score = trial(A, spmv, b, candidates[i], maxIterations);
+
+        std::stable_sort(candidates.begin(), candidates.end(), compareScores);
+
+        while (!candidates.empty() && candidates.back().score == std::numeric_limits<double>::infinity())
+            candidates.pop_back();
+
+        if (candidates.size() <= 1 || maxIterations >= opts.maxNumIterations)
+            break;
+
+        candidates.resize((candidates.size() + 1) / 2);
+        maxIterations = std::min(2 * maxIterations, opts.maxNumIterations);
+    }
+
+    timer.Stop();
+    m_timeTuning = timer.getElapsed();
+
+    if (candidates.empty())
+        return false;
+
+    numPartitions = candidates[0].numPartitions;
+    opts          = candidates[0].opts;
+
+    store(m_features, numPartitions, opts, candidates[0].score);
+
+    return true;
+}
+
+/**
+ * This function looks up the specified features in the database. If a
+ * configuration was saved for a similar matrix, it is applied to
+ * numPartitions and opts and the function returns true.
+ */
+template <typename Array, typename PrecValueType>
+bool
+Tuner<Array, PrecValueType>::lookup(const MatrixFeatures&  features,
+                                    int&                   numPartitions,
+                                    Options&               opts) const
+{
+    std::ifstream in(m_dbFile.c_str());
+    if (!in)
+        return false;
+
+    std::string key = features.key();
+    std::string line;
+    bool        found = false;
+
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream entry(line);
+        std::string        entryKey;
+        int                P, solverType, precondType, factMethod, variableBandwidth, ilu_level;
+        double             dropOffFraction;
+
+        if (!(entry >> entryKey >> P >> solverType >> precondType >> factMethod >> variableBandwidth >> dropOffFraction >> ilu_level))
+            continue;
+        if (entryKey != key)
+            continue;
+
+        numPartitions          = P;
+        opts.solverType        = (KrylovSolverType) solverType;
+        opts.precondType       = (PreconditionerType) precondType;
+        opts.factMethod        = (FactorizationMethod) factMethod;
+        opts.variableBandwidth = (variableBandwidth != 0);
+        opts.dropOffFraction   = dropOffFraction;
+        opts.ilu_level         = ilu_level;
+        found = true;
+    }
+
+    return found;
+}
+
+/**
+ * This function saves the configuration for the specified features in the
+ * database, replacing any previous entry with the same key. Failures to
+ * write the database are ignored.
+ */
+template <typename Array, typename PrecValueType>
+void
+Tuner<Array, PrecValueType>::store(const MatrixFeatures&  features,
+                                   int                    numPartitions,
+                                   const Options&         opts,
+                                   double                 timeToSolution) const
+{
+    std::string               key = features.key();
+    std::vector<std::string>  lines;
+
+    {
+        std::ifstream in(m_dbFile.c_str());
+        std::string   line;
+
+        while (std::getline(in, line)) {
+            std::istringstream entry(line);
+            std::string        entryKey;
+
+            if (!line.empty() && line[0] != '#' && (entry >> entryKey) && entryKey == key)
+                continue;
+            lines.push_back(line);
+        }
+    }
+
+    if (lines.empty())
+        lines.push_back("# key numPartitions solverType precondType factMethod variableBandwidth dropOffFraction ilu_level timeToSolution");
+
+    std::ostringstream entry;
+    entry << key << " " << numPartitions
+          << " " << (int) opts.solverType
+          << " " << (int) opts.precondType
+          << " " << (int) opts.factMethod
+          << " " << (opts.variableBandwidth ? 1 : 0)
+          << " " << opts.dropOffFraction
+          << " " << opts.ilu_level
+          << " " << timeToSolution;
+    lines.push_back(entry.str());
+
+    std::ofstream out(m_dbFile.c_str());
+    for (size_t i = 0; i < lines.size(); i++)
+        out << lines[i] << "\n";
+}
+
+/**
+ * This function builds the (pruned) search space: the number of partitions
+ * grows by factors of 4 up to maxPartitions; SPIKE is only tried with more
+ * than one partition and, with constant bandwidth, with the LU-UL
+ * factorization; drop-off is only tried for the banded preconditioners; ILU(0)
+ * is tried with the block-diagonal preconditioner. The Krylov methods are CG
+ * and BiCGStab(2) for SPD matrices, and BiCGStab(2) and GMRES otherwise.
+ */
+template <typename Array, typename PrecValueType>
+void
+Tuner<Array, PrecValueType>::buildCandidates(int                     maxPartitions,
+                                             const Options&          opts,
+                                             std::vector<Candidate>& candidates) const
+{
+    const double dropOffFractions[] = {0.0, 0.01};
+
+    KrylovSolverType krylov[2];
+    krylov[0] = (opts.isSPD ? CG_C : BiCGStab2);
+    krylov[1] = (opts.isSPD ? BiCGStab2 : GMRES_C);
+
+    candidates.clear();
+
+    for (int P = 1; P <= std::max(maxPartitions, 1); P *= 4) {
+        for (int s = 0; s < 2; s++) {
+            Candidate c;
+            c.numPartitions = P;
+            c.score         = 0;
+            c.opts          = opts;
+            c.opts.solverType = krylov[s];
+
+            // Block-diagonal, exact LU.
+            for (int d = 0; d < 2; d++) {
+                c.opts.precondType       = Block;
+                c.opts.factMethod        = LU_only;
+                c.opts.variableBandwidth = true;
+                c.opts.dropOffFraction   = dropOffFractions[d];
+                c.opts.ilu_level         = -1;
+                candidates.push_back(c);
+            }
+
+            // Block-diagonal, ILU(0).
+            c.opts.precondType       = Block;
+            c.opts.factMethod        = LU_only;
+            c.opts.variableBandwidth = true;
+            c.opts.dropOffFraction   = 0;
+            c.opts.ilu_level         = 0;
+            candidates.push_back(c);
+
+            if (P == 1)
+                continue;
+
+            // SPIKE, with variable (LU only) or constant (LU-UL) bandwidth.
+            for (int v = 0; v < 2; v++) {
+                for (int d = 0; d < 2; d++) {
+                    c.opts.precondType       = Spike;
+                    c.opts.variableBandwidth = (v == 0);
+                    c.opts.factMethod        = (v == 0 ? LU_only : LU_UL);
+                    c.opts.dropOffFraction   = dropOffFractions[d];
+                    c.opts.ilu_level         = -1;
+                    candidates.push_back(c);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * This function runs one trial setup and solve (with at most maxIterations
+ * iterations) and returns the estimated time to solution of the candidate.
+ * If the trial did not converge but reduced the residual, the solve time is
+ * extrapolated assuming the same convergence rate; failed (including any
+ * trial which throws a std::exception) or stagnating trials score infinity.
+ */
+template <typename Array, typename PrecValueType>
+template <typename Matrix, typename SpmvOperator>
+double
+Tuner<Array, PrecValueType>::trial(const Matrix&     A,
+                                   SpmvOperator&     spmv,
+                                   const Array&      b,
+                                   const Candidate&  candidate,
+                                   int               maxIterations)
+{
+    const double INF = std::numeric_limits<double>::infinity();
+
+    Options opts = candidate.opts;
+    opts.maxNumIterations = maxIterations;
+
+    m_numTrials++;
+
+    Stats  stats;
+    bool   converged = false;
+
+    try {
+        Solver<Array, PrecValueType> solver(candidate.numPartitions, opts);
+        Array                        x(b.size(), 0);
+
+        solver.setup(A);
+        converged = solver.solve(spmv, b, x);
+        stats     = solver.getStats();
+    } catch (const std::exception&) {
+        // Any failure (illegal options, out of memory, CUDA or Thrust
+        // errors, ...) disqualifies the candidate, not the whole search.
+        return INF;
+    }
+
+    if (converged)
+        return stats.timeSetup + stats.timeSolve;
+
+    double res = stats.relResidualNorm;
+    if (!(res > 0 && res < 1) || stats.numIterations <= 0)
+        return INF;
+
+    double needed = std::log(std::max(opts.relTol, 1e-300)) / std::log(res);
+
+    return stats.timeSetup + stats.timeSolve * std::max(needed, 1.0);
+}
+
+
+} // namespace sap
+
+
+#endif